@@ -24,6 +24,26 @@ UINT32 LastExecutedCommand = (UINT32) -1;
 
 STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL *mFwProtocol;
 
+//
+// With ADMA2, block read/write commands are not issued from
+// MMCSendCommand, since the descriptor table can only be built
+// once the buffer is known. They are issued from MMCReadBlockData
+// and MMCWriteBlockData instead.
+//
+STATIC BOOLEAN mAdma;
+STATIC ADMA2_DESC *mAdmaDesc;
+STATIC VOID *mAdmaDescMapping;
+STATIC EFI_PHYSICAL_ADDRESS mAdmaDescBusAddress;
+STATIC UINT32 mDeferredCmd;
+STATIC UINT32 mDeferredArg;
+STATIC UINT32 mDeferredBlockCount;
+
+//
+// Block count of the last CMD23, applied to the multi-block command
+// following it so the controller stops the transfer as the card does.
+//
+STATIC UINT32 mSetBlockCount;
+
 /**
    These SD commands are optional, according to the SD Spec
 **/
@@ -283,12 +303,18 @@ MMCBuildDevicePath(
   return EFI_SUCCESS;
 }
 
+/**
+   Issues an already translated command. A non-zero BlockCount enables the
+   block count register, e.g. after CMD23 or for ADMA2 transfers (which
+   also pass DE_ENABLE in MmcCmd, with the descriptor table already set up).
+**/
+STATIC
 EFI_STATUS
-MMCSendCommand(
-               IN EFI_MMC_HOST_PROTOCOL    *This,
-               IN MMC_CMD                  MmcCmd,
-               IN UINT32                   Argument
-               )
+IssueCommand(
+  IN UINT32 MmcCmd,
+  IN UINT32 Argument,
+  IN UINT32 BlockCount
+  )
 {
   UINTN MmcStatus;
   UINTN RetryCount = 0;
@@ -298,17 +324,6 @@ MMCSendCommand(
   BOOLEAN IsDATCmd = FALSE;
   BOOLEAN IsADTCCmd = FALSE;
 
-  DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: MMCSendCommand(MmcCmd: %08x, Argument: %08x)\n", MmcCmd, Argument));
-
-  if (IgnoreCommand(MmcCmd)) {
-    return EFI_SUCCESS;
-  }
-
-  MmcCmd = TranslateCommand(MmcCmd, Argument);
-  if (MmcCmd == 0xffffffff) {
-    return EFI_UNSUPPORTED;
-  }
-
   if ((MmcCmd & CMD_R1_ADTC) == CMD_R1_ADTC) {
     IsADTCCmd = TRUE;
   }
@@ -347,7 +362,11 @@ MMCSendCommand(
   } else if (!IsAppCmd && MmcCmd == CMD6) {
     MmioWrite32(MMCHS_BLK, 64);
   } else if (IsADTCCmd) {
-    MmioWrite32(MMCHS_BLK, BLEN_512BYTES);
+    MmioWrite32(MMCHS_BLK, BLEN_512BYTES | (BlockCount << BLOCK_COUNT_SHIFT));
+  }
+
+  if (BlockCount != 0) {
+    MmcCmd |= BCE_ENABLE;
   }
 
   // Set Data timeout counter value to max value.
@@ -364,6 +383,7 @@ MMCSendCommand(
 
   // Send the command
   MmioWrite32(MMCHS_CMD, MmcCmd);
+  MmcCmd &= ~(DE_ENABLE | BCE_ENABLE);
 
   // Check for the command status.
   while (RetryCount < MAX_RETRY_COUNT) {
@@ -416,6 +436,163 @@ MMCSendCommand(
   return Status;
 }
 
+EFI_STATUS
+MMCSendCommand(
+               IN EFI_MMC_HOST_PROTOCOL    *This,
+               IN MMC_CMD                  MmcCmd,
+               IN UINT32                   Argument
+               )
+{
+  UINT32 BlockCount;
+
+  DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: MMCSendCommand(MmcCmd: %08x, Argument: %08x)\n", MmcCmd, Argument));
+
+  if (IgnoreCommand(MmcCmd)) {
+    return EFI_SUCCESS;
+  }
+
+  MmcCmd = TranslateCommand(MmcCmd, Argument);
+  if (MmcCmd == 0xffffffff) {
+    return EFI_UNSUPPORTED;
+  }
+
+  BlockCount = 0;
+  if (LastExecutedCommand == CMD_SET_BLOCK_COUNT &&
+      (MmcCmd == CMD_READ_MULTIPLE_BLOCK ||
+       MmcCmd == CMD_WRITE_MULTIPLE_BLOCK)) {
+    BlockCount = mSetBlockCount;
+  }
+
+  if (MmcCmd == CMD_SET_BLOCK_COUNT) {
+    mSetBlockCount = Argument;
+  }
+
+  mDeferredCmd = 0;
+  if (mAdma &&
+      (MmcCmd == CMD_READ_SINGLE_BLOCK ||
+       MmcCmd == CMD_READ_MULTIPLE_BLOCK ||
+       MmcCmd == CMD_WRITE_SINGLE_BLOCK ||
+       MmcCmd == CMD_WRITE_MULTIPLE_BLOCK)) {
+    mDeferredCmd = MmcCmd;
+    mDeferredArg = Argument;
+    mDeferredBlockCount = BlockCount;
+    LastExecutedCommand = MmcCmd;
+    return EFI_SUCCESS;
+  }
+
+  return IssueCommand(MmcCmd, Argument, BlockCount);
+}
+
+/**
+   Issues the deferred block command, transferring Length bytes to or
+   from Buffer with ADMA2. If the transfer can't be done with ADMA2, the
+   command is issued without DMA and EFI_UNSUPPORTED is returned, so the
+   caller can fall back to PIO.
+**/
+STATIC
+EFI_STATUS
+AdmaTransfer(
+  IN DMA_MAP_OPERATION Operation,
+  IN UINTN Length,
+  IN VOID *Buffer
+  )
+{
+  EFI_STATUS Status;
+  EFI_PHYSICAL_ADDRESS BusAddress;
+  VOID *Mapping;
+  UINTN MapLength;
+  UINTN Offset;
+  UINTN Index;
+  UINTN DescLen;
+  UINTN MmcStatus;
+  UINTN RetryCount;
+  UINTN MaxRetryCount;
+  UINT32 MmcCmd;
+
+  MmcCmd = mDeferredCmd;
+  mDeferredCmd = 0;
+
+  if (Length == 0 ||
+      Length % BLEN_512BYTES != 0 ||
+      Length > ADMA2_MAX_TRANSFER ||
+      Length / BLEN_512BYTES > ADMA2_MAX_BLOCKS) {
+    goto Pio;
+  }
+
+  MapLength = Length;
+  Status = DmaMap(Operation, Buffer, &MapLength, &BusAddress, &Mapping);
+  if (EFI_ERROR(Status)) {
+    DEBUG((DEBUG_ERROR, "%a(%u): DmaMap: %r\n", __FUNCTION__, __LINE__, Status));
+    goto Pio;
+  }
+
+  if (MapLength != Length ||
+      BusAddress + Length > MAX_UINT32) {
+    DmaUnmap(Mapping);
+    goto Pio;
+  }
+
+  for (Offset = 0, Index = 0; Offset < Length; Offset += DescLen, Index++) {
+    DescLen = MIN(Length - Offset, ADMA2_MAX_DESC_LEN);
+    mAdmaDesc[Index].Attr = ADMA2_VALID | ADMA2_ACT_TRAN;
+    mAdmaDesc[Index].Length = (UINT16) DescLen;
+    mAdmaDesc[Index].Address = (UINT32) (BusAddress + Offset);
+  }
+  mAdmaDesc[Index - 1].Attr |= ADMA2_END;
+  MemoryFence();
+
+  MmioWrite32(MMCHS_ADMA_SAR, (UINT32) mAdmaDescBusAddress);
+  MmioAndThenOr32(MMCHS_HCTL, (UINT32) ~DMAS_MASK, DMAS_ADMA2_32);
+
+  Status = IssueCommand(MmcCmd | DE_ENABLE, mDeferredArg, Length / BLEN_512BYTES);
+  if (EFI_ERROR(Status)) {
+    DmaUnmap(Mapping);
+    return Status;
+  }
+
+  mFwProtocol->LedActivity();
+
+  RetryCount = 0;
+  MaxRetryCount = ADMA2_RETRY_COUNT_PER_MB * (1 + Length / SIZE_1MB);
+  while (RetryCount < MaxRetryCount) {
+    MmcStatus = MmioRead32(MMCHS_INT_STAT);
+    if ((MmcStatus & ERRI) != 0) {
+      DEBUG((DEBUG_ERROR, "%a(%u): MMC_CMD%u ERRI MmcStatus 0x%x ADMA ES 0x%x\n",
+             __FUNCTION__, __LINE__, MMC_CMD_NUM(MmcCmd), MmcStatus,
+             MmioRead32(MMCHS_ADMA_ES)));
+      SoftReset(SRC | SRD);
+      Status = EFI_DEVICE_ERROR;
+      break;
+    }
+
+    if ((MmcStatus & TC) != 0) {
+      MmioWrite32(MMCHS_INT_STAT, TC);
+      break;
+    }
+
+    gBS->Stall(STALL_AFTER_RETRY_US);
+    RetryCount++;
+  }
+
+  if (RetryCount == MaxRetryCount) {
+    DEBUG((DEBUG_ERROR, "%a(%u): MMC_CMD%u TC timeout MmcStatus 0x%x\n",
+           __FUNCTION__, __LINE__, MMC_CMD_NUM(MmcCmd), MmcStatus));
+    SoftReset(SRC | SRD);
+    Status = EFI_TIMEOUT;
+  }
+
+  DmaUnmap(Mapping);
+  return Status;
+
+ Pio:
+  Status = IssueCommand(MmcCmd, mDeferredArg, mDeferredBlockCount);
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
+
+  return EFI_UNSUPPORTED;
+}
+
 EFI_STATUS
 MMCNotifyState(
                IN EFI_MMC_HOST_PROTOCOL    *This,
@@ -552,6 +729,7 @@ MMCReadBlockData(
   UINTN MmcStatus;
   UINTN RemLength;
   UINTN Count;
+  EFI_STATUS Status;
 
   DEBUG((DEBUG_VERBOSE, "%a(%u): LBA: 0x%x, Length: 0x%x, Buffer: 0x%x)\n",
          __FUNCTION__, __LINE__, Lba, Length, Buffer));
@@ -568,6 +746,13 @@ MMCReadBlockData(
     return EFI_INVALID_PARAMETER;
   }
 
+  if (mDeferredCmd != 0) {
+    Status = AdmaTransfer(MapOperationBusMasterWrite, Length, Buffer);
+    if (Status != EFI_UNSUPPORTED) {
+      return Status;
+    }
+  }
+
   RemLength = Length;
   while (RemLength != 0) {
     UINTN RetryCount = 0;
@@ -580,12 +765,10 @@ MMCReadBlockData(
         /*
          * Data is ready.
          */
-        mFwProtocol->SetLed(TRUE);
+        mFwProtocol->LedActivity();
         for (Count = 0; Count < BlockLen; Count += 4, Buffer++) {
           *Buffer = MmioRead32(MMCHS_DATA);
         }
-
-        mFwProtocol->SetLed(FALSE);
         break;
       }
 
@@ -619,6 +802,7 @@ MMCWriteBlockData(
   UINTN MmcStatus;
   UINTN RemLength;
   UINTN Count;
+  EFI_STATUS Status;
 
   DEBUG((DEBUG_VERBOSE, "%a(%u): LBA: 0x%x, Length: 0x%x, Buffer: 0x%x)\n",
          __FUNCTION__, __LINE__, Lba, Length, Buffer));
@@ -635,6 +819,13 @@ MMCWriteBlockData(
     return EFI_INVALID_PARAMETER;
   }
 
+  if (mDeferredCmd != 0) {
+    Status = AdmaTransfer(MapOperationBusMasterRead, Length, Buffer);
+    if (Status != EFI_UNSUPPORTED) {
+      return Status;
+    }
+  }
+
   RemLength = Length;
   while (RemLength != 0) {
     UINTN RetryCount = 0;
@@ -647,12 +838,10 @@ MMCWriteBlockData(
         /*
          * Can write data.
          */
-        mFwProtocol->SetLed(TRUE);
+        mFwProtocol->LedActivity();
         for (Count = 0; Count < BlockLen; Count += 4, Buffer++) {
           MmioWrite32(MMCHS_DATA, *Buffer);
         }
-
-        mFwProtocol->SetLed(FALSE);
         break;
       }
 
@@ -683,6 +872,52 @@ MMCIsMultiBlock (
   return TRUE;
 }
 
+/**
+   Sets up ADMA2, unless disabled via PcdMmcDisableDma or
+   not supported by the controller.
+**/
+STATIC
+VOID
+AdmaInitialize(
+  VOID
+  )
+{
+  EFI_STATUS Status;
+  UINTN BufferSize;
+
+  if (PcdGet32 (PcdMmcDisableDma)) {
+    DEBUG((DEBUG_INFO, "ArasanMMCHost: using PIO\n"));
+    return;
+  }
+
+  if ((MmioRead32(MMCHS_CAPA) & ADMA2S) == 0) {
+    DEBUG((DEBUG_INFO, "ArasanMMCHost: no ADMA2 support, using PIO\n"));
+    return;
+  }
+
+  Status = DmaAllocateBuffer(EfiBootServicesData, ADMA2_DESC_PAGES,
+                             (VOID **) &mAdmaDesc);
+  if (EFI_ERROR(Status)) {
+    DEBUG((DEBUG_ERROR, "ArasanMMCHost: failed to allocate ADMA2 descriptors: %r\n",
+           Status));
+    return;
+  }
+
+  BufferSize = EFI_PAGES_TO_SIZE(ADMA2_DESC_PAGES);
+  Status = DmaMap(MapOperationBusMasterCommonBuffer, mAdmaDesc, &BufferSize,
+                  &mAdmaDescBusAddress, &mAdmaDescMapping);
+  if (EFI_ERROR(Status)) {
+    DEBUG((DEBUG_ERROR, "ArasanMMCHost: failed to map ADMA2 descriptors: %r\n",
+           Status));
+    DmaFreeBuffer(ADMA2_DESC_PAGES, mAdmaDesc);
+    return;
+  }
+
+  ASSERT (mAdmaDescBusAddress <= MAX_UINT32);
+  mAdma = TRUE;
+  DEBUG((DEBUG_INFO, "ArasanMMCHost: using ADMA2\n"));
+}
+
 EFI_MMC_HOST_PROTOCOL gMMCHost =
   {
     MMC_HOST_PROTOCOL_REVISION,
@@ -721,6 +956,8 @@ MMCInitialize(
     return Status;
   }
 
+  AdmaInitialize();
+
   Status = gBS->InstallMultipleProtocolInterfaces(
      &Handle,
      &gRaspberryPiMmcHostProtocolGuid, &gMMCHost,
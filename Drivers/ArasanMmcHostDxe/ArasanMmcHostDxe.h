@@ -47,4 +47,33 @@
 
 #define MAX_DIVISOR_VALUE 1023
 
+//
+// ADMA2 (32-bit) descriptors. A single page of descriptors, each
+// covering up to ADMA2_MAX_DESC_LEN bytes, bounds the largest DMA
+// transfer. Anything larger goes through PIO.
+//
+#pragma pack(1)
+typedef struct {
+  UINT16 Attr;
+  UINT16 Length;
+  UINT32 Address;
+} ADMA2_DESC;
+#pragma pack()
+
+#define ADMA2_VALID         BIT0
+#define ADMA2_END           BIT1
+#define ADMA2_ACT_TRAN      (0x2 << 4)
+
+#define ADMA2_DESC_PAGES    1
+#define ADMA2_NUM_DESC      (EFI_PAGES_TO_SIZE (ADMA2_DESC_PAGES) / sizeof (ADMA2_DESC))
+#define ADMA2_MAX_DESC_LEN  SIZE_32KB
+#define ADMA2_MAX_TRANSFER  (ADMA2_NUM_DESC * ADMA2_MAX_DESC_LEN)
+#define ADMA2_MAX_BLOCKS    0xFFFF
+
+//
+// Transfer completion timeout, in units of STALL_AFTER_RETRY_US,
+// per MiB transferred.
+//
+#define ADMA2_RETRY_COUNT_PER_MB MAX_RETRY_COUNT
+
 #endif
@@ -24,10 +24,19 @@
 #include <Protocol/HardwareInterrupt.h>
 
 //
-// This currently only implements support for the architected timer interrupts
-// on the per-CPU interrupt controllers.
+// This implements support for the architected timer interrupts on the
+// per-CPU interrupt controllers, as well as the "basic" IRQs (which include
+// the ARM mailbox) and GPU IRQs 0-31 (which include USB) of the ARM
+// interrupt controller, routed to us via the GPU interrupt line. See
+// BCM2836_INTC_BASIC_IRQ and BCM2836_INTC_GPU1_IRQ.
 //
-#define NUM_IRQS                    (4)
+#define NUM_IRQS                    (BCM2836_INTC_NUM_TIMER_IRQS + \
+                                     BCM2836_ARM_INTC_NUM_BASIC_IRQS + \
+                                     BCM2836_ARM_INTC_NUM_GPU1_IRQS)
+#define IS_TIMER_IRQ(Source)        ((Source) < BCM2836_INTC_NUM_TIMER_IRQS)
+#define IS_GPU1_IRQ(Source)         ((Source) >= BCM2836_INTC_GPU1_IRQ (0))
+#define BASIC_IRQ_BIT(Source)       (1 << ((Source) - BCM2836_INTC_NUM_TIMER_IRQS))
+#define GPU1_IRQ_BIT(Source)        (1 << ((Source) - BCM2836_INTC_GPU1_IRQ (0)))
 
 #ifdef MDE_CPU_AARCH64
 #define ARM_ARCH_EXCEPTION_IRQ      EXCEPT_AARCH64_IRQ
@@ -63,6 +72,11 @@ ExitBootServicesEvent (
 {
   // Disable all interrupts
   MmioWrite32 (RegBase + BCM2836_INTC_TIMER_CONTROL_OFFSET, 0);
+  MmioWrite32 (BCM2836_ARM_INTC_BASE_ADDRESS +
+               BCM2836_ARM_INTC_BASIC_DISABLE_OFFSET,
+               (1 << BCM2836_ARM_INTC_NUM_BASIC_IRQS) - 1);
+  MmioWrite32 (BCM2836_ARM_INTC_BASE_ADDRESS +
+               BCM2836_ARM_INTC_DISABLE1_OFFSET, MAX_UINT32);
 }
 
 /**
@@ -88,7 +102,15 @@ EnableInterruptSource (
     return EFI_UNSUPPORTED;
   }
 
-  MmioOr32 (RegBase + BCM2836_INTC_TIMER_CONTROL_OFFSET, 1 << Source);
+  if (IS_TIMER_IRQ (Source)) {
+    MmioOr32 (RegBase + BCM2836_INTC_TIMER_CONTROL_OFFSET, 1 << Source);
+  } else if (IS_GPU1_IRQ (Source)) {
+    MmioWrite32 (BCM2836_ARM_INTC_BASE_ADDRESS +
+                 BCM2836_ARM_INTC_ENABLE1_OFFSET, GPU1_IRQ_BIT (Source));
+  } else {
+    MmioWrite32 (BCM2836_ARM_INTC_BASE_ADDRESS +
+                 BCM2836_ARM_INTC_BASIC_ENABLE_OFFSET, BASIC_IRQ_BIT (Source));
+  }
 
   return EFI_SUCCESS;
 }
@@ -117,7 +139,15 @@ DisableInterruptSource (
     return EFI_UNSUPPORTED;
   }
 
-  MmioAnd32 (RegBase + BCM2836_INTC_TIMER_CONTROL_OFFSET, ~(1 << Source));
+  if (IS_TIMER_IRQ (Source)) {
+    MmioAnd32 (RegBase + BCM2836_INTC_TIMER_CONTROL_OFFSET, ~(1 << Source));
+  } else if (IS_GPU1_IRQ (Source)) {
+    MmioWrite32 (BCM2836_ARM_INTC_BASE_ADDRESS +
+                 BCM2836_ARM_INTC_DISABLE1_OFFSET, GPU1_IRQ_BIT (Source));
+  } else {
+    MmioWrite32 (BCM2836_ARM_INTC_BASE_ADDRESS +
+                 BCM2836_ARM_INTC_BASIC_DISABLE_OFFSET, BASIC_IRQ_BIT (Source));
+  }
 
   return EFI_SUCCESS;
 }
@@ -189,8 +219,18 @@ GetInterruptSourceState (
     return EFI_UNSUPPORTED;
   }
 
-  *InterruptState = (MmioRead32 (RegBase + BCM2836_INTC_TIMER_CONTROL_OFFSET) &
-                     (1 << Source)) != 0;
+  if (IS_TIMER_IRQ (Source)) {
+    *InterruptState = (MmioRead32 (RegBase + BCM2836_INTC_TIMER_CONTROL_OFFSET) &
+                       (1 << Source)) != 0;
+  } else if (IS_GPU1_IRQ (Source)) {
+    *InterruptState = (MmioRead32 (BCM2836_ARM_INTC_BASE_ADDRESS +
+                                   BCM2836_ARM_INTC_ENABLE1_OFFSET) &
+                       GPU1_IRQ_BIT (Source)) != 0;
+  } else {
+    *InterruptState = (MmioRead32 (BCM2836_ARM_INTC_BASE_ADDRESS +
+                                   BCM2836_ARM_INTC_BASIC_ENABLE_OFFSET) &
+                       BASIC_IRQ_BIT (Source)) != 0;
+  }
 
   return EFI_SUCCESS;
 }
@@ -241,11 +281,35 @@ IrqInterruptHandler (
   HARDWARE_INTERRUPT_HANDLER  InterruptHandler;
   HARDWARE_INTERRUPT_SOURCE   Source;
   UINT32                      RegVal;
-
-  RegVal = MmioRead32 (RegBase + BCM2836_INTC_TIMER_PENDING_OFFSET) &
-           ((1 << NUM_IRQS) - 1);
-  Source = HighBitSet32 (RegVal);
-  if (Source < 0) {
+  UINT32                      Pending;
+
+  RegVal = MmioRead32 (RegBase + BCM2836_INTC_TIMER_PENDING_OFFSET);
+  Pending = RegVal & ((1 << BCM2836_INTC_NUM_TIMER_IRQS) - 1);
+  if (Pending != 0) {
+    Source = HighBitSet32 (Pending);
+  } else if ((RegVal & BCM2836_INTC_GPU_PENDING) != 0) {
+    RegVal = MmioRead32 (BCM2836_ARM_INTC_BASE_ADDRESS +
+                         BCM2836_ARM_INTC_BASIC_PENDING_OFFSET);
+    Pending = RegVal & ((1 << BCM2836_ARM_INTC_NUM_BASIC_IRQS) - 1);
+    if (Pending != 0) {
+      Source = BCM2836_INTC_BASIC_IRQ (HighBitSet32 (Pending));
+    } else if ((RegVal & (BCM2836_ARM_INTC_BASIC_PENDING1 |
+                          BCM2836_ARM_INTC_BASIC_SHORTCUT1_MASK)) != 0) {
+      //
+      // Some GPU IRQs (USB among them) only show up as shortcut bits
+      // in the basic pending register, but all of them are in
+      // pending register 1.
+      //
+      Pending = MmioRead32 (BCM2836_ARM_INTC_BASE_ADDRESS +
+                            BCM2836_ARM_INTC_PENDING1_OFFSET);
+      if (Pending == 0) {
+        return;
+      }
+      Source = BCM2836_INTC_GPU1_IRQ (HighBitSet32 (Pending));
+    } else {
+      return;
+    }
+  } else {
     return;
   }
 
@@ -21,6 +21,7 @@
 #include <Library/GpioLib.h>
 #include <Protocol/RaspberryPiFirmware.h>
 #include <IndustryStandard/RpiFirmware.h>
+#include <Utils.h>
 #include "ConfigDxeFormSetGuid.h"
 
 extern UINT8 ConfigDxeHiiBin[];
@@ -99,6 +100,7 @@ SetupVariables (
   UINTN Size;
   UINT8 Var8;
   UINT32 Var32;
+  UINT64 Var64;
   EFI_STATUS Status;
 
   /*
@@ -171,6 +173,39 @@ SetupVariables (
     PcdSet32 (PcdMmcDisableMulti, PcdGet32 (PcdMmcDisableMulti));
   }
 
+  Size = sizeof (UINT32);
+  Status = gRT->GetVariable(L"MmcDisableDma",
+                            &gConfigDxeFormSetGuid,
+                            NULL,  &Size, &Var32);
+  if (EFI_ERROR (Status)) {
+    PcdSet32 (PcdMmcDisableDma, PcdGet32 (PcdMmcDisableDma));
+  }
+
+  Size = sizeof (UINT32);
+  Status = gRT->GetVariable(L"MmcDisableCache",
+                            &gConfigDxeFormSetGuid,
+                            NULL,  &Size, &Var32);
+  if (EFI_ERROR (Status)) {
+    PcdSet32 (PcdMmcDisableCache, PcdGet32 (PcdMmcDisableCache));
+  }
+
+  Size = sizeof (UINT64);
+  Status = gRT->GetVariable(L"MmcBenchmarkScratchLba",
+                            &gConfigDxeFormSetGuid,
+                            NULL,  &Size, &Var64);
+  if (EFI_ERROR (Status)) {
+    PcdSet64 (PcdMmcBenchmarkScratchLba, PcdGet64 (PcdMmcBenchmarkScratchLba));
+  }
+
+  Size = sizeof (UINT32);
+  Status = gRT->GetVariable(L"MmcBenchmarkScratchBlocks",
+                            &gConfigDxeFormSetGuid,
+                            NULL,  &Size, &Var32);
+  if (EFI_ERROR (Status)) {
+    PcdSet32 (PcdMmcBenchmarkScratchBlocks,
+              PcdGet32 (PcdMmcBenchmarkScratchBlocks));
+  }
+
   Size = sizeof (UINT32);
   Status = gRT->GetVariable(L"MmcForce1Bit",
                             &gConfigDxeFormSetGuid,
@@ -244,6 +279,23 @@ SetupVariables (
     PcdSet8 (PcdDisplayLogoIndex, PcdGet8 (PcdDisplayLogoIndex));
   }
 
+  Size = sizeof (UINT32);
+  Status = gRT->GetVariable(L"DisplayDisableConsoleBatching",
+                            &gConfigDxeFormSetGuid,
+                            NULL,  &Size, &Var32);
+  if (EFI_ERROR (Status)) {
+    PcdSet32 (PcdDisplayDisableConsoleBatching,
+              PcdGet32 (PcdDisplayDisableConsoleBatching));
+  }
+
+  Size = sizeof (UINT32);
+  Status = gRT->GetVariable(L"DisplayPanning",
+                            &gConfigDxeFormSetGuid,
+                            NULL,  &Size, &Var32);
+  if (EFI_ERROR (Status)) {
+    PcdSet32 (PcdDisplayPanning, PcdGet32 (PcdDisplayPanning));
+  }
+
   return EFI_SUCCESS;
 }
   
@@ -259,6 +311,9 @@ ApplyVariables (
   UINT32 CpuClock = PcdGet32 (PcdCpuClock);
   UINT32 CustomCpuClockRate = PcdGet32 (PcdCustomCpuClockRate);
   UINT32 Rate = 0;
+  UINT32 SetRate[3];
+  UINT32 GetRate[2];
+  RASPBERRY_PI_FIRMWARE_TAG Tags[2];
 
   if (CpuClock != 0) {
     if (CpuClock == 2) {
@@ -278,21 +333,43 @@ ApplyVariables (
     }
   }
 
+  /*
+   * Setting the rate and reading back the resulting rate are
+   * done in the same mailbox transaction. The firmware marks
+   * each tag it processed, so a failure is reported against
+   * the tag it happened to.
+   */
+  SetRate[0] = RPI_FW_CLOCK_RATE_ARM;
+  SetRate[1] = Rate;
+  SetRate[2] = 1;
+  GetRate[0] = RPI_FW_CLOCK_RATE_ARM;
+  GetRate[1] = 0;
+  Tags[0].TagId = RPI_FW_SET_CLOCK_RATE;
+  Tags[0].BufferSize = sizeof (SetRate);
+  Tags[0].Buffer = SetRate;
+  Tags[0].ResponseSize = 0;
+  Tags[1].TagId = RPI_FW_GET_CLOCK_RATE;
+  Tags[1].BufferSize = sizeof (GetRate);
+  Tags[1].Buffer = GetRate;
+  Tags[1].ResponseSize = 0;
+
   if (Rate != 0) {
     DEBUG((EFI_D_INFO, "Setting CPU speed to %uHz\n", Rate));
-    Status = mFwProtocol->SetClockRate(RPI_FW_CLOCK_RATE_ARM, Rate, 1);
-    if (Status != EFI_SUCCESS) {
-      DEBUG((EFI_D_ERROR, "Couldn't set the CPU speed: %r\n",
-             Status));
-    }
+    Status = mFwProtocol->SendTags(Tags, ELES(Tags));
+  } else {
+    Status = mFwProtocol->SendTags(&Tags[1], 1);
   }
 
-  Status = mFwProtocol->GetClockRate(RPI_FW_CLOCK_RATE_ARM, &Rate);
-  if (Status != EFI_SUCCESS) {
+  if (Rate != 0 && Tags[0].ResponseSize == 0) {
+    DEBUG((EFI_D_ERROR, "Couldn't set the CPU speed: %r\n",
+           EFI_ERROR (Status) ? Status : EFI_DEVICE_ERROR));
+  }
+
+  if (Tags[1].ResponseSize == 0) {
     DEBUG((EFI_D_ERROR, "Couldn't get the CPU speed: %r\n",
-           Status));
+           EFI_ERROR (Status) ? Status : EFI_DEVICE_ERROR));
   } else {
-    DEBUG((EFI_D_INFO, "Current CPU speed is %uHz\n", Rate));
+    DEBUG((EFI_D_INFO, "Current CPU speed is %uHz\n", GetRate[1]));
   }
 
   /*
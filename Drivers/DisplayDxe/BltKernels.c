@@ -0,0 +1,132 @@
+/** @file
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include <Uefi.h>
+#include "BltKernels.h"
+
+/*
+ * C versions of the span kernels in AArch64/BltKernels.S, with the
+ * same structure: the destination is brought to 16-byte alignment a
+ * pixel at a time, then 64-byte blocks are each loaded in full
+ * before any of it is stored, which is what keeps a forward copy
+ * safe for overlapping spans with Dst <= Src. Built for other
+ * architectures, and by HostTest.
+ */
+
+#define SPAN_ALIGN        16
+#define SPAN_BLOCK_WORDS  16
+
+STATIC
+VOID
+CopySpan(
+  OUT VOID       *Dst,
+  IN  CONST VOID *Src,
+  IN  UINTN      Bytes
+  )
+{
+  UINT32       *D;
+  CONST UINT32 *S;
+  UINT32       Block[SPAN_BLOCK_WORDS];
+  UINTN        Words;
+  UINTN        Index;
+
+  D = Dst;
+  S = Src;
+  Words = Bytes / sizeof (UINT32);
+
+  while (Words != 0 && ((UINTN) D & (SPAN_ALIGN - 1)) != 0) {
+    *D++ = *S++;
+    Words--;
+  }
+
+  while (Words >= SPAN_BLOCK_WORDS) {
+    for (Index = 0; Index < SPAN_BLOCK_WORDS; Index++) {
+      Block[Index] = S[Index];
+    }
+    for (Index = 0; Index < SPAN_BLOCK_WORDS; Index++) {
+      D[Index] = Block[Index];
+    }
+    D += SPAN_BLOCK_WORDS;
+    S += SPAN_BLOCK_WORDS;
+    Words -= SPAN_BLOCK_WORDS;
+  }
+
+  while (Words != 0) {
+    *D++ = *S++;
+    Words--;
+  }
+}
+
+VOID
+DisplayFillSpan(
+  OUT VOID   *Dst,
+  IN  UINTN  Bytes,
+  IN  UINT32 Pixel
+  )
+{
+  UINT32 *D;
+  UINTN  Words;
+  UINTN  Index;
+
+  D = Dst;
+  Words = Bytes / sizeof (UINT32);
+
+  while (Words != 0 && ((UINTN) D & (SPAN_ALIGN - 1)) != 0) {
+    *D++ = Pixel;
+    Words--;
+  }
+
+  while (Words >= SPAN_BLOCK_WORDS) {
+    for (Index = 0; Index < SPAN_BLOCK_WORDS; Index++) {
+      D[Index] = Pixel;
+    }
+    D += SPAN_BLOCK_WORDS;
+    Words -= SPAN_BLOCK_WORDS;
+  }
+
+  while (Words != 0) {
+    *D++ = Pixel;
+    Words--;
+  }
+}
+
+VOID
+DisplayCopySpanToVideo(
+  OUT VOID       *Dst,
+  IN  CONST VOID *Src,
+  IN  UINTN      Bytes
+  )
+{
+  CopySpan(Dst, Src, Bytes);
+}
+
+VOID
+DisplayCopySpanFromVideo(
+  OUT VOID       *Dst,
+  IN  CONST VOID *Src,
+  IN  UINTN      Bytes
+  )
+{
+  CopySpan(Dst, Src, Bytes);
+}
+
+VOID
+DisplayCopySpanVideo(
+  OUT VOID       *Dst,
+  IN  CONST VOID *Src,
+  IN  UINTN      Bytes
+  )
+{
+  CopySpan(Dst, Src, Bytes);
+}
@@ -0,0 +1,51 @@
+/** @file
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#ifndef _BLT_KERNELS_H_
+#define _BLT_KERNELS_H_
+
+/*
+ * Blt span kernels, in AArch64/BltKernels.S, or BltKernels.c
+ * elsewhere. Byte counts are a multiple of the pixel size. Copies
+ * are safe for overlapping spans only when Dst <= Src.
+ */
+VOID
+DisplayFillSpan(
+  OUT VOID   *Dst,
+  IN  UINTN  Bytes,
+  IN  UINT32 Pixel
+  );
+
+VOID
+DisplayCopySpanToVideo(
+  OUT VOID       *Dst,
+  IN  CONST VOID *Src,
+  IN  UINTN      Bytes
+  );
+
+VOID
+DisplayCopySpanFromVideo(
+  OUT VOID       *Dst,
+  IN  CONST VOID *Src,
+  IN  UINTN      Bytes
+  );
+
+VOID
+DisplayCopySpanVideo(
+  OUT VOID       *Dst,
+  IN  CONST VOID *Src,
+  IN  UINTN      Bytes
+  );
+
+#endif /* _BLT_KERNELS_H_ */
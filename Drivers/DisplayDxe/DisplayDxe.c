@@ -15,9 +15,14 @@
 
 #include "DisplayDxe.h"
 
+/*
+ * GOP coordinates are relative to the visible window, which
+ * starts mPanOffset lines into the virtual framebuffer.
+ */
 #define POS_TO_FB(posX, posY) ((UINT8 *)                                \
                                ((UINTN)This->Mode->FrameBufferBase +    \
-                                (posY) * This->Mode->Info->PixelsPerScanLine * \
+                                ((posY) + mPanOffset) *                 \
+                                This->Mode->Info->PixelsPerScanLine *   \
                                 PI2_BYTES_PER_PIXEL +                   \
                                 (posX) * PI2_BYTES_PER_PIXEL))
 
@@ -92,6 +97,14 @@ DisplayBlt(
            IN  UINTN                                   Delta         OPTIONAL
            );
 
+STATIC
+EFI_STATUS
+EFIAPI
+DisplayScroll(
+              IN DISPLAY_SCROLL_PROTOCOL *This,
+              IN UINT32                  Lines
+              );
+
 STATIC EFI_DRIVER_BINDING_PROTOCOL mDriverBinding = {
   DriverSupported,
   DriverStart,
@@ -129,6 +142,35 @@ STATIC GOP_MODE_DATA mGopModeTemplate[] = {
 STATIC UINTN mLastMode;
 STATIC GOP_MODE_DATA mGopModeData[ELES(mGopModeTemplate)];
 
+/*
+ * PcdDisplayPanning values: pan until ExitBootServices, putting
+ * the window back at the start of the framebuffer whenever a boot
+ * option starts; stop for good when the first one starts; or never
+ * pan, and don't ask for the larger framebuffer at all.
+ */
+#define PAN_UNTIL_EXIT_BOOT_SERVICES 0
+#define PAN_UNTIL_READY_TO_BOOT      1
+#define PAN_NEVER                    2
+
+/*
+ * The current mode's framebuffer is mVirtualHeight lines tall,
+ * twice the visible height when panning is enabled and it could
+ * be allocated that way. The visible window starts mPanOffset
+ * lines in, and is moved by DisplayScroll instead of copying the
+ * screen. Scrolls move it at TPL_NOTIFY, which is also what
+ * DisplayBlt runs at, so a scroll from a console timer never
+ * lands in the middle of a Blt.
+ */
+STATIC UINT32 mVirtualHeight;
+STATIC UINT32 mPanOffset;
+STATIC BOOLEAN mPanDisabled;
+STATIC EFI_EVENT mReadyToBootEvent;
+STATIC EFI_EVENT mExitBootServicesEvent;
+
+STATIC DISPLAY_SCROLL_PROTOCOL mDisplayScroll = {
+  DisplayScroll
+};
+
 STATIC DISPLAY_DEVICE_PATH mDisplayProtoDevicePath =
   {
     {
@@ -200,6 +242,396 @@ DisplayQueryMode(
   return EFI_SUCCESS;
 }
 
+/*
+ * The tags needed to allocate a framebuffer of a given
+ * geometry and learn its pitch.
+ */
+#define FB_PROBE_TAGS 5
+
+/*
+ * The most padding the VC is expected to add to a line. Any
+ * two probed widths differ by more than this, so a pitch
+ * within it belongs to the mode it was asked for.
+ */
+#define FB_PITCH_SLACK (32 * PI2_BYTES_PER_PIXEL)
+
+typedef struct {
+  UINT32 PhysSize[2];
+  UINT32 VirtSize[2];
+  UINT32 Depth;
+  UINT32 AllocFb[2];
+  UINT32 Pitch;
+} FB_PROBE;
+
+STATIC FB_PROBE mFbProbe[ELES(mGopModeTemplate)];
+STATIC RASPBERRY_PI_FIRMWARE_TAG mFbProbeTags[ELES(mGopModeTemplate) *
+                                              FB_PROBE_TAGS];
+
+/*
+ * Fills in FB_PROBE_TAGS tags asking for a Mode framebuffer
+ * VirtualHeight lines tall.
+ */
+STATIC
+VOID
+FbProbeInit(
+  IN  GOP_MODE_DATA             *Mode,
+  IN  UINT32                    VirtualHeight,
+  OUT FB_PROBE                  *Probe,
+  OUT RASPBERRY_PI_FIRMWARE_TAG *Tags
+  )
+{
+  ZeroMem(Probe, sizeof(*Probe));
+  ZeroMem(Tags, FB_PROBE_TAGS * sizeof(*Tags));
+
+  Probe->PhysSize[0] = Mode->Width;
+  Probe->PhysSize[1] = Mode->Height;
+  Probe->VirtSize[0] = Mode->Width;
+  Probe->VirtSize[1] = VirtualHeight;
+  Probe->Depth = PI2_BITS_PER_PIXEL;
+  Probe->AllocFb[0] = 32;
+
+  Tags[0].TagId = RPI_FW_SET_FB_PGEOM;
+  Tags[0].BufferSize = sizeof(Probe->PhysSize);
+  Tags[0].Buffer = Probe->PhysSize;
+  Tags[1].TagId = RPI_FW_SET_FB_VGEOM;
+  Tags[1].BufferSize = sizeof(Probe->VirtSize);
+  Tags[1].Buffer = Probe->VirtSize;
+  Tags[2].TagId = RPI_FW_SET_FB_DEPTH;
+  Tags[2].BufferSize = sizeof(Probe->Depth);
+  Tags[2].Buffer = &Probe->Depth;
+  Tags[3].TagId = RPI_FW_ALLOC_FB;
+  Tags[3].BufferSize = sizeof(Probe->AllocFb);
+  Tags[3].Buffer = Probe->AllocFb;
+  Tags[4].TagId = RPI_FW_GET_FB_LINELENGTH;
+  Tags[4].BufferSize = sizeof(Probe->Pitch);
+  Tags[4].Buffer = &Probe->Pitch;
+}
+
+/*
+ * Checks that the firmware answered the tags FbProbeInit set
+ * up with a framebuffer of the geometry that was asked for.
+ * The firmware may quietly clamp the virtual geometry.
+ */
+STATIC
+EFI_STATUS
+FbProbeCheck(
+  IN  GOP_MODE_DATA             *Mode,
+  IN  UINT32                    VirtualHeight,
+  IN  FB_PROBE                  *Probe,
+  IN  RASPBERRY_PI_FIRMWARE_TAG *Tags
+  )
+{
+  UINTN TagIndex;
+
+  for (TagIndex = 0; TagIndex < FB_PROBE_TAGS; TagIndex++) {
+    if (Tags[TagIndex].ResponseSize == 0) {
+      return EFI_DEVICE_ERROR;
+    }
+  }
+
+  if (Probe->PhysSize[0] != Mode->Width ||
+      Probe->PhysSize[1] != Mode->Height ||
+      Probe->VirtSize[1] != VirtualHeight ||
+      Probe->Pitch < Mode->Width * PI2_BYTES_PER_PIXEL ||
+      Probe->Pitch >= Mode->Width * PI2_BYTES_PER_PIXEL + FB_PITCH_SLACK ||
+      Probe->AllocFb[0] == 0 ||
+      Probe->AllocFb[1] < Probe->Pitch * VirtualHeight) {
+    return EFI_UNSUPPORTED;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/*
+ * Allocates a framebuffer for every mode to learn the real
+ * width (pitch) the VC firmware gives it. All modes are asked
+ * for in one mailbox transaction. The VC keeps only one
+ * pending framebuffer configuration, so it may answer some
+ * modes with another mode's framebuffer: those are probed
+ * again, each in a transaction of its own.
+ */
+STATIC
+EFI_STATUS
+ProbeModes(
+  VOID
+  )
+{
+  UINTN Index;
+  UINTN Retries;
+  EFI_STATUS Status;
+  FB_PROBE *Probe;
+  GOP_MODE_DATA *Mode;
+  RASPBERRY_PI_FIRMWARE_TAG *Tags;
+
+  for (Index = 0; Index <= mLastMode; Index++) {
+    FbProbeInit(&mGopModeData[Index], mGopModeData[Index].Height,
+                &mFbProbe[Index], &mFbProbeTags[Index * FB_PROBE_TAGS]);
+  }
+
+  /*
+   * A tag the firmware didn't process fails the whole call, but
+   * the tags it did answer are still good.
+   */
+  mFwProtocol->SendTags(mFbProbeTags, (mLastMode + 1) * FB_PROBE_TAGS);
+
+  Retries = 0;
+  for (Index = 0; Index <= mLastMode; Index++) {
+    Mode = &mGopModeData[Index];
+    Probe = &mFbProbe[Index];
+    Tags = &mFbProbeTags[Index * FB_PROBE_TAGS];
+
+    if (EFI_ERROR(FbProbeCheck(Mode, Mode->Height, Probe, Tags))) {
+      Retries++;
+      FbProbeInit(Mode, Mode->Height, Probe, Tags);
+      Status = mFwProtocol->SendTags(Tags, FB_PROBE_TAGS);
+      if (EFI_ERROR(Status)) {
+        return Status;
+      }
+
+      Status = FbProbeCheck(Mode, Mode->Height, Probe, Tags);
+      if (EFI_ERROR(Status)) {
+        DEBUG((EFI_D_ERROR, "Mode %u: %u x %u: no framebuffer: %r\n",
+               Index, Mode->Width, Mode->Height, Status));
+        return EFI_DEVICE_ERROR;
+      }
+    }
+
+    //
+    // There is no way to communicate pitch back to OS. OS and even UEFI
+    // expect a fully linear frame buffer. So the width should
+    // be based on the frame buffer's pitch value. In some cases VC
+    // firmware would allocate ao frame buffer with some padding
+    // presumably to be 8 byte align.
+    //
+    Mode->Width = Probe->Pitch / PI2_BYTES_PER_PIXEL;
+
+    DEBUG((EFI_D_INFO, "Mode %u: %u x %u framebuffer is %u bytes at %p\n",
+           Index, Mode->Width, Mode->Height, Probe->AllocFb[1],
+           (VOID *)(UINTN)(Probe->AllocFb[0] - BCM2836_DMA_DEVICE_OFFSET)));
+  }
+
+  DEBUG((EFI_D_INFO, "Probed %u modes in %u mailbox transactions\n",
+         mLastMode + 1, Retries + 1));
+  return EFI_SUCCESS;
+}
+
+/*
+ * Allocates a framebuffer for Mode with a virtual height of
+ * VirtualHeight lines, and resets the virtual offset.
+ */
+STATIC
+EFI_STATUS
+AllocVirtualFb(
+  IN  GOP_MODE_DATA        *Mode,
+  IN  UINT32               VirtualHeight,
+  OUT EFI_PHYSICAL_ADDRESS *FbBase,
+  OUT UINTN                *FbSize,
+  OUT UINTN                *FbPitch
+  )
+{
+  EFI_STATUS Status;
+  FB_PROBE Probe;
+  UINT32 VirtOffset[2];
+  RASPBERRY_PI_FIRMWARE_TAG Tags[FB_PROBE_TAGS + 1];
+
+  FbProbeInit(Mode, VirtualHeight, &Probe, Tags);
+
+  VirtOffset[0] = 0;
+  VirtOffset[1] = 0;
+  Tags[FB_PROBE_TAGS].TagId = RPI_FW_SET_FB_VOFFSET;
+  Tags[FB_PROBE_TAGS].BufferSize = sizeof(VirtOffset);
+  Tags[FB_PROBE_TAGS].Buffer = VirtOffset;
+  Tags[FB_PROBE_TAGS].ResponseSize = 0;
+
+  Status = mFwProtocol->SendTags(Tags, ELES(Tags));
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
+
+  Status = FbProbeCheck(Mode, VirtualHeight, &Probe, Tags);
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
+
+  *FbBase = Probe.AllocFb[0] - BCM2836_DMA_DEVICE_OFFSET;
+  *FbSize = Probe.AllocFb[1];
+  *FbPitch = Probe.Pitch;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+SetPanOffset(
+  IN  UINT32 Offset
+  )
+{
+  EFI_STATUS Status;
+  UINT32 VirtOffset[2];
+  RASPBERRY_PI_FIRMWARE_TAG Tag;
+
+  VirtOffset[0] = 0;
+  VirtOffset[1] = Offset;
+
+  Tag.TagId = RPI_FW_SET_FB_VOFFSET;
+  Tag.BufferSize = sizeof(VirtOffset);
+  Tag.Buffer = VirtOffset;
+  Tag.ResponseSize = 0;
+
+  Status = mFwProtocol->SendTags(&Tag, 1);
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
+
+  if (Tag.ResponseSize == 0 || VirtOffset[1] != Offset) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/*
+ * Scrolls by moving the visible window down the virtual
+ * framebuffer. Once it runs off the end, the lines that stay
+ * visible are copied to the top and the window starts over,
+ * so a full-screen copy happens once per screenful of lines.
+ */
+STATIC
+EFI_STATUS
+EFIAPI
+DisplayScroll(
+              IN DISPLAY_SCROLL_PROTOCOL *This,
+              IN UINT32                  Lines
+              )
+{
+  UINT8 *FbBase;
+  UINTN Pitch;
+  UINT32 Height;
+  UINT32 Offset;
+  EFI_STATUS Status;
+  EFI_TPL OldTpl;
+
+  Height = gDisplayProto.Mode->Info->VerticalResolution;
+  if (Lines >= Height) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  OldTpl = gBS->RaiseTPL(TPL_NOTIFY);
+  if (mPanDisabled || mVirtualHeight < Height * 2) {
+    gBS->RestoreTPL(OldTpl);
+    return EFI_UNSUPPORTED;
+  }
+
+  if (Lines == 0) {
+    gBS->RestoreTPL(OldTpl);
+    return EFI_SUCCESS;
+  }
+
+  FbBase = (UINT8 *)(UINTN) gDisplayProto.Mode->FrameBufferBase;
+  Pitch = gDisplayProto.Mode->Info->PixelsPerScanLine * PI2_BYTES_PER_PIXEL;
+  Offset = mPanOffset + Lines;
+
+  if (Offset + Height > mVirtualHeight) {
+    /*
+     * The window is more than Height - Lines lines in, so the
+     * destination is never part of the visible window, and is
+     * below the source, so a forward copy is safe. If moving
+     * the window fails, nothing visible has been touched.
+     */
+    ASSERT (mPanOffset >= Height - Lines);
+    DisplayCopySpanVideo(FbBase, FbBase + Offset * Pitch,
+                         (Height - Lines) * Pitch);
+    Offset = 0;
+  }
+
+  Status = SetPanOffset(Offset);
+  if (EFI_ERROR(Status)) {
+    DEBUG((EFI_D_ERROR, "Could not pan to line %u: %r\n", Offset, Status));
+    mPanDisabled = TRUE;
+    gBS->RestoreTPL(OldTpl);
+    return Status;
+  }
+
+  mPanOffset = Offset;
+  gBS->RestoreTPL(OldTpl);
+  return EFI_SUCCESS;
+}
+
+/*
+ * Puts the visible window back at the start of the framebuffer,
+ * for anyone about to draw into FrameBufferBase directly. The
+ * window is moved before the copy, so if that fails the screen is
+ * left as it was, at the cost of stale lines showing until the
+ * copy is done. Panning carries on from there unless the window
+ * could not be moved. Called at TPL_NOTIFY.
+ */
+STATIC
+VOID
+DisplayResetPan(
+  VOID
+  )
+{
+  UINT8 *FbBase;
+  UINTN Pitch;
+  UINT32 Offset;
+  EFI_STATUS Status;
+
+  if (mPanOffset == 0) {
+    return;
+  }
+
+  Status = SetPanOffset(0);
+  if (EFI_ERROR(Status)) {
+    DEBUG((EFI_D_ERROR, "Could not reset pan offset: %r\n", Status));
+    mPanDisabled = TRUE;
+    return;
+  }
+
+  FbBase = (UINT8 *)(UINTN) gDisplayProto.Mode->FrameBufferBase;
+  Pitch = gDisplayProto.Mode->Info->PixelsPerScanLine * PI2_BYTES_PER_PIXEL;
+  Offset = mPanOffset;
+  mPanOffset = 0;
+
+  DisplayCopySpanVideo(FbBase, FbBase + Offset * Pitch,
+                       gDisplayProto.Mode->Info->VerticalResolution * Pitch);
+}
+
+/*
+ * Boot loaders (e.g. GRUB's gfxterm) may draw into FrameBufferBase
+ * directly, so the window goes back to the start before each boot
+ * option runs. A loader that mixes console text with drawing of its
+ * own would see the console pan away from what it drew, which is
+ * what PAN_UNTIL_READY_TO_BOOT is for.
+ */
+STATIC
+VOID
+EFIAPI
+DisplayReadyToBoot(
+  IN EFI_EVENT Event,
+  IN VOID      *Context
+  )
+{
+  DisplayResetPan();
+  if (PcdGet32(PcdDisplayPanning) == PAN_UNTIL_READY_TO_BOOT) {
+    mPanDisabled = TRUE;
+  }
+}
+
+/*
+ * The OS only knows about the first screen's worth of the
+ * framebuffer, so panning stops here for good.
+ */
+STATIC
+VOID
+EFIAPI
+DisplayExitBootServices(
+  IN EFI_EVENT Event,
+  IN VOID      *Context
+  )
+{
+  DisplayResetPan();
+  mPanDisabled = TRUE;
+}
+
 STATIC
 VOID
 ClearScreen(
@@ -228,6 +660,7 @@ DisplaySetMode(
 {
   UINTN FbSize;
   UINTN FbPitch;
+  UINT32 VirtualHeight;
   EFI_STATUS Status;
   EFI_PHYSICAL_ADDRESS FbBase;
   GOP_MODE_DATA *Mode = &mGopModeData[ModeNumber];
@@ -238,9 +671,21 @@ DisplaySetMode(
 
   DEBUG((EFI_D_INFO, "Setting mode %u from %u: %u x %u\n",
          ModeNumber, This->Mode->Mode, Mode->Width, Mode->Height));
-  Status = mFwProtocol->GetFB(Mode->Width, Mode->Height,
-                              PI2_BITS_PER_PIXEL, &FbBase,
-                              &FbSize, &FbPitch);
+  Status = EFI_UNSUPPORTED;
+  if (!mPanDisabled) {
+    VirtualHeight = Mode->Height * 2;
+    Status = AllocVirtualFb(Mode, VirtualHeight, &FbBase, &FbSize, &FbPitch);
+    if (EFI_ERROR(Status)) {
+      DEBUG((EFI_D_INFO, "Mode %u: no %u line virtual framebuffer, "
+             "scrolling will copy\n", ModeNumber, VirtualHeight));
+    }
+  }
+  if (EFI_ERROR(Status)) {
+    VirtualHeight = Mode->Height;
+    Status = mFwProtocol->GetFB(Mode->Width, Mode->Height,
+                                PI2_BITS_PER_PIXEL, &FbBase,
+                                &FbSize, &FbPitch);
+  }
   if (EFI_ERROR(Status)) {
     DEBUG((EFI_D_ERROR, "Could not set mode %u\n", ModeNumber));
     return EFI_DEVICE_ERROR;
@@ -268,6 +713,9 @@ DisplaySetMode(
     return Status;
   }
 
+  mVirtualHeight = VirtualHeight;
+  mPanOffset = 0;
+
   This->Mode->Mode = ModeNumber;
   This->Mode->Info->Version = 0;
   This->Mode->Info->HorizontalResolution = Mode->Width;
@@ -280,6 +728,13 @@ DisplaySetMode(
   This->Mode->SizeOfInfo = sizeof(*This->Mode->Info);
   This->Mode->FrameBufferBase = FbBase;
   This->Mode->FrameBufferSize = FbSize;
+  if (VirtualHeight != Mode->Height) {
+    /*
+     * Only the first screen's worth is the linear frame
+     * buffer other users know about.
+     */
+    This->Mode->FrameBufferSize = FbPitch * Mode->Height;
+  }
 
   ClearScreen(This);
   return EFI_SUCCESS;
@@ -303,53 +758,118 @@ DisplayBlt(
 {
   UINT8 *VidBuf, *BltBuf, *VidBuf1;
   UINTN i;
+  UINTN Pitch;
+  UINTN Bytes;
+  EFI_TPL OldTpl;
+
+  /*
+   * POS_TO_FB goes by mPanOffset, which must not move under us.
+   */
+  OldTpl = gBS->RaiseTPL(TPL_NOTIFY);
+  Pitch = This->Mode->Info->PixelsPerScanLine * PI2_BYTES_PER_PIXEL;
+  Bytes = Width * PI2_BYTES_PER_PIXEL;
 
   switch(BltOperation) {
   case EfiBltVideoFill:
-    BltBuf = (UINT8 *)BltBuffer;
+    VidBuf = POS_TO_FB(DestinationX, DestinationY);
 
-    for (i = 0; i < Height; i++) {
-      VidBuf = POS_TO_FB(DestinationX, DestinationY + i);
+    /*
+     * Full-width rectangles are one contiguous span.
+     */
+    if (Bytes == Pitch) {
+      DisplayFillSpan(VidBuf, Bytes * Height, *(UINT32 *) BltBuffer);
+      break;
+    }
 
-      SetMem32(VidBuf, Width * PI2_BYTES_PER_PIXEL, *(UINT32 *) BltBuf);
+    for (i = 0; i < Height; i++) {
+      DisplayFillSpan(VidBuf, Bytes, *(UINT32 *) BltBuffer);
+      VidBuf += Pitch;
     }
     break;
 
   case EfiBltVideoToBltBuffer:
     if (Delta == 0) {
-      Delta = Width * PI2_BYTES_PER_PIXEL;
+      Delta = Bytes;
     }
 
-    for (i = 0; i < Height; i++) {
-      VidBuf = POS_TO_FB(SourceX, SourceY + i);
+    VidBuf = POS_TO_FB(SourceX, SourceY);
+    BltBuf = (UINT8 *)((UINTN)BltBuffer + DestinationY * Delta +
+                       DestinationX * PI2_BYTES_PER_PIXEL);
 
-      BltBuf = (UINT8 *)((UINTN)BltBuffer + (DestinationY + i) * Delta +
-                         DestinationX * PI2_BYTES_PER_PIXEL);
+    if (Bytes == Pitch && Delta == Pitch) {
+      DisplayCopySpanFromVideo(BltBuf, VidBuf, Bytes * Height);
+      break;
+    }
 
-      gBS->CopyMem((VOID *)BltBuf, (VOID *)VidBuf, PI2_BYTES_PER_PIXEL * Width);
+    for (i = 0; i < Height; i++) {
+      DisplayCopySpanFromVideo(BltBuf, VidBuf, Bytes);
+      VidBuf += Pitch;
+      BltBuf += Delta;
     }
     break;
 
   case EfiBltBufferToVideo:
     if (Delta == 0) {
-      Delta = Width * PI2_BYTES_PER_PIXEL;
+      Delta = Bytes;
     }
 
-    for (i = 0; i < Height; i++) {
-      VidBuf = POS_TO_FB(DestinationX, DestinationY + i);
-      BltBuf = (UINT8 *)((UINTN) BltBuffer + (SourceY + i) * Delta +
-                         SourceX * PI2_BYTES_PER_PIXEL);
+    VidBuf = POS_TO_FB(DestinationX, DestinationY);
+    BltBuf = (UINT8 *)((UINTN) BltBuffer + SourceY * Delta +
+                       SourceX * PI2_BYTES_PER_PIXEL);
 
-      gBS->CopyMem((VOID *)VidBuf, (VOID *)BltBuf, Width * PI2_BYTES_PER_PIXEL);
+    if (Bytes == Pitch && Delta == Pitch) {
+      DisplayCopySpanToVideo(VidBuf, BltBuf, Bytes * Height);
+      break;
+    }
+
+    for (i = 0; i < Height; i++) {
+      DisplayCopySpanToVideo(VidBuf, BltBuf, Bytes);
+      VidBuf += Pitch;
+      BltBuf += Delta;
     }
     break;
 
   case EfiBltVideoToVideo:
-    for (i = 0; i < Height; i++) {
-      VidBuf = POS_TO_FB(SourceX, SourceY + i);
-      VidBuf1 = POS_TO_FB(DestinationX, DestinationY + i);
+    VidBuf = POS_TO_FB(SourceX, SourceY);
+    VidBuf1 = POS_TO_FB(DestinationX, DestinationY);
 
-      gBS->CopyMem((VOID *)VidBuf1, (VOID *)VidBuf, Width * PI2_BYTES_PER_PIXEL);
+    if (VidBuf1 <= VidBuf) {
+      /*
+       * Scrolling up (or left): a forward copy never overwrites
+       * source pixels before they are read.
+       */
+      if (Bytes == Pitch) {
+        DisplayCopySpanVideo(VidBuf1, VidBuf, Bytes * Height);
+        break;
+      }
+
+      for (i = 0; i < Height; i++) {
+        DisplayCopySpanVideo(VidBuf1, VidBuf, Bytes);
+        VidBuf += Pitch;
+        VidBuf1 += Pitch;
+      }
+      break;
+    }
+
+    if (DestinationY == SourceY) {
+      /*
+       * Shifting right within the same rows, rows may overlap.
+       */
+      for (i = 0; i < Height; i++) {
+        gBS->CopyMem((VOID *)VidBuf1, (VOID *)VidBuf, Bytes);
+        VidBuf += Pitch;
+        VidBuf1 += Pitch;
+      }
+      break;
+    }
+
+    /*
+     * Scrolling down: go bottom-up so each source row is read
+     * before a destination row lands on it.
+     */
+    for (i = Height; i > 0; i--) {
+      DisplayCopySpanVideo(VidBuf1 + (i - 1) * Pitch,
+                           VidBuf + (i - 1) * Pitch, Bytes);
     }
     break;
 
@@ -358,6 +878,7 @@ DisplayBlt(
     break;
   }
 
+  gBS->RestoreTPL(OldTpl);
   return EFI_SUCCESS;
 }
 
@@ -544,35 +1065,38 @@ DriverStart (
      mGopModeData[mLastMode].Height = mBootHeight;
   }
 
-  for (Index = 0; Index <= mLastMode; Index++) {
-    UINTN FbSize;
-    UINTN FbPitch;
-    EFI_PHYSICAL_ADDRESS FbBase;
-
-    GOP_MODE_DATA *Mode = &mGopModeData[Index];
-
-    Status = mFwProtocol->GetFB(Mode->Width, Mode->Height,
-                                PI2_BITS_PER_PIXEL, &FbBase,
-                                &FbSize, &FbPitch);
-    if (EFI_ERROR(Status)) {
-      goto done;
-    }
-
-    //
-    // There is no way to communicate pitch back to OS. OS and even UEFI
-    // expect a fully linear frame buffer. So the width should
-    // be based on the frame buffer's pitch value. In some cases VC
-    // firmware would allocate ao frame buffer with some padding
-    // presumably to be 8 byte align.
-    //
-    Mode->Width = FbPitch / PI2_BYTES_PER_PIXEL;
+  Status = ProbeModes();
+  if (EFI_ERROR(Status)) {
+    goto done;
+  }
 
-    DEBUG((EFI_D_INFO, "Mode %u: %u x %u framebuffer is %u bytes at %p\n",
-           Index, Mode->Width, Mode->Height, FbSize, FbBase));
+  /*
+   * Before the first mode is set, so that it only asks for the
+   * larger framebuffer when panning can be used. Without both
+   * events the window could be left panned, so it can't be.
+   */
+  mPanDisabled = PcdGet32(PcdDisplayPanning) == PAN_NEVER;
+  Status = gBS->CreateEventEx(EVT_NOTIFY_SIGNAL, TPL_NOTIFY,
+                              DisplayReadyToBoot, NULL,
+                              &gEfiEventReadyToBootGuid,
+                              &mReadyToBootEvent);
+  if (EFI_ERROR (Status)) {
+    DEBUG((EFI_D_ERROR, "Could not create ReadyToBoot event: %r\n",
+           Status));
+    mPanDisabled = TRUE;
+    mReadyToBootEvent = NULL;
+    Status = EFI_SUCCESS;
+  }
 
-    ASSERT (FbPitch != 0);
-    ASSERT (FbBase != 0);
-    ASSERT (FbSize != 0);
+  Status = gBS->CreateEvent(EVT_SIGNAL_EXIT_BOOT_SERVICES, TPL_NOTIFY,
+                            DisplayExitBootServices, NULL,
+                            &mExitBootServicesEvent);
+  if (EFI_ERROR (Status)) {
+    DEBUG((EFI_D_ERROR, "Could not create ExitBootServices event: %r\n",
+           Status));
+    mPanDisabled = TRUE;
+    mExitBootServicesEvent = NULL;
+    Status = EFI_SUCCESS;
   }
 
   // Both set the mode and initialize current mode information.
@@ -581,7 +1105,8 @@ DriverStart (
 
   Status = gBS->InstallMultipleProtocolInterfaces (
     &Controller, &gEfiGraphicsOutputProtocolGuid,
-    &gDisplayProto, NULL);
+    &gDisplayProto, &gDisplayScrollProtocolGuid,
+    &mDisplayScroll, NULL);
   if (EFI_ERROR (Status)) {
     goto done;
   }
@@ -595,6 +1120,16 @@ DriverStart (
 done:
   if (EFI_ERROR (Status)) {
     DEBUG((EFI_D_ERROR, "Could not start DisplayDxe: %r\n", Status));
+    if (mReadyToBootEvent != NULL) {
+      gBS->CloseEvent(mReadyToBootEvent);
+      mReadyToBootEvent = NULL;
+    }
+
+    if (mExitBootServicesEvent != NULL) {
+      gBS->CloseEvent(mExitBootServicesEvent);
+      mExitBootServicesEvent = NULL;
+    }
+
     if (gDisplayProto.Mode->Info != NULL) {
       FreePool(gDisplayProto.Mode->Info);
       gDisplayProto.Mode->Info = NULL;
@@ -631,11 +1166,22 @@ DriverStop (
 
   Status = gBS->UninstallMultipleProtocolInterfaces (
     Controller, &gEfiGraphicsOutputProtocolGuid,
-    &gDisplayProto, NULL);
+    &gDisplayProto, &gDisplayScrollProtocolGuid,
+    &mDisplayScroll, NULL);
   if (EFI_ERROR (Status)) {
     return Status;
   }
 
+  if (mReadyToBootEvent != NULL) {
+    gBS->CloseEvent(mReadyToBootEvent);
+    mReadyToBootEvent = NULL;
+  }
+
+  if (mExitBootServicesEvent != NULL) {
+    gBS->CloseEvent(mExitBootServicesEvent);
+    mExitBootServicesEvent = NULL;
+  }
+
   FreePool(gDisplayProto.Mode->Info);
   gDisplayProto.Mode->Info = NULL;
   FreePool(gDisplayProto.Mode);
@@ -24,12 +24,17 @@
 #include <Library/PcdLib.h>
 #include <Library/IoLib.h>
 #include <Library/TimerLib.h>
+#include <Guid/EventGroup.h>
 #include <Protocol/GraphicsOutput.h>
 #include <Protocol/DevicePath.h>
+#include <Protocol/DisplayScroll.h>
 #include <Protocol/RaspberryPiFirmware.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Protocol/Cpu.h>
+#include <IndustryStandard/Bcm2836.h>
+#include <IndustryStandard/RpiFirmware.h>
 #include <Utils.h>
+#include "BltKernels.h"
 
 extern EFI_GRAPHICS_OUTPUT_PROTOCOL gDisplayProto;
 extern EFI_COMPONENT_NAME_PROTOCOL  gComponentName;
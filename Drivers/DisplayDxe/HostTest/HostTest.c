@@ -0,0 +1,340 @@
+/** @file
+ *
+ *  Checks the DisplayBlt span kernels against memset and memmove:
+ *  every destination and source alignment a pixel span can have,
+ *  overlapping copies with Dst <= Src as scrolling does them, and
+ *  the throughput on a full 1080p frame next to the C library's.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "HostUefi.h"
+#include "BltKernels.h"
+
+#define PIXEL               4
+
+/*
+ * Spans up to MAX_SPAN_PIXELS long, at each pixel offset from a
+ * 16-byte boundary, with GUARD bytes either side that must come
+ * through untouched.
+ */
+#define MAX_SPAN_PIXELS     150
+#define GUARD               64
+#define GUARD_BYTE          0xE5
+
+#define FRAME_WIDTH         1920
+#define FRAME_HEIGHT        1080
+#define FRAME_BYTES         (FRAME_WIDTH * FRAME_HEIGHT * PIXEL)
+#define FRAME_REPEATS       20
+#define FRAME_RUNS          5
+
+/*
+ * The kernels replaced per-row SetMem32 and CopyMem calls, which
+ * come down to about what memset and memmove do. Half their rate
+ * leaves room for a noisy host.
+ */
+#define MIN_RATE_PERCENT    50
+
+#define CHECK(Expression)                                               \
+  do {                                                                  \
+    if (!(Expression)) {                                                \
+      fprintf (stderr, "%s:%u: %s: check failed: %s\n", __FILE__,      \
+               __LINE__, __func__, #Expression);                        \
+      mFailures++;                                                      \
+    }                                                                   \
+  } while (FALSE)
+
+typedef VOID (*COPY_SPAN) (OUT VOID *Dst, IN CONST VOID *Src, IN UINTN Bytes);
+
+typedef struct {
+  CONST CHAR8 *Name;
+  COPY_SPAN   Copy;
+} COPY_KERNEL;
+
+STATIC CONST COPY_KERNEL mCopyKernels[] = {
+  { "to video",   DisplayCopySpanToVideo },
+  { "from video", DisplayCopySpanFromVideo },
+  { "video",      DisplayCopySpanVideo },
+};
+
+STATIC UINTN mFailures;
+
+STATIC UINT8 mDst[GUARD + 16 + MAX_SPAN_PIXELS * PIXEL + GUARD] __attribute__ ((aligned (16)));
+STATIC UINT8 mSrc[GUARD + 16 + MAX_SPAN_PIXELS * PIXEL + GUARD] __attribute__ ((aligned (16)));
+STATIC UINT8 mExpect[sizeof (mDst)];
+
+STATIC
+VOID
+Pattern (
+  OUT UINT8 *Buffer,
+  IN  UINTN Length,
+  IN  UINTN Seed
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < Length; Index++) {
+    Buffer[Index] = (UINT8) (Index * 13 + Seed * 7 + (Index >> 8));
+  }
+}
+
+STATIC
+VOID
+TestFill (
+  VOID
+  )
+{
+  UINTN  Offset;
+  UINTN  Pixels;
+  UINTN  Index;
+  UINT32 Pixel;
+  UINT8  *Dst;
+
+  Pixel = 0x00C0FFEE;
+  for (Offset = 0; Offset < 16; Offset += PIXEL) {
+    for (Pixels = 0; Pixels <= MAX_SPAN_PIXELS; Pixels++) {
+      memset (mDst, GUARD_BYTE, sizeof (mDst));
+      memset (mExpect, GUARD_BYTE, sizeof (mExpect));
+      Dst = mDst + GUARD + Offset;
+      for (Index = 0; Index < Pixels; Index++) {
+        memcpy (mExpect + GUARD + Offset + Index * PIXEL, &Pixel, PIXEL);
+      }
+
+      DisplayFillSpan (Dst, Pixels * PIXEL, Pixel);
+      if (memcmp (mDst, mExpect, sizeof (mDst)) != 0) {
+        fprintf (stderr, "fill: offset %u, %u pixels\n",
+                 (unsigned) Offset, (unsigned) Pixels);
+        CHECK (FALSE);
+        return;
+      }
+    }
+  }
+}
+
+/*
+ * Separate source and destination, each at any pixel offset from a
+ * 16-byte boundary: the kernels only align the destination.
+ */
+STATIC
+VOID
+TestCopy (
+  IN  CONST COPY_KERNEL *Kernel
+  )
+{
+  UINTN DstOffset;
+  UINTN SrcOffset;
+  UINTN Pixels;
+  UINT8 *Dst;
+  UINT8 *Src;
+
+  Pattern (mSrc, sizeof (mSrc), 1);
+  for (DstOffset = 0; DstOffset < 16; DstOffset += PIXEL) {
+    for (SrcOffset = 0; SrcOffset < 16; SrcOffset += PIXEL) {
+      for (Pixels = 0; Pixels <= MAX_SPAN_PIXELS; Pixels++) {
+        memset (mDst, GUARD_BYTE, sizeof (mDst));
+        memset (mExpect, GUARD_BYTE, sizeof (mExpect));
+        Dst = mDst + GUARD + DstOffset;
+        Src = mSrc + GUARD + SrcOffset;
+        memcpy (mExpect + GUARD + DstOffset, Src, Pixels * PIXEL);
+
+        Kernel->Copy (Dst, Src, Pixels * PIXEL);
+        if (memcmp (mDst, mExpect, sizeof (mDst)) != 0) {
+          fprintf (stderr, "copy %s: dst offset %u, src offset %u, %u pixels\n",
+                   Kernel->Name, (unsigned) DstOffset, (unsigned) SrcOffset,
+                   (unsigned) Pixels);
+          CHECK (FALSE);
+          return;
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Dst <= Src within one buffer, from the same span to a distance
+ * past a whole 64-byte block, as a left shift or an upward scroll
+ * of a narrow window does it.
+ */
+STATIC
+VOID
+TestOverlap (
+  IN  CONST COPY_KERNEL *Kernel
+  )
+{
+  STATIC CONST UINTN Distances[] = { 0, 1, 2, 3, 4, 5, 15, 16, 17, 31, 33 };
+  UINTN              DstOffset;
+  UINTN              Distance;
+  UINTN              Pixels;
+  UINT8              *Dst;
+
+  for (DstOffset = 0; DstOffset < 16; DstOffset += PIXEL) {
+    for (Distance = 0; Distance < ARRAY_SIZE (Distances); Distance++) {
+      for (Pixels = 0;
+           Pixels + Distances[Distance] <= MAX_SPAN_PIXELS;
+           Pixels++) {
+        Pattern (mDst, sizeof (mDst), Pixels);
+        memcpy (mExpect, mDst, sizeof (mDst));
+        Dst = mDst + GUARD + DstOffset;
+        memmove (mExpect + GUARD + DstOffset,
+                 Dst + Distances[Distance] * PIXEL, Pixels * PIXEL);
+
+        Kernel->Copy (Dst, Dst + Distances[Distance] * PIXEL, Pixels * PIXEL);
+        if (memcmp (mDst, mExpect, sizeof (mDst)) != 0) {
+          fprintf (stderr, "overlap %s: dst offset %u, distance %u, %u pixels\n",
+                   Kernel->Name, (unsigned) DstOffset,
+                   (unsigned) Distances[Distance], (unsigned) Pixels);
+          CHECK (FALSE);
+          return;
+        }
+      }
+    }
+  }
+}
+
+/*
+ * A one-line scroll of a whole frame is a single span copy from one
+ * line down to the top.
+ */
+STATIC
+VOID
+TestScroll (
+  IN  UINT8 *Frame,
+  IN  UINT8 *Expect
+  )
+{
+  UINTN Pitch;
+
+  Pitch = FRAME_WIDTH * PIXEL;
+  Pattern (Frame, FRAME_BYTES, 3);
+  memcpy (Expect, Frame, FRAME_BYTES);
+  memmove (Expect, Expect + Pitch, FRAME_BYTES - Pitch);
+
+  DisplayCopySpanVideo (Frame, Frame + Pitch, FRAME_BYTES - Pitch);
+  CHECK (memcmp (Frame, Expect, FRAME_BYTES) == 0);
+}
+
+STATIC
+UINT64
+NowNs (
+  VOID
+  )
+{
+  struct timespec Now;
+
+  clock_gettime (CLOCK_MONOTONIC, &Now);
+  return (UINT64) Now.tv_sec * 1000000000ULL + (UINT64) Now.tv_nsec;
+}
+
+/*
+ * The best of FRAME_RUNS runs of FRAME_REPEATS frames, in MiB/s.
+ * Kernel 0 is the fill, the rest index mCopyKernels; Library picks
+ * memset or memmove instead.
+ */
+STATIC
+UINT64
+FrameRate (
+  IN  UINTN   Kernel,
+  IN  BOOLEAN Library,
+  IN  UINT8   *Frame,
+  IN  UINT8   *Other
+  )
+{
+  UINT64 Best;
+  UINT64 Start;
+  UINT64 Elapsed;
+  UINTN  Run;
+  UINTN  Repeat;
+
+  Best = ~0ULL;
+  for (Run = 0; Run < FRAME_RUNS; Run++) {
+    Start = NowNs ();
+    for (Repeat = 0; Repeat < FRAME_REPEATS; Repeat++) {
+      if (Kernel == 0 && Library) {
+        memset (Frame, (int) Repeat, FRAME_BYTES);
+      } else if (Kernel == 0) {
+        DisplayFillSpan (Frame, FRAME_BYTES, (UINT32) Repeat);
+      } else if (Library) {
+        memmove (Frame, Other, FRAME_BYTES);
+      } else {
+        mCopyKernels[Kernel - 1].Copy (Frame, Other, FRAME_BYTES);
+      }
+      __asm__ __volatile__ ("" : : "r" (Frame) : "memory");
+    }
+    Elapsed = NowNs () - Start;
+    Best = MIN (Best, MAX (Elapsed, 1));
+  }
+
+  return (UINT64) FRAME_BYTES * FRAME_REPEATS * 1000000000ULL / Best / (1 << 20);
+}
+
+STATIC
+VOID
+TestThroughput (
+  IN  UINT8 *Frame,
+  IN  UINT8 *Other
+  )
+{
+  UINTN  Kernel;
+  UINT64 Rate;
+  UINT64 LibraryRate;
+
+  Pattern (Other, FRAME_BYTES, 5);
+  for (Kernel = 0; Kernel <= ARRAY_SIZE (mCopyKernels); Kernel++) {
+    LibraryRate = FrameRate (Kernel, TRUE, Frame, Other);
+    Rate = FrameRate (Kernel, FALSE, Frame, Other);
+    printf ("%-10s %6llu MiB/s, %s %6llu MiB/s\n",
+            Kernel == 0 ? "fill" : mCopyKernels[Kernel - 1].Name,
+            (unsigned long long) Rate, Kernel == 0 ? "memset " : "memmove",
+            (unsigned long long) LibraryRate);
+    CHECK (Rate * 100 >= LibraryRate * MIN_RATE_PERCENT);
+  }
+}
+
+int
+main (
+  int  argc,
+  char **argv
+  )
+{
+  UINTN Kernel;
+  UINT8 *Frame;
+  UINT8 *Other;
+
+  for (Kernel = 0; Kernel < ARRAY_SIZE (mCopyKernels); Kernel++) {
+    TestCopy (&mCopyKernels[Kernel]);
+    TestOverlap (&mCopyKernels[Kernel]);
+  }
+  TestFill ();
+
+  if (posix_memalign ((VOID **) &Frame, 64, FRAME_BYTES) != 0 ||
+      posix_memalign ((VOID **) &Other, 64, FRAME_BYTES) != 0) {
+    fprintf (stderr, "out of memory\n");
+    return 1;
+  }
+
+  TestScroll (Frame, Other);
+  TestThroughput (Frame, Other);
+  free (Frame);
+  free (Other);
+
+  if (mFailures != 0) {
+    printf ("%u check(s) failed\n", (unsigned) mFailures);
+    return 1;
+  }
+
+  printf ("all checks passed\n");
+  return 0;
+}
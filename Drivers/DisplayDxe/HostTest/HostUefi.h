@@ -0,0 +1,48 @@
+/** @file
+ *
+ *  Just enough of the UEFI environment to build the DisplayDxe span
+ *  kernels as part of a host program.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#ifndef __HOST_UEFI_H__
+#define __HOST_UEFI_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t             UINT8;
+typedef uint16_t            UINT16;
+typedef uint32_t            UINT32;
+typedef uint64_t            UINT64;
+typedef uintptr_t           UINTN;
+typedef intptr_t            INTN;
+typedef unsigned char       BOOLEAN;
+typedef char                CHAR8;
+typedef void                VOID;
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define CONST               const
+#define STATIC              static
+
+#define TRUE                ((BOOLEAN)(1==1))
+#define FALSE               ((BOOLEAN)(0==1))
+
+#define MIN(a, b)                 (((a) < (b)) ? (a) : (b))
+#define MAX(a, b)                 (((a) > (b)) ? (a) : (b))
+#define ARRAY_SIZE(Array)         (sizeof (Array) / sizeof ((Array)[0]))
+
+#endif /* __HOST_UEFI_H__ */
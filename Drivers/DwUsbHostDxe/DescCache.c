@@ -0,0 +1,227 @@
+/** @file
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include "DwUsbHostDxe.h"
+
+/*
+ * Configuration descriptor cache. UsbBusDxe reads every
+ * configuration of every device each time it enumerates, and
+ * the descriptors don't change while the device keeps its
+ * address.
+ *
+ * Entries are keyed by address alone, and only live as long as
+ * that address does: SET_ADDRESS to an address drops what was
+ * cached for it, and any port reset or connect change drops
+ * everything, since a device behind a hub port can't be told
+ * apart by address. Requests are never rewritten, a cached
+ * configuration only answers reads it fully covers.
+ */
+
+STATIC
+BOOLEAN
+DwHcIsGetDescriptor (
+  IN  EFI_USB_DEVICE_REQUEST *Request,
+  IN  UINT8                  Type
+  )
+{
+  return Request->RequestType == USB_DEV_GET_DESCRIPTOR_REQ_TYPE &&
+    Request->Request == USB_REQ_GET_DESCRIPTOR &&
+    (Request->Value >> 8) == Type &&
+    Request->Index == 0;
+}
+
+/*
+ * Hub class requests that reset a downstream port or acknowledge
+ * a connect change on it.
+ */
+STATIC
+BOOLEAN
+DwHcIsHubPortChange (
+  IN  EFI_USB_DEVICE_REQUEST *Request
+  )
+{
+  if (Request->RequestType != USB_HUB_PORT_REQ_TYPE) {
+    return FALSE;
+  }
+
+  return (Request->Request == USB_REQ_SET_FEATURE &&
+          Request->Value == USB_HUB_PORT_RESET) ||
+    (Request->Request == USB_REQ_CLEAR_FEATURE &&
+     Request->Value == USB_HUB_C_PORT_CONNECTION);
+}
+
+STATIC
+BOOLEAN
+DwHcDescCacheAddressValid (
+  IN  UINT8           DeviceAddress
+  )
+{
+  return DeviceAddress != 0 && DeviceAddress < DESC_CACHE_MAX_ADDRESS;
+}
+
+STATIC
+DWUSB_CONFIG_CACHE *
+DwHcDescCacheFindConfig (
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  IN  UINT8           DeviceAddress,
+  IN  UINT8           ConfigIndex
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < DESC_CACHE_ENTRIES; Index++) {
+    if (DwHc->ConfigCache[Index].Address == DeviceAddress &&
+        DwHc->ConfigCache[Index].ConfigIndex == ConfigIndex) {
+      return &DwHc->ConfigCache[Index];
+    }
+  }
+
+  return NULL;
+}
+
+STATIC
+VOID
+DwHcDescCacheDropDevice (
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  IN  UINT8           DeviceAddress
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < DESC_CACHE_ENTRIES; Index++) {
+    if (DwHc->ConfigCache[Index].Address == DeviceAddress) {
+      DwHc->ConfigCache[Index].Address = 0;
+    }
+  }
+}
+
+VOID
+DwHcDescCacheFlush (
+  IN  DWUSB_OTGHC_DEV        *DwHc
+  )
+{
+  EFI_TPL Tpl;
+  UINTN   Index;
+
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+  for (Index = 0; Index < DESC_CACHE_ENTRIES; Index++) {
+    DwHc->ConfigCache[Index].Address = 0;
+  }
+  gBS->RestoreTPL (Tpl);
+}
+
+BOOLEAN
+DwHcDescCacheLookup (
+  IN      DWUSB_OTGHC_DEV        *DwHc,
+  IN      UINT8                  DeviceAddress,
+  IN      EFI_USB_DEVICE_REQUEST *Request,
+  OUT     VOID                   *Data,
+  IN  OUT UINTN                  *DataLength
+  )
+{
+  EFI_TPL            Tpl;
+  DWUSB_CONFIG_CACHE *Config;
+
+  if (!DwHcDescCacheAddressValid (DeviceAddress) ||
+      !DwHcIsGetDescriptor (Request, USB_DESC_TYPE_CONFIG)) {
+    return FALSE;
+  }
+
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+  Config = DwHcDescCacheFindConfig (DwHc, DeviceAddress,
+                                    Request->Value & 0xFF);
+  if (Config != NULL) {
+    /*
+     * The device would return at most wLength bytes, and the
+     * cached copy is the whole configuration.
+     */
+    *DataLength = MIN (*DataLength, Request->Length);
+    *DataLength = MIN (*DataLength, Config->Length);
+    CopyMem (Data, Config->Data, *DataLength);
+  }
+  gBS->RestoreTPL (Tpl);
+
+  return Config != NULL;
+}
+
+VOID
+DwHcDescCacheUpdate (
+  IN  DWUSB_OTGHC_DEV        *DwHc,
+  IN  UINT8                  DeviceAddress,
+  IN  EFI_USB_DEVICE_REQUEST *Request,
+  IN  VOID                   *Data,
+  IN  UINTN                  DataLength,
+  IN  EFI_STATUS             Status
+  )
+{
+  EFI_TPL               Tpl;
+  DWUSB_CONFIG_CACHE    *Config;
+  USB_CONFIG_DESCRIPTOR *ConfigDesc;
+
+  if (DwHcIsHubPortChange (Request)) {
+    /*
+     * Even a failed request may have reset the port.
+     */
+    DwHcDescCacheFlush (DwHc);
+    return;
+  }
+
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+
+  if (Request->RequestType == USB_DEV_SET_ADDRESS_REQ_TYPE &&
+      Request->Request == USB_REQ_SET_ADDRESS) {
+    /*
+     * A new device now owns this address.
+     */
+    if (DwHcDescCacheAddressValid ((UINT8) Request->Value)) {
+      DwHcDescCacheDropDevice (DwHc, (UINT8) Request->Value);
+    }
+    goto out;
+  }
+
+  if (!DwHcDescCacheAddressValid (DeviceAddress) ||
+      !DwHcIsGetDescriptor (Request, USB_DESC_TYPE_CONFIG) ||
+      DataLength < sizeof (USB_CONFIG_DESCRIPTOR)) {
+    goto out;
+  }
+
+  /*
+   * Only complete configurations are kept, so that any read
+   * can be answered from the entry.
+   */
+  ConfigDesc = Data;
+  if (ConfigDesc->TotalLength > DESC_CACHE_CONFIG_SIZE ||
+      ConfigDesc->TotalLength > DataLength ||
+      ConfigDesc->TotalLength < sizeof (USB_CONFIG_DESCRIPTOR)) {
+    goto out;
+  }
+
+  Config = DwHcDescCacheFindConfig (DwHc, DeviceAddress, Request->Value & 0xFF);
+  if (Config == NULL) {
+    Config = &DwHc->ConfigCache[DwHc->ConfigCacheNext];
+    DwHc->ConfigCacheNext = (DwHc->ConfigCacheNext + 1) % DESC_CACHE_ENTRIES;
+  }
+
+  Config->Address = DeviceAddress;
+  Config->ConfigIndex = Request->Value & 0xFF;
+  Config->Length = ConfigDesc->TotalLength;
+  CopyMem (Config->Data, Data, Config->Length);
+
+ out:
+  gBS->RestoreTPL (Tpl);
+}
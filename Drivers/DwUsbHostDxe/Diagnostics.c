@@ -0,0 +1,594 @@
+/** @file
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include "DwUsbHostDxe.h"
+#include <Protocol/BlockIo.h>
+#include <Protocol/UsbIo.h>
+#include <Library/BenchmarkLib.h>
+#include <Library/PrintLib.h>
+
+#define DIAGNOSTIC_LOGBUFFER_MAXCHAR  (16 * 1024)
+#define DIAGNOSTIC_TRACE_ENTRIES      64
+
+/*
+ * The benchmark reads from the first USB disk, with transfer
+ * sizes from one block to 1MiB, as BenchmarkLib plans them.
+ */
+#define BENCHMARK_MAX_SIZE            SIZE_1MB
+#define BENCHMARK_LOG_FILE            L"\\UsbBench.csv"
+
+/*
+ * The bulk-only transport status wrapper the disk sends at the end
+ * of every command.
+ */
+#define BENCHMARK_CSW_LENGTH          13
+
+/*
+ * The disk under test, and the device address and bulk endpoints
+ * its transfers are traced under.
+ */
+typedef struct {
+  EFI_BLOCK_IO_PROTOCOL *BlockIo;
+  UINT8                 DeviceAddress;
+  UINT8                 BulkIn;
+  UINT8                 BulkOut;
+} DWHC_BENCHMARK_DISK;
+
+typedef struct {
+  BENCHMARK_RESULT Timing;
+  UINT64           CopyNs;
+  UINT64           SetupNs;
+  UINT64           WaitNs;
+  UINT64           Retries;
+} DWHC_BENCHMARK_RESULT;
+
+STATIC CONST CHAR8 *mEpTypeNames[] = { "ctrl", "isoc", "bulk", "intr" };
+
+STATIC CHAR16 *mLogBuffer;
+STATIC UINTN  mLogRemainChar;
+
+STATIC
+CHAR16 *
+DiagnosticInitLog (
+  IN  UINTN MaxBufferChar
+  )
+{
+  mLogRemainChar = MaxBufferChar;
+  mLogBuffer = AllocatePool (MaxBufferChar * sizeof (CHAR16));
+  return mLogBuffer;
+}
+
+STATIC
+VOID
+DiagnosticLog (
+  IN  CONST CHAR16 *Str
+  )
+{
+  UINTN Len;
+
+  Len = StrLen (Str);
+  if (Len < mLogRemainChar) {
+    StrCpyS (mLogBuffer, mLogRemainChar, Str);
+    mLogRemainChar -= Len;
+    mLogBuffer += Len;
+  }
+}
+
+STATIC
+VOID
+DwHcLogEndpointStats (
+  IN  DW_USB_HOST_TRACE_PROTOCOL *Trace
+  )
+{
+  UINTN                      Index;
+  DW_USB_HOST_ENDPOINT_STATS Stats;
+  CHAR16                     Line[160];
+
+  DiagnosticLog (L"Dev EP   Type  Transfers      KiB Errors Restarts "
+                 L"    NAKs CSPLITs Overruns  Avg uF\n");
+
+  for (Index = 0;
+       !EFI_ERROR (Trace->GetEndpointStats (Trace, Index, &Stats));
+       Index++) {
+    UnicodeSPrint (Line, sizeof (Line),
+                   L"%3u %02x   %a %10Lu %8Lu %6Lu %8Lu %8Lu %7Lu %8Lu %7Lu\n",
+                   Stats.DeviceAddress, Stats.EpAddress,
+                   mEpTypeNames[Stats.EpType & 3],
+                   Stats.Transfers, RShiftU64 (Stats.Bytes, 10),
+                   Stats.Errors, Stats.Restarts, Stats.Naks, Stats.Csplits,
+                   Stats.FrameOverruns,
+                   Stats.Transfers == 0 ? 0 :
+                   DivU64x64Remainder (Stats.MicroFrames, Stats.Transfers, NULL));
+    DiagnosticLog (Line);
+  }
+}
+
+STATIC
+VOID
+DwHcLogTrace (
+  IN  DW_USB_HOST_TRACE_PROTOCOL *Trace
+  )
+{
+  UINTN                   Index;
+  DW_USB_HOST_TRACE_ENTRY Entry;
+  CHAR16                  Line[160];
+
+  DiagnosticLog (L"\nMost recent transfers, newest first:\n");
+  DiagnosticLog (L"   uF Dev EP   Type Ch   Length   Actual Rst  NAK CSPL Ovr"
+                 L"  Dur Result\n");
+
+  for (Index = 0;
+       Index < DIAGNOSTIC_TRACE_ENTRIES &&
+       !EFI_ERROR (Trace->GetTraceEntry (Trace, Index, &Entry));
+       Index++) {
+    UnicodeSPrint (Line, sizeof (Line),
+                   L"%5u %3u %02x   %a %2d %8u %8u %3u %4u %4u %3u %4u %r (0x%x)\n",
+                   Entry.StartMicroFrame, Entry.DeviceAddress, Entry.EpAddress,
+                   mEpTypeNames[Entry.EpType & 3],
+                   Entry.Channel == MAX_UINT8 ? -1 : (INT32) Entry.Channel,
+                   Entry.Length, Entry.Actual, Entry.Restarts, Entry.Naks,
+                   Entry.Csplits, Entry.FrameOverruns, Entry.MicroFrames,
+                   Entry.Status, Entry.TransferResult);
+    DiagnosticLog (Line);
+  }
+}
+
+/*
+ * Sums the cost breakdown over the disk's bulk endpoints, leaving
+ * out whatever else is on the bus.
+ */
+STATIC
+VOID
+DwHcBenchmarkTotals (
+  IN  DW_USB_HOST_TRACE_PROTOCOL *Trace,
+  IN  DWHC_BENCHMARK_DISK        *Disk,
+  OUT DW_USB_HOST_ENDPOINT_STATS *Totals
+  )
+{
+  UINTN                      Index;
+  DW_USB_HOST_ENDPOINT_STATS Stats;
+
+  ZeroMem (Totals, sizeof (*Totals));
+  for (Index = 0;
+       !EFI_ERROR (Trace->GetEndpointStats (Trace, Index, &Stats));
+       Index++) {
+    if (Stats.DeviceAddress != Disk->DeviceAddress ||
+        Stats.EpType != DW_USB_HOST_EP_BULK ||
+        (Stats.EpAddress != Disk->BulkIn && Stats.EpAddress != Disk->BulkOut)) {
+      continue;
+    }
+
+    Totals->Restarts += Stats.Restarts + Stats.Naks + Stats.Csplits +
+      Stats.FrameOverruns;
+    Totals->CopyNs += Stats.CopyNs;
+    Totals->SetupNs += Stats.SetupNs;
+    Totals->WaitNs += Stats.WaitNs;
+  }
+}
+
+/*
+ * The bulk endpoints of the USB interface Handle's disk sits on.
+ */
+STATIC
+EFI_STATUS
+DwHcBenchmarkFindEndpoints (
+  IN  EFI_HANDLE          Handle,
+  OUT DWHC_BENCHMARK_DISK *Disk
+  )
+{
+  EFI_STATUS                   Status;
+  EFI_DEVICE_PATH_PROTOCOL     *Path;
+  EFI_HANDLE                   UsbHandle;
+  EFI_USB_IO_PROTOCOL          *UsbIo;
+  EFI_USB_INTERFACE_DESCRIPTOR Interface;
+  EFI_USB_ENDPOINT_DESCRIPTOR  Endpoint;
+  UINT8                        Index;
+
+  Path = DevicePathFromHandle (Handle);
+  Status = gBS->LocateDevicePath (&gEfiUsbIoProtocolGuid, &Path, &UsbHandle);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = gBS->HandleProtocol (UsbHandle, &gEfiUsbIoProtocolGuid,
+                                (VOID **) &UsbIo);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = UsbIo->UsbGetInterfaceDescriptor (UsbIo, &Interface);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Disk->BulkIn = 0;
+  Disk->BulkOut = 0;
+  for (Index = 0; Index < Interface.NumEndpoints; Index++) {
+    Status = UsbIo->UsbGetEndpointDescriptor (UsbIo, Index, &Endpoint);
+    if (EFI_ERROR (Status) ||
+        (Endpoint.Attributes & USB_ENDPOINT_TYPE_MASK) != USB_ENDPOINT_BULK) {
+      continue;
+    }
+
+    if ((Endpoint.EndpointAddress & USB_ENDPOINT_DIR_IN) != 0) {
+      Disk->BulkIn = Endpoint.EndpointAddress;
+    } else {
+      Disk->BulkOut = Endpoint.EndpointAddress;
+    }
+  }
+
+  if (Disk->BulkIn == 0 || Disk->BulkOut == 0) {
+    return EFI_UNSUPPORTED;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/*
+ * The first whole bulk-only USB disk with media behind this
+ * controller.
+ */
+STATIC
+EFI_STATUS
+DwHcBenchmarkFindDisk (
+  IN  EFI_HANDLE          ControllerHandle,
+  OUT DWHC_BENCHMARK_DISK *Disk
+  )
+{
+  EFI_STATUS               Status;
+  EFI_DEVICE_PATH_PROTOCOL *ControllerPath;
+  EFI_DEVICE_PATH_PROTOCOL *Path;
+  EFI_BLOCK_IO_PROTOCOL    *BlockIo;
+  EFI_HANDLE               *Handles;
+  UINTN                    HandleCount;
+  UINTN                    PathSize;
+  UINTN                    Index;
+
+  ControllerPath = DevicePathFromHandle (ControllerHandle);
+  if (ControllerPath == NULL) {
+    return EFI_NOT_FOUND;
+  }
+  PathSize = GetDevicePathSize (ControllerPath) - END_DEVICE_PATH_LENGTH;
+
+  Status = gBS->LocateHandleBuffer (ByProtocol, &gEfiBlockIoProtocolGuid,
+                                    NULL, &HandleCount, &Handles);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Disk->BlockIo = NULL;
+  for (Index = 0; Index < HandleCount && Disk->BlockIo == NULL; Index++) {
+    Path = DevicePathFromHandle (Handles[Index]);
+    if (Path == NULL ||
+        GetDevicePathSize (Path) <= PathSize + END_DEVICE_PATH_LENGTH ||
+        CompareMem (Path, ControllerPath, PathSize) != 0) {
+      continue;
+    }
+
+    Status = gBS->HandleProtocol (Handles[Index], &gEfiBlockIoProtocolGuid,
+                                  (VOID **) &BlockIo);
+    if (EFI_ERROR (Status) ||
+        BlockIo->Media->LogicalPartition ||
+        !BlockIo->Media->MediaPresent) {
+      continue;
+    }
+
+    Status = DwHcBenchmarkFindEndpoints (Handles[Index], Disk);
+    if (!EFI_ERROR (Status)) {
+      Disk->BlockIo = BlockIo;
+    }
+  }
+
+  FreePool (Handles);
+  return Disk->BlockIo == NULL ? EFI_NOT_FOUND : EFI_SUCCESS;
+}
+
+/*
+ * USB I/O doesn't give out device addresses. Every command the disk
+ * completes ends in a status wrapper read on its bulk IN endpoint,
+ * so after a one-block read the newest such transfer in the trace is
+ * the disk's. An adapter with bulk endpoints at the same addresses
+ * doesn't move 13-byte packets.
+ */
+STATIC
+EFI_STATUS
+DwHcBenchmarkFindAddress (
+  IN  DW_USB_HOST_TRACE_PROTOCOL *Trace,
+  IN  UINT8                      *Buffer,
+  IN  DWHC_BENCHMARK_DISK        *Disk
+  )
+{
+  EFI_STATUS              Status;
+  EFI_BLOCK_IO_PROTOCOL   *BlockIo;
+  DW_USB_HOST_TRACE_ENTRY Entry;
+  UINTN                   Index;
+
+  BlockIo = Disk->BlockIo;
+  Status = BlockIo->ReadBlocks (BlockIo, BlockIo->Media->MediaId, 0,
+                                BlockIo->Media->BlockSize, Buffer);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  for (Index = 0;
+       !EFI_ERROR (Trace->GetTraceEntry (Trace, Index, &Entry));
+       Index++) {
+    if (Entry.EpType == DW_USB_HOST_EP_BULK &&
+        Entry.EpAddress == Disk->BulkIn &&
+        Entry.Length == BENCHMARK_CSW_LENGTH &&
+        !EFI_ERROR (Entry.Status)) {
+      Disk->DeviceAddress = Entry.DeviceAddress;
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_NOT_FOUND;
+}
+
+/**
+  Times reads of Size bytes each, at sequential or random
+  Size-aligned LBAs.
+**/
+STATIC
+EFI_STATUS
+DwHcBenchmarkRun (
+  IN  DW_USB_HOST_TRACE_PROTOCOL *Trace,
+  IN  DWHC_BENCHMARK_DISK        *Disk,
+  IN  BOOLEAN                    Random,
+  IN  UINTN                      Size,
+  IN  UINT8                      *Buffer,
+  IN  EFI_LBA                    *Lbas,
+  IN  UINT64                     *Samples,
+  OUT DWHC_BENCHMARK_RESULT      *Result
+  )
+{
+  EFI_STATUS                 Status;
+  EFI_BLOCK_IO_PROTOCOL      *BlockIo;
+  DW_USB_HOST_ENDPOINT_STATS Before;
+  DW_USB_HOST_ENDPOINT_STATS After;
+  UINT64                     Start;
+  UINTN                      Ops;
+  UINTN                      Index;
+
+  BlockIo = Disk->BlockIo;
+  Ops = BenchmarkPlan (0, BlockIo->Media->LastBlock + 1,
+                       BlockIo->Media->BlockSize, Size, Random, Lbas);
+  if (Ops == 0) {
+    return EFI_UNSUPPORTED;
+  }
+
+  DwHcBenchmarkTotals (Trace, Disk, &Before);
+
+  for (Index = 0; Index < Ops; Index++) {
+    Start = GetPerformanceCounter ();
+    Status = BlockIo->ReadBlocks (BlockIo, BlockIo->Media->MediaId,
+                                  Lbas[Index], Size, Buffer);
+    Samples[Index] = BenchmarkElapsedNs (Start, GetPerformanceCounter ());
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  DwHcBenchmarkTotals (Trace, Disk, &After);
+  Result->CopyNs = After.CopyNs - Before.CopyNs;
+  Result->SetupNs = After.SetupNs - Before.SetupNs;
+  Result->WaitNs = After.WaitNs - Before.WaitNs;
+  Result->Retries = After.Restarts - Before.Restarts;
+
+  BenchmarkSummarize (Samples, Ops, &Result->Timing);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+DwHcBenchmark (
+  IN  EFI_HANDLE                 ControllerHandle,
+  IN  DW_USB_HOST_TRACE_PROTOCOL *Trace
+  )
+{
+  EFI_STATUS            Status;
+  DWHC_BENCHMARK_DISK   Disk;
+  EFI_BLOCK_IO_PROTOCOL *BlockIo;
+  EFI_FILE_PROTOCOL     *File;
+  DWHC_BENCHMARK_RESULT Result;
+  BOOLEAN               Random;
+  UINTN                 Pattern;
+  UINTN                 Size;
+  UINT8                 *Buffer;
+  EFI_LBA               *Lbas;
+  UINT64                *Samples;
+  UINT64                KiBPerSec;
+  UINT64                Iops;
+  UINT64                Ops1000;
+  CHAR16                Line[160];
+  CHAR8                 CsvLine[256];
+
+  Status = DwHcBenchmarkFindDisk (ControllerHandle, &Disk);
+  if (EFI_ERROR (Status)) {
+    DiagnosticLog (L"ERROR: No USB disk with media present\n");
+    return EFI_NOT_FOUND;
+  }
+  BlockIo = Disk.BlockIo;
+
+  Buffer = AllocatePages (EFI_SIZE_TO_PAGES (BENCHMARK_MAX_SIZE));
+  Lbas = AllocatePool (BENCHMARK_MAX_OPS * sizeof (EFI_LBA));
+  Samples = AllocatePool (BENCHMARK_MAX_OPS * sizeof (UINT64));
+  if (Buffer == NULL || Lbas == NULL || Samples == NULL) {
+    DiagnosticLog (L"ERROR: Out of memory\n");
+    Status = EFI_OUT_OF_RESOURCES;
+    goto Done;
+  }
+
+  Status = DwHcBenchmarkFindAddress (Trace, Buffer, &Disk);
+  if (EFI_ERROR (Status)) {
+    UnicodeSPrint (Line, sizeof (Line),
+                   L"ERROR: No transfers from the disk in the trace: %r\n", Status);
+    DiagnosticLog (Line);
+    goto Done;
+  }
+
+  UnicodeSPrint (Line, sizeof (Line),
+                 L"Disk: device %u, EPs %02x/%02x, %u-byte blocks, %Lu MiB\n",
+                 Disk.DeviceAddress, Disk.BulkIn, Disk.BulkOut,
+                 BlockIo->Media->BlockSize,
+                 RShiftU64 (MultU64x32 (BlockIo->Media->LastBlock + 1,
+                                        BlockIo->Media->BlockSize), 20));
+  DiagnosticLog (Line);
+  DiagnosticLog (L"Copy, setup and wait are per read, retries are totals\n");
+
+  File = BenchmarkOpenLog (BENCHMARK_LOG_FILE,
+                           "firmware,revision,pattern,size,ops,kib_per_s,iops,"
+                           "p50_us,p99_us,copy_us,setup_us,wait_us,retries\r\n");
+  if (File == NULL) {
+    DiagnosticLog (L"WARNING: no boot or EFI system partition, results are not saved\n");
+  }
+
+  Status = EFI_SUCCESS;
+  for (Pattern = 0; Pattern < 2; Pattern++) {
+    Random = (Pattern != 0);
+    for (Size = BlockIo->Media->BlockSize;
+         Size <= BENCHMARK_MAX_SIZE;
+         Size <<= 1) {
+      Status = DwHcBenchmarkRun (Trace, &Disk, Random, Size, Buffer,
+                                 Lbas, Samples, &Result);
+      if (EFI_ERROR (Status)) {
+        UnicodeSPrint (Line, sizeof (Line), L"ERROR: %a read of %u bytes: %r\n",
+                       Random ? "random" : "sequential", (UINT32) Size, Status);
+        DiagnosticLog (Line);
+        goto Close;
+      }
+
+      KiBPerSec = BenchmarkKiBPerSecond (Size, &Result.Timing);
+      Iops = BenchmarkIops (&Result.Timing);
+      Ops1000 = MultU64x32 (Result.Timing.Ops, 1000);
+
+      UnicodeSPrint (Line, sizeof (Line),
+                     L"%a %7u: %6Lu KiB/s %5Lu IOPS, p50 %Lu us, p99 %Lu us, "
+                     L"copy %Lu us, setup %Lu us, wait %Lu us, %Lu retries\n",
+                     Random ? "rand" : "seq ", (UINT32) Size, KiBPerSec, Iops,
+                     DivU64x32 (Result.Timing.P50Ns, 1000),
+                     DivU64x32 (Result.Timing.P99Ns, 1000),
+                     DivU64x64Remainder (Result.CopyNs, Ops1000, NULL),
+                     DivU64x64Remainder (Result.SetupNs, Ops1000, NULL),
+                     DivU64x64Remainder (Result.WaitNs, Ops1000, NULL),
+                     Result.Retries);
+      DiagnosticLog (Line);
+
+      AsciiSPrint (CsvLine, sizeof (CsvLine),
+                   "%s,0x%x,%a,%u,%u,%Lu,%Lu,%Lu,%Lu,%Lu,%Lu,%Lu,%Lu\r\n",
+                   gST->FirmwareVendor, gST->FirmwareRevision,
+                   Random ? "random" : "sequential",
+                   (UINT32) Size, (UINT32) Result.Timing.Ops, KiBPerSec, Iops,
+                   DivU64x32 (Result.Timing.P50Ns, 1000),
+                   DivU64x32 (Result.Timing.P99Ns, 1000),
+                   DivU64x64Remainder (Result.CopyNs, Ops1000, NULL),
+                   DivU64x64Remainder (Result.SetupNs, Ops1000, NULL),
+                   DivU64x64Remainder (Result.WaitNs, Ops1000, NULL),
+                   Result.Retries);
+      BenchmarkLogWrite (File, CsvLine);
+    }
+  }
+
+Close:
+  if (File != NULL) {
+    File->Close (File);
+  }
+
+Done:
+  if (Buffer != NULL) {
+    FreePages (Buffer, EFI_SIZE_TO_PAGES (BENCHMARK_MAX_SIZE));
+  }
+  if (Lbas != NULL) {
+    FreePool (Lbas);
+  }
+  if (Samples != NULL) {
+    FreePool (Samples);
+  }
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+DwHcRunDiagnostics (
+  IN  EFI_DRIVER_DIAGNOSTICS2_PROTOCOL *This,
+  IN  EFI_HANDLE                       ControllerHandle,
+  IN  EFI_HANDLE                       ChildHandle  OPTIONAL,
+  IN  EFI_DRIVER_DIAGNOSTIC_TYPE       DiagnosticType,
+  IN  CHAR8                            *Language,
+  OUT EFI_GUID                         **ErrorType,
+  OUT UINTN                            *BufferSize,
+  OUT CHAR16                           **Buffer
+  )
+{
+  EFI_STATUS                 Status;
+  DW_USB_HOST_TRACE_PROTOCOL *Trace;
+
+  if ((Language         == NULL) ||
+      (ErrorType        == NULL) ||
+      (Buffer           == NULL) ||
+      (ControllerHandle == NULL) ||
+      (BufferSize       == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (AsciiStrnCmp (Language, "en", 2) != 0) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (ChildHandle != NULL) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = gBS->HandleProtocol (ControllerHandle, &gDwUsbHostTraceProtocolGuid,
+                                (VOID **) &Trace);
+  if (EFI_ERROR (Status)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  *ErrorType = NULL;
+  *BufferSize = DIAGNOSTIC_LOGBUFFER_MAXCHAR;
+  *Buffer = DiagnosticInitLog (*BufferSize);
+  if (*Buffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  /*
+   * The extended diagnostic is a USB disk read benchmark.
+   */
+  if (DiagnosticType == EfiDriverDiagnosticTypeExtended) {
+    DiagnosticLog (L"DwUsbHostDxe USB disk benchmark\n");
+    return DwHcBenchmark (ControllerHandle, Trace);
+  }
+
+  DiagnosticLog (L"DwUsbHostDxe transfer statistics\n\n");
+  DwHcLogEndpointStats (Trace);
+  DwHcLogTrace (Trace);
+
+  /*
+   * Manufacturing diagnostics start a fresh measurement window.
+   */
+  if (DiagnosticType == EfiDriverDiagnosticTypeManufacturing) {
+    Trace->ResetTrace (Trace);
+  }
+
+  return EFI_SUCCESS;
+}
+
+GLOBAL_REMOVE_IF_UNREFERENCED
+EFI_DRIVER_DIAGNOSTICS2_PROTOCOL gDriverDiagnostics2 = {
+  DwHcRunDiagnostics,
+  "en"
+};
@@ -152,6 +152,7 @@ DriverStart (
   Status = gBS->InstallMultipleProtocolInterfaces (
     &Controller,
     &gEfiUsb2HcProtocolGuid, &DwHc->DwUsbOtgHc,
+    &gDwUsbHostTraceProtocolGuid, &DwHc->TraceProtocol,
     NULL
   );
 
@@ -202,6 +203,7 @@ DriverStop (
   Status = gBS->UninstallMultipleProtocolInterfaces (
     Controller,
     &gEfiUsb2HcProtocolGuid, &DwHc->DwUsbOtgHc,
+    &gDwUsbHostTraceProtocolGuid, &DwHc->TraceProtocol,
     NULL);
   if (EFI_ERROR (Status)) {
     DEBUG((EFI_D_ERROR, "DriverStop: UninstallMultipleProtocolInterfaces: %r\n",
@@ -252,17 +254,21 @@ DwUsbHostEntryPoint (
     return Status;
   }
 
-  Status = EfiLibInstallDriverBindingComponentName2 (
+  Status = EfiLibInstallAllDriverProtocols2 (
              ImageHandle,
              SystemTable,
              &mDriverBinding,
              ImageHandle,
              &gComponentName,
-             &gComponentName2
+             &gComponentName2,
+             NULL,
+             NULL,
+             NULL,
+             &gDriverDiagnostics2
              );
 
   if (EFI_ERROR (Status)) {
-    DEBUG((EFI_D_ERROR, "EfiLibInstallDriverBindingComponentName2: %r\n",
+    DEBUG((EFI_D_ERROR, "EfiLibInstallAllDriverProtocols2: %r\n",
            Status));
     gBS->UninstallMultipleProtocolInterfaces (
        mDevice,
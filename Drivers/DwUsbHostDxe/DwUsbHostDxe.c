@@ -21,6 +21,17 @@
  */
 #define DW_HC_RESET_TIMEOUT_MS (10000)
 
+/*
+ * The root port reset is held for TDRSTR (USB 2.0 7.1.7.5).
+ * Everything else in the reset sequence is polled for, with
+ * these bounds.
+ */
+#define DW_HC_PORT_RESET_MS            50
+#define DW_HC_PORT_ENABLE_TIMEOUT_US   20000
+#define DW_HC_HOST_MODE_TIMEOUT_US     100000
+#define DW_HC_SOFT_RESET_TIMEOUT_US    100000
+#define DW_HC_POLL_US                  10
+
   /*
    * TimerPeriodic to account for timeout processing
    * within DwHcTransfer.
@@ -43,11 +54,37 @@ typedef enum {
   XFER_DONE
 } CHANNEL_HALT_REASON;
 
-typedef struct {
-  BOOLEAN Splitting;
-  BOOLEAN SplitStart;
-  UINT32 Tries;
-} SPLIT_CONTROL;
+/*
+ * Periodic split scheduling, after USB 2.0 11.18: a start-split
+ * goes out no later than microframe 5, so the TT can finish the
+ * full/low-speed transaction within the frame, and is followed by
+ * complete-splits in the 2nd to 4th microframes after it. A TT may
+ * spend 90% of a frame (1350 full-speed byte times) on periodic
+ * transactions, which are costed with bit stuffing and a rough
+ * per-transaction overhead.
+ */
+#define SSPLIT_LAST_MICROFRAME          5
+#define CSPLIT_FIRST_MICROFRAME         2
+#define CSPLIT_PERIODIC_TRIES           3
+#define TT_PERIODIC_BUDGET              1350
+#define TT_TRANSACTION_OVERHEAD         13
+#define TT_BYTE_TIMES(Length, Speed)                                  \
+  ((((Length) * 7) / 6 + TT_TRANSACTION_OVERHEAD) *                   \
+   ((Speed) == EFI_USB_SPEED_LOW ? 8 : 1))
+
+/*
+ * Without the channel halt interrupt, a periodic split poll runs
+ * from start-split to its last complete-split in the timer handler.
+ * Split polls are only started in the first microframes of a tick,
+ * so the handler leaves most of the frame to everything else.
+ */
+#define DW_HC_POLLED_SPLIT_TIMEOUT_MS   2
+#define DW_HC_POLLED_SPLIT_MICROFRAMES  4
+
+/*
+ * For DwHcInterruptHandler, which gets no context.
+ */
+STATIC DWUSB_OTGHC_DEV *mDwHc;
 
 EFI_STATUS DwHcInit (IN DWUSB_OTGHC_DEV *DwHc,
                      IN EFI_EVENT Timeout);
@@ -56,16 +93,17 @@ EFI_STATUS DwCoreInit (IN DWUSB_OTGHC_DEV *DwHc,
 
 EFI_STATUS
 Wait4Bit (
-  IN  EFI_EVENT Timeout,
-  IN  UINT32    Reg,
-  IN  UINT32    Mask,
-  IN  BOOLEAN   Set
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  IN  EFI_EVENT       Timeout,
+  IN  UINT32          Reg,
+  IN  UINT32          Mask,
+  IN  BOOLEAN         Set
   )
 {
   UINT32 Value;
 
   do {
-    Value = MmioRead32 (Reg);
+    Value = DwHcRead32 (DwHc, Reg);
     if (!Set) {
       Value = ~Value;
     }
@@ -78,6 +116,228 @@ Wait4Bit (
   return EFI_TIMEOUT;
 }
 
+/*
+ * Like Wait4Bit, but bounded by TimeoutUs instead of a timer
+ * event, for when timer events can't be relied on (e.g. at
+ * ExitBootServices) or only a short wait makes sense.
+ */
+STATIC
+EFI_STATUS
+DwHcPollBit (
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  IN  UINT32          Reg,
+  IN  UINT32          Mask,
+  IN  BOOLEAN         Set,
+  IN  UINTN           TimeoutUs
+  )
+{
+  UINT32 Value;
+
+  for (;;) {
+    Value = DwHcRead32 (DwHc, Reg);
+    if (!Set) {
+      Value = ~Value;
+    }
+
+    if ((Value & Mask) == Mask) {
+      return EFI_SUCCESS;
+    }
+
+    if (TimeoutUs < DW_HC_POLL_US) {
+      return EFI_TIMEOUT;
+    }
+
+    MicroSecondDelay (DW_HC_POLL_US);
+    TimeoutUs -= DW_HC_POLL_US;
+  }
+}
+
+/*
+ * Performance counter ticks since Start.
+ */
+STATIC
+UINT64
+DwHcTicksSince (
+  IN  UINT64 Start
+  )
+{
+  UINT64 Now;
+  UINT64 CounterStart;
+  UINT64 CounterEnd;
+
+  Now = GetPerformanceCounter ();
+  GetPerformanceCounterProperties (&CounterStart, &CounterEnd);
+  if (CounterEnd < CounterStart) {
+    return Start - Now;
+  }
+
+  return Now - Start;
+}
+
+STATIC
+UINT64
+DwHcElapsedUs (
+  IN  UINT64 Start
+  )
+{
+  return DivU64x32 (GetTimeInNanoSecond (DwHcTicksSince (Start)), 1000);
+}
+
+/*
+ * Root port reset. DwHcPortResetStart asserts PRTRST and returns;
+ * DwHcPortResetFinish releases it once it has been held long
+ * enough. UsbBusDxe already stalls between setting and clearing
+ * the reset feature, so it no longer gets a full reset on each.
+ */
+STATIC
+VOID
+DwHcPortResetStart (
+  IN  DWUSB_OTGHC_DEV *DwHc
+  )
+{
+  if (DwHc->PortResetActive) {
+    return;
+  }
+
+  DwHcAndThenOr32 (DwHc, HPRT0,
+                   ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET |
+                     DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG),
+                   DWC2_HPRT0_PRTRST);
+  DwHc->PortResetStart = GetPerformanceCounter ();
+  DwHc->PortResetActive = TRUE;
+}
+
+STATIC
+VOID
+DwHcPortResetFinish (
+  IN  DWUSB_OTGHC_DEV *DwHc
+  )
+{
+  UINT64 Elapsed;
+
+  if (!DwHc->PortResetActive) {
+    return;
+  }
+
+  Elapsed = DwHcElapsedUs (DwHc->PortResetStart);
+  if (Elapsed < DW_HC_PORT_RESET_MS * 1000) {
+    MicroSecondDelay (DW_HC_PORT_RESET_MS * 1000 - (UINTN) Elapsed);
+  }
+
+  DwHcAnd32 (DwHc, HPRT0, ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET |
+                            DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG |
+                            DWC2_HPRT0_PRTRST));
+  DwHc->PortResetActive = FALSE;
+
+  /*
+   * The port enables itself once the reset handshake with an
+   * attached device is done.
+   */
+  if ((DwHcRead32 (DwHc, HPRT0) & DWC2_HPRT0_PRTCONNSTS) != 0 &&
+      EFI_ERROR (DwHcPollBit (DwHc, HPRT0, DWC2_HPRT0_PRTENA, TRUE,
+                              DW_HC_PORT_ENABLE_TIMEOUT_US))) {
+    DEBUG ((DEBUG_WARN, "DwHcPortResetFinish: port not enabled after reset\n"));
+  }
+}
+
+/*
+ * Channel halts are the only unmasked channel interrupts. The
+ * handler moves the HCINT bits into the channel so the line
+ * drops, leaving Wait4Chhltd to decode them, and has
+ * DwHcPeriodicHandler pick up async interrupt transfers that
+ * have halted.
+ */
+STATIC
+VOID
+EFIAPI
+DwHcInterruptHandler (
+  IN  HARDWARE_INTERRUPT_SOURCE Source,
+  IN  EFI_SYSTEM_CONTEXT        SystemContext
+  )
+{
+  DWUSB_OTGHC_DEV *DwHc = mDwHc;
+  DWUSB_CHANNEL   *Ch;
+  UINT32          Haint;
+  UINT32          Hcint;
+  UINT32          Channel;
+  BOOLEAN         Periodic;
+  EFI_TPL         OriginalTPL;
+
+  OriginalTPL = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+
+  Periodic = FALSE;
+  Haint = DwHcRead32 (DwHc, HAINT) &
+    ((1 << DwHc->NumChannels) - 1);
+
+  while (Haint != 0) {
+    Channel = LowBitSet32 (Haint);
+    Haint &= ~(1 << Channel);
+
+    Ch = &DwHc->Channels[Channel];
+    Hcint = DwHcRead32 (DwHc, HCINT(Channel));
+    DwHcWrite32 (DwHc, HCINT(Channel), Hcint);
+    Ch->Hcint |= Hcint;
+
+    if ((Ch->Hcint & DWC2_HCINT_CHHLTD) != 0) {
+      DwHcWrite32 (DwHc, HCINTMSK(Channel), 0);
+      Ch->Halted = TRUE;
+      if (Ch->Req != NULL) {
+        Periodic = TRUE;
+      }
+    }
+  }
+
+  DwHc->Interrupt->EndOfInterrupt (DwHc->Interrupt, Source);
+
+  if (Periodic && DwHc->PeriodicEvent != NULL) {
+    gBS->SignalEvent (DwHc->PeriodicEvent);
+  }
+
+  gBS->RestoreTPL (OriginalTPL);
+}
+
+/*
+ * Waits for the channel to halt, sleeping in WFI until the
+ * USB interrupt (or the timer tick) when interrupts are
+ * available, and polling HAINT otherwise.
+ */
+STATIC
+EFI_STATUS
+DwHcWaitForHalt (
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  IN  EFI_EVENT       Timeout,
+  IN  UINT32          Channel
+  )
+{
+  DWUSB_CHANNEL *Ch = &DwHc->Channels[Channel];
+
+  do {
+    if (Ch->Halted ||
+        (DwHcRead32 (DwHc, HAINT) & (1 << Channel)) != 0) {
+      return EFI_SUCCESS;
+    }
+
+    if (DwHc->Interrupt != NULL && ArmGetInterruptState ()) {
+      /*
+       * Check again with interrupts masked, so the IRQ can't sneak in
+       * between the check and the WFI. A pending IRQ still wakes us up.
+       */
+      ArmDisableInterrupts ();
+      if (!Ch->Halted) {
+        CpuSleep ();
+      }
+      ArmEnableInterrupts ();
+    }
+  } while (EFI_ERROR (gBS->CheckEvent (Timeout)));
+
+  if (Ch->Halted ||
+      (DwHcRead32 (DwHc, HAINT) & (1 << Channel)) != 0) {
+    return EFI_SUCCESS;
+  }
+
+  return EFI_TIMEOUT;
+}
+
 CHANNEL_HALT_REASON
 Wait4Chhltd (
   IN  DWUSB_OTGHC_DEV *DwHc,
@@ -92,15 +352,17 @@ Wait4Chhltd (
   EFI_STATUS Status;
   UINT32  Hcint, Hctsiz;
   UINT32  HcintCompHltAck = DWC2_HCINT_XFERCOMP;
+  BOOLEAN InterruptState;
 
-  MicroSecondDelay (100);
-  Status  = Wait4Bit (Timeout, DwHc->DwUsbBase + HCINT(Channel), DWC2_HCINT_CHHLTD, 1);
+  Status  = DwHcWaitForHalt (DwHc, Timeout, Channel);
   if (EFI_ERROR (Status)) {
     return XFER_NOT_HALTED;
   }
 
-  MicroSecondDelay (100);
-  Hcint = MmioRead32 (DwHc->DwUsbBase + HCINT(Channel));
+  InterruptState = SaveAndDisableInterrupts ();
+  Hcint = DwHc->Channels[Channel].Hcint |
+    DwHcRead32 (DwHc, HCINT(Channel));
+  SetInterruptState (InterruptState);
 
   ASSERT ((Hcint & DWC2_HCINT_CHHLTD) != 0);
   Hcint &= ~DWC2_HCINT_CHHLTD;
@@ -137,6 +399,8 @@ Wait4Chhltd (
       ((Hcint & DWC2_HCINT_ACK) != 0)) {
     Split->SplitStart = FALSE;
     Split->Tries = 0;
+    Split->StartMicroFrame = DwHcRead32 (DwHc, HFNUM) &
+      DWC2_HFNUM_FRNUM_MASK;
     return XFER_CSPLIT;
   }
 
@@ -149,7 +413,7 @@ Wait4Chhltd (
     return XFER_ERROR;
   }
 
-  Hctsiz = MmioRead32 (DwHc->DwUsbBase + HCTSIZ(Channel));
+  Hctsiz = DwHcRead32 (DwHc, HCTSIZ(Channel));
   *Sub = (Hctsiz & DWC2_HCTSIZ_XFERSIZE_MASK) >> DWC2_HCTSIZ_XFERSIZE_OFFSET;
   *Toggle = (Hctsiz & DWC2_HCTSIZ_PID_MASK) >> DWC2_HCTSIZ_PID_OFFSET;
 
@@ -171,6 +435,7 @@ DwOtgHcInit (
   )
 {
   UINT32 Split = 0;
+  UINT32 MicroFrame;
   UINT32 Hcchar = (DevAddr << DWC2_HCCHAR_DEVADDR_OFFSET) |
     (Endpoint << DWC2_HCCHAR_EPNUM_OFFSET) |
     (EpDir << DWC2_HCCHAR_EPDIR_OFFSET) |
@@ -178,9 +443,38 @@ DwOtgHcInit (
     (MaxPacket << DWC2_HCCHAR_MPS_OFFSET) |
     ((DeviceSpeed == EFI_USB_SPEED_LOW) ? DWC2_HCCHAR_LSPDDEV : 0);
 
-  MmioWrite32 (DwHc->DwUsbBase + HCINT(HcNum), 0x3FFF);
+  /*
+   * Periodic transactions go out in the next (micro)frame of the
+   * parity ODDFRM selects. That is normally the next one, but a
+   * start-split past SSPLIT_LAST_MICROFRAME is put off to the
+   * first microframe of the next frame, and a complete-split
+   * started right after its start-split is aimed two microframes
+   * ahead, at its slot in the window.
+   */
+  if (EpType == DWC2_HCCHAR_EPTYPE_INTR) {
+    MicroFrame = DwHcRead32 (DwHc, HFNUM);
+    if (SplitControl->Splitting && SplitControl->SplitStart &&
+        (MicroFrame & 7) > SSPLIT_LAST_MICROFRAME) {
+      MicroFrame |= 7;
+    }
+    MicroFrame++;
+    if (SplitControl->Splitting && !SplitControl->SplitStart &&
+        ((SplitControl->StartMicroFrame + CSPLIT_FIRST_MICROFRAME - 1 +
+          SplitControl->Tries - MicroFrame) & DWC2_HFNUM_FRNUM_MASK) == 1) {
+      MicroFrame++;
+    }
+
+    if ((MicroFrame & 1) != 0) {
+      Hcchar |= DWC2_HCCHAR_ODDFRM;
+    }
+  }
+
+  DwHcWrite32 (DwHc, HCINT(HcNum), 0x3FFF);
+  DwHc->Channels[HcNum].Hcint = 0;
+  DwHc->Channels[HcNum].Halted = FALSE;
+  DwHcWrite32 (DwHc, HCINTMSK(HcNum), DWC2_HCINTMSK_CHHLTD);
 
-  MmioWrite32 (DwHc->DwUsbBase + HCCHAR(HcNum), Hcchar);
+  DwHcWrite32 (DwHc, HCCHAR(HcNum), Hcchar);
 
   if (SplitControl->Splitting) {
     Split = DWC2_HCSPLT_SPLTENA |
@@ -192,7 +486,7 @@ DwOtgHcInit (
     }
   }
 
-  MmioWrite32 (DwHc->DwUsbBase + HCSPLT(HcNum), Split);
+  DwHcWrite32 (DwHc, HCSPLT(HcNum), Split);
 }
 
 EFI_STATUS
@@ -203,30 +497,417 @@ DwCoreReset (
 {
   EFI_STATUS Status;
 
-  Status = Wait4Bit (Timeout, DwHc->DwUsbBase + GRSTCTL, DWC2_GRSTCTL_AHBIDLE, 1);
+  Status = Wait4Bit (DwHc, Timeout, GRSTCTL, DWC2_GRSTCTL_AHBIDLE, 1);
   if (Status) {
     DEBUG ((EFI_D_ERROR, "DwCoreReset: AHBIDLE Timeout!\n"));
     return Status;
   }
 
-  MmioWrite32 (DwHc->DwUsbBase + GRSTCTL, DWC2_GRSTCTL_CSFTRST);
+  DwHcWrite32 (DwHc, GRSTCTL, DWC2_GRSTCTL_CSFTRST);
 
-  Status = Wait4Bit (Timeout, DwHc->DwUsbBase + GRSTCTL, DWC2_GRSTCTL_CSFTRST, 0);
+  Status = Wait4Bit (DwHc, Timeout, GRSTCTL, DWC2_GRSTCTL_CSFTRST, 0);
   if (Status) {
     DEBUG ((EFI_D_ERROR, "DwCoreReset: CSFTRST Timeout!\n"));
     return Status;
   }
 
-  MicroSecondDelay (100000);
+  Status = Wait4Bit (DwHc, Timeout, GRSTCTL, DWC2_GRSTCTL_AHBIDLE, 1);
+  if (Status) {
+    DEBUG ((EFI_D_ERROR, "DwCoreReset: AHBIDLE Timeout after reset!\n"));
+    return Status;
+  }
+
+  /*
+   * The core takes a while to come back in host mode. It not
+   * doing so isn't fatal here, DwHcInit checks for it.
+   */
+  if (EFI_ERROR (DwHcPollBit (DwHc, GINTSTS, DWC2_GINTSTS_CURMODE_HOST, TRUE,
+                              DW_HC_HOST_MODE_TIMEOUT_US))) {
+    DEBUG ((DEBUG_WARN, "DwCoreReset: core not in host mode\n"));
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+UINT32
+DwHcMicroFrame (
+  IN  DWUSB_OTGHC_DEV *DwHc
+  )
+{
+  return DwHcRead32 (DwHc, HFNUM) & DWC2_HFNUM_FRNUM_MASK;
+}
+
+/*
+ * Waits until Count microframes have passed since Start.
+ */
+STATIC
+EFI_STATUS
+DwHcWaitMicroFrames (
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  IN  EFI_EVENT       Timeout,
+  IN  UINT32          Start,
+  IN  UINT32          Count
+  )
+{
+  do {
+    if (((DwHcMicroFrame (DwHc) - Start) & DWC2_HFNUM_FRNUM_MASK) >= Count) {
+      return EFI_SUCCESS;
+    }
+  } while (EFI_ERROR (gBS->CheckEvent (Timeout)));
+
+  return EFI_TIMEOUT;
+}
+
+/*
+ * Charges a periodic start-split against the TT's budget for the
+ * frame it goes out in: this one, or the next one once past its
+ * last start-split microframe (see DwOtgHcInit). When that frame
+ * is full, either fails with EFI_OUT_OF_RESOURCES (so the caller
+ * can retry in a later frame) or, if CanDefer is FALSE, waits for
+ * the next frame.
+ */
+STATIC
+EFI_STATUS
+DwHcScheduleStartSplit (
+  IN  DWUSB_OTGHC_DEV                    *DwHc,
+  IN  EFI_EVENT                          Timeout,
+  IN  EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator,
+  IN  UINT8                              DeviceSpeed,
+  IN  UINT32                             Length,
+  IN  BOOLEAN                            CanDefer
+  )
+{
+  EFI_STATUS      Status;
+  UINT32          MicroFrame;
+  UINT32          Frame;
+  UINT32          ByteTimes;
+  DWUSB_TT_BUDGET *Budget;
+
+  Budget = &DwHc->TtBudget[Translator->TranslatorHubAddress % MAX_TT_HUB];
+  ByteTimes = TT_BYTE_TIMES (Length, DeviceSpeed);
+
+  for (;;) {
+    MicroFrame = DwHcMicroFrame (DwHc);
+    Frame = MicroFrame >> 3;
+    if ((MicroFrame & 7) > SSPLIT_LAST_MICROFRAME) {
+      Frame++;
+    }
+
+    if (Budget->Frame != Frame) {
+      Budget->Frame = Frame;
+      Budget->ByteTimes = 0;
+    }
+
+    /*
+     * A lone transaction always fits.
+     */
+    if (Budget->ByteTimes == 0 ||
+        Budget->ByteTimes + ByteTimes <= TT_PERIODIC_BUDGET) {
+      Budget->ByteTimes += ByteTimes;
+      return EFI_SUCCESS;
+    }
+
+    if (CanDefer) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    Status = DwHcWaitMicroFrames (DwHc, Timeout, MicroFrame,
+                                  8 - (MicroFrame & 7));
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+}
+
+/*
+ * Maps Length bytes of a caller buffer for the channel to DMA to/from
+ * directly, avoiding a copy through the bounce buffer. Buffers the
+ * controller can't use directly (HCDMA must be word-aligned, and IN
+ * buffers must cover whole cache lines to be safely invalidated) are
+ * left to the bounce buffer.
+ */
+STATIC
+EFI_STATUS
+DwHcMapData (
+  IN  VOID                  *Data,
+  IN  UINT32                Length,
+  IN  UINT32                TransferDirection,
+  OUT EFI_PHYSICAL_ADDRESS  *BusAddress,
+  OUT VOID                  **Mapping
+  )
+{
+  EFI_STATUS Status;
+  UINTN      Alignment;
+  UINTN      MapLength;
+
+  if (TransferDirection) { // in
+    Alignment = ArmDataCacheLineLength ();
+  } else {
+    Alignment = sizeof (UINT32);
+  }
+
+  if (Length == 0 ||
+      ((UINTN) Data & (Alignment - 1)) != 0 ||
+      (Length & (Alignment - 1)) != 0) {
+    return EFI_UNSUPPORTED;
+  }
+
+  MapLength = Length;
+  Status = DmaMap (TransferDirection ? MapOperationBusMasterWrite :
+                   MapOperationBusMasterRead, Data, &MapLength,
+                   BusAddress, Mapping);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (MapLength != Length ||
+      *BusAddress + Length > MAX_UINT32) {
+    DmaUnmap (*Mapping);
+    return EFI_UNSUPPORTED;
+  }
+
   return EFI_SUCCESS;
 }
 
+/*
+ * Releases Wedged channels that have since halted, or all of
+ * them if the core was just reset. Called at TPL_NOTIFY.
+ */
+STATIC
+VOID
+DwHcReclaimChannels (
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  IN  BOOLEAN         CoreReset
+  )
+{
+  UINT32        Index;
+  DWUSB_CHANNEL *Ch;
+
+  for (Index = 0; Index < MAX_CHANNEL; Index++) {
+    Ch = &DwHc->Channels[Index];
+    if (!Ch->Wedged) {
+      continue;
+    }
+
+    if (!CoreReset &&
+        (DwHcRead32 (DwHc, HCCHAR (Index)) & DWC2_HCCHAR_CHEN) != 0) {
+      continue;
+    }
+
+    DEBUG ((DEBUG_INFO, "Channel %u reclaimed\n", Index));
+    if (Ch->WedgedMapping != NULL) {
+      DmaUnmap (Ch->WedgedMapping);
+      Ch->WedgedMapping = NULL;
+    }
+
+    Ch->Wedged = FALSE;
+    DwHc->ChannelsInUse &= ~(1 << Index);
+  }
+}
+
+/*
+ * Hands out a free channel for one transfer. Control and bulk
+ * transfers never take the last DWC2_HC_PERIODIC_RESERVED
+ * channels, so the periodic schedule keeps running while bulk
+ * traffic is in flight. Transfers only run concurrently when
+ * one preempts another (e.g. DwHcPeriodicHandler at TPL_NOTIFY),
+ * so running out of channels means the caller should retry
+ * later rather than wait.
+ */
+STATIC
+EFI_STATUS
+DwHcAllocateChannel (
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  IN  UINT32          EpType,
+  OUT UINT32          *Channel
+  )
+{
+  EFI_STATUS    Status;
+  EFI_TPL       Tpl;
+  UINT32        Index;
+  UINT32        Free;
+  UINTN         Pages;
+  UINTN         BufferSize;
+  DWUSB_CHANNEL *Ch;
+
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+
+  DwHcReclaimChannels (DwHc, FALSE);
+
+  Free = 0;
+  for (Index = 0; Index < DwHc->NumChannels; Index++) {
+    if ((DwHc->ChannelsInUse & (1 << Index)) == 0) {
+      Free++;
+    }
+  }
+
+  if (EpType != DWC2_HCCHAR_EPTYPE_INTR &&
+      DwHc->NumChannels > DWC2_HC_PERIODIC_RESERVED &&
+      Free <= DWC2_HC_PERIODIC_RESERVED) {
+    Free = 0;
+  }
+
+  if (Free == 0) {
+    gBS->RestoreTPL (Tpl);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  for (Index = 0; (DwHc->ChannelsInUse & (1 << Index)) != 0; Index++);
+  DwHc->ChannelsInUse |= 1 << Index;
+
+  gBS->RestoreTPL (Tpl);
+
+  Ch = &DwHc->Channels[Index];
+  if (Ch->AlignedBuffer == NULL) {
+    Pages = EFI_SIZE_TO_PAGES (DWC2_DATA_BUF_SIZE);
+    Status = DmaAllocateBuffer (EfiBootServicesData, Pages,
+                                (VOID **) &Ch->AlignedBuffer);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "DwHcAllocateChannel: DmaAllocateBuffer: %r\n", Status));
+      Ch->AlignedBuffer = NULL;
+      goto out;
+    }
+
+    BufferSize = EFI_PAGES_TO_SIZE (Pages);
+    Status = DmaMap (MapOperationBusMasterCommonBuffer, Ch->AlignedBuffer,
+                     &BufferSize, &Ch->AlignedBufferBusAddress,
+                     &Ch->AlignedBufferMapping);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "DwHcAllocateChannel: DmaMap: %r\n", Status));
+      DmaFreeBuffer (Pages, Ch->AlignedBuffer);
+      Ch->AlignedBuffer = NULL;
+      goto out;
+    }
+  }
+
+  *Channel = Index;
+  return EFI_SUCCESS;
+
+ out:
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+  DwHc->ChannelsInUse &= ~(1 << Index);
+  gBS->RestoreTPL (Tpl);
+  return EFI_OUT_OF_RESOURCES;
+}
+
+STATIC
+VOID
+DwHcFreeChannel (
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  IN  UINT32          Channel
+  )
+{
+  EFI_TPL Tpl;
+
+  DwHcWrite32 (DwHc, HCINTMSK(Channel), 0);
+  DwHcWrite32 (DwHc, HCINT(Channel), 0xFFFFFFFF);
+
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+  if (!DwHc->Channels[Channel].Wedged) {
+    DwHc->ChannelsInUse &= ~(1 << Channel);
+  }
+  gBS->RestoreTPL (Tpl);
+}
+
+/*
+ * Points the channel at BusAddress and enables it for TxferLen
+ * bytes in NumPackets packets.
+ */
+STATIC
+VOID
+DwHcStartChannel (
+  IN  DWUSB_OTGHC_DEV                    *DwHc,
+  IN  UINT32                             Channel,
+  IN  EFI_PHYSICAL_ADDRESS               BusAddress,
+  IN  EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator,
+  IN  UINT8                              DeviceSpeed,
+  IN  UINT8                              DeviceAddress,
+  IN  UINT32                             EpAddress,
+  IN  UINT32                             TransferDirection,
+  IN  UINT32                             EpType,
+  IN  UINTN                              MaximumPacketLength,
+  IN  UINT32                             TxferLen,
+  IN  UINT32                             NumPackets,
+  IN  UINT32                             Pid,
+  IN  SPLIT_CONTROL                      *Split
+  )
+{
+  DwHcWrite32 (DwHc, HCDMA(Channel), (UINT32) BusAddress);
+
+  DwOtgHcInit (DwHc, Channel, Translator, DeviceSpeed,
+               DeviceAddress, EpAddress,
+               TransferDirection, EpType,
+               MaximumPacketLength, Split);
+
+  DwHcWrite32 (DwHc, HCTSIZ(Channel),
+               (TxferLen << DWC2_HCTSIZ_XFERSIZE_OFFSET) |
+               (NumPackets << DWC2_HCTSIZ_PKTCNT_OFFSET) |
+               (Pid << DWC2_HCTSIZ_PID_OFFSET));
+
+  DwHcAndThenOr32 (DwHc, HCCHAR(Channel),
+                   ~(DWC2_HCCHAR_MULTICNT_MASK |
+                     DWC2_HCCHAR_CHEN |
+                     DWC2_HCCHAR_CHDIS),
+                   ((1 << DWC2_HCCHAR_MULTICNT_OFFSET) |
+                    DWC2_HCCHAR_CHEN));
+}
+
+/*
+ * Sizes the next channel start of a transfer with Remaining bytes
+ * left: at most MaxSize bytes, rounded down to whole packets, and
+ * no more packets than HCTSIZ can count. IN transfers are rounded
+ * up to whole packets, which may run past Remaining.
+ */
+STATIC
+UINT32
+DwHcChunkLength (
+  IN  DWUSB_OTGHC_DEV *DwHc,
+  IN  UINT32          Remaining,
+  IN  UINT32          MaxSize,
+  IN  UINTN           MaximumPacketLength,
+  IN  BOOLEAN         Splitting,
+  IN  UINT32          TransferDirection,
+  OUT UINT32          *NumPackets
+  )
+{
+  UINT32 TxferLen;
+  UINT32 Limit;
+
+  TxferLen = Remaining;
+  Limit = (MaxSize / MaximumPacketLength) * MaximumPacketLength;
+  if (TxferLen > Limit) {
+    TxferLen = Limit;
+  }
+
+  if (Splitting || TxferLen == 0) {
+    *NumPackets = 1;
+    TxferLen = MIN (TxferLen, MaximumPacketLength);
+  } else {
+    *NumPackets = (TxferLen + MaximumPacketLength - 1) / MaximumPacketLength;
+    if (*NumPackets > DwHc->MaxPacketCount) {
+      *NumPackets = DwHc->MaxPacketCount;
+      TxferLen = *NumPackets * MaximumPacketLength;
+    }
+  }
+
+  if (TransferDirection) { // in
+    TxferLen = *NumPackets * MaximumPacketLength;
+  }
+
+  return TxferLen;
+}
+
+/*
+ * Channel is DWHC_ANY_CHANNEL to have one allocated just for
+ * this transfer, or a channel the caller already owns.
+ */
 STATIC
 EFI_STATUS
 DwHcTransfer (
   IN      DWUSB_OTGHC_DEV        *DwHc,
-  IN      EFI_EVENT              Timeout,
   IN      UINT32                 Channel,
+  IN      EFI_EVENT              Timeout,
   IN      EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator,
   IN      UINT8                  DeviceSpeed,
   IN      UINT8                  DeviceAddress,
@@ -249,13 +930,49 @@ DwHcTransfer (
   UINT32                          StopTransfer = 0;
   EFI_STATUS                      Status = EFI_SUCCESS;
   SPLIT_CONTROL                   Split = { 0 };
+  EFI_PHYSICAL_ADDRESS            BusAddress;
+  VOID                            *Mapping = NULL;
+  BOOLEAN                         Bounce;
+  BOOLEAN                         OwnChannel;
+  DWUSB_CHANNEL                   *Ch;
+  DW_USB_HOST_TRACE_ENTRY         Trace = { 0 };
+  UINT64                          Ticks;
+  UINT64                          CopyTicks = 0;
+  UINT64                          SetupTicks = 0;
+  UINT64                          WaitTicks = 0;
+
+  Trace.DeviceAddress = DeviceAddress;
+  Trace.EpAddress = EpAddress | (TransferDirection ? BIT7 : 0);
+  Trace.EpType = EpType;
+  Trace.Length = *DataLength;
+  Trace.StartMicroFrame = DwHcMicroFrame (DwHc);
+
+  OwnChannel = (Channel == DWHC_ANY_CHANNEL);
+  if (OwnChannel) {
+    Status = DwHcAllocateChannel (DwHc, EpType, &Channel);
+  }
+  if (EFI_ERROR (Status)) {
+    *TransferResult = EFI_USB_ERR_SYSTEM;
+    *DataLength = 0;
+    Trace.Channel = MAX_UINT8;
+    Trace.TransferResult = *TransferResult;
+    Trace.Status = Status;
+    DwHcTraceTransfer (DwHc, &Trace);
+    return Status;
+  }
 
-  EFI_TPL Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+  Trace.Channel = Channel;
 
+  Ch = &DwHc->Channels[Channel];
   *TransferResult = EFI_USB_NOERROR;
 
   do {
   restart_xfer:
+    if (Mapping != NULL) {
+      DmaUnmap (Mapping);
+      Mapping = NULL;
+    }
+
     if (DeviceSpeed == EFI_USB_SPEED_LOW ||
         DeviceSpeed == EFI_USB_SPEED_FULL) {
       Split.Splitting = TRUE;
@@ -263,71 +980,97 @@ DwHcTransfer (
       Split.Tries = 0;
     }
 
-    TxferLen = *DataLength - Done;
-
-    if (TxferLen > DWC2_MAX_TRANSFER_SIZE) {
-      TxferLen = DWC2_MAX_TRANSFER_SIZE - MaximumPacketLength + 1;
-    }
+    TxferLen = DwHcChunkLength (DwHc, *DataLength - Done, DwHc->MaxTransferSize,
+                                MaximumPacketLength, Split.Splitting,
+                                TransferDirection, &NumPackets);
 
-    if (TxferLen > DWC2_DATA_BUF_SIZE) {
-      TxferLen = DWC2_DATA_BUF_SIZE - MaximumPacketLength + 1;
+    if (Split.Splitting && EpType == DWC2_HCCHAR_EPTYPE_INTR) {
+      Status = DwHcScheduleStartSplit (DwHc, Timeout, Translator,
+                                       DeviceSpeed, TxferLen, Done == 0);
+      if (EFI_ERROR (Status)) {
+        *TransferResult = Status == EFI_OUT_OF_RESOURCES ?
+          EFI_USB_ERR_SYSTEM : EFI_USB_ERR_TIMEOUT;
+        break;
+      }
     }
 
-    if (Split.Splitting || TxferLen == 0) {
-      NumPackets = 1;
+    /*
+     * An IN transfer rounded up past the end of the caller
+     * buffer must go through the bounce buffer.
+     */
+    Ticks = GetPerformanceCounter ();
+    if (Done + TxferLen > *DataLength ||
+        EFI_ERROR (DwHcMapData ((UINT8 *) Data + Done, TxferLen,
+                                TransferDirection, &BusAddress,
+                                &Mapping))) {
+      Mapping = NULL;
+      Bounce = TRUE;
+      BusAddress = Ch->AlignedBufferBusAddress;
+      TxferLen = DwHcChunkLength (DwHc, *DataLength - Done, DWC2_DATA_BUF_SIZE,
+                                  MaximumPacketLength, Split.Splitting,
+                                  TransferDirection, &NumPackets);
     } else {
-      NumPackets = (TxferLen + MaximumPacketLength - 1) / MaximumPacketLength;
-      if (NumPackets > DWC2_MAX_PACKET_COUNT) {
-        NumPackets = DWC2_MAX_PACKET_COUNT;
-        TxferLen = NumPackets * MaximumPacketLength;
-      }
+      Bounce = FALSE;
     }
+    SetupTicks += DwHcTicksSince (Ticks);
 
-    if (TransferDirection) { // in
-      TxferLen = NumPackets * MaximumPacketLength;
-    } else {
-      CopyMem (DwHc->AlignedBuffer, Data+Done, TxferLen);
-      ArmDataSynchronizationBarrier();
+    if (Bounce && !TransferDirection) { // out
+      Ticks = GetPerformanceCounter ();
+      CopyMem (Ch->AlignedBuffer, Data+Done, TxferLen);
+      CopyTicks += DwHcTicksSince (Ticks);
     }
+    ArmDataSynchronizationBarrier();
 
 restart_channel:
-    MmioWrite32 (DwHc->DwUsbBase + HCDMA(Channel),
-                 (UINTN)DwHc->AlignedBufferBusAddress);
-
-    DwOtgHcInit (DwHc, Channel, Translator, DeviceSpeed,
-                 DeviceAddress, EpAddress,
-                 TransferDirection, EpType,
-                 MaximumPacketLength, &Split);
-
-    MmioWrite32 (DwHc->DwUsbBase + HCTSIZ(Channel),
-                 (TxferLen << DWC2_HCTSIZ_XFERSIZE_OFFSET) |
-                 (NumPackets << DWC2_HCTSIZ_PKTCNT_OFFSET) |
-                 (*Pid << DWC2_HCTSIZ_PID_OFFSET));
-
-    MmioAndThenOr32 (DwHc->DwUsbBase + HCCHAR(Channel),
-                     ~(DWC2_HCCHAR_MULTICNT_MASK |
-                       DWC2_HCCHAR_CHEN |
-                       DWC2_HCCHAR_CHDIS),
-                     ((1 << DWC2_HCCHAR_MULTICNT_OFFSET) |
-                      DWC2_HCCHAR_CHEN));
-
+    Ticks = GetPerformanceCounter ();
+    DwHcStartChannel (DwHc, Channel, BusAddress, Translator, DeviceSpeed,
+                      DeviceAddress, EpAddress, TransferDirection, EpType,
+                      MaximumPacketLength, TxferLen, NumPackets, *Pid,
+                      &Split);
+    SetupTicks += DwHcTicksSince (Ticks);
+
+    Ticks = GetPerformanceCounter ();
     Ret = Wait4Chhltd (DwHc, Timeout, Channel, &Sub, Pid, IgnoreAck, &Split);
+    WaitTicks += DwHcTicksSince (Ticks);
 
     if (Ret == XFER_NOT_HALTED) {
       *TransferResult = EFI_USB_ERR_TIMEOUT;
-      MmioOr32 (DwHc->DwUsbBase + HCCHAR (Channel), DWC2_HCCHAR_CHDIS);
+      DwHcOr32 (DwHc, HCCHAR (Channel), DWC2_HCCHAR_CHDIS);
       Status = gBS->SetTimer (Timeout, TimerRelative,
                               EFI_TIMER_PERIOD_MILLISECONDS (1));
       ASSERT_EFI_ERROR (Status);
       if (EFI_ERROR (Status)) {
         break;
       }
-      Status = Wait4Bit (Timeout, DwHc->DwUsbBase + HCINT (Channel),
-                         DWC2_HCINT_CHHLTD, 1);
+      Status = DwHcWaitForHalt (DwHc, Timeout, Channel);
       if (Status == EFI_SUCCESS) {
         Status = EFI_TIMEOUT;
+      } else if (TransferDirection && !Bounce) {
+        /*
+         * The channel may still write into the caller's buffer,
+         * which is handed back on return. Only a core reset is
+         * sure to stop it.
+         */
+        DEBUG ((DEBUG_ERROR, "Channel %u did not halt, resetting the core\n",
+                Channel));
+        Status = DwHcReset (&DwHc->DwUsbOtgHc, EFI_USB_HC_RESET_GLOBAL);
+        if (EFI_ERROR (Status)) {
+          DEBUG ((DEBUG_ERROR, "DwHcReset: %r\n", Status));
+          Ch->WedgedMapping = Mapping;
+          Ch->Wedged = TRUE;
+          Mapping = NULL;
+        }
+        Status = EFI_DEVICE_ERROR;
       } else {
-        DEBUG ((DEBUG_ERROR, "Channel %u did not halt\n", Channel));
+        /*
+         * The channel may still be moving data, so neither it
+         * nor the buffer mapping can be given back yet.
+         */
+        DEBUG ((DEBUG_ERROR, "Channel %u did not halt, leaving it wedged\n",
+                Channel));
+        Ch->WedgedMapping = Mapping;
+        Ch->Wedged = TRUE;
+        Mapping = NULL;
         Status = EFI_DEVICE_ERROR;
       }
       break;
@@ -337,12 +1080,37 @@ restart_channel:
       break;
     } else if (Ret == XFER_CSPLIT) {
       ASSERT (Split.Splitting);
+      Trace.Csplits++;
+
+      /*
+       * The TT has taken the start-split. Periodic complete-splits
+       * must land in their window, after which the TT has dropped
+       * the transaction. Non-periodic ones are just retried each
+       * microframe until the TT has the result, without resending
+       * the start-split.
+       */
+      if (EpType == DWC2_HCCHAR_EPTYPE_INTR) {
+        if (Split.Tries == CSPLIT_PERIODIC_TRIES) {
+          Trace.Restarts++;
+          goto restart_xfer;
+        }
+
+        /*
+         * The channel goes out in the microframe after the wait.
+         */
+        Status = DwHcWaitMicroFrames (DwHc, Timeout, Split.StartMicroFrame,
+                                      CSPLIT_FIRST_MICROFRAME - 1 +
+                                      Split.Tries++);
+      } else {
+        Status = DwHcWaitMicroFrames (DwHc, Timeout, DwHcMicroFrame (DwHc), 1);
+      }
 
-      if (Split.Tries++ < 3) {
-        goto restart_channel;
+      if (EFI_ERROR (Status)) {
+        *TransferResult = EFI_USB_ERR_TIMEOUT;
+        break;
       }
 
-      goto restart_xfer;
+      goto restart_channel;
     } else if (Ret == XFER_ERROR) {
       *TransferResult =
         EFI_USB_ERR_CRC |
@@ -352,10 +1120,23 @@ restart_channel:
       Status = EFI_DEVICE_ERROR;
       break;
     } else if (Ret == XFER_FRMOVRUN) {
+      Trace.FrameOverruns++;
       goto restart_channel;
     } else if (Ret == XFER_NAK) {
+      Trace.Naks++;
       if (Split.Splitting &&
-          (EpType == DWC2_HCCHAR_EPTYPE_CONTROL)) {
+          (EpType != DWC2_HCCHAR_EPTYPE_INTR)) {
+        /*
+         * The device NAKed the full/low-speed transaction, so it
+         * starts over with a new start-split.
+         */
+        Status = DwHcWaitMicroFrames (DwHc, Timeout, DwHcMicroFrame (DwHc), 1);
+        if (EFI_ERROR (Status)) {
+          *TransferResult = EFI_USB_ERR_TIMEOUT;
+          break;
+        }
+
+        Trace.Restarts++;
         goto restart_xfer;
       }
 
@@ -364,10 +1145,19 @@ restart_channel:
       break;
     }
 
+    if (Mapping != NULL) {
+      DmaUnmap (Mapping);
+      Mapping = NULL;
+    }
+
     if (TransferDirection) { // in
       ArmDataSynchronizationBarrier();
       TxferLen -= Sub;
-      CopyMem (Data+Done, DwHc->AlignedBuffer, TxferLen);
+      if (Bounce) {
+        Ticks = GetPerformanceCounter ();
+        CopyMem (Data+Done, Ch->AlignedBuffer, TxferLen);
+        CopyTicks += DwHcTicksSince (Ticks);
+      }
       if (Sub) {
         StopTransfer = 1;
       }
@@ -376,16 +1166,29 @@ restart_channel:
     Done += TxferLen;
   } while (Done < *DataLength && !StopTransfer);
 
-  MmioWrite32 (DwHc->DwUsbBase + HCINTMSK(Channel), 0);
-  MmioWrite32 (DwHc->DwUsbBase + HCINT(Channel), 0xFFFFFFFF);
+  if (Mapping != NULL) {
+    DmaUnmap (Mapping);
+  }
 
-  *DataLength = Done;
+  if (OwnChannel) {
+    DwHcFreeChannel (DwHc, Channel);
+  }
 
-  gBS->RestoreTPL (Tpl);
+  *DataLength = Done;
 
   ASSERT (!EFI_ERROR (Status) ||
           *TransferResult != EFI_USB_NOERROR);
 
+  Trace.Actual = Done;
+  Trace.MicroFrames = (DwHcMicroFrame (DwHc) - Trace.StartMicroFrame) &
+    DWC2_HFNUM_FRNUM_MASK;
+  Trace.CopyNs = GetTimeInNanoSecond (CopyTicks);
+  Trace.SetupNs = GetTimeInNanoSecond (SetupTicks);
+  Trace.WaitNs = GetTimeInNanoSecond (WaitTicks);
+  Trace.TransferResult = *TransferResult;
+  Trace.Status = Status;
+  DwHcTraceTransfer (DwHc, &Trace);
+
   return Status;
 }
 
@@ -398,10 +1201,15 @@ DwHcFindDeferredTransfer (
   )
 {
   LIST_ENTRY *Entry;
+  LIST_ENTRY *Bucket;
+
+  Bucket = &DwHc->DeferredHash[DEFERRED_HASH (DeviceAddress,
+                                              EndPointAddress & 0xF,
+                                              (EndPointAddress >> 7) & 0x01)];
 
-  EFI_LIST_FOR_EACH (Entry, &DwHc->DeferredList) {
+  EFI_LIST_FOR_EACH (Entry, Bucket) {
     DWUSB_DEFERRED_REQ *Req = EFI_LIST_CONTAINER (Entry, DWUSB_DEFERRED_REQ,
-                                                  List);
+                                                  HashList);
 
     if (Req->DeviceAddress == DeviceAddress &&
         Req->EpAddress == (EndPointAddress & 0xF) &&
@@ -413,56 +1221,344 @@ DwHcFindDeferredTransfer (
   return NULL;
 }
 
+/*
+ * Puts Req on the wheel for TargetFrame, or for the next frame
+ * not yet serviced if TargetFrame has gone by. A Retry goes ahead
+ * of the slot's other requests, so those don't starve it.
+ */
 STATIC
 VOID
-DwHcDeferredTransfer (
+DwHcScheduleDeferredTransfer (
+  IN  DWUSB_DEFERRED_REQ *Req,
+  IN  UINTN              TargetFrame,
+  IN  BOOLEAN            Retry
+  )
+{
+  DWUSB_OTGHC_DEV *DwHc = Req->DwHc;
+  LIST_ENTRY      *Slot;
+
+  if (TargetFrame <= DwHc->WheelFrame) {
+    TargetFrame = DwHc->WheelFrame + 1;
+  }
+
+  Req->TargetFrame = TargetFrame;
+  Slot = &DwHc->DeferredWheel[TargetFrame % DEFERRED_WHEEL_SLOTS];
+  if (Retry) {
+    InsertHeadList (Slot, &Req->List);
+  } else {
+    InsertTailList (Slot, &Req->List);
+  }
+}
+
+/*
+ * Puts Req back on the wheel for its next poll and, unless the
+ * device just NAKed, reports the result. The callback comes last,
+ * since it may cancel (and free) Req.
+ */
+STATIC
+VOID
+DwHcFinishDeferredTransfer (
+  IN  DWUSB_DEFERRED_REQ *Req,
+  IN  UINT32             TransferResult
+  )
+{
+  DwHcScheduleDeferredTransfer (Req, Req->TargetFrame + Req->FrameInterval,
+                                FALSE);
+
+  Req->TransferResult = TransferResult;
+  if (TransferResult == EFI_USB_ERR_NAK) {
+    /*
+     * Swallow the NAK, the upper layer expects us to resubmit automatically.
+     */
+    return;
+  }
+
+  Req->CallbackFunction (Req->Data, Req->ActualLength,
+                         Req->CallbackContext,
+                         TransferResult);
+}
+
+/*
+ * Records a poll DwHcPollDeferredTransfer picked up, and finishes it.
+ */
+STATIC
+VOID
+DwHcCompleteDeferredTransfer (
+  IN  DWUSB_DEFERRED_REQ *Req,
+  IN  UINT32             TransferResult,
+  IN  EFI_STATUS         Status
+  )
+{
+  DWUSB_OTGHC_DEV *DwHc = Req->DwHc;
+
+  Req->Trace.Actual = (UINT32) Req->ActualLength;
+  Req->Trace.MicroFrames = (DwHcMicroFrame (DwHc) -
+                            Req->Trace.StartMicroFrame) &
+    DWC2_HFNUM_FRNUM_MASK;
+  Req->Trace.TransferResult = TransferResult;
+  Req->Trace.Status = Status;
+  DwHcTraceTransfer (DwHc, &Req->Trace);
+
+  DwHcFinishDeferredTransfer (Req, TransferResult);
+}
+
+STATIC
+VOID
+DwHcReleaseDeferredChannel (
   IN  DWUSB_DEFERRED_REQ *Req
   )
 {
-  EFI_STATUS Status;
-  EFI_EVENT TimeoutEvt = NULL;
+  DWUSB_OTGHC_DEV *DwHc = Req->DwHc;
 
-  Status = gBS->CreateEvent (
-                             EVT_TIMER, 0, NULL, NULL,
-                             &TimeoutEvt
-                             );
-  ASSERT_EFI_ERROR (Status);
+  DwHc->Channels[Req->Channel].Req = NULL;
+  DwHcFreeChannel (DwHc, Req->Channel);
+  Req->Channel = DWHC_ANY_CHANNEL;
+}
+
+/*
+ * Stops Req's poll. The channel may still write to its bounce
+ * buffer, so it is left wedged until it halts.
+ */
+STATIC
+VOID
+DwHcAbortDeferredTransfer (
+  IN  DWUSB_DEFERRED_REQ *Req
+  )
+{
+  DWUSB_OTGHC_DEV *DwHc = Req->DwHc;
+  DWUSB_CHANNEL   *Ch = &DwHc->Channels[Req->Channel];
+
+  DwHcOr32 (DwHc, HCCHAR (Req->Channel), DWC2_HCCHAR_CHDIS);
+  Ch->Req = NULL;
+  Ch->WedgedMapping = NULL;
+  Ch->Wedged = TRUE;
+  Req->Channel = DWHC_ANY_CHANNEL;
+}
+
+STATIC
+VOID
+DwHcRestartDeferredChannel (
+  IN  DWUSB_DEFERRED_REQ *Req
+  )
+{
+  DWUSB_OTGHC_DEV *DwHc = Req->DwHc;
+
+  DwHcStartChannel (DwHc, Req->Channel,
+                    DwHc->Channels[Req->Channel].AlignedBufferBusAddress,
+                    Req->Translator, Req->DeviceSpeed, Req->DeviceAddress,
+                    Req->EpAddress, Req->TransferDirection, Req->EpType,
+                    Req->MaximumPacketLength, Req->TxferLen, Req->NumPackets,
+                    Req->Pid, &Req->Split);
+}
+
+/*
+ * Starts Req's poll on a channel of its own, through the bounce
+ * buffer and one packet per split, leaving DwHcPollDeferredTransfer
+ * to pick up the result. Fails with EFI_OUT_OF_RESOURCES when
+ * there is no channel, or no room on the TT, this frame.
+ */
+STATIC
+EFI_STATUS
+DwHcStartDeferredTransfer (
+  IN  DWUSB_DEFERRED_REQ *Req
+  )
+{
+  EFI_STATUS      Status;
+  DWUSB_OTGHC_DEV *DwHc = Req->DwHc;
+  UINT32          Channel;
+
+  Req->Split.Splitting = (Req->DeviceSpeed == EFI_USB_SPEED_LOW ||
+                          Req->DeviceSpeed == EFI_USB_SPEED_FULL);
+  Req->Split.SplitStart = Req->Split.Splitting;
+  Req->Split.Tries = 0;
+  Req->TxferLen = DwHcChunkLength (DwHc, Req->DataLength, DWC2_DATA_BUF_SIZE,
+                                   Req->MaximumPacketLength,
+                                   Req->Split.Splitting,
+                                   Req->TransferDirection, &Req->NumPackets);
+
+  Status = DwHcAllocateChannel (DwHc, Req->EpType, &Channel);
   if (EFI_ERROR (Status)) {
-    goto out;
+    return Status;
   }
 
-  Status = gBS->SetTimer (TimeoutEvt, TimerForTransfer,
+  if (Req->Split.Splitting) {
+    Status = DwHcScheduleStartSplit (DwHc, Req->TimeoutEvent, Req->Translator,
+                                     Req->DeviceSpeed, Req->TxferLen, TRUE);
+    if (EFI_ERROR (Status)) {
+      DwHcFreeChannel (DwHc, Channel);
+      return EFI_OUT_OF_RESOURCES;
+    }
+  }
+
+  Status = gBS->SetTimer (Req->TimeoutEvent, TimerForTransfer,
                           EFI_TIMER_PERIOD_MILLISECONDS(Req->TimeOut));
   ASSERT_EFI_ERROR (Status);
   if (EFI_ERROR (Status)) {
-    goto out;
+    DwHcFreeChannel (DwHc, Channel);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  ZeroMem (&Req->Trace, sizeof (Req->Trace));
+  Req->Trace.DeviceAddress = Req->DeviceAddress;
+  Req->Trace.EpAddress = Req->EpAddress | (Req->TransferDirection ? BIT7 : 0);
+  Req->Trace.EpType = Req->EpType;
+  Req->Trace.Length = (UINT32) Req->DataLength;
+  Req->Trace.StartMicroFrame = DwHcMicroFrame (DwHc);
+  Req->Trace.Channel = Channel;
+
+  if (!Req->TransferDirection) { // out
+    CopyMem (DwHc->Channels[Channel].AlignedBuffer, Req->Data, Req->TxferLen);
+  }
+  ArmDataSynchronizationBarrier ();
+
+  InitializeListHead (&Req->List);
+  Req->Channel = Channel;
+  DwHc->Channels[Channel].Req = Req;
+  DwHcRestartDeferredChannel (Req);
+  return EFI_SUCCESS;
+}
+
+/*
+ * Picks up the result of Req's poll once its channel has halted,
+ * or gives up on it after Req->TimeOut. A complete-split is sent
+ * straight away, aimed at its slot one or two microframes on; a
+ * split that can no longer make its window starts over.
+ */
+STATIC
+VOID
+DwHcPollDeferredTransfer (
+  IN  DWUSB_DEFERRED_REQ *Req
+  )
+{
+  DWUSB_OTGHC_DEV *DwHc = Req->DwHc;
+  UINT32          Channel = Req->Channel;
+  DWUSB_CHANNEL   *Ch = &DwHc->Channels[Channel];
+  UINT32          Ret;
+  UINT32          Sub;
+  UINT32          Slot;
+  UINT32          Length;
+
+  if (!Ch->Halted &&
+      (DwHcRead32 (DwHc, HAINT) & (1 << Channel)) == 0) {
+    if (EFI_ERROR (gBS->CheckEvent (Req->TimeoutEvent))) {
+      return;
+    }
+
+    DEBUG ((DEBUG_ERROR, "Channel %u did not halt, leaving it wedged\n",
+            Channel));
+    DwHcAbortDeferredTransfer (Req);
+    Req->ActualLength = 0;
+    DwHcCompleteDeferredTransfer (Req, EFI_USB_ERR_TIMEOUT, EFI_TIMEOUT);
+    return;
+  }
+
+  Ret = Wait4Chhltd (DwHc, Req->TimeoutEvent, Channel, &Sub, &Req->Pid,
+                     Req->IgnoreAck, &Req->Split);
+  switch (Ret) {
+  case XFER_DONE:
+    Length = MIN (Req->TxferLen - Sub, Req->DataLength);
+    if (Req->TransferDirection) { // in
+      ArmDataSynchronizationBarrier ();
+      CopyMem (Req->Data, Ch->AlignedBuffer, Length);
+    }
+    Req->ActualLength = Length;
+    DwHcReleaseDeferredChannel (Req);
+    DwHcCompleteDeferredTransfer (Req, EFI_USB_NOERROR, EFI_SUCCESS);
+    return;
+  case XFER_CSPLIT:
+    Req->Trace.Csplits++;
+    Slot = Req->Split.StartMicroFrame + CSPLIT_FIRST_MICROFRAME +
+      Req->Split.Tries;
+    if (Req->Split.Tries < CSPLIT_PERIODIC_TRIES &&
+        ((Slot - DwHcMicroFrame (DwHc) - 1) & DWC2_HFNUM_FRNUM_MASK) < 2) {
+      Req->Split.Tries++;
+      DwHcRestartDeferredChannel (Req);
+      return;
+    }
+
+    Req->Trace.Restarts++;
+    DwHcReleaseDeferredChannel (Req);
+    DwHcScheduleDeferredTransfer (Req, DwHc->CurrentFrame, TRUE);
+    return;
+  case XFER_FRMOVRUN:
+    Req->Trace.FrameOverruns++;
+    DwHcRestartDeferredChannel (Req);
+    return;
+  case XFER_NAK:
+    Req->Trace.Naks++;
+    Req->ActualLength = 0;
+    DwHcReleaseDeferredChannel (Req);
+    DwHcCompleteDeferredTransfer (Req, EFI_USB_ERR_NAK, EFI_DEVICE_ERROR);
+    return;
+  case XFER_STALL:
+    Req->ActualLength = 0;
+    DwHcReleaseDeferredChannel (Req);
+    DwHcCompleteDeferredTransfer (Req, EFI_USB_ERR_STALL, EFI_DEVICE_ERROR);
+    return;
+  default:
+    Req->ActualLength = 0;
+    DwHcReleaseDeferredChannel (Req);
+    DwHcCompleteDeferredTransfer (Req,
+                                  EFI_USB_ERR_CRC |
+                                  EFI_USB_ERR_TIMEOUT |
+                                  EFI_USB_ERR_BITSTUFF |
+                                  EFI_USB_ERR_SYSTEM,
+                                  EFI_DEVICE_ERROR);
+    return;
+  }
+}
+
+/*
+ * Polls Req, due in DwHc->WheelFrame. Without the channel halt
+ * interrupt, the timer tick comes too late to follow a start-split
+ * up with its complete-splits, so a split poll runs to completion
+ * here, bounded by its window rather than by Req->TimeOut.
+ *
+ * Fails with EFI_OUT_OF_RESOURCES, leaving Req off the wheel, if
+ * there was no channel, TT or handler time for it this frame.
+ */
+STATIC
+EFI_STATUS
+DwHcDeferredTransfer (
+  IN  DWUSB_DEFERRED_REQ *Req
+  )
+{
+  EFI_STATUS Status;
+  DWUSB_OTGHC_DEV *DwHc = Req->DwHc;
+
+  if (DwHc->Interrupt != NULL ||
+      (Req->DeviceSpeed != EFI_USB_SPEED_LOW &&
+       Req->DeviceSpeed != EFI_USB_SPEED_FULL)) {
+    return DwHcStartDeferredTransfer (Req);
+  }
+
+  if (((DwHcMicroFrame (DwHc) - DwHc->LastMicroFrame) &
+       DWC2_HFNUM_FRNUM_MASK) >= DW_HC_POLLED_SPLIT_MICROFRAMES) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = gBS->SetTimer (Req->TimeoutEvent, TimerForTransfer,
+                          EFI_TIMER_PERIOD_MILLISECONDS(DW_HC_POLLED_SPLIT_TIMEOUT_MS));
+  ASSERT_EFI_ERROR (Status);
+  if (EFI_ERROR (Status)) {
+    return EFI_OUT_OF_RESOURCES;
   }
 
   Req->TransferResult = EFI_USB_NOERROR;
-  Status = DwHcTransfer (Req->DwHc, TimeoutEvt,
-                         Req->Channel, Req->Translator,
+  Req->ActualLength = Req->DataLength;
+  Status = DwHcTransfer (DwHc, DWHC_ANY_CHANNEL, Req->TimeoutEvent,
+                         Req->Translator,
                          Req->DeviceSpeed, Req->DeviceAddress,
                          Req->MaximumPacketLength, &Req->Pid,
-                         Req->TransferDirection, Req->Data, &Req->DataLength,
+                         Req->TransferDirection, Req->Data, &Req->ActualLength,
                          Req->EpAddress, Req->EpType, &Req->TransferResult,
                          Req->IgnoreAck);
-
-  if (Req->EpType == DWC2_HCCHAR_EPTYPE_INTR &&
-      Status == EFI_DEVICE_ERROR &&
-      Req->TransferResult == EFI_USB_ERR_NAK) {
-    /*
-     * Swallow the NAK, the upper layer expects us to resubmit automatically.
-     */
-    goto out;
+  if (Status == EFI_OUT_OF_RESOURCES) {
+    return Status;
   }
 
-  Req->CallbackFunction (Req->Data, Req->DataLength,
-                         Req->CallbackContext,
-                         Req->TransferResult);
- out:
-  if (TimeoutEvt != NULL) {
-    gBS->CloseEvent (TimeoutEvt);
-  }
+  DwHcFinishDeferredTransfer (Req, Req->TransferResult);
+  return EFI_SUCCESS;
 }
 
 /**
@@ -502,6 +1598,8 @@ DwHcReset (
   DWUSB_OTGHC_DEV *DwHc;
   DwHc = DWHC_FROM_THIS (This);
 
+  DwHcDescCacheFlush (DwHc);
+
   Status = gBS->CreateEvent (
                              EVT_TIMER, 0, NULL, NULL,
                              &TimeoutEvt
@@ -530,16 +1628,13 @@ DwHcReset (
     goto out;
   }
 
-  MmioAndThenOr32 (DwHc->DwUsbBase + HPRT0,
-                   ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET |
-                     DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG),
-                   DWC2_HPRT0_PRTRST);
-
-  MicroSecondDelay (50000);
-
-  MmioAnd32 (DwHc->DwUsbBase + HPRT0, ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET |
-                                        DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG |
-                                        DWC2_HPRT0_PRTRST));
+  /*
+   * Released by the root port reset UsbBusDxe does on connect,
+   * or by the first port status query after it's been held long
+   * enough.
+   */
+  DwHc->PortResetActive = FALSE;
+  DwHcPortResetStart (DwHc);
 
  out:
   if (TimeoutEvt != NULL) {
@@ -602,9 +1697,14 @@ DwHcGetRootHubPortStatus (
 
   DwHc = DWHC_FROM_THIS (This);
 
+  if (DwHc->PortResetActive &&
+      DwHcElapsedUs (DwHc->PortResetStart) >= DW_HC_PORT_RESET_MS * 1000) {
+    DwHcPortResetFinish (DwHc);
+  }
+
   PortStatus->PortStatus = 0;
   PortStatus->PortChangeStatus = 0;
-  Hprt0 = MmioRead32 (DwHc->DwUsbBase + HPRT0);
+  Hprt0 = DwHcRead32 (DwHc, HPRT0);
 
   if (Hprt0 & DWC2_HPRT0_PRTCONNSTS) {
     PortStatus->PortStatus |= USB_PORT_STAT_CONNECTION;
@@ -638,6 +1738,7 @@ DwHcGetRootHubPortStatus (
 
   if (Hprt0 & DWC2_HPRT0_PRTCONNDET) {
     PortStatus->PortChangeStatus |= USB_PORT_STAT_C_CONNECTION;
+    DwHcDescCacheFlush (DwHc);
   }
 
   if (Hprt0 & DWC2_HPRT0_PRTOVRCURRCHNG) {
@@ -670,26 +1771,22 @@ DwHcSetRootHubPortFeature (
   case EfiUsbPortEnable:
     break;
   case EfiUsbPortSuspend:
-    Hprt0 = MmioRead32 (DwHc->DwUsbBase + HPRT0);
+    Hprt0 = DwHcRead32 (DwHc, HPRT0);
     Hprt0 &= ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET |
                DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG);
     Hprt0 |= DWC2_HPRT0_PRTSUSP;
-    MmioWrite32 (DwHc->DwUsbBase + HPRT0, Hprt0);
+    DwHcWrite32 (DwHc, HPRT0, Hprt0);
     break;
   case EfiUsbPortReset:
-    MmioAndThenOr32 (DwHc->DwUsbBase + HPRT0,
-                     ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET |
-                       DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG),
-                     DWC2_HPRT0_PRTRST);
-    MicroSecondDelay (50000);
-    MmioAnd32 (DwHc->DwUsbBase + HPRT0, ~DWC2_HPRT0_PRTRST);
+    DwHcDescCacheFlush (DwHc);
+    DwHcPortResetStart (DwHc);
     break;
   case EfiUsbPortPower:
-    Hprt0 = MmioRead32 (DwHc->DwUsbBase + HPRT0);
+    Hprt0 = DwHcRead32 (DwHc, HPRT0);
     Hprt0 &= ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET |
                DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG);
     Hprt0 |= DWC2_HPRT0_PRTPWR;
-    MmioWrite32 (DwHc->DwUsbBase + HPRT0, Hprt0);
+    DwHcWrite32 (DwHc, HPRT0, Hprt0);
     break;
   case EfiUsbPortOwner:
     break;
@@ -723,60 +1820,56 @@ DwHcClearRootHubPortFeature (
 
   switch (PortFeature) {
   case EfiUsbPortEnable:
-    Hprt0 = MmioRead32 (DwHc->DwUsbBase + HPRT0);
+    Hprt0 = DwHcRead32 (DwHc, HPRT0);
     Hprt0 &= ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET |
                DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG);
     Hprt0 |= DWC2_HPRT0_PRTENA;
-    MmioWrite32 (DwHc->DwUsbBase + HPRT0, Hprt0);
+    DwHcWrite32 (DwHc, HPRT0, Hprt0);
     break;
   case EfiUsbPortReset:
-    MmioAndThenOr32 (DwHc->DwUsbBase + HPRT0,
-                     ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET |
-                       DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG),
-                     DWC2_HPRT0_PRTRST);
-    MicroSecondDelay (50000);
-    MmioAnd32 (DwHc->DwUsbBase + HPRT0, ~DWC2_HPRT0_PRTRST);
+    DwHcPortResetStart (DwHc);
+    DwHcPortResetFinish (DwHc);
     break;
   case EfiUsbPortSuspend:
-    MmioWrite32 (DwHc->DwUsbBase + PCGCCTL, 0);
+    DwHcWrite32 (DwHc, PCGCCTL, 0);
     MicroSecondDelay (40000);
-    Hprt0 = MmioRead32 (DwHc->DwUsbBase + HPRT0);
+    Hprt0 = DwHcRead32 (DwHc, HPRT0);
     Hprt0 &= ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET |
                DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG);
     Hprt0 |= DWC2_HPRT0_PRTRES;
-    MmioWrite32 (DwHc->DwUsbBase + HPRT0, Hprt0);
+    DwHcWrite32 (DwHc, HPRT0, Hprt0);
     Hprt0 &= ~DWC2_HPRT0_PRTSUSP;
     MicroSecondDelay (150000);
     Hprt0 &= ~DWC2_HPRT0_PRTRES;
-    MmioWrite32 (DwHc->DwUsbBase + HPRT0, Hprt0);
+    DwHcWrite32 (DwHc, HPRT0, Hprt0);
     break;
   case EfiUsbPortPower:
-    Hprt0 = MmioRead32 (DwHc->DwUsbBase + HPRT0);
+    Hprt0 = DwHcRead32 (DwHc, HPRT0);
     Hprt0 &= ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET |
                DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG);
     Hprt0 &= ~DWC2_HPRT0_PRTPWR;
-    MmioWrite32 (DwHc->DwUsbBase + HPRT0, Hprt0);
+    DwHcWrite32 (DwHc, HPRT0, Hprt0);
     break;
   case EfiUsbPortOwner:
     break;
   case EfiUsbPortConnectChange:
-    Hprt0 = MmioRead32 (DwHc->DwUsbBase + HPRT0);
+    Hprt0 = DwHcRead32 (DwHc, HPRT0);
     Hprt0 &= ~DWC2_HPRT0_PRTCONNDET;
-    MmioWrite32 (DwHc->DwUsbBase + HPRT0, Hprt0);
+    DwHcWrite32 (DwHc, HPRT0, Hprt0);
     break;
   case EfiUsbPortResetChange:
     break;
   case EfiUsbPortEnableChange:
-    Hprt0 = MmioRead32 (DwHc->DwUsbBase + HPRT0);
+    Hprt0 = DwHcRead32 (DwHc, HPRT0);
     Hprt0 &= ~DWC2_HPRT0_PRTENCHNG;
-    MmioWrite32 (DwHc->DwUsbBase + HPRT0, Hprt0);
+    DwHcWrite32 (DwHc, HPRT0, Hprt0);
     break;
   case EfiUsbPortSuspendChange:
     break;
   case EfiUsbPortOverCurrentChange:
-    Hprt0 = MmioRead32 (DwHc->DwUsbBase + HPRT0);
+    Hprt0 = DwHcRead32 (DwHc, HPRT0);
     Hprt0 &= ~DWC2_HPRT0_PRTOVRCURRCHNG;
-    MmioWrite32 (DwHc->DwUsbBase + HPRT0, Hprt0);
+    DwHcWrite32 (DwHc, HPRT0, Hprt0);
     break;
   default:
     Status = EFI_INVALID_PARAMETER;
@@ -809,6 +1902,7 @@ DwHcControlTransfer (
   UINTN                   Length;
   EFI_USB_DATA_DIRECTION  StatusDirection;
   UINT32                  Direction;
+  UINT32                  Channel;
   EFI_EVENT TimeoutEvt = NULL;
 
   if ((Request == NULL) || (TransferResult == NULL)) {
@@ -841,6 +1935,12 @@ DwHcControlTransfer (
   }
 
   DwHc  = DWHC_FROM_THIS(This);
+  Channel = DWHC_ANY_CHANNEL;
+
+  if (DwHcDescCacheLookup (DwHc, DeviceAddress, Request, Data, DataLength)) {
+    *TransferResult = EFI_USB_NOERROR;
+    return EFI_SUCCESS;
+  }
 
   Status = gBS->CreateEvent (
                              EVT_TIMER, 0, NULL, NULL,
@@ -858,10 +1958,20 @@ DwHcControlTransfer (
     goto out;
   }
 
+  /*
+   * All three stages run on the same channel.
+   */
+  Status = DwHcAllocateChannel (DwHc, DWC2_HCCHAR_EPTYPE_CONTROL, &Channel);
+  if (EFI_ERROR (Status)) {
+    *TransferResult = EFI_USB_ERR_SYSTEM;
+    Channel = DWHC_ANY_CHANNEL;
+    goto out;
+  }
+
   Pid = DWC2_HC_PID_SETUP;
   Length = 8;
-  Status = DwHcTransfer (DwHc, TimeoutEvt,
-                         DWC2_HC_CHANNEL, Translator, DeviceSpeed,
+  Status = DwHcTransfer (DwHc, Channel, TimeoutEvt,
+                         Translator, DeviceSpeed,
                          DeviceAddress, MaximumPacketLength, &Pid, 0,
                          Request, &Length, 0, DWC2_HCCHAR_EPTYPE_CONTROL,
                          TransferResult, 1);
@@ -881,8 +1991,8 @@ DwHcControlTransfer (
       Direction = 0;
     }
 
-    Status = DwHcTransfer (DwHc, TimeoutEvt,
-                           DWC2_HC_CHANNEL, Translator, DeviceSpeed,
+    Status = DwHcTransfer (DwHc, Channel, TimeoutEvt,
+                           Translator, DeviceSpeed,
                            DeviceAddress, MaximumPacketLength, &Pid,
                            Direction, Data, DataLength, 0,
                            DWC2_HCCHAR_EPTYPE_CONTROL,
@@ -904,8 +2014,8 @@ DwHcControlTransfer (
 
   Pid = DWC2_HC_PID_DATA1;
   Length = 0;
-  Status = DwHcTransfer (DwHc, TimeoutEvt,
-                         DWC2_HC_CHANNEL, Translator, DeviceSpeed,
+  Status = DwHcTransfer (DwHc, Channel, TimeoutEvt,
+                         Translator, DeviceSpeed,
                          DeviceAddress, MaximumPacketLength, &Pid,
                          StatusDirection, DwHc->StatusBuffer, &Length, 0,
                          DWC2_HCCHAR_EPTYPE_CONTROL, TransferResult, 1);
@@ -917,10 +2027,16 @@ DwHcControlTransfer (
   }
 
 out:
+  if (Channel != DWHC_ANY_CHANNEL) {
+    DwHcFreeChannel (DwHc, Channel);
+  }
+
   if (TimeoutEvt != NULL) {
     gBS->CloseEvent (TimeoutEvt);
   }
 
+  DwHcDescCacheUpdate (DwHc, DeviceAddress, Request, Data, *DataLength, Status);
+
   if (EFI_ERROR(Status)) {
     DEBUG((DEBUG_ERROR, "RequestType 0x%x\n", Request->RequestType));
     DEBUG((DEBUG_ERROR, "Request 0x%x\n", Request->Request));
@@ -997,8 +2113,8 @@ DwHcBulkTransfer (
   EpAddress               = EndPointAddress & 0x0F;
   Pid                     = (*DataToggle << 1);
 
-  Status = DwHcTransfer (DwHc, TimeoutEvt,
-                         DWC2_HC_CHANNEL_BULK, Translator, DeviceSpeed,
+  Status = DwHcTransfer (DwHc, DWHC_ANY_CHANNEL, TimeoutEvt,
+                         Translator, DeviceSpeed,
                          DeviceAddress, MaximumPacketLength, &Pid,
                          TransferDirection, Data[0], DataLength, EpAddress,
                          DWC2_HCCHAR_EPTYPE_BULK, TransferResult, 1);
@@ -1083,10 +2199,16 @@ DwHcAsyncInterruptTransfer (
       goto done;
     }
 
+    if (FoundReq->Channel != DWHC_ANY_CHANNEL) {
+      DwHcAbortDeferredTransfer (FoundReq);
+    }
+
     *DataToggle = FoundReq->Pid >> 1;
     FreePool (FoundReq->Data);
 
+    gBS->CloseEvent (FoundReq->TimeoutEvent);
     RemoveEntryList (&FoundReq->List);
+    RemoveEntryList (&FoundReq->HashList);
     FreePool (FoundReq);
 
     Status = EFI_SUCCESS;
@@ -1107,14 +2229,14 @@ DwHcAsyncInterruptTransfer (
     goto done;
   }
 
-  InitializeListHead (&NewReq->List);
+  Status = gBS->CreateEvent (EVT_TIMER, 0, NULL, NULL, &NewReq->TimeoutEvent);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_ERROR, "DwHcAsyncInterruptTransfer: failed to create event: %r\n", Status));
+    goto done;
+  }
 
   NewReq->FrameInterval = PollingInterval;
-  NewReq->TargetFrame = DwHc->CurrentFrame +
-    NewReq->FrameInterval;
-
   NewReq->DwHc = DwHc;
-  NewReq->Channel = DWC2_HC_CHANNEL_ASYNC;
   NewReq->Translator = Translator;
   NewReq->DeviceSpeed = DeviceSpeed;
   NewReq->DeviceAddress = DeviceAddress;
@@ -1129,8 +2251,14 @@ DwHcAsyncInterruptTransfer (
   NewReq->CallbackFunction = CallbackFunction;
   NewReq->CallbackContext = Context;
   NewReq->TimeOut = 1000; /* 1000 ms */
-
-  InsertTailList (&DwHc->DeferredList, &NewReq->List);
+  NewReq->Channel = DWHC_ANY_CHANNEL;
+
+  InsertTailList (&DwHc->DeferredHash[DEFERRED_HASH (NewReq->DeviceAddress,
+                                                     NewReq->EpAddress,
+                                                     NewReq->TransferDirection)],
+                  &NewReq->HashList);
+  DwHcScheduleDeferredTransfer (NewReq, DwHc->CurrentFrame +
+                                NewReq->FrameInterval, FALSE);
   Status = EFI_SUCCESS;
 
  done:
@@ -1171,6 +2299,7 @@ DwHcSyncInterruptTransfer (
   UINT8 TransferDirection;
   UINT8 EpAddress;
   UINT32 Pid;
+  UINTN Length;
 
   DwHc  = DWHC_FROM_THIS(This);
 
@@ -1205,14 +2334,23 @@ DwHcSyncInterruptTransfer (
   TransferDirection = (EndPointAddress >> 7) & 0x01;
   EpAddress = EndPointAddress & 0x0F;
   Pid = (*DataToggle << 1);
-  Status = DwHcTransfer(DwHc, TimeoutEvt,
-                        DWC2_HC_CHANNEL_SYNC, Translator,
-                        DeviceSpeed, DeviceAddress,
-                        MaximumPacketLength,
-                        &Pid, TransferDirection, Data,
-                        DataLength, EpAddress,
-                        DWC2_HCCHAR_EPTYPE_INTR,
-                        TransferResult, 0);
+  Length = *DataLength;
+
+  /*
+   * Retry if the TT's periodic budget for this frame is used up.
+   */
+  do {
+    *DataLength = Length;
+    Status = DwHcTransfer(DwHc, DWHC_ANY_CHANNEL, TimeoutEvt,
+                          Translator, DeviceSpeed,
+                          DeviceAddress,
+                          MaximumPacketLength,
+                          &Pid, TransferDirection, Data,
+                          DataLength, EpAddress,
+                          DWC2_HCCHAR_EPTYPE_INTR,
+                          TransferResult, 0);
+  } while (Status == EFI_OUT_OF_RESOURCES &&
+           EFI_ERROR (gBS->CheckEvent (TimeoutEvt)));
   *DataToggle = (Pid >> 1);
 
  out:
@@ -1274,7 +2412,7 @@ InitFslspClkSel (
 
   PhyClk = DWC2_HCFG_FSLSPCLKSEL_30_60_MHZ;
 
-  MmioAndThenOr32 (DwHc->DwUsbBase + HCFG,
+  DwHcAndThenOr32 (DwHc, HCFG,
                    ~DWC2_HCFG_FSLSPCLKSEL_MASK,
                    PhyClk << DWC2_HCFG_FSLSPCLKSEL_OFFSET);
 }
@@ -1288,10 +2426,10 @@ DwFlushTxFifo (
 {
   EFI_STATUS Status;
 
-  MmioWrite32 (DwHc->DwUsbBase + GRSTCTL, DWC2_GRSTCTL_TXFFLSH |
+  DwHcWrite32 (DwHc, GRSTCTL, DWC2_GRSTCTL_TXFFLSH |
                (Num << DWC2_GRSTCTL_TXFNUM_OFFSET));
 
-  Status = Wait4Bit (Timeout, DwHc->DwUsbBase + GRSTCTL, DWC2_GRSTCTL_TXFFLSH, 0);
+  Status = Wait4Bit (DwHc, Timeout, GRSTCTL, DWC2_GRSTCTL_TXFFLSH, 0);
   if (Status)
     DEBUG ((EFI_D_ERROR, "DwFlushTxFifo: Timeout!\n"));
 
@@ -1306,9 +2444,9 @@ DwFlushRxFifo (
 {
   EFI_STATUS Status;
 
-  MmioWrite32 (DwHc->DwUsbBase + GRSTCTL, DWC2_GRSTCTL_RXFFLSH);
+  DwHcWrite32 (DwHc, GRSTCTL, DWC2_GRSTCTL_RXFFLSH);
 
-  Status = Wait4Bit (Timeout, DwHc->DwUsbBase + GRSTCTL, DWC2_GRSTCTL_RXFFLSH, 0);
+  Status = Wait4Bit (DwHc, Timeout, GRSTCTL, DWC2_GRSTCTL_RXFFLSH, 0);
   if (Status)
     DEBUG ((EFI_D_ERROR, "DwFlushRxFifo: Timeout!\n"));
 
@@ -1324,58 +2462,95 @@ DwHcInit (
   UINT32 NpTxFifoSz = 0;
   UINT32 pTxFifoSz = 0;
   UINT32 Hprt0 = 0;
+  UINT32 HwCfg3;
   INT32  i, Status, NumChannels;
+  EFI_TPL            Tpl;
+  DWUSB_DEFERRED_REQ *Req;
 
-  MmioWrite32 (DwHc->DwUsbBase + PCGCCTL, 0);
+  DwHcWrite32 (DwHc, PCGCCTL, 0);
 
   InitFslspClkSel (DwHc);
 
-  MmioWrite32 (DwHc->DwUsbBase + GRXFSIZ, DWC2_HOST_RX_FIFO_SIZE);
+  DwHcWrite32 (DwHc, GRXFSIZ, DWC2_HOST_RX_FIFO_SIZE);
 
   NpTxFifoSz |= DWC2_HOST_NPERIO_TX_FIFO_SIZE << DWC2_FIFOSIZE_DEPTH_OFFSET;
   NpTxFifoSz |= DWC2_HOST_RX_FIFO_SIZE << DWC2_FIFOSIZE_STARTADDR_OFFSET;
-  MmioWrite32 (DwHc->DwUsbBase + GNPTXFSIZ, NpTxFifoSz);
+  DwHcWrite32 (DwHc, GNPTXFSIZ, NpTxFifoSz);
 
   pTxFifoSz |= DWC2_HOST_PERIO_TX_FIFO_SIZE << DWC2_FIFOSIZE_DEPTH_OFFSET;
   pTxFifoSz |= (DWC2_HOST_RX_FIFO_SIZE + DWC2_HOST_NPERIO_TX_FIFO_SIZE) <<
     DWC2_FIFOSIZE_STARTADDR_OFFSET;
-  MmioWrite32 (DwHc->DwUsbBase + HPTXFSIZ, pTxFifoSz);
+  DwHcWrite32 (DwHc, HPTXFSIZ, pTxFifoSz);
 
-  MmioAnd32 (DwHc->DwUsbBase + GOTGCTL, ~(DWC2_GOTGCTL_HSTSETHNPEN));
+  DwHcAnd32 (DwHc, GOTGCTL, ~(DWC2_GOTGCTL_HSTSETHNPEN));
 
   DwFlushTxFifo (DwHc, Timeout, 0x10);
   DwFlushRxFifo (DwHc, Timeout);
 
-  NumChannels = MmioRead32 (DwHc->DwUsbBase + GHWCFG2);
+  NumChannels = DwHcRead32 (DwHc, GHWCFG2);
   NumChannels &= DWC2_HWCFG2_NUM_HOST_CHAN_MASK;
   NumChannels >>= DWC2_HWCFG2_NUM_HOST_CHAN_OFFSET;
   NumChannels += 1;
   DEBUG ((DEBUG_INFO, "Host has %u channels\n", NumChannels));
 
+  DwHc->NumChannels = MIN (NumChannels, MAX_CHANNEL);
+
+  HwCfg3 = DwHcRead32 (DwHc, GHWCFG3);
+  DwHc->MaxTransferSize = (1 << (((HwCfg3 & DWC2_HWCFG3_XFER_SIZE_CNTR_WIDTH_MASK) >>
+                                  DWC2_HWCFG3_XFER_SIZE_CNTR_WIDTH_OFFSET) + 11)) - 1;
+  DwHc->MaxPacketCount = (1 << (((HwCfg3 & DWC2_HWCFG3_PACKET_SIZE_CNTR_WIDTH_MASK) >>
+                                 DWC2_HWCFG3_PACKET_SIZE_CNTR_WIDTH_OFFSET) + 4)) - 1;
+  DEBUG ((DEBUG_INFO, "Channel transfers up to %u bytes, %u packets\n",
+          DwHc->MaxTransferSize, DwHc->MaxPacketCount));
+
+  /*
+   * Polls in flight were lost with the reset: start them over.
+   */
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+  for (i = 0; i < MAX_CHANNEL; i++) {
+    Req = DwHc->Channels[i].Req;
+    if (Req != NULL) {
+      DwHc->Channels[i].Req = NULL;
+      Req->Channel = DWHC_ANY_CHANNEL;
+      DwHcScheduleDeferredTransfer (Req, DwHc->WheelFrame + 1, TRUE);
+    }
+  }
+
+  DwHcReclaimChannels (DwHc, TRUE);
+  DwHc->ChannelsInUse = 0;
+  gBS->RestoreTPL (Tpl);
+
   for (i=0; i<NumChannels; i++)
-    MmioAndThenOr32 (DwHc->DwUsbBase + HCCHAR(i),
+    DwHcAndThenOr32 (DwHc, HCCHAR(i),
                      ~(DWC2_HCCHAR_CHEN | DWC2_HCCHAR_EPDIR),
                      DWC2_HCCHAR_CHDIS);
 
   for (i=0; i<NumChannels; i++) {
-    MmioAndThenOr32 (DwHc->DwUsbBase + HCCHAR(i),
+    DwHcAndThenOr32 (DwHc, HCCHAR(i),
                      ~DWC2_HCCHAR_EPDIR,
                      (DWC2_HCCHAR_CHEN | DWC2_HCCHAR_CHDIS));
-    Status = Wait4Bit (Timeout, DwHc->DwUsbBase + HCCHAR(i), DWC2_HCCHAR_CHEN, 0);
+    Status = Wait4Bit (DwHc, Timeout, HCCHAR(i), DWC2_HCCHAR_CHEN, 0);
     if (Status) {
       DEBUG ((EFI_D_ERROR, "DwHcInit: Timeout!\n"));
       return Status;
     }
   }
 
-  if (MmioRead32 (DwHc->DwUsbBase + GINTSTS) & DWC2_GINTSTS_CURMODE_HOST) {
-    Hprt0 = MmioRead32 (DwHc->DwUsbBase + HPRT0);
+  if (DwHc->Interrupt != NULL) {
+    DwHcWrite32 (DwHc, HAINTMSK, (1 << DwHc->NumChannels) - 1);
+    DwHcWrite32 (DwHc, GINTSTS, 0xFFFFFFFF);
+    DwHcWrite32 (DwHc, GINTMSK, DWC2_GINTMSK_HCINTR);
+    DwHcOr32 (DwHc, GAHBCFG, DWC2_GAHBCFG_GLBLINTRMSK);
+  }
+
+  if (DwHcRead32 (DwHc, GINTSTS) & DWC2_GINTSTS_CURMODE_HOST) {
+    Hprt0 = DwHcRead32 (DwHc, HPRT0);
     Hprt0 &= ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET);
     Hprt0 &= ~(DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG);
 
     if (!(Hprt0 & DWC2_HPRT0_PRTPWR)) {
       Hprt0 |= DWC2_HPRT0_PRTPWR;
-      MmioWrite32 (DwHc->DwUsbBase + HPRT0, Hprt0);
+      DwHcWrite32 (DwHc, HPRT0, Hprt0);
     }
   }
 
@@ -1392,12 +2567,12 @@ DwCoreInit (
   UINT32 UsbCfg = 0;
   EFI_STATUS Status;
 
-  UsbCfg = MmioRead32 (DwHc->DwUsbBase + GUSBCFG);
+  UsbCfg = DwHcRead32 (DwHc, GUSBCFG);
 
   UsbCfg |= DWC2_GUSBCFG_ULPI_EXT_VBUS_DRV;
   UsbCfg &= ~DWC2_GUSBCFG_TERM_SEL_DL_PULSE;
 
-  MmioWrite32 (DwHc->DwUsbBase + GUSBCFG, UsbCfg);
+  DwHcWrite32 (DwHc, GUSBCFG, UsbCfg);
 
   Status = DwCoreReset (DwHc, Timeout);
   if (Status != EFI_SUCCESS) {
@@ -1409,7 +2584,7 @@ DwCoreInit (
   UsbCfg |= CONFIG_DWC2_PHY_TYPE << DWC2_GUSBCFG_ULPI_UTMI_SEL_OFFSET;
   UsbCfg &= ~DWC2_GUSBCFG_DDRSEL;
 
-  MmioWrite32 (DwHc->DwUsbBase + GUSBCFG, UsbCfg);
+  DwHcWrite32 (DwHc, GUSBCFG, UsbCfg);
 
   Status = DwCoreReset (DwHc, Timeout);
   if (Status != EFI_SUCCESS) {
@@ -1417,16 +2592,16 @@ DwCoreInit (
     return Status;
   }
 
-  UsbCfg = MmioRead32 (DwHc->DwUsbBase + GUSBCFG);
+  UsbCfg = DwHcRead32 (DwHc, GUSBCFG);
 
   UsbCfg &= ~(DWC2_GUSBCFG_ULPI_FSLS | DWC2_GUSBCFG_ULPI_CLK_SUS_M);
-  MmioWrite32 (DwHc->DwUsbBase + GUSBCFG, UsbCfg);
+  DwHcWrite32 (DwHc, GUSBCFG, UsbCfg);
 
   AhbCfg &= ~DWC2_GAHBCFG_AXI_BURST4_MASK;
   AhbCfg |= DWC2_GAHBCFG_DMAENABLE | DWC2_GAHBCFG_WAIT_AXI_WRITES;
 
-  MmioWrite32 (DwHc->DwUsbBase + GAHBCFG, AhbCfg);
-  MmioAnd32 (DwHc->DwUsbBase + GUSBCFG, ~(DWC2_GUSBCFG_HNPCAP | DWC2_GUSBCFG_SRPCAP));
+  DwHcWrite32 (DwHc, GAHBCFG, AhbCfg);
+  DwHcAnd32 (DwHc, GUSBCFG, ~(DWC2_GUSBCFG_HNPCAP | DWC2_GUSBCFG_SRPCAP));
 
   return EFI_SUCCESS;
 }
@@ -1437,6 +2612,7 @@ DestroyDwUsbHc(
   )
 {
   UINT32 Pages;
+  UINT32 Index;
   EFI_TPL PreviousTpl;
 
   if (DwHc == NULL) {
@@ -1453,9 +2629,22 @@ DestroyDwUsbHc(
     gBS->CloseEvent (DwHc->ExitBootServiceEvent);
   }
 
+  if (DwHc->Interrupt != NULL) {
+    DwHcAnd32 (DwHc, GAHBCFG, ~DWC2_GAHBCFG_GLBLINTRMSK);
+    DwHc->Interrupt->RegisterInterruptSource (DwHc->Interrupt,
+                                              BCM2836_USB_IRQ, NULL);
+    DwHc->Interrupt->DisableInterruptSource (DwHc->Interrupt,
+                                             BCM2836_USB_IRQ);
+    mDwHc = NULL;
+  }
+
   Pages = EFI_SIZE_TO_PAGES (DWC2_DATA_BUF_SIZE);
-  DmaUnmap (DwHc->AlignedBufferMapping);
-  DmaFreeBuffer (Pages, DwHc->AlignedBuffer);
+  for (Index = 0; Index < MAX_CHANNEL; Index++) {
+    if (DwHc->Channels[Index].AlignedBuffer != NULL) {
+      DmaUnmap (DwHc->Channels[Index].AlignedBufferMapping);
+      DmaFreeBuffer (Pages, DwHc->Channels[Index].AlignedBuffer);
+    }
+  }
 
   Pages = EFI_SIZE_TO_PAGES (DWC2_STATUS_BUF_SIZE);
   FreePages (DwHc->StatusBuffer, Pages);
@@ -1477,39 +2666,35 @@ DwUsbHcExitBootService (
   DwHcQuiesce (DwHc);
 }
 
+/*
+ * Brings CurrentFrame up to date with the microframes counted
+ * in HFNUM since the last call. The handler also runs on channel
+ * halts, so partial frames carry over rather than rounding up.
+ */
 STATIC
-UINT32
-FramesPassed (
+VOID
+DwHcUpdateFrame (
   IN  DWUSB_OTGHC_DEV *DwHc
   )
 {
-  UINT32 MicroFrameStart = DwHc->LastMicroFrame;
-  UINT32 MicroFrameEnd =
-    MmioRead32 (DwHc->DwUsbBase + HFNUM) &
-    DWC2_HFNUM_FRNUM_MASK;
-  UINT32 MicroFramesPassed;
-
-  DwHc->LastMicroFrame = (UINT16) MicroFrameEnd;
-
-  if (MicroFrameEnd < MicroFrameStart) {
-    /*
-     * Being delayed by 0x8000 microframes is 262 seconds.
-     * Unlikely. Also, we can't really do better unless we
-     * start polling time (which is tedious in EFI...).
-     */
-    MicroFrameEnd += DWC2_HFNUM_FRNUM_MASK + 1;
-  }
-
-  MicroFramesPassed = MicroFrameEnd - MicroFrameStart;
+  UINT32 MicroFrame = DwHcMicroFrame (DwHc);
 
   /*
-   * Round up. We're supposedly getting called every
-   * 8 microframes anyway. This means we'll end up
-   * going a bit faster, which is okay.
+   * Being delayed by 0x4000 microframes is 2 seconds.
+   * Unlikely.
    */
-  return ALIGN_VALUE(MicroFramesPassed, 8) / 8;
+  DwHc->MicroFrames += (MicroFrame - DwHc->LastMicroFrame) &
+    DWC2_HFNUM_FRNUM_MASK;
+  DwHc->LastMicroFrame = (UINT16) MicroFrame;
+  DwHc->CurrentFrame = DwHc->MicroFrames / 8;
 }
 
+/*
+ * Runs on the timer tick, and on channel halts when there is
+ * an interrupt controller: picks up the polls in flight (and
+ * the channels of cancelled ones), then starts the ones that
+ * have come due.
+ */
 STATIC
 VOID
 DwHcPeriodicHandler (
@@ -1517,22 +2702,78 @@ DwHcPeriodicHandler (
                       IN VOID      *Context
                       )
 {
-  UINT32 Frame;
+  UINTN Frame;
+  UINT32 Channel;
   LIST_ENTRY *Entry;
-  LIST_ENTRY *NextEntry;
+  LIST_ENTRY *Slot;
+  LIST_ENTRY Due;
+  LIST_ENTRY Retry;
+  DWUSB_DEFERRED_REQ *Req;
   DWUSB_OTGHC_DEV *DwHc = Context;
 
-  DwHc->CurrentFrame += FramesPassed(DwHc);
+  DwHcUpdateFrame (DwHc);
   Frame = DwHc->CurrentFrame;
 
-  EFI_LIST_FOR_EACH_SAFE (Entry, NextEntry,
-                          &DwHc->DeferredList) {
-    DWUSB_DEFERRED_REQ *Req = EFI_LIST_CONTAINER (Entry, DWUSB_DEFERRED_REQ,
-                                                  List);
+  for (Channel = 0; Channel < DwHc->NumChannels; Channel++) {
+    Req = DwHc->Channels[Channel].Req;
+    if (Req != NULL) {
+      DwHcPollDeferredTransfer (Req);
+    }
+  }
+
+  DwHcReclaimChannels (DwHc, FALSE);
+
+  if (Frame - DwHc->WheelFrame > DEFERRED_WHEEL_SLOTS) {
+    DwHc->WheelFrame = Frame - DEFERRED_WHEEL_SLOTS;
+  }
+
+  InitializeListHead (&Due);
+  InitializeListHead (&Retry);
+
+  while (DwHc->WheelFrame != Frame) {
+    DwHc->WheelFrame++;
+    Slot = &DwHc->DeferredWheel[DwHc->WheelFrame % DEFERRED_WHEEL_SLOTS];
+
+    /*
+     * Move the slot aside first: polled requests go back on the
+     * wheel, and callbacks may cancel any request.
+     */
+    while (!IsListEmpty (Slot)) {
+      Entry = GetFirstNode (Slot);
+      RemoveEntryList (Entry);
+      InsertTailList (&Due, Entry);
+    }
+
+    while (!IsListEmpty (&Due)) {
+      Entry = GetFirstNode (&Due);
+      RemoveEntryList (Entry);
+      Req = EFI_LIST_CONTAINER (Entry, DWUSB_DEFERRED_REQ, List);
+
+      if (Req->TargetFrame > DwHc->WheelFrame) {
+        /*
+         * Rescheduled a whole turn ahead while catching up
+         * on missed frames.
+         */
+        InsertTailList (Slot, Entry);
+        continue;
+      }
+
+      if (EFI_ERROR (DwHcDeferredTransfer (Req))) {
+        InsertTailList (&Retry, Entry);
+      }
+    }
 
-    if (Frame >= Req->TargetFrame) {
-      Req->TargetFrame = Frame + Req->FrameInterval;
-      DwHcDeferredTransfer(Req);
+    /*
+     * Requests that found no channel or TT time go first in
+     * the next frame, in order, so none of them starves.
+     */
+    Slot = &DwHc->DeferredWheel[(DwHc->WheelFrame + 1) % DEFERRED_WHEEL_SLOTS];
+    while (!IsListEmpty (&Retry)) {
+      Entry = GetPreviousNode (&Retry, &Retry);
+      RemoveEntryList (Entry);
+      Req = EFI_LIST_CONTAINER (Entry, DWUSB_DEFERRED_REQ, List);
+      Req->TargetFrame = DwHc->WheelFrame + 1;
+      InsertHeadList (Slot, Entry);
     }
   }
 }
@@ -1544,7 +2785,7 @@ CreateDwUsbHc (
 {
   DWUSB_OTGHC_DEV *DwHc;
   UINT32          Pages;
-  UINTN           BufferSize;
+  UINT32          Index;
   EFI_STATUS      Status;
 
   DwHc = AllocateZeroPool (sizeof(DWUSB_OTGHC_DEV));
@@ -1569,6 +2810,7 @@ CreateDwUsbHc (
   DwHc->DwUsbOtgHc.MajorRevision                  = 0x02;
   DwHc->DwUsbOtgHc.MinorRevision                  = 0x00;
   DwHc->DwUsbBase                                 = BCM2836_USB_DW2_BASE_ADDRESS;
+  DwHcInitTrace (DwHc);
 
   Pages = EFI_SIZE_TO_PAGES (DWC2_STATUS_BUF_SIZE);
   DwHc->StatusBuffer = AllocatePages(Pages);
@@ -1577,23 +2819,14 @@ CreateDwUsbHc (
     return EFI_OUT_OF_RESOURCES;
   }
 
-  Pages = EFI_SIZE_TO_PAGES (DWC2_DATA_BUF_SIZE);
-  Status = DmaAllocateBuffer (EfiBootServicesData, Pages, (VOID **) &DwHc->AlignedBuffer);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((EFI_D_ERROR, "CreateDwUsbHc: DmaAllocateBuffer: %r\n", Status));
-    return Status;
+  for (Index = 0; Index < DEFERRED_WHEEL_SLOTS; Index++) {
+    InitializeListHead (&DwHc->DeferredWheel[Index]);
   }
 
-  BufferSize = EFI_PAGES_TO_SIZE (Pages);
-  Status = DmaMap (MapOperationBusMasterCommonBuffer, DwHc->AlignedBuffer, &BufferSize,
-                   &DwHc->AlignedBufferBusAddress, &DwHc->AlignedBufferMapping);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((EFI_D_ERROR, "CreateDwUsbHc: DmaMap: %r\n", Status));
-    return Status;
+  for (Index = 0; Index < DEFERRED_HASH_SIZE; Index++) {
+    InitializeListHead (&DwHc->DeferredHash[Index]);
   }
 
-  InitializeListHead (&DwHc->DeferredList);
-
   Status = gBS->CreateEventEx (
                                EVT_NOTIFY_SIGNAL,
                                TPL_NOTIFY,
@@ -1626,6 +2859,24 @@ CreateDwUsbHc (
     return Status;
   }
 
+  Status = gBS->LocateProtocol (&gHardwareInterruptProtocolGuid, NULL,
+                                (VOID **) &DwHc->Interrupt);
+  if (!EFI_ERROR (Status)) {
+    mDwHc = DwHc;
+    Status = DwHc->Interrupt->RegisterInterruptSource (DwHc->Interrupt,
+                                                       BCM2836_USB_IRQ,
+                                                       DwHcInterruptHandler);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "CreateDwUsbHc: RegisterInterruptSource: %r\n", Status));
+      mDwHc = NULL;
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_INFO, "CreateDwUsbHc: polling for channel halts\n"));
+    DwHc->Interrupt = NULL;
+  }
+
   *OutDwHc = DwHc;
   return EFI_SUCCESS;
 }
@@ -1643,13 +2894,19 @@ DwHcQuiesce (
     gBS->RestoreTPL(PreviousTpl);
   }
 
-  MmioAndThenOr32 (DwHc->DwUsbBase + HPRT0,
-                   ~(DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTCONNDET |
-                     DWC2_HPRT0_PRTENCHNG | DWC2_HPRT0_PRTOVRCURRCHNG),
-                   DWC2_HPRT0_PRTRST);
+  DwHcAnd32 (DwHc, GAHBCFG, ~DWC2_GAHBCFG_GLBLINTRMSK);
 
-  MicroSecondDelay (50000);
+  /*
+   * Timer events can't be relied on here, so everything is
+   * bounded by DwHcPollBit.
+   */
+  DwHcPortResetStart (DwHc);
+  MicroSecondDelay (DW_HC_PORT_RESET_MS * 1000);
 
-  MmioWrite32 (DwHc->DwUsbBase + GRSTCTL, DWC2_GRSTCTL_CSFTRST);
-  MicroSecondDelay (100000);
+  DwHcWrite32 (DwHc, GRSTCTL, DWC2_GRSTCTL_CSFTRST);
+  if (EFI_ERROR (DwHcPollBit (DwHc, GRSTCTL, DWC2_GRSTCTL_CSFTRST, FALSE,
+                              DW_HC_SOFT_RESET_TIMEOUT_US))) {
+    DEBUG ((EFI_D_ERROR, "DwHcQuiesce: CSFTRST Timeout!\n"));
+  }
+  DwHc->PortResetActive = FALSE;
 }
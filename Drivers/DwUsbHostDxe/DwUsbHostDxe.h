@@ -18,9 +18,13 @@
 
 #include <Uefi.h>
 
+#include <Protocol/DriverDiagnostics2.h>
+#include <Protocol/DwUsbHostTrace.h>
+#include <Protocol/HardwareInterrupt.h>
 #include <Protocol/RaspberryPiFirmware.h>
 #include <Protocol/Usb2HostController.h>
 #include <IndustryStandard/RpiFirmware.h>
+#include <IndustryStandard/Usb.h>
 #include <IndustryStandard/Bcm2836.h>
 
 #include <Guid/EventGroup.h>
@@ -44,9 +48,63 @@
 
 #define MAX_DEVICE                      16
 #define MAX_ENDPOINT                    16
+#define MAX_CHANNEL                     16
+#define MAX_TT_HUB                      128
+
+/*
+ * Transfers kept in the trace ring, and endpoints
+ * counters are kept for.
+ */
+#define TRACE_RING_SIZE                 256
+#define TRACE_MAX_ENDPOINTS             32
+
+/*
+ * Configuration descriptors cached, and the most each can
+ * hold. Larger configurations are not cached.
+ */
+#define DESC_CACHE_ENTRIES              32
+#define DESC_CACHE_CONFIG_SIZE          255
+#define DESC_CACHE_MAX_ADDRESS          128
+
+/*
+ * Hub class port requests (USB 2.0 11.24.2) the descriptor
+ * cache watches for.
+ */
+#define USB_HUB_PORT_REQ_TYPE           0x23
+#define USB_HUB_PORT_RESET              4
+#define USB_HUB_C_PORT_CONNECTION       16
+
+/*
+ * For DwHcTransfer, to allocate a channel just for the transfer.
+ */
+#define DWHC_ANY_CHANNEL                MAX_UINT32
+
+/*
+ * Async interrupt transfers are kept on a timer wheel indexed
+ * by TargetFrame. The wheel is larger than the longest polling
+ * interval (255 frames), so a slot only ever holds requests due
+ * in that exact frame. They are also hashed by endpoint for
+ * DwHcFindDeferredTransfer.
+ */
+#define DEFERRED_WHEEL_SLOTS            256
+#define DEFERRED_HASH_SIZE              32
+#define DEFERRED_HASH(Address, EpAddress, Direction) \
+  (((Address) ^ (((EpAddress) << 1) | (Direction))) % DEFERRED_HASH_SIZE)
 
 #define DWUSB_OTGHC_DEV_SIGNATURE       SIGNATURE_32 ('d', 'w', 'h', 'c')
 #define DWHC_FROM_THIS(a)               CR(a, DWUSB_OTGHC_DEV, DwUsbOtgHc, DWUSB_OTGHC_DEV_SIGNATURE)
+#define DWHC_FROM_TRACE_THIS(a)         CR(a, DWUSB_OTGHC_DEV, TraceProtocol, DWUSB_OTGHC_DEV_SIGNATURE)
+
+//
+// Controller register access. The driver only touches the DWC2 core
+// through these, so a simulated register model can stand in for
+// IoLib when building the transfer code for something else.
+//
+#define DwHcRead32(Dev, Reg)                MmioRead32 ((Dev)->DwUsbBase + (Reg))
+#define DwHcWrite32(Dev, Reg, Val)          MmioWrite32 ((Dev)->DwUsbBase + (Reg), (Val))
+#define DwHcOr32(Dev, Reg, Or)              MmioOr32 ((Dev)->DwUsbBase + (Reg), (Or))
+#define DwHcAnd32(Dev, Reg, And)            MmioAnd32 ((Dev)->DwUsbBase + (Reg), (And))
+#define DwHcAndThenOr32(Dev, Reg, And, Or)  MmioAndThenOr32 ((Dev)->DwUsbBase + (Reg), (And), (Or))
 
 //
 // Iterate through the double linked list. NOT delete safe
@@ -77,19 +135,39 @@ typedef struct {
   EFI_DEVICE_PATH_PROTOCOL      EndDevicePath;
 } EFI_DW_DEVICE_PATH;
 
+typedef struct {
+  BOOLEAN Splitting;
+  BOOLEAN SplitStart;
+  UINT32 Tries;
+  /*
+   * Microframe the start-split was ACKed in.
+   */
+  UINT32 StartMicroFrame;
+} SPLIT_CONTROL;
+
+/*
+ * An async interrupt transfer. Each poll runs on a channel of
+ * its own without DwHcPeriodicHandler waiting for it (but see
+ * DwHcDeferredTransfer for split polls without the interrupt):
+ * the request is off the wheel while Channel is set, and the
+ * handler picks up the result on a later tick, or when the
+ * channel halt interrupt signals it.
+ */
 typedef struct _DWUSB_DEFERRED_REQ {
   IN OUT LIST_ENTRY                         List;
+  IN OUT LIST_ENTRY                         HashList;
   IN     struct _DWUSB_OTGHC_DEV            *DwHc;
-  IN     UINT32                             Channel;
+  IN     EFI_EVENT                          TimeoutEvent;
   IN     UINT32                             FrameInterval;
-  IN     UINT32                             TargetFrame;
+  IN     UINTN                              TargetFrame;
   IN     EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator;
   IN     UINT8                              DeviceSpeed;
   IN     UINT8                              DeviceAddress;
   IN     UINTN                              MaximumPacketLength;
   IN     UINT32                             TransferDirection;
   IN OUT VOID                               *Data;
-  IN OUT UINTN                              DataLength;
+  IN     UINTN                              DataLength;
+  OUT    UINTN                              ActualLength;
   IN OUT UINT32                             Pid;
   IN     UINT32                             EpAddress;
   IN     UINT32                             EpType;
@@ -98,38 +176,132 @@ typedef struct _DWUSB_DEFERRED_REQ {
   IN     EFI_ASYNC_USB_TRANSFER_CALLBACK    CallbackFunction;
   IN     VOID                               *CallbackContext;
   IN     UINTN                              TimeOut;
+
+  /*
+   * The poll in flight: DWHC_ANY_CHANNEL if none.
+   */
+  UINT32                                    Channel;
+  UINT32                                    TxferLen;
+  UINT32                                    NumPackets;
+  SPLIT_CONTROL                             Split;
+  DW_USB_HOST_TRACE_ENTRY                   Trace;
 } DWUSB_DEFERRED_REQ;
 
+/*
+ * Full-speed byte times of periodic split transactions
+ * already started through a hub's TT in Frame.
+ */
+typedef struct {
+  UINT32                          Frame;
+  UINT32                          ByteTimes;
+} DWUSB_TT_BUDGET;
+
+/*
+ * Per-channel bounce buffer, allocated the first time
+ * the channel is handed out, the HCINT bits collected
+ * by the interrupt handler, and the async interrupt
+ * transfer in flight on the channel, if any.
+ *
+ * A channel that would not halt after CHDIS may still be
+ * doing DMA, so it is Wedged: it stays in ChannelsInUse,
+ * with the transfer's data mapping in WedgedMapping, until
+ * it is seen halted or the core is reset. One that was
+ * writing straight into the caller's buffer gets the core
+ * reset before the transfer returns.
+ */
+typedef struct {
+  UINT8                           *AlignedBuffer;
+  VOID                            *AlignedBufferMapping;
+  EFI_PHYSICAL_ADDRESS            AlignedBufferBusAddress;
+  volatile UINT32                 Hcint;
+  volatile BOOLEAN                Halted;
+  struct _DWUSB_DEFERRED_REQ      *Req;
+  BOOLEAN                         Wedged;
+  VOID                            *WedgedMapping;
+} DWUSB_CHANNEL;
+
+/*
+ * A complete configuration descriptor, with its interface
+ * and endpoint descriptors. Address 0 marks a free entry.
+ */
+typedef struct {
+  UINT8                           Address;
+  UINT8                           ConfigIndex;
+  UINT16                          Length;
+  UINT8                           Data[DESC_CACHE_CONFIG_SIZE];
+} DWUSB_CONFIG_CACHE;
+
 typedef struct _DWUSB_OTGHC_DEV {
   UINTN                           Signature;
 
   EFI_USB2_HC_PROTOCOL            DwUsbOtgHc;
 
+  DW_USB_HOST_TRACE_PROTOCOL      TraceProtocol;
+  DW_USB_HOST_TRACE_ENTRY         Trace[TRACE_RING_SIZE];
+  UINTN                           TraceNext;
+  UINTN                           TraceCount;
+  DW_USB_HOST_ENDPOINT_STATS      EndpointStats[TRACE_MAX_ENDPOINTS];
+  UINTN                           EndpointCount;
+
   EFI_USB_HC_STATE                DwHcState;
 
   EFI_EVENT                       ExitBootServiceEvent;
 
   EFI_EVENT                       PeriodicEvent;
 
+  /*
+   * NULL if channel halts are polled for.
+   */
+  EFI_HARDWARE_INTERRUPT_PROTOCOL *Interrupt;
+
   EFI_PHYSICAL_ADDRESS            DwUsbBase;
   UINT8                           *StatusBuffer;
 
-  UINT8                           *AlignedBuffer;
-  VOID *                          AlignedBufferMapping;
-  UINTN                           AlignedBufferBusAddress;
-  LIST_ENTRY                      DeferredList;
   /*
-   * 1ms frames.
+   * Channels are handed out per transfer from ChannelsInUse,
+   * a bitmap of the NumChannels reported by GHWCFG2.
    */
-  UINTN                           CurrentFrame;
+  UINT32                          NumChannels;
+  UINT32                          ChannelsInUse;
+  DWUSB_CHANNEL                   Channels[MAX_CHANNEL];
+
+  /*
+   * Largest HCTSIZ XferSize and PktCnt, from the counter
+   * widths in GHWCFG3.
+   */
+  UINT32                          MaxTransferSize;
+  UINT32                          MaxPacketCount;
+
+  /*
+   * Root port reset in progress, asserted at PortResetStart
+   * (a performance counter value).
+   */
+  BOOLEAN                         PortResetActive;
+  UINT64                          PortResetStart;
+
+  DWUSB_TT_BUDGET                 TtBudget[MAX_TT_HUB];
+
+  DWUSB_CONFIG_CACHE              ConfigCache[DESC_CACHE_ENTRIES];
+  UINTN                           ConfigCacheNext;
+
+  LIST_ENTRY                      DeferredWheel[DEFERRED_WHEEL_SLOTS];
+  LIST_ENTRY                      DeferredHash[DEFERRED_HASH_SIZE];
   /*
-   * 125us frames;
+   * Last frame whose wheel slot was serviced.
    */
+  UINTN                           WheelFrame;
+  /*
+   * 125us microframes counted from HFNUM, as of LastMicroFrame,
+   * and the 1ms frames they make up.
+   */
+  UINTN                           CurrentFrame;
+  UINTN                           MicroFrames;
   UINT16                          LastMicroFrame;
 } DWUSB_OTGHC_DEV;
 
 extern EFI_COMPONENT_NAME_PROTOCOL gComponentName;
 extern EFI_COMPONENT_NAME2_PROTOCOL gComponentName2;
+extern EFI_DRIVER_DIAGNOSTICS2_PROTOCOL gDriverDiagnostics2;
 
 EFI_STATUS
 CreateDwUsbHc (
@@ -160,4 +332,39 @@ DwHcQuiesce (
   IN  DWUSB_OTGHC_DEV *DwHc
   );
 
+VOID
+DwHcInitTrace (
+  IN  DWUSB_OTGHC_DEV *DwHc
+  );
+
+VOID
+DwHcTraceTransfer (
+  IN  DWUSB_OTGHC_DEV         *DwHc,
+  IN  DW_USB_HOST_TRACE_ENTRY *Entry
+  );
+
+BOOLEAN
+DwHcDescCacheLookup (
+  IN      DWUSB_OTGHC_DEV        *DwHc,
+  IN      UINT8                  DeviceAddress,
+  IN      EFI_USB_DEVICE_REQUEST *Request,
+  OUT     VOID                   *Data,
+  IN  OUT UINTN                  *DataLength
+  );
+
+VOID
+DwHcDescCacheFlush (
+  IN  DWUSB_OTGHC_DEV        *DwHc
+  );
+
+VOID
+DwHcDescCacheUpdate (
+  IN  DWUSB_OTGHC_DEV        *DwHc,
+  IN  UINT8                  DeviceAddress,
+  IN  EFI_USB_DEVICE_REQUEST *Request,
+  IN  VOID                   *Data,
+  IN  UINTN                  DataLength,
+  IN  EFI_STATUS             Status
+  );
+
 #endif //_DWUSBHOSTDXE_H_
@@ -755,13 +755,8 @@
 #define DWC2_HOST_RX_FIFO_SIZE           (516 + DWC2_MAX_CHANNELS)
 #define DWC2_HOST_NPERIO_TX_FIFO_SIZE    0x100   /* nPeriodic TX FIFO */
 #define DWC2_HOST_PERIO_TX_FIFO_SIZE     0x200   /* Periodic TX FIFO */
-#define DWC2_MAX_TRANSFER_SIZE           65535
-#define DWC2_MAX_PACKET_COUNT            511
 
-#define DWC2_HC_CHANNEL                 0
-#define DWC2_HC_CHANNEL_ASYNC           1
-#define DWC2_HC_CHANNEL_SYNC            2
-#define DWC2_HC_CHANNEL_BULK            3
+#define DWC2_HC_PERIODIC_RESERVED       1       /* Channels kept for intr EPs */
 #define DWC2_HC_PORT                    0
 
 #define DWC2_STATUS_BUF_SIZE            64
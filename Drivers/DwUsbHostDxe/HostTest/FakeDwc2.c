@@ -0,0 +1,635 @@
+/** @file
+ *
+ *  Simulated DWC2 host core. Registers that only hold configuration
+ *  are plain storage; the reset, port and channel registers behave
+ *  closely enough for the driver's init and transfer paths. A
+ *  non-periodic channel runs its whole transfer as soon as it is
+ *  enabled and halts before the HCCHAR write returns, except on a
+ *  Hang endpoint. A periodic channel waits for the next microframe
+ *  of the parity ODDFRM asks for, and runs from FakeDwc2Advance.
+ *
+ *  Devices behind a hub's transaction translator are only reached
+ *  through split transactions. The TT takes a start-split and
+ *  answers complete-splits with NYET until the full/low-speed
+ *  transaction is done, after which it hands back the device's
+ *  answer. A periodic complete-split that comes later than the
+ *  4th microframe after the start-split finds the transaction
+ *  dropped.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include "FakeDwc2.h"
+#include "DwcHw.h"
+
+#define FAKE_DWC2_REGS_SIZE     0x1000
+
+/*
+ * As on the BCM2835: 19-bit XferSize and 10-bit PktCnt.
+ */
+#define FAKE_DWC2_HWCFG3        ((8 << DWC2_HWCFG3_XFER_SIZE_CNTR_WIDTH_OFFSET) | \
+                                 (6 << DWC2_HWCFG3_PACKET_SIZE_CNTR_WIDTH_OFFSET))
+
+#define FAKE_DWC2_MICROFRAME_NS 125000
+
+/*
+ * Microframes after a start-split before the TT has the result,
+ * and the last one a periodic complete-split may come in.
+ */
+#define FAKE_TT_PERIODIC_READY  2
+#define FAKE_TT_PERIODIC_LAST   4
+#define FAKE_TT_BULK_READY      1
+
+#define HPRT0_W1C               (DWC2_HPRT0_PRTCONNDET |        \
+                                 DWC2_HPRT0_PRTENCHNG |         \
+                                 DWC2_HPRT0_PRTOVRCURRCHNG)
+
+STATIC UINT32      mRegs[FAKE_DWC2_REGS_SIZE / sizeof (UINT32)];
+STATIC BOOLEAN     mHung[FAKE_DWC2_CHANNELS];
+STATIC FAKE_DEVICE *mDevices[FAKE_DWC2_MAX_DEVICES];
+STATIC UINTN       mDeviceCount;
+STATIC UINT64      mChannelStarts;
+STATIC BOOLEAN     mPeriodicPending[FAKE_DWC2_CHANNELS];
+STATIC UINT64      mPeriodicDue[FAKE_DWC2_CHANNELS];
+STATIC UINT64      mSplitFrame;
+STATIC UINT32      mSplitFrameStarts;
+STATIC UINT32      mSplitPeakStarts;
+
+/*
+ * Microframes of simulated time.
+ */
+STATIC
+UINT64
+MicroFrameNow (
+  VOID
+  )
+{
+  return GetPerformanceCounter () / FAKE_DWC2_MICROFRAME_NS;
+}
+
+STATIC
+UINT32 *
+Reg (
+  IN  UINTN Offset
+  )
+{
+  ASSERT (Offset < FAKE_DWC2_REGS_SIZE && (Offset & 3) == 0);
+  return &mRegs[Offset / sizeof (UINT32)];
+}
+
+STATIC
+BOOLEAN
+IsChannelReg (
+  IN  UINTN  Offset,
+  IN  UINTN  Reg0,
+  OUT UINT32 *Channel
+  )
+{
+  if (Offset < Reg0 ||
+      Offset >= Reg0 + 0x20 * FAKE_DWC2_CHANNELS ||
+      ((Offset - Reg0) % 0x20) != 0) {
+    return FALSE;
+  }
+
+  *Channel = (UINT32) ((Offset - Reg0) / 0x20);
+  return TRUE;
+}
+
+STATIC
+FAKE_DEVICE *
+FindDevice (
+  IN  UINT8 Address
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < mDeviceCount; Index++) {
+    if (mDevices[Index]->Address == Address) {
+      return mDevices[Index];
+    }
+  }
+
+  return NULL;
+}
+
+STATIC
+VOID
+CoreReset (
+  VOID
+  )
+{
+  UINT32 Channel;
+
+  for (Channel = 0; Channel < FAKE_DWC2_CHANNELS; Channel++) {
+    *Reg (HCCHAR (Channel)) = 0;
+    *Reg (HCSPLT (Channel)) = 0;
+    *Reg (HCINT (Channel)) = 0;
+    *Reg (HCINTMSK (Channel)) = 0;
+    *Reg (HCTSIZ (Channel)) = 0;
+    *Reg (HCDMA (Channel)) = 0;
+    mHung[Channel] = FALSE;
+    mPeriodicPending[Channel] = FALSE;
+  }
+
+  *Reg (GINTSTS) = DWC2_GINTSTS_CURMODE_HOST;
+  *Reg (GHWCFG2) = (FAKE_DWC2_CHANNELS - 1) << DWC2_HWCFG2_NUM_HOST_CHAN_OFFSET;
+  *Reg (GHWCFG3) = FAKE_DWC2_HWCFG3;
+  *Reg (HPRT0) &= DWC2_HPRT0_PRTPWR;
+  if (mDeviceCount != 0) {
+    *Reg (HPRT0) |= DWC2_HPRT0_PRTCONNSTS | DWC2_HPRT0_PRTCONNDET;
+  }
+}
+
+STATIC
+VOID
+Halt (
+  IN  UINT32 Channel,
+  IN  UINT32 Hcint
+  )
+{
+  *Reg (HCCHAR (Channel)) &= ~(DWC2_HCCHAR_CHEN | DWC2_HCCHAR_CHDIS);
+  *Reg (HCINT (Channel)) |= Hcint | DWC2_HCINT_CHHLTD;
+  mPeriodicPending[Channel] = FALSE;
+}
+
+/*
+ * The TT's side of a split transaction. Returns FALSE once it has
+ * halted the channel, TRUE if the device should now answer the
+ * transaction.
+ */
+STATIC
+BOOLEAN
+TtSplit (
+  IN  UINT32        Channel,
+  IN  FAKE_DEVICE   *Device,
+  IN  FAKE_ENDPOINT *Ep,
+  IN  BOOLEAN       Periodic
+  )
+{
+  UINT32 Hcsplt;
+  UINT64 Now;
+  UINT64 Elapsed;
+
+  Hcsplt = *Reg (HCSPLT (Channel));
+  Now = MicroFrameNow ();
+
+  if ((Hcsplt & DWC2_HCSPLT_SPLTENA) == 0) {
+    if (Device->TtHub == 0) {
+      return TRUE;
+    }
+    /*
+     * Full/low-speed devices don't understand high-speed packets.
+     */
+    Halt (Channel, DWC2_HCINT_XACTERR);
+    return FALSE;
+  }
+
+  if (Device->TtHub == 0 ||
+      ((Hcsplt & DWC2_HCSPLT_HUBADDR_MASK) >> DWC2_HCSPLT_HUBADDR_OFFSET) !=
+      Device->TtHub ||
+      ((Hcsplt & DWC2_HCSPLT_PRTADDR_MASK) >> DWC2_HCSPLT_PRTADDR_OFFSET) !=
+      Device->TtPort) {
+    Halt (Channel, DWC2_HCINT_XACTERR);
+    return FALSE;
+  }
+
+  if ((Hcsplt & DWC2_HCSPLT_COMPSPLT) == 0) {
+    Ep->StartSplits++;
+    Ep->SplitPending = TRUE;
+    Ep->SplitMicroFrame = Now;
+    if (Periodic) {
+      if ((Now >> 3) != mSplitFrame) {
+        mSplitFrame = Now >> 3;
+        mSplitFrameStarts = 0;
+      }
+      mSplitFrameStarts++;
+      mSplitPeakStarts = MAX (mSplitPeakStarts, mSplitFrameStarts);
+    }
+    Halt (Channel, DWC2_HCINT_ACK);
+    return FALSE;
+  }
+
+  Ep->CompleteSplits++;
+  if (!Ep->SplitPending) {
+    Halt (Channel, DWC2_HCINT_XACTERR);
+    return FALSE;
+  }
+
+  Elapsed = Now - Ep->SplitMicroFrame;
+  if (Periodic && Elapsed > FAKE_TT_PERIODIC_LAST) {
+    Ep->SplitPending = FALSE;
+    Ep->LostSplits++;
+    Halt (Channel, DWC2_HCINT_XACTERR);
+    return FALSE;
+  }
+
+  if (Elapsed < (Periodic ? FAKE_TT_PERIODIC_READY : FAKE_TT_BULK_READY) ||
+      Ep->Nyets != 0) {
+    if (Ep->Nyets != 0) {
+      Ep->Nyets--;
+    }
+    Halt (Channel, DWC2_HCINT_NYET);
+    return FALSE;
+  }
+
+  Ep->SplitPending = FALSE;
+  return TRUE;
+}
+
+STATIC
+UINT32
+TogglePid (
+  IN  UINT32 Pid,
+  IN  UINT32 Packets
+  )
+{
+  if ((Packets & 1) == 0) {
+    return Pid;
+  }
+
+  return Pid == DWC2_HC_PID_DATA0 ? DWC2_HC_PID_DATA1 : DWC2_HC_PID_DATA0;
+}
+
+/*
+ * Answers a SETUP packet by queueing the IN data stage on endpoint 0.
+ */
+STATIC
+VOID
+Setup (
+  IN  FAKE_DEVICE        *Device,
+  IN  USB_DEVICE_REQUEST *Request
+  )
+{
+  FAKE_ENDPOINT *Ep0;
+  CONST UINT8   *Data;
+  UINT16        Length;
+
+  Ep0 = &Device->In[0];
+  CopyMem (Device->LastSetup, Request, sizeof (Device->LastSetup));
+  Device->Setups++;
+
+  Data = NULL;
+  Length = 0;
+  if (Request->RequestType == USB_DEV_GET_DESCRIPTOR_REQ_TYPE &&
+      Request->Request == USB_REQ_GET_DESCRIPTOR) {
+    switch (Request->Value >> 8) {
+    case USB_DESC_TYPE_DEVICE:
+      Data = Device->DeviceDescriptor;
+      Length = Device->DeviceDescriptorLength;
+      break;
+    case USB_DESC_TYPE_CONFIG:
+      Data = Device->ConfigDescriptor;
+      Length = Device->ConfigDescriptorLength;
+      break;
+    }
+  } else if (Request->RequestType == 0 &&
+             Request->Request == USB_REQ_SET_ADDRESS) {
+    Device->PendingAddress = (UINT8) Request->Value;
+  }
+
+  Ep0->InData = Data;
+  Ep0->InLength = MIN (Length, Request->Length);
+  Ep0->InOffset = 0;
+}
+
+/*
+ * Runs the transfer the channel was just enabled for.
+ */
+STATIC
+VOID
+StartChannel (
+  IN  UINT32 Channel
+  )
+{
+  UINT32        Hcchar;
+  UINT32        Hctsiz;
+  UINT32        Size;
+  UINT32        Packets;
+  UINT32        Pid;
+  UINT32        Mps;
+  UINT32        EpNum;
+  BOOLEAN       In;
+  BOOLEAN       Periodic;
+  UINT32        Moved;
+  UINT8         *Buffer;
+  FAKE_DEVICE   *Device;
+  FAKE_ENDPOINT *Ep;
+
+  mChannelStarts++;
+
+  Hcchar = *Reg (HCCHAR (Channel));
+  Hctsiz = *Reg (HCTSIZ (Channel));
+  Size = Hctsiz & DWC2_HCTSIZ_XFERSIZE_MASK;
+  Packets = (Hctsiz & DWC2_HCTSIZ_PKTCNT_MASK) >> DWC2_HCTSIZ_PKTCNT_OFFSET;
+  Pid = (Hctsiz & DWC2_HCTSIZ_PID_MASK) >> DWC2_HCTSIZ_PID_OFFSET;
+  Mps = Hcchar & DWC2_HCCHAR_MPS_MASK;
+  EpNum = (Hcchar & DWC2_HCCHAR_EPNUM_MASK) >> DWC2_HCCHAR_EPNUM_OFFSET;
+  In = (Hcchar & (1 << DWC2_HCCHAR_EPDIR_OFFSET)) != 0;
+  Periodic = ((Hcchar & DWC2_HCCHAR_EPTYPE_MASK) >> DWC2_HCCHAR_EPTYPE_OFFSET) ==
+    DWC2_HCCHAR_EPTYPE_INTR;
+
+  /*
+   * No one answers, as for a missing device.
+   */
+  Device = FindDevice ((Hcchar & DWC2_HCCHAR_DEVADDR_MASK) >>
+                       DWC2_HCCHAR_DEVADDR_OFFSET);
+  if (Device == NULL || Mps == 0) {
+    Halt (Channel, DWC2_HCINT_XACTERR);
+    return;
+  }
+
+  Ep = In ? &Device->In[EpNum] : &Device->Out[EpNum];
+  Ep->Transactions++;
+
+  if (Ep->Hang) {
+    mHung[Channel] = TRUE;
+    return;
+  }
+
+  if (!TtSplit (Channel, Device, Ep, Periodic)) {
+    return;
+  }
+
+  if (Ep->XactErrors != 0) {
+    Ep->XactErrors--;
+    Halt (Channel, DWC2_HCINT_XACTERR);
+    return;
+  }
+
+  if (Ep->FrameOverruns != 0) {
+    Ep->FrameOverruns--;
+    Halt (Channel, DWC2_HCINT_FRMOVRUN);
+    return;
+  }
+
+  if (Ep->Stall) {
+    Halt (Channel, DWC2_HCINT_STALL);
+    return;
+  }
+
+  if (Ep->Naks != 0) {
+    Ep->Naks--;
+    Halt (Channel, DWC2_HCINT_NAK);
+    return;
+  }
+
+  Buffer = NULL;
+  if (Size != 0) {
+    Buffer = HostBusToHost (*Reg (HCDMA (Channel)), Size);
+    if (Buffer == NULL) {
+      Halt (Channel, DWC2_HCINT_AHBERR);
+      return;
+    }
+  }
+
+  if (!In && EpNum == 0 && Pid == DWC2_HC_PID_SETUP) {
+    ASSERT (Size == sizeof (USB_DEVICE_REQUEST));
+    Setup (Device, (USB_DEVICE_REQUEST *) Buffer);
+    Moved = Size;
+    Pid = DWC2_HC_PID_DATA1;
+  } else if (In) {
+    Moved = MIN (Size, Ep->InLength - Ep->InOffset);
+    if (Moved != 0) {
+      CopyMem (Buffer, Ep->InData + Ep->InOffset, Moved);
+      Ep->InOffset += Moved;
+    }
+    Pid = TogglePid (Pid, MAX ((Moved + Mps - 1) / Mps, 1));
+
+    /*
+     * A zero-length IN is the status stage of a control write.
+     */
+    if (EpNum == 0 && Moved == 0 && Device->PendingAddress != 0) {
+      Device->Address = Device->PendingAddress;
+      Device->PendingAddress = 0;
+    }
+  } else {
+    Moved = Size;
+    if (Ep->OutData != NULL) {
+      Moved = MIN (Size, Ep->OutCapacity - Ep->OutLength);
+      CopyMem (Ep->OutData + Ep->OutLength, Buffer, Moved);
+      Ep->OutLength += Moved;
+    }
+    Pid = TogglePid (Pid, MAX (Packets, 1));
+  }
+
+  *Reg (HCTSIZ (Channel)) = (Size - Moved) |
+    (Pid << DWC2_HCTSIZ_PID_OFFSET);
+  Halt (Channel, DWC2_HCINT_XFERCOMP | DWC2_HCINT_ACK);
+}
+
+VOID
+FakeDwc2Init (
+  VOID
+  )
+{
+  ZeroMem (mRegs, sizeof (mRegs));
+  mDeviceCount = 0;
+  mChannelStarts = 0;
+  mSplitFrame = 0;
+  mSplitFrameStarts = 0;
+  mSplitPeakStarts = 0;
+  CoreReset ();
+}
+
+VOID
+FakeDwc2Attach (
+  IN  FAKE_DEVICE *Device
+  )
+{
+  ASSERT (mDeviceCount < FAKE_DWC2_MAX_DEVICES);
+  mDevices[mDeviceCount++] = Device;
+  *Reg (HPRT0) |= DWC2_HPRT0_PRTCONNSTS | DWC2_HPRT0_PRTCONNDET;
+}
+
+VOID
+FakeDwc2ReleaseHung (
+  VOID
+  )
+{
+  UINT32 Channel;
+
+  for (Channel = 0; Channel < FAKE_DWC2_CHANNELS; Channel++) {
+    if (mHung[Channel]) {
+      mHung[Channel] = FALSE;
+      Halt (Channel, 0);
+    }
+  }
+}
+
+UINT64
+FakeDwc2ChannelStarts (
+  VOID
+  )
+{
+  return mChannelStarts;
+}
+
+UINT32
+FakeDwc2PeakPeriodicSplits (
+  VOID
+  )
+{
+  return mSplitPeakStarts;
+}
+
+VOID
+FakeDwc2Advance (
+  VOID
+  )
+{
+  UINT32 Channel;
+  UINT64 Now;
+
+  Now = MicroFrameNow ();
+  for (Channel = 0; Channel < FAKE_DWC2_CHANNELS; Channel++) {
+    if (mPeriodicPending[Channel] && Now >= mPeriodicDue[Channel]) {
+      mPeriodicPending[Channel] = FALSE;
+      StartChannel (Channel);
+    }
+  }
+}
+
+BOOLEAN
+FakeDwc2InterruptLine (
+  VOID
+  )
+{
+  return (*Reg (GAHBCFG) & DWC2_GAHBCFG_GLBLINTRMSK) != 0 &&
+    (*Reg (GINTMSK) & DWC2_GINTMSK_HCINTR) != 0 &&
+    (FakeDwc2Read32 (HAINT) & *Reg (HAINTMSK)) != 0;
+}
+
+UINT32
+FakeDwc2Read32 (
+  IN  UINTN Offset
+  )
+{
+  UINT32 Value;
+  UINT32 Channel;
+
+  switch (Offset) {
+  case GRSTCTL:
+    return *Reg (GRSTCTL) | DWC2_GRSTCTL_AHBIDLE;
+  case HFNUM:
+    return (UINT32) MicroFrameNow () & DWC2_HFNUM_FRNUM_MASK;
+  case HAINT:
+    Value = 0;
+    for (Channel = 0; Channel < FAKE_DWC2_CHANNELS; Channel++) {
+      if ((*Reg (HCINT (Channel)) & *Reg (HCINTMSK (Channel))) != 0) {
+        Value |= 1 << Channel;
+      }
+    }
+    return Value;
+  }
+
+  return *Reg (Offset);
+}
+
+VOID
+FakeDwc2Write32 (
+  IN  UINTN  Offset,
+  IN  UINT32 Value
+  )
+{
+  UINT32 Channel;
+  UINT32 Old;
+  UINT64 Due;
+
+  if (IsChannelReg (Offset, HCINT (0), &Channel)) {
+    *Reg (Offset) &= ~Value;
+    return;
+  }
+
+  if (IsChannelReg (Offset, HCCHAR (0), &Channel)) {
+    Old = *Reg (Offset);
+    if ((Old & DWC2_HCCHAR_CHEN) != 0) {
+      /*
+       * Busy: only a disable request does anything, and then
+       * only if the endpoint isn't hung.
+       */
+      if ((Value & DWC2_HCCHAR_CHDIS) != 0 && !mHung[Channel]) {
+        Halt (Channel, 0);
+      }
+      return;
+    }
+
+    if ((Value & DWC2_HCCHAR_CHEN) == 0) {
+      *Reg (Offset) = Value & ~DWC2_HCCHAR_CHDIS;
+      return;
+    }
+
+    *Reg (Offset) = Value;
+    if ((Value & DWC2_HCCHAR_CHDIS) != 0) {
+      /*
+       * Enabled and disabled at once: halts straight away.
+       */
+      Halt (Channel, 0);
+      return;
+    }
+
+    if (((Value & DWC2_HCCHAR_EPTYPE_MASK) >> DWC2_HCCHAR_EPTYPE_OFFSET) ==
+        DWC2_HCCHAR_EPTYPE_INTR) {
+      Due = MicroFrameNow () + 1;
+      if ((Due & 1) != ((Value & DWC2_HCCHAR_ODDFRM) != 0)) {
+        Due++;
+      }
+      mPeriodicPending[Channel] = TRUE;
+      mPeriodicDue[Channel] = Due;
+      return;
+    }
+
+    StartChannel (Channel);
+    return;
+  }
+
+  switch (Offset) {
+  case GRSTCTL:
+    if ((Value & DWC2_GRSTCTL_CSFTRST) != 0) {
+      CoreReset ();
+    }
+    /*
+     * Resets and FIFO flushes complete instantly.
+     */
+    *Reg (GRSTCTL) = Value & ~(DWC2_GRSTCTL_CSFTRST |
+                               DWC2_GRSTCTL_RXFFLSH |
+                               DWC2_GRSTCTL_TXFFLSH);
+    return;
+  case GINTSTS:
+    *Reg (GINTSTS) &= ~(Value & ~DWC2_GINTSTS_CURMODE_HOST);
+    return;
+  case HFNUM:
+  case HAINT:
+  case GHWCFG2:
+  case GHWCFG3:
+    return;
+  case HPRT0:
+    Old = *Reg (HPRT0);
+    *Reg (HPRT0) &= ~(Value & HPRT0_W1C);
+    if ((Value & DWC2_HPRT0_PRTENA) != 0) {
+      *Reg (HPRT0) &= ~DWC2_HPRT0_PRTENA;
+    }
+    *Reg (HPRT0) = (*Reg (HPRT0) & ~(DWC2_HPRT0_PRTRST | DWC2_HPRT0_PRTPWR)) |
+      (Value & (DWC2_HPRT0_PRTRST | DWC2_HPRT0_PRTPWR));
+
+    /*
+     * Releasing the reset enables the port if something is attached.
+     */
+    if ((Old & DWC2_HPRT0_PRTRST) != 0 &&
+        (Value & DWC2_HPRT0_PRTRST) == 0 &&
+        (Old & DWC2_HPRT0_PRTCONNSTS) != 0) {
+      *Reg (HPRT0) |= DWC2_HPRT0_PRTENA | DWC2_HPRT0_PRTENCHNG;
+    }
+    return;
+  }
+
+  *Reg (Offset) = Value;
+}
@@ -0,0 +1,183 @@
+/** @file
+ *
+ *  Simulated DWC2 host core and the devices behind it.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#ifndef __FAKE_DWC2_H__
+#define __FAKE_DWC2_H__
+
+#include "HostUefi.h"
+
+#define FAKE_DWC2_CHANNELS      8
+#define FAKE_DWC2_MAX_DEVICES   8
+
+/*
+ * What an endpoint does with the next transactions. The error
+ * counters are consumed one per transaction, before any data
+ * moves; Stall and Hang stay in effect until cleared.
+ */
+typedef struct {
+  /*
+   * IN data still to be sent, and OUT data received.
+   */
+  CONST UINT8 *InData;
+  UINT32      InLength;
+  UINT32      InOffset;
+  UINT8       *OutData;
+  UINT32      OutCapacity;
+  UINT32      OutLength;
+
+  UINT32      Naks;
+  UINT32      XactErrors;
+  UINT32      FrameOverruns;
+  BOOLEAN     Stall;
+  /*
+   * Never halts, not even on CHDIS, until FakeDwc2ReleaseHung
+   * or a core reset.
+   */
+  BOOLEAN     Hang;
+  /*
+   * Complete-splits the TT answers with NYET even when the
+   * transaction is done.
+   */
+  UINT32      Nyets;
+
+  UINT32      Transactions;
+  UINT32      StartSplits;
+  UINT32      CompleteSplits;
+  /*
+   * Periodic transactions the TT dropped because no complete-split
+   * came in time.
+   */
+  UINT32      LostSplits;
+
+  BOOLEAN     SplitPending;
+  UINT64      SplitMicroFrame;
+} FAKE_ENDPOINT;
+
+/*
+ * A device, high-speed unless TtHub is set: then it is a full or
+ * low-speed device on port TtPort of the hub at address TtHub,
+ * reached through the hub's TT. Standard GET_DESCRIPTOR and
+ * SET_ADDRESS requests are answered from the fields here, anything
+ * else on endpoint 0 completes without data.
+ */
+typedef struct {
+  UINT8         Address;
+  UINT8         TtHub;
+  UINT8         TtPort;
+  CONST UINT8   *DeviceDescriptor;
+  UINT16        DeviceDescriptorLength;
+  CONST UINT8   *ConfigDescriptor;
+  UINT16        ConfigDescriptorLength;
+
+  UINT8         LastSetup[8];
+  UINT32        Setups;
+  UINT8         PendingAddress;
+
+  FAKE_ENDPOINT In[16];
+  FAKE_ENDPOINT Out[16];
+} FAKE_DEVICE;
+
+VOID
+FakeDwc2Init (
+  VOID
+  );
+
+VOID
+FakeDwc2Attach (
+  IN  FAKE_DEVICE *Device
+  );
+
+/*
+ * Lets channels stuck on a Hang endpoint halt.
+ */
+VOID
+FakeDwc2ReleaseHung (
+  VOID
+  );
+
+/*
+ * Channels started since FakeDwc2Init.
+ */
+UINT64
+FakeDwc2ChannelStarts (
+  VOID
+  );
+
+/*
+ * Most periodic start-splits any TT took in one frame.
+ */
+UINT32
+FakeDwc2PeakPeriodicSplits (
+  VOID
+  );
+
+/*
+ * Runs the periodic channels due by now. The host shim calls
+ * this whenever simulated time moves.
+ */
+VOID
+FakeDwc2Advance (
+  VOID
+  );
+
+/*
+ * Whether the core is asserting its interrupt.
+ */
+BOOLEAN
+FakeDwc2InterruptLine (
+  VOID
+  );
+
+UINT32
+FakeDwc2Read32 (
+  IN  UINTN Offset
+  );
+
+VOID
+FakeDwc2Write32 (
+  IN  UINTN  Offset,
+  IN  UINT32 Value
+  );
+
+/*
+ * From HostShim.c: the host buffer behind a simulated bus address,
+ * or NULL if [BusAddress, BusAddress + Length) is not mapped.
+ */
+VOID *
+HostBusToHost (
+  IN  UINT32 BusAddress,
+  IN  UINT32 Length
+  );
+
+/*
+ * From HostShim.c: whether LocateProtocol finds an interrupt
+ * controller, delivering the USB interrupt. Takes effect for
+ * controllers created afterwards.
+ */
+VOID
+HostUseInterruptController (
+  IN  BOOLEAN Use
+  );
+
+/*
+ * From HostShim.c: DMA mappings currently outstanding.
+ */
+UINTN
+HostDmaMappings (
+  VOID
+  );
+
+#endif /* __FAKE_DWC2_H__ */
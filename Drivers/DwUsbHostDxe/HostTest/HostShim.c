@@ -0,0 +1,1148 @@
+/** @file
+ *
+ *  Host implementations of the boot services and libraries the
+ *  driver uses. Time is simulated: it only moves when the driver
+ *  delays or checks a timer event, so timeouts are deterministic.
+ *  Whenever it moves, and whenever the TPL drops or interrupts are
+ *  enabled again, the simulated timer interrupt fires due timer
+ *  events and notification functions run as the boot services
+ *  would run them. The USB interrupt is delivered the same way
+ *  once HostUseInterruptController has installed the interrupt
+ *  controller.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FakeDwc2.h"
+#include <IndustryStandard/Bcm2836.h>
+
+/*
+ * Simulated time each CheckEvent call takes, so that polling
+ * loops always make progress towards their timeout.
+ */
+#define HOST_CHECK_EVENT_NS     1000
+
+/*
+ * Longest step simulated time takes: one microframe.
+ */
+#define HOST_STEP_NS            125000
+
+/*
+ * Each DMA mapping gets a window of this size in the simulated
+ * 32-bit bus address space, keeping the low bits of the host
+ * address so alignment checks see the real buffer alignment.
+ */
+#define HOST_DMA_BASE           0x10000000
+#define HOST_DMA_WINDOW         0x00200000
+#define HOST_DMA_WINDOWS        64
+
+typedef struct _HOST_EVENT HOST_EVENT;
+
+struct _HOST_EVENT {
+  HOST_EVENT        *Next;
+  UINT32            Type;
+  EFI_TPL           Tpl;
+  EFI_EVENT_NOTIFY  Notify;
+  VOID              *Context;
+  UINT64            Deadline;
+  UINT64            Period;
+  BOOLEAN           Armed;
+  BOOLEAN           Signaled;
+  BOOLEAN           NotifyPending;
+};
+
+typedef struct {
+  BOOLEAN           InUse;
+  UINT8             *Host;
+  UINTN             Length;
+} HOST_DMA_MAPPING;
+
+STATIC UINT64           mNowNs;
+STATIC EFI_TPL          mTpl = TPL_APPLICATION;
+STATIC BOOLEAN          mInterrupts = TRUE;
+STATIC HOST_EVENT       *mEvents;
+STATIC HOST_DMA_MAPPING mMappings[HOST_DMA_WINDOWS];
+
+STATIC BOOLEAN                    mInterruptController;
+STATIC HARDWARE_INTERRUPT_HANDLER mUsbIrqHandler;
+STATIC BOOLEAN                    mUsbIrqEnabled;
+
+EFI_GUID gEfiEventExitBootServicesGuid;
+EFI_GUID gEfiEventReadyToBootGuid;
+EFI_GUID gHardwareInterruptProtocolGuid;
+EFI_GUID gDwUsbHostTraceProtocolGuid;
+EFI_GUID gEfiUsb2HcProtocolGuid;
+
+/*
+ * DebugLib. Only errors and warnings are printed unless
+ * DWHC_HOST_VERBOSE is set in the environment. EDK2 format
+ * strings are mostly printf's: %a is an ASCII string, %r a
+ * status, and an l or L makes an integer 64-bit.
+ */
+VOID
+HostDebugPrint (
+  IN  UINTN       ErrorLevel,
+  IN  CONST CHAR8 *Format,
+  ...
+  )
+{
+  va_list     Args;
+  CHAR8       Spec[32];
+  UINTN       SpecLength;
+  BOOLEAN     Long;
+  CONST CHAR8 *Walk;
+
+  if ((ErrorLevel & (DEBUG_ERROR | DEBUG_WARN)) == 0 &&
+      getenv ("DWHC_HOST_VERBOSE") == NULL) {
+    return;
+  }
+
+  va_start (Args, Format);
+  for (Walk = Format; *Walk != '\0'; Walk++) {
+    if (*Walk != '%') {
+      fputc (*Walk, stderr);
+      continue;
+    }
+
+    SpecLength = 0;
+    Spec[SpecLength++] = '%';
+    Walk++;
+    while (*Walk == '-' || *Walk == '0' || (*Walk >= '1' && *Walk <= '9') ||
+           *Walk == '.') {
+      if (SpecLength < sizeof (Spec) - 4) {
+        Spec[SpecLength++] = *Walk;
+      }
+      Walk++;
+    }
+
+    Long = FALSE;
+    if (*Walk == 'l' || *Walk == 'L') {
+      Long = TRUE;
+      Walk++;
+    }
+
+    switch (*Walk) {
+    case 'a':
+      Spec[SpecLength++] = 's';
+      Spec[SpecLength] = '\0';
+      fprintf (stderr, Spec, va_arg (Args, CHAR8 *));
+      break;
+    case 'r':
+      fprintf (stderr, "Status 0x%llx",
+               (unsigned long long) va_arg (Args, EFI_STATUS));
+      break;
+    case 'p':
+      fprintf (stderr, "%p", va_arg (Args, VOID *));
+      break;
+    case 'c':
+      fputc (va_arg (Args, int), stderr);
+      break;
+    case 'd':
+    case 'u':
+    case 'x':
+    case 'X':
+      if (Long) {
+        Spec[SpecLength++] = 'l';
+        Spec[SpecLength++] = 'l';
+        Spec[SpecLength++] = *Walk;
+        Spec[SpecLength] = '\0';
+        fprintf (stderr, Spec, va_arg (Args, unsigned long long));
+      } else {
+        Spec[SpecLength++] = *Walk;
+        Spec[SpecLength] = '\0';
+        fprintf (stderr, Spec, va_arg (Args, unsigned int));
+      }
+      break;
+    case '%':
+      fputc ('%', stderr);
+      break;
+    default:
+      fputc ('?', stderr);
+      if (*Walk == '\0') {
+        Walk--;
+      }
+      break;
+    }
+  }
+  va_end (Args);
+}
+
+VOID
+HostAssert (
+  IN  CONST CHAR8 *FileName,
+  IN  UINTN       LineNumber,
+  IN  CONST CHAR8 *Description
+  )
+{
+  fprintf (stderr, "ASSERT %s(%u): %s\n", FileName, (unsigned) LineNumber,
+           Description);
+  abort ();
+}
+
+/*
+ * Runs pending notification functions above the current TPL,
+ * highest TPL first.
+ */
+STATIC
+VOID
+HostDispatch (
+  VOID
+  )
+{
+  HOST_EVENT *Event;
+  HOST_EVENT *Next;
+  EFI_TPL    OldTpl;
+
+  for (;;) {
+    Next = NULL;
+    for (Event = mEvents; Event != NULL; Event = Event->Next) {
+      if (Event->NotifyPending && Event->Tpl > mTpl &&
+          (Next == NULL || Event->Tpl > Next->Tpl)) {
+        Next = Event;
+      }
+    }
+
+    if (Next == NULL) {
+      return;
+    }
+
+    Next->NotifyPending = FALSE;
+    OldTpl = mTpl;
+    mTpl = Next->Tpl;
+    Next->Notify (Next, Next->Context);
+    mTpl = OldTpl;
+  }
+}
+
+STATIC
+VOID
+HostSignal (
+  IN  HOST_EVENT *Event
+  )
+{
+  if ((Event->Type & EVT_NOTIFY_SIGNAL) != 0 && Event->Notify != NULL) {
+    Event->NotifyPending = TRUE;
+  } else {
+    Event->Signaled = TRUE;
+  }
+}
+
+/*
+ * The USB interrupt, taken while the line is asserted.
+ */
+STATIC
+VOID
+HostUsbIrq (
+  VOID
+  )
+{
+  EFI_SYSTEM_CONTEXT SystemContext;
+
+  SystemContext.SystemContextAArch64 = NULL;
+  while (mUsbIrqHandler != NULL && mUsbIrqEnabled && mInterrupts &&
+         FakeDwc2InterruptLine ()) {
+    mInterrupts = FALSE;
+    mUsbIrqHandler (BCM2836_USB_IRQ, SystemContext);
+    mInterrupts = TRUE;
+  }
+}
+
+/*
+ * Takes the timer and USB interrupts if they are enabled, and
+ * dispatches what they signaled.
+ */
+STATIC
+VOID
+HostInterrupts (
+  VOID
+  )
+{
+  HOST_EVENT *Event;
+
+  if (!mInterrupts || mTpl >= TPL_HIGH_LEVEL) {
+    return;
+  }
+
+  for (Event = mEvents; Event != NULL; Event = Event->Next) {
+    if ((Event->Type & EVT_NOTIFY_SIGNAL) != 0 && Event->Armed &&
+        mNowNs >= Event->Deadline) {
+      HostSignal (Event);
+      if (Event->Period != 0) {
+        while (Event->Deadline <= mNowNs) {
+          Event->Deadline += Event->Period;
+        }
+      } else {
+        Event->Armed = FALSE;
+      }
+    }
+  }
+
+  HostUsbIrq ();
+  HostDispatch ();
+}
+
+/*
+ * Moves simulated time on, at most a microframe at a time and
+ * stopping at each timer deadline, so a long delay sees the
+ * interrupts it would have seen on hardware.
+ */
+STATIC
+VOID
+HostAdvance (
+  IN  UINT64 Ns
+  )
+{
+  HOST_EVENT *Event;
+  UINT64     Target;
+  UINT64     Next;
+
+  Target = mNowNs + Ns;
+  while (mNowNs < Target) {
+    Next = MIN (Target, mNowNs + HOST_STEP_NS);
+    for (Event = mEvents; Event != NULL; Event = Event->Next) {
+      if (Event->Armed && Event->Deadline > mNowNs && Event->Deadline < Next) {
+        Next = Event->Deadline;
+      }
+    }
+
+    mNowNs = Next;
+    FakeDwc2Advance ();
+    HostInterrupts ();
+  }
+}
+
+/*
+ * Boot services.
+ */
+STATIC
+EFI_TPL
+EFIAPI
+HostRaiseTpl (
+  IN  EFI_TPL NewTpl
+  )
+{
+  EFI_TPL OldTpl;
+
+  OldTpl = mTpl;
+  ASSERT (NewTpl >= OldTpl);
+  if (NewTpl >= TPL_HIGH_LEVEL && OldTpl < TPL_HIGH_LEVEL) {
+    mInterrupts = FALSE;
+  }
+  mTpl = NewTpl;
+  return OldTpl;
+}
+
+STATIC
+VOID
+EFIAPI
+HostRestoreTpl (
+  IN  EFI_TPL OldTpl
+  )
+{
+  ASSERT (OldTpl <= mTpl);
+  HostDispatch ();
+  if (OldTpl < TPL_HIGH_LEVEL && mTpl >= TPL_HIGH_LEVEL) {
+    mInterrupts = TRUE;
+  }
+  mTpl = OldTpl;
+  HostInterrupts ();
+  HostDispatch ();
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction,
+  IN  VOID              *NotifyContext,
+  OUT EFI_EVENT         *Event
+  )
+{
+  HOST_EVENT *HostEvent;
+
+  HostEvent = AllocateZeroPool (sizeof (*HostEvent));
+  if (HostEvent == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  HostEvent->Type = Type;
+  HostEvent->Tpl = NotifyTpl;
+  HostEvent->Notify = NotifyFunction;
+  HostEvent->Context = NotifyContext;
+  HostEvent->Next = mEvents;
+  mEvents = HostEvent;
+  *Event = HostEvent;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostCreateEventEx (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction,
+  IN  CONST VOID        *NotifyContext,
+  IN  CONST EFI_GUID    *EventGroup,
+  OUT EFI_EVENT         *Event
+  )
+{
+  return HostCreateEvent (Type, NotifyTpl, NotifyFunction,
+                          (VOID *) NotifyContext, Event);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostSetTimer (
+  IN  EFI_EVENT       Event,
+  IN  EFI_TIMER_DELAY Type,
+  IN  UINT64          TriggerTime
+  )
+{
+  HOST_EVENT *HostEvent;
+
+  HostEvent = Event;
+  HostEvent->Signaled = FALSE;
+  HostEvent->Armed = (Type != TimerCancel);
+  HostEvent->Deadline = mNowNs + TriggerTime * 100;
+  HostEvent->Period = (Type == TimerPeriodic) ? TriggerTime * 100 : 0;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostCheckEvent (
+  IN  EFI_EVENT Event
+  )
+{
+  HOST_EVENT *HostEvent;
+
+  HostEvent = Event;
+  HostAdvance (HOST_CHECK_EVENT_NS);
+
+  if (HostEvent->Armed && mNowNs >= HostEvent->Deadline) {
+    HostEvent->Armed = FALSE;
+    HostEvent->Signaled = TRUE;
+  }
+
+  if (HostEvent->Signaled) {
+    HostEvent->Signaled = FALSE;
+    return EFI_SUCCESS;
+  }
+
+  return EFI_NOT_READY;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostSignalEvent (
+  IN  EFI_EVENT Event
+  )
+{
+  HostSignal (Event);
+  HostDispatch ();
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostCloseEvent (
+  IN  EFI_EVENT Event
+  )
+{
+  HOST_EVENT **Link;
+
+  for (Link = &mEvents; *Link != NULL; Link = &(*Link)->Next) {
+    if (*Link == Event) {
+      *Link = (*Link)->Next;
+      break;
+    }
+  }
+
+  free (Event);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostAllocatePoolService (
+  IN  EFI_MEMORY_TYPE PoolType,
+  IN  UINTN           Size,
+  OUT VOID            **Buffer
+  )
+{
+  *Buffer = AllocatePool (Size);
+  return *Buffer == NULL ? EFI_OUT_OF_RESOURCES : EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostFreePoolService (
+  IN  VOID *Buffer
+  )
+{
+  FreePool (Buffer);
+  return EFI_SUCCESS;
+}
+
+/*
+ * The interrupt controller, with only the USB interrupt wired up.
+ */
+STATIC
+EFI_STATUS
+EFIAPI
+HostRegisterInterruptSource (
+  IN  EFI_HARDWARE_INTERRUPT_PROTOCOL *This,
+  IN  HARDWARE_INTERRUPT_SOURCE       Source,
+  IN  HARDWARE_INTERRUPT_HANDLER      Handler
+  )
+{
+  ASSERT (Source == BCM2836_USB_IRQ);
+  mUsbIrqHandler = Handler;
+  mUsbIrqEnabled = (Handler != NULL);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostEnableInterruptSource (
+  IN  EFI_HARDWARE_INTERRUPT_PROTOCOL *This,
+  IN  HARDWARE_INTERRUPT_SOURCE       Source
+  )
+{
+  ASSERT (Source == BCM2836_USB_IRQ);
+  mUsbIrqEnabled = TRUE;
+  HostInterrupts ();
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostDisableInterruptSource (
+  IN  EFI_HARDWARE_INTERRUPT_PROTOCOL *This,
+  IN  HARDWARE_INTERRUPT_SOURCE       Source
+  )
+{
+  ASSERT (Source == BCM2836_USB_IRQ);
+  mUsbIrqEnabled = FALSE;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostGetInterruptSourceState (
+  IN  EFI_HARDWARE_INTERRUPT_PROTOCOL *This,
+  IN  HARDWARE_INTERRUPT_SOURCE       Source,
+  IN  BOOLEAN                         *InterruptState
+  )
+{
+  ASSERT (Source == BCM2836_USB_IRQ);
+  *InterruptState = mUsbIrqEnabled;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostEndOfInterrupt (
+  IN  EFI_HARDWARE_INTERRUPT_PROTOCOL *This,
+  IN  HARDWARE_INTERRUPT_SOURCE       Source
+  )
+{
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_HARDWARE_INTERRUPT_PROTOCOL mHardwareInterrupt = {
+  HostRegisterInterruptSource,
+  HostEnableInterruptSource,
+  HostDisableInterruptSource,
+  HostGetInterruptSourceState,
+  HostEndOfInterrupt
+};
+
+VOID
+HostUseInterruptController (
+  IN  BOOLEAN Use
+  )
+{
+  mInterruptController = Use;
+}
+
+/*
+ * Only the interrupt controller can be found, and only once
+ * HostUseInterruptController has put it in. Without it, the
+ * driver polls for channel halts.
+ */
+STATIC
+EFI_STATUS
+EFIAPI
+HostLocateProtocol (
+  IN  EFI_GUID *Protocol,
+  IN  VOID     *Registration OPTIONAL,
+  OUT VOID     **Interface
+  )
+{
+  if (mInterruptController && Protocol == &gHardwareInterruptProtocolGuid) {
+    *Interface = &mHardwareInterrupt;
+    return EFI_SUCCESS;
+  }
+
+  *Interface = NULL;
+  return EFI_NOT_FOUND;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostStall (
+  IN  UINTN Microseconds
+  )
+{
+  MicroSecondDelay (Microseconds);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_BOOT_SERVICES mBootServices = {
+  HostRaiseTpl,
+  HostRestoreTpl,
+  HostCreateEvent,
+  HostCreateEventEx,
+  HostSetTimer,
+  HostCheckEvent,
+  HostSignalEvent,
+  HostCloseEvent,
+  HostAllocatePoolService,
+  HostFreePoolService,
+  HostLocateProtocol,
+  HostStall
+};
+
+EFI_BOOT_SERVICES *gBS = &mBootServices;
+
+/*
+ * BaseLib.
+ */
+LIST_ENTRY *
+InitializeListHead (
+  IN OUT LIST_ENTRY *ListHead
+  )
+{
+  ListHead->ForwardLink = ListHead;
+  ListHead->BackLink = ListHead;
+  return ListHead;
+}
+
+LIST_ENTRY *
+InsertTailList (
+  IN OUT LIST_ENTRY *ListHead,
+  IN OUT LIST_ENTRY *Entry
+  )
+{
+  Entry->ForwardLink = ListHead;
+  Entry->BackLink = ListHead->BackLink;
+  Entry->BackLink->ForwardLink = Entry;
+  ListHead->BackLink = Entry;
+  return ListHead;
+}
+
+LIST_ENTRY *
+InsertHeadList (
+  IN OUT LIST_ENTRY *ListHead,
+  IN OUT LIST_ENTRY *Entry
+  )
+{
+  Entry->ForwardLink = ListHead->ForwardLink;
+  Entry->BackLink = ListHead;
+  Entry->ForwardLink->BackLink = Entry;
+  ListHead->ForwardLink = Entry;
+  return ListHead;
+}
+
+LIST_ENTRY *
+RemoveEntryList (
+  IN CONST LIST_ENTRY *Entry
+  )
+{
+  Entry->ForwardLink->BackLink = Entry->BackLink;
+  Entry->BackLink->ForwardLink = Entry->ForwardLink;
+  return Entry->ForwardLink;
+}
+
+BOOLEAN
+IsListEmpty (
+  IN CONST LIST_ENTRY *ListHead
+  )
+{
+  return ListHead->ForwardLink == ListHead;
+}
+
+LIST_ENTRY *
+GetFirstNode (
+  IN CONST LIST_ENTRY *List
+  )
+{
+  return List->ForwardLink;
+}
+
+LIST_ENTRY *
+GetNextNode (
+  IN CONST LIST_ENTRY *List,
+  IN CONST LIST_ENTRY *Node
+  )
+{
+  return Node->ForwardLink;
+}
+
+LIST_ENTRY *
+GetPreviousNode (
+  IN CONST LIST_ENTRY *List,
+  IN CONST LIST_ENTRY *Node
+  )
+{
+  return Node->BackLink;
+}
+
+BOOLEAN
+IsNull (
+  IN CONST LIST_ENTRY *List,
+  IN CONST LIST_ENTRY *Node
+  )
+{
+  return List == Node;
+}
+
+INTN
+LowBitSet32 (
+  IN UINT32 Operand
+  )
+{
+  return Operand == 0 ? -1 : __builtin_ctz (Operand);
+}
+
+INTN
+HighBitSet32 (
+  IN UINT32 Operand
+  )
+{
+  return Operand == 0 ? -1 : 31 - __builtin_clz (Operand);
+}
+
+UINT64
+DivU64x32 (
+  IN UINT64 Dividend,
+  IN UINT32 Divisor
+  )
+{
+  return Dividend / Divisor;
+}
+
+UINT64
+MultU64x32 (
+  IN UINT64 Multiplicand,
+  IN UINT32 Multiplier
+  )
+{
+  return Multiplicand * Multiplier;
+}
+
+BOOLEAN
+SaveAndDisableInterrupts (
+  VOID
+  )
+{
+  BOOLEAN State;
+
+  State = mInterrupts;
+  mInterrupts = FALSE;
+  return State;
+}
+
+BOOLEAN
+SetInterruptState (
+  IN BOOLEAN InterruptState
+  )
+{
+  mInterrupts = InterruptState;
+  HostInterrupts ();
+  return InterruptState;
+}
+
+VOID
+CpuSleep (
+  VOID
+  )
+{
+}
+
+VOID
+CpuPause (
+  VOID
+  )
+{
+}
+
+/*
+ * MemoryAllocationLib.
+ */
+VOID *
+AllocatePool (
+  IN UINTN AllocationSize
+  )
+{
+  return malloc (AllocationSize);
+}
+
+VOID *
+AllocateZeroPool (
+  IN UINTN AllocationSize
+  )
+{
+  return calloc (1, AllocationSize);
+}
+
+VOID *
+AllocateCopyPool (
+  IN UINTN       AllocationSize,
+  IN CONST VOID  *Buffer
+  )
+{
+  VOID *Copy;
+
+  Copy = malloc (AllocationSize);
+  if (Copy != NULL) {
+    CopyMem (Copy, Buffer, AllocationSize);
+  }
+  return Copy;
+}
+
+VOID *
+AllocatePages (
+  IN UINTN Pages
+  )
+{
+  VOID *Buffer;
+
+  if (posix_memalign (&Buffer, EFI_PAGE_SIZE, EFI_PAGES_TO_SIZE (Pages)) != 0) {
+    return NULL;
+  }
+  return Buffer;
+}
+
+VOID
+FreePages (
+  IN VOID  *Buffer,
+  IN UINTN Pages
+  )
+{
+  free (Buffer);
+}
+
+VOID
+FreePool (
+  IN VOID *Buffer
+  )
+{
+  free (Buffer);
+}
+
+/*
+ * IoLib. The driver only accesses the DWC2 core.
+ */
+STATIC
+UINTN
+DwHcOffset (
+  IN  UINTN Address
+  )
+{
+  ASSERT (Address >= BCM2836_USB_DW2_BASE_ADDRESS);
+  return Address - BCM2836_USB_DW2_BASE_ADDRESS;
+}
+
+UINT32
+MmioRead32 (
+  IN UINTN Address
+  )
+{
+  return FakeDwc2Read32 (DwHcOffset (Address));
+}
+
+UINT32
+MmioWrite32 (
+  IN UINTN  Address,
+  IN UINT32 Value
+  )
+{
+  FakeDwc2Write32 (DwHcOffset (Address), Value);
+  HostInterrupts ();
+  return Value;
+}
+
+UINT32
+MmioOr32 (
+  IN UINTN  Address,
+  IN UINT32 OrData
+  )
+{
+  return MmioWrite32 (Address, MmioRead32 (Address) | OrData);
+}
+
+UINT32
+MmioAnd32 (
+  IN UINTN  Address,
+  IN UINT32 AndData
+  )
+{
+  return MmioWrite32 (Address, MmioRead32 (Address) & AndData);
+}
+
+UINT32
+MmioAndThenOr32 (
+  IN UINTN  Address,
+  IN UINT32 AndData,
+  IN UINT32 OrData
+  )
+{
+  return MmioWrite32 (Address, (MmioRead32 (Address) & AndData) | OrData);
+}
+
+/*
+ * TimerLib.
+ */
+UINTN
+MicroSecondDelay (
+  IN UINTN MicroSeconds
+  )
+{
+  HostAdvance ((UINT64) MicroSeconds * 1000);
+  return MicroSeconds;
+}
+
+UINTN
+NanoSecondDelay (
+  IN UINTN NanoSeconds
+  )
+{
+  HostAdvance (NanoSeconds);
+  return NanoSeconds;
+}
+
+UINT64
+GetPerformanceCounter (
+  VOID
+  )
+{
+  return mNowNs;
+}
+
+UINT64
+GetPerformanceCounterProperties (
+  OUT UINT64 *StartValue OPTIONAL,
+  OUT UINT64 *EndValue OPTIONAL
+  )
+{
+  if (StartValue != NULL) {
+    *StartValue = 0;
+  }
+  if (EndValue != NULL) {
+    *EndValue = MAX_UINT64;
+  }
+  return 1000000000;
+}
+
+UINT64
+GetTimeInNanoSecond (
+  IN UINT64 Ticks
+  )
+{
+  return Ticks;
+}
+
+/*
+ * DmaLib.
+ */
+EFI_STATUS
+DmaMap (
+  IN     DMA_MAP_OPERATION Operation,
+  IN     VOID              *HostAddress,
+  IN OUT UINTN             *NumberOfBytes,
+  OUT    PHYSICAL_ADDRESS  *DeviceAddress,
+  OUT    VOID              **Mapping
+  )
+{
+  UINTN Index;
+  UINTN Offset;
+
+  Offset = (UINTN) HostAddress & EFI_PAGE_MASK;
+  if (Offset + *NumberOfBytes > HOST_DMA_WINDOW) {
+    return EFI_UNSUPPORTED;
+  }
+
+  for (Index = 0; Index < HOST_DMA_WINDOWS; Index++) {
+    if (!mMappings[Index].InUse) {
+      mMappings[Index].InUse = TRUE;
+      mMappings[Index].Host = (UINT8 *) HostAddress - Offset;
+      mMappings[Index].Length = Offset + *NumberOfBytes;
+      *DeviceAddress = HOST_DMA_BASE + Index * HOST_DMA_WINDOW + Offset;
+      *Mapping = &mMappings[Index];
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_OUT_OF_RESOURCES;
+}
+
+EFI_STATUS
+DmaUnmap (
+  IN  VOID *Mapping
+  )
+{
+  HOST_DMA_MAPPING *HostMapping;
+
+  HostMapping = Mapping;
+  ASSERT (HostMapping->InUse);
+  HostMapping->InUse = FALSE;
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+DmaAllocateBuffer (
+  IN  EFI_MEMORY_TYPE MemoryType,
+  IN  UINTN           Pages,
+  OUT VOID            **HostAddress
+  )
+{
+  *HostAddress = AllocatePages (Pages);
+  return *HostAddress == NULL ? EFI_OUT_OF_RESOURCES : EFI_SUCCESS;
+}
+
+EFI_STATUS
+DmaFreeBuffer (
+  IN  UINTN Pages,
+  IN  VOID  *HostAddress
+  )
+{
+  FreePages (HostAddress, Pages);
+  return EFI_SUCCESS;
+}
+
+VOID *
+HostBusToHost (
+  IN  UINT32 BusAddress,
+  IN  UINT32 Length
+  )
+{
+  UINTN            Index;
+  UINTN            Offset;
+  HOST_DMA_MAPPING *HostMapping;
+
+  if (BusAddress < HOST_DMA_BASE) {
+    return NULL;
+  }
+
+  Index = (BusAddress - HOST_DMA_BASE) / HOST_DMA_WINDOW;
+  Offset = (BusAddress - HOST_DMA_BASE) % HOST_DMA_WINDOW;
+  if (Index >= HOST_DMA_WINDOWS) {
+    return NULL;
+  }
+
+  HostMapping = &mMappings[Index];
+  if (!HostMapping->InUse || Offset + Length > HostMapping->Length) {
+    return NULL;
+  }
+
+  return HostMapping->Host + Offset;
+}
+
+UINTN
+HostDmaMappings (
+  VOID
+  )
+{
+  UINTN Index;
+  UINTN Count;
+
+  Count = 0;
+  for (Index = 0; Index < HOST_DMA_WINDOWS; Index++) {
+    if (mMappings[Index].InUse) {
+      Count++;
+    }
+  }
+
+  return Count;
+}
+
+/*
+ * ArmLib.
+ */
+VOID
+ArmDataSynchronizationBarrier (
+  VOID
+  )
+{
+  __sync_synchronize ();
+}
+
+VOID
+ArmDataMemoryBarrier (
+  VOID
+  )
+{
+  __sync_synchronize ();
+}
+
+UINTN
+ArmDataCacheLineLength (
+  VOID
+  )
+{
+  return 64;
+}
+
+BOOLEAN
+ArmGetInterruptState (
+  VOID
+  )
+{
+  return mInterrupts;
+}
+
+VOID
+ArmEnableInterrupts (
+  VOID
+  )
+{
+  mInterrupts = TRUE;
+  HostInterrupts ();
+}
+
+VOID
+ArmDisableInterrupts (
+  VOID
+  )
+{
+  mInterrupts = FALSE;
+}
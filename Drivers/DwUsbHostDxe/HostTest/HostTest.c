@@ -0,0 +1,1204 @@
+/** @file
+ *
+ *  Runs the driver through EFI_USB2_HC_PROTOCOL against FakeDwc2:
+ *  enumeration and the descriptor cache, bulk and interrupt
+ *  transfers, transfers larger than the bounce buffer, injected
+ *  STALL/NAK/XACTERR/FRMOVRUN, a channel that never halts, async
+ *  interrupt polling off the periodic timer, split transactions
+ *  through a hub's TT and its periodic budget, a bulk throughput
+ *  benchmark measuring host CPU time per transfer, and replaying the
+ *  transfer trace of a mixed workload. The tests run twice, polling
+ *  for channel halts and then taking the USB interrupt.
+ *
+ *  "DwUsbHostTest --replay LOG" instead replays the transfer trace
+ *  in a diagnostics log saved on the target, in both modes, printing
+ *  what came out differently.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "DwUsbHostDxe.h"
+#include "DwcHw.h"
+#include "FakeDwc2.h"
+#include "TraceReplay.h"
+
+#define STORAGE_ADDRESS     1
+#define HID_ADDRESS         2
+#define HUB_ADDRESS         3
+#define NEW_ADDRESS         4
+#define FS_ADDRESS          5
+#define LS_ADDRESS          6
+
+#define TT_PORT_FS          1
+#define TT_PORT_LS          2
+
+#define BULK_IN_EP          1
+#define BULK_OUT_EP         2
+#define BULK_MPS            512
+#define INTR_IN_EP          1
+#define INTR_MPS            8
+#define LS_INTR_EPS         10
+#define FS_INTR_EP          3
+#define FS_BULK_MPS         64
+
+#define TIMEOUT_MS          100
+#define DISK_LENGTH         (256 * 1024)
+#define BENCH_LENGTH        (64 * 1024)
+#define BENCH_TRANSFERS     2000
+#define REPLAY_TRANSFERS    9
+
+#define CHECK(Expression)                                               \
+  do {                                                                  \
+    if (!(Expression)) {                                                \
+      fprintf (stderr, "%s:%u: %s: check failed: %s\n", __FILE__,      \
+               __LINE__, __func__, #Expression);                        \
+      mFailures++;                                                      \
+    }                                                                   \
+  } while (FALSE)
+
+STATIC UINTN                mFailures;
+STATIC DWUSB_OTGHC_DEV      *mDwHc;
+STATIC EFI_USB2_HC_PROTOCOL *mHc;
+
+STATIC CONST UINT8 mDeviceDescriptor[18] = {
+  18, USB_DESC_TYPE_DEVICE, 0x00, 0x02, 0, 0, 0, 64,
+  0x34, 0x12, 0x78, 0x56, 0x00, 0x01, 1, 2, 3, 1
+};
+
+/*
+ * One interface with a bulk IN and a bulk OUT endpoint.
+ */
+STATIC CONST UINT8 mConfigDescriptor[32] = {
+  9, USB_DESC_TYPE_CONFIG, 32, 0, 1, 1, 0, 0x80, 50,
+  9, USB_DESC_TYPE_INTERFACE, 0, 0, 2, 0x08, 0x06, 0x50, 0,
+  7, USB_DESC_TYPE_ENDPOINT, 0x80 | BULK_IN_EP, 0x02, 0x00, 0x02, 0,
+  7, USB_DESC_TYPE_ENDPOINT, BULK_OUT_EP, 0x02, 0x00, 0x02, 0
+};
+
+STATIC FAKE_DEVICE mStorage;
+STATIC FAKE_DEVICE mHid;
+STATIC FAKE_DEVICE mHub;
+STATIC FAKE_DEVICE mNewDevice;
+STATIC FAKE_DEVICE mFsDevice;
+STATIC FAKE_DEVICE mLsDevice;
+
+STATIC EFI_USB2_HC_TRANSACTION_TRANSLATOR mFsTranslator = {
+  HUB_ADDRESS, TT_PORT_FS
+};
+
+STATIC EFI_USB2_HC_TRANSACTION_TRANSLATOR mLsTranslator = {
+  HUB_ADDRESS, TT_PORT_LS
+};
+
+/*
+ * What an async interrupt transfer's callbacks saw. Each callback
+ * has the endpoint queue its report again.
+ */
+typedef struct {
+  FAKE_ENDPOINT *Ep;
+  UINTN         Callbacks;
+  UINTN         Errors;
+  UINTN         Length;
+  UINT8         Data[INTR_MPS];
+} ASYNC_STATE;
+
+STATIC UINT8 mDiskData[DISK_LENGTH];
+STATIC UINT8 mOutData[BENCH_LENGTH];
+STATIC UINT8 mHidReport[INTR_MPS] = { 0, 0, 0x04, 0, 0, 0, 0, 0 };
+
+STATIC
+VOID
+Setup (
+  VOID
+  )
+{
+  UINTN      Index;
+  EFI_STATUS Status;
+
+  for (Index = 0; Index < sizeof (mDiskData); Index++) {
+    mDiskData[Index] = (UINT8) (Index * 7 + (Index >> 9));
+  }
+
+  ZeroMem (&mStorage, sizeof (mStorage));
+  mStorage.Address = STORAGE_ADDRESS;
+  mStorage.DeviceDescriptor = mDeviceDescriptor;
+  mStorage.DeviceDescriptorLength = sizeof (mDeviceDescriptor);
+  mStorage.ConfigDescriptor = mConfigDescriptor;
+  mStorage.ConfigDescriptorLength = sizeof (mConfigDescriptor);
+  mStorage.Out[BULK_OUT_EP].OutData = mOutData;
+  mStorage.Out[BULK_OUT_EP].OutCapacity = sizeof (mOutData);
+
+  ZeroMem (&mHid, sizeof (mHid));
+  mHid.Address = HID_ADDRESS;
+  mHid.DeviceDescriptor = mDeviceDescriptor;
+  mHid.DeviceDescriptorLength = sizeof (mDeviceDescriptor);
+
+  ZeroMem (&mHub, sizeof (mHub));
+  mHub.Address = HUB_ADDRESS;
+
+  ZeroMem (&mNewDevice, sizeof (mNewDevice));
+  mNewDevice.Address = 0;
+  mNewDevice.DeviceDescriptor = mDeviceDescriptor;
+  mNewDevice.DeviceDescriptorLength = sizeof (mDeviceDescriptor);
+
+  ZeroMem (&mFsDevice, sizeof (mFsDevice));
+  mFsDevice.Address = FS_ADDRESS;
+  mFsDevice.TtHub = HUB_ADDRESS;
+  mFsDevice.TtPort = TT_PORT_FS;
+  mFsDevice.DeviceDescriptor = mDeviceDescriptor;
+  mFsDevice.DeviceDescriptorLength = sizeof (mDeviceDescriptor);
+  mFsDevice.Out[BULK_OUT_EP].OutData = mOutData;
+  mFsDevice.Out[BULK_OUT_EP].OutCapacity = sizeof (mOutData);
+
+  ZeroMem (&mLsDevice, sizeof (mLsDevice));
+  mLsDevice.Address = LS_ADDRESS;
+  mLsDevice.TtHub = HUB_ADDRESS;
+  mLsDevice.TtPort = TT_PORT_LS;
+
+  FakeDwc2Init ();
+  FakeDwc2Attach (&mStorage);
+  FakeDwc2Attach (&mHid);
+  FakeDwc2Attach (&mHub);
+  FakeDwc2Attach (&mNewDevice);
+  FakeDwc2Attach (&mFsDevice);
+  FakeDwc2Attach (&mLsDevice);
+
+  Status = CreateDwUsbHc (&mDwHc);
+  if (EFI_ERROR (Status)) {
+    fprintf (stderr, "CreateDwUsbHc: 0x%llx\n", (unsigned long long) Status);
+    exit (1);
+  }
+
+  mHc = &mDwHc->DwUsbOtgHc;
+}
+
+STATIC
+EFI_STATUS
+Control (
+  IN      UINT8                   Address,
+  IN      UINT8                   RequestType,
+  IN      UINT8                   Request,
+  IN      UINT16                  Value,
+  IN      UINT16                  Index,
+  IN      EFI_USB_DATA_DIRECTION  Direction,
+  IN OUT  VOID                    *Data,
+  IN OUT  UINTN                   *Length,
+  OUT     UINT32                  *Result
+  )
+{
+  EFI_USB_DEVICE_REQUEST  DevReq;
+  UINTN                   NoLength;
+
+  DevReq.RequestType = RequestType;
+  DevReq.Request = Request;
+  DevReq.Value = Value;
+  DevReq.Index = Index;
+  DevReq.Length = (Length != NULL) ? (UINT16) *Length : 0;
+
+  NoLength = 0;
+  return mHc->ControlTransfer (mHc, Address, EFI_USB_SPEED_HIGH, 64, &DevReq,
+                               Direction, Data,
+                               (Length != NULL) ? Length : &NoLength,
+                               TIMEOUT_MS, NULL, Result);
+}
+
+STATIC
+VOID
+Teardown (
+  VOID
+  )
+{
+  DestroyDwUsbHc (mDwHc);
+  mDwHc = NULL;
+  mHc = NULL;
+}
+
+STATIC
+EFI_STATUS
+GetDescriptor (
+  IN      UINT8   Address,
+  IN      UINT8   Type,
+  OUT     VOID    *Data,
+  IN OUT  UINTN   *Length,
+  OUT     UINT32  *Result
+  )
+{
+  return Control (Address, USB_DEV_GET_DESCRIPTOR_REQ_TYPE,
+                  USB_REQ_GET_DESCRIPTOR, Type << 8, 0, EfiUsbDataIn,
+                  Data, Length, Result);
+}
+
+STATIC
+EFI_STATUS
+Bulk (
+  IN      UINT8   EndPointAddress,
+  IN OUT  VOID    *Data,
+  IN OUT  UINTN   *Length,
+  IN OUT  UINT8   *Toggle,
+  OUT     UINT32  *Result
+  )
+{
+  VOID *Buffers[EFI_USB_MAX_BULK_BUFFER_NUM];
+
+  ZeroMem (Buffers, sizeof (Buffers));
+  Buffers[0] = Data;
+  return mHc->BulkTransfer (mHc, STORAGE_ADDRESS, EndPointAddress,
+                            EFI_USB_SPEED_HIGH, BULK_MPS, 1, Buffers,
+                            Length, Toggle, TIMEOUT_MS, NULL, Result);
+}
+
+/*
+ * DMA mappings held by transfers, leaving out the channel bounce
+ * buffers that stay mapped once allocated.
+ */
+STATIC
+UINTN
+TransferMappings (
+  VOID
+  )
+{
+  UINTN Index;
+  UINTN Mappings;
+
+  Mappings = HostDmaMappings ();
+  for (Index = 0; Index < MAX_CHANNEL; Index++) {
+    if (mDwHc->Channels[Index].AlignedBuffer != NULL) {
+      Mappings--;
+    }
+  }
+
+  return Mappings;
+}
+
+STATIC
+VOID
+ResetBulkIn (
+  VOID
+  )
+{
+  FAKE_ENDPOINT *Ep;
+
+  Ep = &mStorage.In[BULK_IN_EP];
+  Ep->InData = mDiskData;
+  Ep->InLength = sizeof (mDiskData);
+  Ep->InOffset = 0;
+}
+
+STATIC
+VOID
+TestReset (
+  VOID
+  )
+{
+  EFI_USB_PORT_STATUS PortStatus;
+
+  CHECK (mHc->Reset (mHc, EFI_USB_HC_RESET_GLOBAL) == EFI_SUCCESS);
+  CHECK (mDwHc->NumChannels == FAKE_DWC2_CHANNELS);
+  CHECK (mDwHc->ChannelsInUse == 0);
+
+  MicroSecondDelay (100 * 1000);
+  CHECK (mHc->GetRootHubPortStatus (mHc, 0, &PortStatus) == EFI_SUCCESS);
+  CHECK ((PortStatus.PortStatus & USB_PORT_STAT_CONNECTION) != 0);
+}
+
+STATIC
+VOID
+TestEnumerate (
+  VOID
+  )
+{
+  UINT8      Buffer[64];
+  UINTN      Length;
+  UINT32     Result;
+  EFI_STATUS Status;
+
+  Length = 8;
+  Status = GetDescriptor (0, USB_DESC_TYPE_DEVICE, Buffer, &Length, &Result);
+  CHECK (Status == EFI_SUCCESS && Result == EFI_USB_NOERROR);
+  CHECK (Length == 8 && CompareMem (Buffer, mDeviceDescriptor, 8) == 0);
+
+  Status = Control (0, USB_DEV_SET_ADDRESS_REQ_TYPE, USB_REQ_SET_ADDRESS,
+                    NEW_ADDRESS, 0, EfiUsbNoData, NULL, NULL, &Result);
+  CHECK (Status == EFI_SUCCESS && Result == EFI_USB_NOERROR);
+  CHECK (mNewDevice.Address == NEW_ADDRESS);
+
+  Length = sizeof (mDeviceDescriptor);
+  Status = GetDescriptor (NEW_ADDRESS, USB_DESC_TYPE_DEVICE, Buffer, &Length,
+                          &Result);
+  CHECK (Status == EFI_SUCCESS && Result == EFI_USB_NOERROR);
+  CHECK (Length == sizeof (mDeviceDescriptor) &&
+         CompareMem (Buffer, mDeviceDescriptor, Length) == 0);
+}
+
+/*
+ * A configuration read twice only reaches the device once, until
+ * a hub port reset drops the cache.
+ */
+STATIC
+VOID
+TestDescCache (
+  VOID
+  )
+{
+  UINT8      Buffer[64];
+  UINTN      Length;
+  UINT32     Result;
+  UINT32     Setups;
+  EFI_STATUS Status;
+
+  Length = sizeof (mConfigDescriptor);
+  Status = GetDescriptor (STORAGE_ADDRESS, USB_DESC_TYPE_CONFIG, Buffer,
+                          &Length, &Result);
+  CHECK (Status == EFI_SUCCESS && Length == sizeof (mConfigDescriptor));
+  Setups = mStorage.Setups;
+
+  ZeroMem (Buffer, sizeof (Buffer));
+  Length = sizeof (mConfigDescriptor);
+  Status = GetDescriptor (STORAGE_ADDRESS, USB_DESC_TYPE_CONFIG, Buffer,
+                          &Length, &Result);
+  CHECK (Status == EFI_SUCCESS && Result == EFI_USB_NOERROR);
+  CHECK (mStorage.Setups == Setups);
+  CHECK (Length == sizeof (mConfigDescriptor) &&
+         CompareMem (Buffer, mConfigDescriptor, Length) == 0);
+
+  Status = Control (HUB_ADDRESS, USB_HUB_PORT_REQ_TYPE, USB_REQ_SET_FEATURE,
+                    USB_HUB_PORT_RESET, 1, EfiUsbNoData, NULL, NULL, &Result);
+  CHECK (Status == EFI_SUCCESS);
+
+  Length = sizeof (mConfigDescriptor);
+  Status = GetDescriptor (STORAGE_ADDRESS, USB_DESC_TYPE_CONFIG, Buffer,
+                          &Length, &Result);
+  CHECK (Status == EFI_SUCCESS);
+  CHECK (mStorage.Setups == Setups + 1);
+}
+
+STATIC
+VOID
+TestBulk (
+  VOID
+  )
+{
+  UINT8      *Buffer;
+  UINTN      Length;
+  UINT8      Toggle;
+  UINT32     Result;
+  EFI_STATUS Status;
+
+  Buffer = AllocatePages (EFI_SIZE_TO_PAGES (BENCH_LENGTH + EFI_PAGE_SIZE));
+
+  /*
+   * Aligned, so the channel DMAs straight into the buffer.
+   */
+  ResetBulkIn ();
+  Toggle = 0;
+  Length = BENCH_LENGTH;
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_SUCCESS && Result == EFI_USB_NOERROR);
+  CHECK (Length == BENCH_LENGTH &&
+         CompareMem (Buffer, mDiskData, BENCH_LENGTH) == 0);
+  CHECK (Toggle == 0);
+
+  /*
+   * Misaligned, through the bounce buffer, and short.
+   */
+  ResetBulkIn ();
+  mStorage.In[BULK_IN_EP].InLength = 1000;
+  Length = 4096;
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer + 1, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_SUCCESS && Result == EFI_USB_NOERROR);
+  CHECK (Length == 1000 && CompareMem (Buffer + 1, mDiskData, 1000) == 0);
+  CHECK (Toggle == 0);
+
+  /*
+   * A 31-byte command block.
+   */
+  SetMem (Buffer, 31, 0x55);
+  Length = 31;
+  Toggle = 0;
+  mStorage.Out[BULK_OUT_EP].OutLength = 0;
+  Status = Bulk (BULK_OUT_EP, Buffer, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_SUCCESS && Length == 31);
+  CHECK (mStorage.Out[BULK_OUT_EP].OutLength == 31 &&
+         CompareMem (mOutData, Buffer, 31) == 0);
+  CHECK (Toggle == 1);
+
+  CHECK (mDwHc->ChannelsInUse == 0);
+  CHECK (TransferMappings () == 0);
+  FreePages (Buffer, EFI_SIZE_TO_PAGES (BENCH_LENGTH + EFI_PAGE_SIZE));
+}
+
+/*
+ * Straight into the caller's buffer, one channel start moves as
+ * much as HCTSIZ can count. Through the bounce buffer, it takes
+ * one start per bounce buffer full.
+ */
+STATIC
+VOID
+TestLargeBulk (
+  VOID
+  )
+{
+  UINT8      *Buffer;
+  UINTN      Length;
+  UINT8      Toggle;
+  UINT32     Result;
+  UINT64     Starts;
+  EFI_STATUS Status;
+
+  Buffer = AllocatePages (EFI_SIZE_TO_PAGES (DISK_LENGTH + EFI_PAGE_SIZE));
+  CHECK (mDwHc->MaxTransferSize == (512 * 1024) - 1);
+  CHECK (mDwHc->MaxPacketCount == 1023);
+
+  ResetBulkIn ();
+  Toggle = 0;
+  Length = DISK_LENGTH;
+  Starts = FakeDwc2ChannelStarts ();
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_SUCCESS && Result == EFI_USB_NOERROR);
+  CHECK (Length == DISK_LENGTH &&
+         CompareMem (Buffer, mDiskData, DISK_LENGTH) == 0);
+  CHECK (FakeDwc2ChannelStarts () - Starts == 1);
+
+  ResetBulkIn ();
+  ZeroMem (Buffer, DISK_LENGTH + 1);
+  Length = DISK_LENGTH;
+  Starts = FakeDwc2ChannelStarts ();
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer + 1, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_SUCCESS && Result == EFI_USB_NOERROR);
+  CHECK (Length == DISK_LENGTH &&
+         CompareMem (Buffer + 1, mDiskData, DISK_LENGTH) == 0);
+  CHECK (FakeDwc2ChannelStarts () - Starts == DISK_LENGTH / DWC2_DATA_BUF_SIZE);
+
+  CHECK (mDwHc->ChannelsInUse == 0);
+  CHECK (TransferMappings () == 0);
+  FreePages (Buffer, EFI_SIZE_TO_PAGES (DISK_LENGTH + EFI_PAGE_SIZE));
+}
+
+STATIC
+VOID
+TestInterrupt (
+  VOID
+  )
+{
+  UINT8      Report[INTR_MPS];
+  UINTN      Length;
+  UINT8      Toggle;
+  UINT32     Result;
+  EFI_STATUS Status;
+
+  mHid.In[INTR_IN_EP].InData = mHidReport;
+  mHid.In[INTR_IN_EP].InLength = sizeof (mHidReport);
+  mHid.In[INTR_IN_EP].InOffset = 0;
+  mHid.In[INTR_IN_EP].FrameOverruns = 2;
+
+  Length = sizeof (Report);
+  Toggle = 0;
+  Status = mHc->SyncInterruptTransfer (mHc, HID_ADDRESS, 0x80 | INTR_IN_EP,
+                                       EFI_USB_SPEED_HIGH, INTR_MPS, Report,
+                                       &Length, &Toggle, TIMEOUT_MS, NULL,
+                                       &Result);
+  CHECK (Status == EFI_SUCCESS && Result == EFI_USB_NOERROR);
+  CHECK (Length == sizeof (Report) &&
+         CompareMem (Report, mHidReport, Length) == 0);
+  CHECK (Toggle == 1);
+  CHECK (mHid.In[INTR_IN_EP].Transactions == 3);
+}
+
+STATIC
+VOID
+TestErrors (
+  VOID
+  )
+{
+  UINT8      Buffer[BULK_MPS];
+  UINTN      Length;
+  UINT8      Toggle;
+  UINT32     Result;
+  EFI_STATUS Status;
+  FAKE_ENDPOINT *Ep;
+
+  Ep = &mStorage.In[BULK_IN_EP];
+
+  ResetBulkIn ();
+  Ep->Stall = TRUE;
+  Length = sizeof (Buffer);
+  Toggle = 0;
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_DEVICE_ERROR && (Result & EFI_USB_ERR_STALL) != 0);
+  Ep->Stall = FALSE;
+
+  Ep->Naks = 1;
+  Length = sizeof (Buffer);
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_DEVICE_ERROR && (Result & EFI_USB_ERR_NAK) != 0);
+  CHECK (Ep->Naks == 0);
+
+  Ep->XactErrors = 1;
+  Length = sizeof (Buffer);
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_DEVICE_ERROR && (Result & EFI_USB_ERR_TIMEOUT) != 0);
+
+  /*
+   * The endpoint recovers.
+   */
+  Length = sizeof (Buffer);
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_SUCCESS && Length == sizeof (Buffer));
+
+  CHECK (mDwHc->ChannelsInUse == 0);
+  CHECK (TransferMappings () == 0);
+}
+
+/*
+ * A channel that won't halt stays allocated, with its bounce
+ * buffer, until it halts or the core is reset. One DMAing
+ * straight into the caller's buffer has the core reset before
+ * the buffer is handed back.
+ */
+STATIC
+VOID
+TestWedgedChannel (
+  VOID
+  )
+{
+  UINT8      *Buffer;
+  UINTN      Length;
+  UINT8      Toggle;
+  UINT32     Result;
+  EFI_STATUS Status;
+  FAKE_ENDPOINT *Ep;
+
+  Buffer = AllocatePages (2);
+  Ep = &mStorage.In[BULK_IN_EP];
+
+  ResetBulkIn ();
+  Ep->Hang = TRUE;
+  Length = EFI_PAGE_SIZE;
+  Toggle = 0;
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer + 1, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_DEVICE_ERROR && (Result & EFI_USB_ERR_TIMEOUT) != 0);
+  CHECK (mDwHc->ChannelsInUse != 0);
+  CHECK (TransferMappings () == 0);
+  Ep->Hang = FALSE;
+
+  /*
+   * Halting lets the next allocation reclaim it.
+   */
+  FakeDwc2ReleaseHung ();
+  Length = EFI_PAGE_SIZE;
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer + 1, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_SUCCESS);
+  CHECK (mDwHc->ChannelsInUse == 0);
+
+  Ep->Hang = TRUE;
+  Length = EFI_PAGE_SIZE;
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer + 1, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_DEVICE_ERROR);
+  CHECK (mDwHc->ChannelsInUse != 0);
+  Ep->Hang = FALSE;
+
+  CHECK (mHc->Reset (mHc, EFI_USB_HC_RESET_GLOBAL) == EFI_SUCCESS);
+  CHECK (mDwHc->ChannelsInUse == 0);
+
+  /*
+   * Zero-copy: the core is reset and nothing stays mapped.
+   */
+  ResetBulkIn ();
+  Ep->Hang = TRUE;
+  Length = EFI_PAGE_SIZE;
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_DEVICE_ERROR && (Result & EFI_USB_ERR_TIMEOUT) != 0);
+  CHECK (mDwHc->ChannelsInUse == 0);
+  CHECK (TransferMappings () == 0);
+  Ep->Hang = FALSE;
+
+  MicroSecondDelay (100 * 1000);
+  Length = EFI_PAGE_SIZE;
+  Status = Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+  CHECK (Status == EFI_SUCCESS);
+
+  FreePages (Buffer, 2);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+AsyncCallback (
+  IN  VOID   *Data,
+  IN  UINTN  DataLength,
+  IN  VOID   *Context,
+  IN  UINT32 Status
+  )
+{
+  ASYNC_STATE *State;
+
+  State = Context;
+  State->Callbacks++;
+  if (Status != EFI_USB_NOERROR) {
+    State->Errors++;
+  }
+
+  State->Length = DataLength;
+  CopyMem (State->Data, Data, MIN (DataLength, sizeof (State->Data)));
+  State->Ep->InOffset = 0;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+StartAsync (
+  IN  UINT8                              Address,
+  IN  UINT8                              EpNum,
+  IN  UINT8                              Speed,
+  IN  UINTN                              Interval,
+  IN  EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator,
+  IN  FAKE_ENDPOINT                      *Ep,
+  OUT ASYNC_STATE                        *State
+  )
+{
+  UINT8 Toggle;
+
+  ZeroMem (State, sizeof (*State));
+  State->Ep = Ep;
+  Ep->InData = mHidReport;
+  Ep->InLength = sizeof (mHidReport);
+  Ep->InOffset = 0;
+
+  Toggle = 0;
+  return mHc->AsyncInterruptTransfer (mHc, Address, 0x80 | EpNum, Speed,
+                                      INTR_MPS, TRUE, &Toggle, Interval,
+                                      INTR_MPS, Translator, AsyncCallback,
+                                      State);
+}
+
+STATIC
+EFI_STATUS
+StopAsync (
+  IN  UINT8 Address,
+  IN  UINT8 EpNum
+  )
+{
+  UINT8 Toggle;
+
+  Toggle = 0;
+  return mHc->AsyncInterruptTransfer (mHc, Address, 0x80 | EpNum, 0, 0,
+                                      FALSE, &Toggle, 0, 0, NULL, NULL,
+                                      NULL);
+}
+
+/*
+ * An async interrupt transfer is polled off the periodic timer
+ * at its interval, NAKs don't reach the callback, and cancelling
+ * it stops the polling.
+ */
+STATIC
+VOID
+TestAsyncInterrupt (
+  VOID
+  )
+{
+  ASYNC_STATE   State;
+  FAKE_ENDPOINT *Ep;
+  UINTN         Callbacks;
+  UINT32        Transactions;
+
+  Ep = &mHid.In[INTR_IN_EP];
+  CHECK (StartAsync (HID_ADDRESS, INTR_IN_EP, EFI_USB_SPEED_HIGH, 4, NULL,
+                     Ep, &State) == EFI_SUCCESS);
+
+  MicroSecondDelay (100 * 1000);
+  CHECK (State.Callbacks >= 24 && State.Callbacks <= 26);
+  CHECK (State.Errors == 0);
+  CHECK (State.Length == sizeof (mHidReport) &&
+         CompareMem (State.Data, mHidReport, sizeof (mHidReport)) == 0);
+
+  /*
+   * A poll already in flight may still complete.
+   */
+  Ep->Naks = 1000;
+  MicroSecondDelay (2 * 1000);
+  Callbacks = State.Callbacks;
+  MicroSecondDelay (20 * 1000);
+  CHECK (State.Callbacks == Callbacks);
+  CHECK (Ep->Naks < 1000);
+  Ep->Naks = 0;
+
+  MicroSecondDelay (20 * 1000);
+  CHECK (State.Callbacks > Callbacks);
+
+  CHECK (StopAsync (HID_ADDRESS, INTR_IN_EP) == EFI_SUCCESS);
+  CHECK (StopAsync (HID_ADDRESS, INTR_IN_EP) == EFI_INVALID_PARAMETER);
+  Callbacks = State.Callbacks;
+  Transactions = Ep->Transactions;
+  MicroSecondDelay (20 * 1000);
+  CHECK (State.Callbacks == Callbacks);
+  CHECK (Ep->Transactions == Transactions);
+
+  CHECK (mDwHc->ChannelsInUse == 0);
+  CHECK (TransferMappings () == 0);
+}
+
+/*
+ * Endpoints with intervals from one frame to most of the wheel
+ * each get polled once per interval.
+ */
+STATIC
+VOID
+TestTimerWheel (
+  VOID
+  )
+{
+  STATIC CONST UINTN Intervals[] = { 1, 3, 8, 32, 200 };
+  ASYNC_STATE        State[ARRAY_SIZE (Intervals)];
+  UINTN              Index;
+  UINTN              Frames;
+  UINTN              Expected;
+
+  for (Index = 0; Index < ARRAY_SIZE (Intervals); Index++) {
+    CHECK (StartAsync (HID_ADDRESS, (UINT8) (Index + 1), EFI_USB_SPEED_HIGH,
+                       Intervals[Index], NULL, &mHid.In[Index + 1],
+                       &State[Index]) == EFI_SUCCESS);
+  }
+
+  Frames = 600;
+  MicroSecondDelay (Frames * 1000);
+
+  for (Index = 0; Index < ARRAY_SIZE (Intervals); Index++) {
+    Expected = Frames / Intervals[Index];
+    CHECK (StopAsync (HID_ADDRESS, (UINT8) (Index + 1)) == EFI_SUCCESS);
+    CHECK (State[Index].Errors == 0);
+    if (State[Index].Callbacks + 1 < Expected ||
+        State[Index].Callbacks > Expected + 1) {
+      fprintf (stderr, "interval %u: %u callbacks in %u frames\n",
+               (unsigned) Intervals[Index], (unsigned) State[Index].Callbacks,
+               (unsigned) Frames);
+      mFailures++;
+    }
+  }
+
+  /*
+   * The channels of polls cancelled in flight come back
+   * on the next tick.
+   */
+  MicroSecondDelay (1000);
+  CHECK (mDwHc->ChannelsInUse == 0);
+}
+
+/*
+ * A full-speed device behind the hub's TT: control, bulk and
+ * interrupt transfers all go through split transactions.
+ */
+STATIC
+VOID
+TestSplit (
+  VOID
+  )
+{
+  EFI_USB_DEVICE_REQUEST DevReq;
+  UINT8                  Buffer[512];
+  UINT8                  Report[INTR_MPS];
+  VOID                   *Buffers[EFI_USB_MAX_BULK_BUFFER_NUM];
+  UINTN                  Length;
+  UINT8                  Toggle;
+  UINT32                 Result;
+  UINT32                 StartSplits;
+  EFI_STATUS             Status;
+  FAKE_ENDPOINT          *Ep;
+  ASYNC_STATE            State;
+
+  DevReq.RequestType = USB_DEV_GET_DESCRIPTOR_REQ_TYPE;
+  DevReq.Request = USB_REQ_GET_DESCRIPTOR;
+  DevReq.Value = USB_DESC_TYPE_DEVICE << 8;
+  DevReq.Index = 0;
+  DevReq.Length = sizeof (mDeviceDescriptor);
+  Length = sizeof (mDeviceDescriptor);
+  Status = mHc->ControlTransfer (mHc, FS_ADDRESS, EFI_USB_SPEED_FULL, 64,
+                                 &DevReq, EfiUsbDataIn, Buffer, &Length,
+                                 TIMEOUT_MS, &mFsTranslator, &Result);
+  CHECK (Status == EFI_SUCCESS && Length == sizeof (mDeviceDescriptor));
+  CHECK (CompareMem (Buffer, mDeviceDescriptor, Length) == 0);
+  CHECK (mFsDevice.In[0].StartSplits != 0);
+
+  /*
+   * Without the TT the device can't be reached.
+   */
+  Length = sizeof (mDeviceDescriptor);
+  Status = mHc->ControlTransfer (mHc, FS_ADDRESS, EFI_USB_SPEED_HIGH, 64,
+                                 &DevReq, EfiUsbDataIn, Buffer, &Length,
+                                 TIMEOUT_MS, NULL, &Result);
+  CHECK (Status == EFI_DEVICE_ERROR);
+
+  /*
+   * Bulk both ways, one packet per split, and a NAK that makes
+   * the transfer start over with a new start-split.
+   */
+  ZeroMem (Buffers, sizeof (Buffers));
+  Buffers[0] = mDiskData;
+  Length = sizeof (Buffer);
+  Toggle = 0;
+  mFsDevice.Out[BULK_OUT_EP].OutLength = 0;
+  Status = mHc->BulkTransfer (mHc, FS_ADDRESS, BULK_OUT_EP, EFI_USB_SPEED_FULL,
+                              FS_BULK_MPS, 1, Buffers, &Length, &Toggle,
+                              TIMEOUT_MS, &mFsTranslator, &Result);
+  CHECK (Status == EFI_SUCCESS && Length == sizeof (Buffer));
+  CHECK (mFsDevice.Out[BULK_OUT_EP].OutLength == sizeof (Buffer) &&
+         CompareMem (mOutData, mDiskData, sizeof (Buffer)) == 0);
+  CHECK (mFsDevice.Out[BULK_OUT_EP].StartSplits ==
+         sizeof (Buffer) / FS_BULK_MPS);
+
+  Ep = &mFsDevice.In[BULK_IN_EP];
+  Ep->InData = mDiskData;
+  Ep->InLength = sizeof (mDiskData);
+  Ep->InOffset = 0;
+  Ep->Naks = 1;
+  Buffers[0] = Buffer;
+  Length = sizeof (Buffer);
+  Toggle = 0;
+  Status = mHc->BulkTransfer (mHc, FS_ADDRESS, 0x80 | BULK_IN_EP,
+                              EFI_USB_SPEED_FULL, FS_BULK_MPS, 1, Buffers,
+                              &Length, &Toggle, TIMEOUT_MS, &mFsTranslator,
+                              &Result);
+  CHECK (Status == EFI_SUCCESS && Length == sizeof (Buffer));
+  CHECK (CompareMem (Buffer, mDiskData, sizeof (Buffer)) == 0);
+  CHECK (Ep->StartSplits == sizeof (Buffer) / FS_BULK_MPS + 1);
+  CHECK (Ep->Naks == 0);
+
+  /*
+   * Periodic complete-splits in their window, with the TT late
+   * for the first ones and then late for the whole window.
+   */
+  Ep = &mFsDevice.In[FS_INTR_EP];
+  Ep->InData = mHidReport;
+  Ep->InLength = sizeof (mHidReport);
+  Ep->InOffset = 0;
+  Ep->Nyets = 2;
+  Length = sizeof (Report);
+  Toggle = 0;
+  Status = mHc->SyncInterruptTransfer (mHc, FS_ADDRESS, 0x80 | FS_INTR_EP,
+                                       EFI_USB_SPEED_FULL, INTR_MPS, Report,
+                                       &Length, &Toggle, TIMEOUT_MS,
+                                       &mFsTranslator, &Result);
+  CHECK (Status == EFI_SUCCESS && Result == EFI_USB_NOERROR);
+  CHECK (Length == sizeof (Report) &&
+         CompareMem (Report, mHidReport, Length) == 0);
+  CHECK (Ep->StartSplits == 1 && Ep->CompleteSplits == 3);
+
+  StartSplits = Ep->StartSplits;
+  Ep->InOffset = 0;
+  Ep->Nyets = 3;
+  Length = sizeof (Report);
+  Status = mHc->SyncInterruptTransfer (mHc, FS_ADDRESS, 0x80 | FS_INTR_EP,
+                                       EFI_USB_SPEED_FULL, INTR_MPS, Report,
+                                       &Length, &Toggle, TIMEOUT_MS,
+                                       &mFsTranslator, &Result);
+  CHECK (Status == EFI_SUCCESS && Length == sizeof (Report));
+  CHECK (Ep->StartSplits == StartSplits + 2);
+  CHECK (Ep->LostSplits == 0);
+
+  CHECK (StartAsync (FS_ADDRESS, FS_INTR_EP, EFI_USB_SPEED_FULL, 2,
+                     &mFsTranslator, Ep, &State) == EFI_SUCCESS);
+  MicroSecondDelay (64 * 1000);
+  CHECK (StopAsync (FS_ADDRESS, FS_INTR_EP) == EFI_SUCCESS);
+  CHECK (State.Callbacks >= 31 && State.Callbacks <= 33);
+  CHECK (State.Errors == 0);
+  CHECK (Ep->LostSplits == 0);
+
+  CHECK (mDwHc->ChannelsInUse == 0);
+  CHECK (TransferMappings () == 0);
+}
+
+/*
+ * More low-speed interrupt endpoints polled every frame than
+ * the TT's periodic budget fits in one frame: start-splits are
+ * spread over frames, and every endpoint still gets polled.
+ */
+STATIC
+VOID
+TestTtBudget (
+  VOID
+  )
+{
+  ASYNC_STATE State[LS_INTR_EPS];
+  UINTN       Index;
+
+  for (Index = 0; Index < LS_INTR_EPS; Index++) {
+    CHECK (StartAsync (LS_ADDRESS, (UINT8) (Index + 1), EFI_USB_SPEED_LOW, 1,
+                       &mLsTranslator, &mLsDevice.In[Index + 1],
+                       &State[Index]) == EFI_SUCCESS);
+  }
+
+  MicroSecondDelay (64 * 1000);
+
+  for (Index = 0; Index < LS_INTR_EPS; Index++) {
+    CHECK (StopAsync (LS_ADDRESS, (UINT8) (Index + 1)) == EFI_SUCCESS);
+    CHECK (State[Index].Callbacks >= 8);
+    CHECK (State[Index].Errors == 0);
+    CHECK (mLsDevice.In[Index + 1].LostSplits == 0);
+  }
+
+  /*
+   * 1350 byte times at (8 * 7 / 6 + 13) * 8 for each.
+   */
+  CHECK (FakeDwc2PeakPeriodicSplits () <= 7);
+  CHECK (mDwHc->ChannelsInUse == 0);
+}
+
+STATIC
+VOID
+BenchBulk (
+  IN  CONST CHAR8 *Name,
+  IN  UINTN       Misalign
+  )
+{
+  UINT8           *Buffer;
+  UINTN           Index;
+  UINTN           Length;
+  UINT8           Toggle;
+  UINT32          Result;
+  UINT64          Starts;
+  struct timespec Start;
+  struct timespec End;
+  double          Seconds;
+
+  Buffer = AllocatePages (EFI_SIZE_TO_PAGES (BENCH_LENGTH + EFI_PAGE_SIZE));
+  Toggle = 0;
+  Starts = FakeDwc2ChannelStarts ();
+
+  clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &Start);
+  for (Index = 0; Index < BENCH_TRANSFERS; Index++) {
+    ResetBulkIn ();
+    Length = BENCH_LENGTH;
+    if (EFI_ERROR (Bulk (0x80 | BULK_IN_EP, Buffer + Misalign, &Length,
+                         &Toggle, &Result))) {
+      mFailures++;
+      break;
+    }
+  }
+  clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &End);
+
+  Seconds = (End.tv_sec - Start.tv_sec) + (End.tv_nsec - Start.tv_nsec) / 1e9;
+  printf ("bench %-10s %u x %u bytes: %.0f transfers/s, %.2f us CPU each, "
+          "%.2f channel starts each\n", Name, BENCH_TRANSFERS, BENCH_LENGTH,
+          BENCH_TRANSFERS / Seconds, Seconds * 1e6 / BENCH_TRANSFERS,
+          (double) (FakeDwc2ChannelStarts () - Starts) / BENCH_TRANSFERS);
+
+  FreePages (Buffer, EFI_SIZE_TO_PAGES (BENCH_LENGTH + EFI_PAGE_SIZE));
+}
+
+/*
+ * Runs a mix of bulk and interrupt transfers, some of them NAKed,
+ * overrun, stalled or split, and replays their trace, taken as it
+ * would be from the diagnostics log, against a fresh controller.
+ * Tears the controller down.
+ */
+STATIC
+VOID
+TestTraceReplay (
+  VOID
+  )
+{
+  DW_USB_HOST_TRACE_PROTOCOL *TraceProtocol;
+  DW_USB_HOST_TRACE_ENTRY    Entries[REPLAY_TRANSFERS];
+  DW_USB_HOST_TRACE_ENTRY    Entry;
+  TRACE_REPLAY_RESULT        Replay;
+  VOID                       *Buffers[EFI_USB_MAX_BULK_BUFFER_NUM];
+  UINT8                      Buffer[1024];
+  UINT8                      Report[INTR_MPS];
+  CHAR8                      Line[128];
+  UINTN                      Count;
+  UINTN                      Length;
+  UINT8                      Toggle;
+  UINT32                     Result;
+  FAKE_ENDPOINT              *Ep;
+
+  TraceProtocol = &mDwHc->TraceProtocol;
+  TraceProtocol->ResetTrace (TraceProtocol);
+
+  ResetBulkIn ();
+  Toggle = 0;
+  Length = sizeof (Buffer);
+  Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+
+  Length = 31;
+  mStorage.Out[BULK_OUT_EP].OutLength = 0;
+  Bulk (BULK_OUT_EP, Buffer, &Length, &Toggle, &Result);
+
+  mStorage.In[BULK_IN_EP].Naks = 1;
+  Length = BULK_MPS;
+  Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+
+  mStorage.In[BULK_IN_EP].FrameOverruns = 2;
+  Length = BULK_MPS;
+  Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+
+  mStorage.In[BULK_IN_EP].Stall = TRUE;
+  Length = BULK_MPS;
+  Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+  mStorage.In[BULK_IN_EP].Stall = FALSE;
+
+  mStorage.In[BULK_IN_EP].XactErrors = 1;
+  Length = BULK_MPS;
+  Bulk (0x80 | BULK_IN_EP, Buffer, &Length, &Toggle, &Result);
+
+  mHid.In[INTR_IN_EP].InData = mHidReport;
+  mHid.In[INTR_IN_EP].InLength = sizeof (mHidReport);
+  mHid.In[INTR_IN_EP].InOffset = 0;
+  Length = sizeof (Report);
+  mHc->SyncInterruptTransfer (mHc, HID_ADDRESS, 0x80 | INTR_IN_EP,
+                              EFI_USB_SPEED_HIGH, INTR_MPS, Report, &Length,
+                              &Toggle, TIMEOUT_MS, NULL, &Result);
+
+  Ep = &mFsDevice.In[BULK_IN_EP];
+  Ep->InData = mDiskData;
+  Ep->InLength = sizeof (mDiskData);
+  Ep->InOffset = 0;
+  Ep->Naks = 1;
+  ZeroMem (Buffers, sizeof (Buffers));
+  Buffers[0] = Buffer;
+  Length = 256;
+  mHc->BulkTransfer (mHc, FS_ADDRESS, 0x80 | BULK_IN_EP, EFI_USB_SPEED_FULL,
+                     FS_BULK_MPS, 1, Buffers, &Length, &Toggle, TIMEOUT_MS,
+                     &mFsTranslator, &Result);
+
+  Ep = &mFsDevice.In[FS_INTR_EP];
+  Ep->InData = mHidReport;
+  Ep->InLength = sizeof (mHidReport);
+  Ep->InOffset = 0;
+  Ep->Nyets = 2;
+  Length = sizeof (Report);
+  mHc->SyncInterruptTransfer (mHc, FS_ADDRESS, 0x80 | FS_INTR_EP,
+                              EFI_USB_SPEED_FULL, INTR_MPS, Report, &Length,
+                              &Toggle, TIMEOUT_MS, &mFsTranslator, &Result);
+
+  /*
+   * Oldest first, through the diagnostics log's format.
+   */
+  CHECK (mDwHc->TraceCount == REPLAY_TRANSFERS);
+  Count = 0;
+  while (Count < REPLAY_TRANSFERS &&
+         !EFI_ERROR (TraceProtocol->GetTraceEntry (TraceProtocol,
+                                                   REPLAY_TRANSFERS - 1 - Count,
+                                                   &Entry))) {
+    TraceReplayFormat (&Entry, Line, sizeof (Line));
+    CHECK (TraceReplayParse (Line, &Entries[Count]) == EFI_SUCCESS);
+    Count++;
+  }
+  CHECK (TraceReplayParse ("   uF Dev EP   Type Ch   Length   Actual Rst  NAK "
+                           "CSPL Ovr  Dur Result", &Entry) ==
+         EFI_INVALID_PARAMETER);
+
+  Teardown ();
+
+  TraceReplay (Entries, Count, &Replay);
+  CHECK (Replay.Replayed == REPLAY_TRANSFERS);
+  CHECK (Replay.Mismatches == 0);
+}
+
+/*
+ * Replays the transfer trace in a diagnostics log, which lists
+ * the most recent transfer first.
+ */
+STATIC
+int
+ReplayLog (
+  IN  CONST char *Path
+  )
+{
+  FILE                    *File;
+  DW_USB_HOST_TRACE_ENTRY *Entries;
+  DW_USB_HOST_TRACE_ENTRY Entry;
+  TRACE_REPLAY_RESULT     Replay;
+  char                    Line[256];
+  UINTN                   Count;
+  BOOLEAN                 Irq;
+
+  File = fopen (Path, "r");
+  if (File == NULL) {
+    perror (Path);
+    return 1;
+  }
+
+  Entries = AllocatePool (TRACE_RING_SIZE * sizeof (*Entries));
+  Count = 0;
+  while (Count < TRACE_RING_SIZE && fgets (Line, sizeof (Line), File) != NULL) {
+    if (!EFI_ERROR (TraceReplayParse (Line, &Entry))) {
+      CopyMem (&Entries[TRACE_RING_SIZE - 1 - Count++], &Entry, sizeof (Entry));
+    }
+  }
+  fclose (File);
+
+  for (Irq = FALSE; Irq <= TRUE; Irq++) {
+    HostUseInterruptController (Irq);
+    TraceReplay (&Entries[TRACE_RING_SIZE - Count], Count, &Replay);
+    printf ("%s: %u replayed, %u skipped, %u mismatched, "
+            "%llu microframes recorded, %llu replayed\n",
+            Irq ? "taking the USB interrupt" : "polling",
+            (unsigned) Replay.Replayed, (unsigned) Replay.Skipped,
+            (unsigned) Replay.Mismatches,
+            (unsigned long long) Replay.RecordedMicroFrames,
+            (unsigned long long) Replay.ReplayedMicroFrames);
+    mFailures += Replay.Mismatches;
+  }
+
+  FreePool (Entries);
+  return mFailures != 0;
+}
+
+int
+main (
+  int  argc,
+  char **argv
+  )
+{
+  BOOLEAN Irq;
+
+  if (argc == 3 && strcmp (argv[1], "--replay") == 0) {
+    return ReplayLog (argv[2]);
+  }
+
+  for (Irq = FALSE; Irq <= TRUE; Irq++) {
+    printf ("%s\n", Irq ? "taking the USB interrupt" : "polling");
+    HostUseInterruptController (Irq);
+    Setup ();
+    CHECK ((mDwHc->Interrupt != NULL) == Irq);
+
+    TestReset ();
+    TestEnumerate ();
+    TestDescCache ();
+    TestBulk ();
+    TestLargeBulk ();
+    TestInterrupt ();
+    TestErrors ();
+    TestWedgedChannel ();
+    TestAsyncInterrupt ();
+    TestTimerWheel ();
+    TestSplit ();
+    TestTtBudget ();
+
+    BenchBulk ("direct", 0);
+    BenchBulk ("bounce", 1);
+
+    TestTraceReplay ();
+  }
+
+  if (mFailures != 0) {
+    printf ("%u check(s) failed\n", (unsigned) mFailures);
+    return 1;
+  }
+
+  printf ("all checks passed\n");
+  return 0;
+}
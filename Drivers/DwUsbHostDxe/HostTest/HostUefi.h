@@ -0,0 +1,605 @@
+/** @file
+ *
+ *  Just enough of the UEFI environment to build the DwUsbHostDxe
+ *  transfer code as a host program. Every EDK2 header the driver
+ *  includes is generated by the Makefile as an include of this one.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#ifndef __HOST_UEFI_H__
+#define __HOST_UEFI_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//
+// Base types.
+//
+typedef uint8_t             UINT8;
+typedef uint16_t            UINT16;
+typedef uint32_t            UINT32;
+typedef uint64_t            UINT64;
+typedef int8_t              INT8;
+typedef int16_t             INT16;
+typedef int32_t             INT32;
+typedef int64_t             INT64;
+typedef uintptr_t           UINTN;
+typedef intptr_t            INTN;
+typedef unsigned char       BOOLEAN;
+typedef char                CHAR8;
+typedef uint16_t            CHAR16;
+typedef void                VOID;
+
+typedef UINTN               EFI_STATUS;
+typedef UINTN               RETURN_STATUS;
+typedef VOID                *EFI_HANDLE;
+typedef VOID                *EFI_EVENT;
+typedef UINTN               EFI_TPL;
+typedef UINT64              EFI_PHYSICAL_ADDRESS;
+typedef UINT64              PHYSICAL_ADDRESS;
+
+typedef struct {
+  UINT32  Data1;
+  UINT16  Data2;
+  UINT16  Data3;
+  UINT8   Data4[8];
+} EFI_GUID;
+
+typedef struct _LIST_ENTRY LIST_ENTRY;
+struct _LIST_ENTRY {
+  LIST_ENTRY  *ForwardLink;
+  LIST_ENTRY  *BackLink;
+};
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define CONST               const
+#define STATIC              static
+#define EFIAPI
+
+#define TRUE                ((BOOLEAN)(1==1))
+#define FALSE               ((BOOLEAN)(0==1))
+
+#define MAX_UINT8           ((UINT8)0xFF)
+#define MAX_UINT16          ((UINT16)0xFFFF)
+#define MAX_UINT32          ((UINT32)0xFFFFFFFF)
+#define MAX_UINT64          ((UINT64)0xFFFFFFFFFFFFFFFFULL)
+#define MAX_UINTN           ((UINTN)-1)
+
+#define BIT0     0x00000001
+#define BIT1     0x00000002
+#define BIT2     0x00000004
+#define BIT3     0x00000008
+#define BIT4     0x00000010
+#define BIT5     0x00000020
+#define BIT6     0x00000040
+#define BIT7     0x00000080
+#define BIT8     0x00000100
+#define BIT15    0x00008000
+#define BIT31    0x80000000
+
+#define MIN(a, b)                 (((a) < (b)) ? (a) : (b))
+#define MAX(a, b)                 (((a) > (b)) ? (a) : (b))
+#define ARRAY_SIZE(Array)         (sizeof (Array) / sizeof ((Array)[0]))
+#define ALIGN_VALUE(Value, Alignment) ((Value) + (((Alignment) - (Value)) & ((Alignment) - 1)))
+#define OFFSET_OF(TYPE, Field)    ((UINTN) offsetof (TYPE, Field))
+#define BASE_CR(Record, TYPE, Field) \
+  ((TYPE *) ((CHAR8 *) (Record) - OFFSET_OF (TYPE, Field)))
+#define CR(Record, TYPE, Field, TestSignature) BASE_CR (Record, TYPE, Field)
+#define SIGNATURE_16(A, B)        ((A) | (B << 8))
+#define SIGNATURE_32(A, B, C, D)  (SIGNATURE_16 (A, B) | (SIGNATURE_16 (C, D) << 16))
+
+#define EFI_PAGE_SIZE             0x1000
+#define EFI_PAGE_MASK             0xFFF
+#define EFI_SIZE_TO_PAGES(Size)   (((Size) >> 12) + (((Size) & EFI_PAGE_MASK) ? 1 : 0))
+#define EFI_PAGES_TO_SIZE(Pages)  ((UINTN) (Pages) << 12)
+
+//
+// Status codes.
+//
+#define ENCODE_ERROR(a)           ((EFI_STATUS) (MAX_UINTN ^ (MAX_UINTN >> 1)) | (a))
+#define EFI_ERROR(a)              (((INTN) (EFI_STATUS) (a)) < 0)
+#define EFI_SUCCESS               0
+#define EFI_INVALID_PARAMETER     ENCODE_ERROR (2)
+#define EFI_UNSUPPORTED           ENCODE_ERROR (3)
+#define EFI_BUFFER_TOO_SMALL      ENCODE_ERROR (5)
+#define EFI_NOT_READY             ENCODE_ERROR (6)
+#define EFI_DEVICE_ERROR          ENCODE_ERROR (7)
+#define EFI_OUT_OF_RESOURCES      ENCODE_ERROR (9)
+#define EFI_NOT_FOUND             ENCODE_ERROR (14)
+#define EFI_ACCESS_DENIED         ENCODE_ERROR (15)
+#define EFI_TIMEOUT               ENCODE_ERROR (18)
+#define EFI_ABORTED               ENCODE_ERROR (21)
+
+//
+// DebugLib. DEBUG output goes to stderr, ASSERT aborts.
+//
+#define DEBUG_INIT      0x00000001
+#define DEBUG_WARN      0x00000002
+#define DEBUG_LOAD      0x00000004
+#define DEBUG_INFO      0x00000040
+#define DEBUG_VERBOSE   0x00400000
+#define DEBUG_ERROR     0x80000000
+#define EFI_D_INIT      DEBUG_INIT
+#define EFI_D_WARN      DEBUG_WARN
+#define EFI_D_INFO      DEBUG_INFO
+#define EFI_D_VERBOSE   DEBUG_VERBOSE
+#define EFI_D_ERROR     DEBUG_ERROR
+
+VOID HostDebugPrint (UINTN ErrorLevel, CONST CHAR8 *Format, ...);
+VOID HostAssert (CONST CHAR8 *FileName, UINTN LineNumber, CONST CHAR8 *Description);
+
+#define DEBUG(Expression)   HostDebugPrint Expression
+#define ASSERT(Expression)                                \
+  do {                                                    \
+    if (!(Expression)) {                                  \
+      HostAssert (__FILE__, __LINE__, #Expression);       \
+    }                                                     \
+  } while (FALSE)
+#define ASSERT_EFI_ERROR(StatusParameter)                 \
+  do {                                                    \
+    if (EFI_ERROR (StatusParameter)) {                    \
+      HostAssert (__FILE__, __LINE__, #StatusParameter);  \
+    }                                                     \
+  } while (FALSE)
+#define DEBUG_CODE_BEGIN()  do { if (TRUE) {
+#define DEBUG_CODE_END()    } } while (FALSE)
+
+//
+// Boot services, with events driven by a simulated clock.
+//
+#define TPL_APPLICATION       4
+#define TPL_CALLBACK          8
+#define TPL_NOTIFY            16
+#define TPL_HIGH_LEVEL        31
+
+#define EVT_TIMER                     0x80000000
+#define EVT_NOTIFY_WAIT               0x00000100
+#define EVT_NOTIFY_SIGNAL             0x00000200
+#define EVT_SIGNAL_EXIT_BOOT_SERVICES 0x00000201
+
+#define EFI_TIMER_PERIOD_MICROSECONDS(Microseconds) ((UINT64)(Microseconds) * 10)
+#define EFI_TIMER_PERIOD_MILLISECONDS(Milliseconds) ((UINT64)(Milliseconds) * 10000)
+#define EFI_TIMER_PERIOD_SECONDS(Seconds)           ((UINT64)(Seconds) * 10000000)
+
+typedef enum {
+  TimerCancel,
+  TimerPeriodic,
+  TimerRelative
+} EFI_TIMER_DELAY;
+
+typedef enum {
+  EfiReservedMemoryType,
+  EfiLoaderCode,
+  EfiLoaderData,
+  EfiBootServicesCode,
+  EfiBootServicesData,
+  EfiRuntimeServicesCode,
+  EfiRuntimeServicesData,
+  EfiConventionalMemory
+} EFI_MEMORY_TYPE;
+
+typedef VOID (EFIAPI *EFI_EVENT_NOTIFY) (IN EFI_EVENT Event, IN VOID *Context);
+
+typedef struct {
+  EFI_TPL     (EFIAPI *RaiseTPL) (IN EFI_TPL NewTpl);
+  VOID        (EFIAPI *RestoreTPL) (IN EFI_TPL OldTpl);
+  EFI_STATUS  (EFIAPI *CreateEvent) (IN UINT32 Type, IN EFI_TPL NotifyTpl,
+                                     IN EFI_EVENT_NOTIFY NotifyFunction,
+                                     IN VOID *NotifyContext, OUT EFI_EVENT *Event);
+  EFI_STATUS  (EFIAPI *CreateEventEx) (IN UINT32 Type, IN EFI_TPL NotifyTpl,
+                                       IN EFI_EVENT_NOTIFY NotifyFunction,
+                                       IN CONST VOID *NotifyContext,
+                                       IN CONST EFI_GUID *EventGroup,
+                                       OUT EFI_EVENT *Event);
+  EFI_STATUS  (EFIAPI *SetTimer) (IN EFI_EVENT Event, IN EFI_TIMER_DELAY Type,
+                                  IN UINT64 TriggerTime);
+  EFI_STATUS  (EFIAPI *CheckEvent) (IN EFI_EVENT Event);
+  EFI_STATUS  (EFIAPI *SignalEvent) (IN EFI_EVENT Event);
+  EFI_STATUS  (EFIAPI *CloseEvent) (IN EFI_EVENT Event);
+  EFI_STATUS  (EFIAPI *AllocatePool) (IN EFI_MEMORY_TYPE PoolType, IN UINTN Size,
+                                      OUT VOID **Buffer);
+  EFI_STATUS  (EFIAPI *FreePool) (IN VOID *Buffer);
+  EFI_STATUS  (EFIAPI *LocateProtocol) (IN EFI_GUID *Protocol,
+                                        IN VOID *Registration OPTIONAL,
+                                        OUT VOID **Interface);
+  EFI_STATUS  (EFIAPI *Stall) (IN UINTN Microseconds);
+} EFI_BOOT_SERVICES;
+
+extern EFI_BOOT_SERVICES *gBS;
+
+extern EFI_GUID gEfiEventExitBootServicesGuid;
+extern EFI_GUID gEfiEventReadyToBootGuid;
+extern EFI_GUID gHardwareInterruptProtocolGuid;
+extern EFI_GUID gDwUsbHostTraceProtocolGuid;
+extern EFI_GUID gEfiUsb2HcProtocolGuid;
+
+//
+// BaseLib, BaseMemoryLib, MemoryAllocationLib.
+//
+LIST_ENTRY *InitializeListHead (IN OUT LIST_ENTRY *ListHead);
+LIST_ENTRY *InsertTailList (IN OUT LIST_ENTRY *ListHead, IN OUT LIST_ENTRY *Entry);
+LIST_ENTRY *InsertHeadList (IN OUT LIST_ENTRY *ListHead, IN OUT LIST_ENTRY *Entry);
+LIST_ENTRY *RemoveEntryList (IN CONST LIST_ENTRY *Entry);
+BOOLEAN IsListEmpty (IN CONST LIST_ENTRY *ListHead);
+LIST_ENTRY *GetFirstNode (IN CONST LIST_ENTRY *List);
+LIST_ENTRY *GetNextNode (IN CONST LIST_ENTRY *List, IN CONST LIST_ENTRY *Node);
+LIST_ENTRY *GetPreviousNode (IN CONST LIST_ENTRY *List, IN CONST LIST_ENTRY *Node);
+BOOLEAN IsNull (IN CONST LIST_ENTRY *List, IN CONST LIST_ENTRY *Node);
+
+INTN LowBitSet32 (IN UINT32 Operand);
+INTN HighBitSet32 (IN UINT32 Operand);
+UINT64 DivU64x32 (IN UINT64 Dividend, IN UINT32 Divisor);
+UINT64 MultU64x32 (IN UINT64 Multiplicand, IN UINT32 Multiplier);
+BOOLEAN SaveAndDisableInterrupts (VOID);
+BOOLEAN SetInterruptState (IN BOOLEAN InterruptState);
+VOID CpuSleep (VOID);
+VOID CpuPause (VOID);
+
+#define CopyMem(Destination, Source, Length)  memmove ((Destination), (Source), (Length))
+#define SetMem(Buffer, Length, Value)         memset ((Buffer), (Value), (Length))
+#define ZeroMem(Buffer, Length)               memset ((Buffer), 0, (Length))
+#define CompareMem(A, B, Length)              memcmp ((A), (B), (Length))
+
+VOID *AllocatePool (IN UINTN AllocationSize);
+VOID *AllocateZeroPool (IN UINTN AllocationSize);
+VOID *AllocateCopyPool (IN UINTN AllocationSize, IN CONST VOID *Buffer);
+VOID *AllocatePages (IN UINTN Pages);
+VOID FreePages (IN VOID *Buffer, IN UINTN Pages);
+VOID FreePool (IN VOID *Buffer);
+
+//
+// IoLib. Accesses to the DWC2 register window go to FakeDwc2.
+//
+UINT32 MmioRead32 (IN UINTN Address);
+UINT32 MmioWrite32 (IN UINTN Address, IN UINT32 Value);
+UINT32 MmioOr32 (IN UINTN Address, IN UINT32 OrData);
+UINT32 MmioAnd32 (IN UINTN Address, IN UINT32 AndData);
+UINT32 MmioAndThenOr32 (IN UINTN Address, IN UINT32 AndData, IN UINT32 OrData);
+
+//
+// TimerLib. One performance counter tick is one simulated nanosecond.
+//
+UINTN MicroSecondDelay (IN UINTN MicroSeconds);
+UINTN NanoSecondDelay (IN UINTN NanoSeconds);
+UINT64 GetPerformanceCounter (VOID);
+UINT64 GetPerformanceCounterProperties (OUT UINT64 *StartValue OPTIONAL,
+                                        OUT UINT64 *EndValue OPTIONAL);
+UINT64 GetTimeInNanoSecond (IN UINT64 Ticks);
+
+//
+// DmaLib. Bus addresses are 32 bits, so each mapping gets its own
+// window in a simulated bus address space.
+//
+typedef enum {
+  MapOperationBusMasterRead,
+  MapOperationBusMasterWrite,
+  MapOperationBusMasterCommonBuffer,
+  MapOperationMaximum
+} DMA_MAP_OPERATION;
+
+EFI_STATUS DmaMap (IN DMA_MAP_OPERATION Operation, IN VOID *HostAddress,
+                   IN OUT UINTN *NumberOfBytes, OUT PHYSICAL_ADDRESS *DeviceAddress,
+                   OUT VOID **Mapping);
+EFI_STATUS DmaUnmap (IN VOID *Mapping);
+EFI_STATUS DmaAllocateBuffer (IN EFI_MEMORY_TYPE MemoryType, IN UINTN Pages,
+                              OUT VOID **HostAddress);
+EFI_STATUS DmaFreeBuffer (IN UINTN Pages, IN VOID *HostAddress);
+
+//
+// ArmLib.
+//
+VOID ArmDataSynchronizationBarrier (VOID);
+VOID ArmDataMemoryBarrier (VOID);
+UINTN ArmDataCacheLineLength (VOID);
+BOOLEAN ArmGetInterruptState (VOID);
+VOID ArmEnableInterrupts (VOID);
+VOID ArmDisableInterrupts (VOID);
+
+//
+// Device paths, only needed for type definitions.
+//
+typedef struct {
+  UINT8 Type;
+  UINT8 SubType;
+  UINT8 Length[2];
+} EFI_DEVICE_PATH_PROTOCOL;
+
+typedef struct {
+  EFI_DEVICE_PATH_PROTOCOL  Header;
+  EFI_GUID                  Guid;
+} VENDOR_DEVICE_PATH;
+
+typedef struct _EFI_COMPONENT_NAME_PROTOCOL       EFI_COMPONENT_NAME_PROTOCOL;
+typedef struct _EFI_COMPONENT_NAME2_PROTOCOL      EFI_COMPONENT_NAME2_PROTOCOL;
+typedef struct _EFI_DRIVER_DIAGNOSTICS2_PROTOCOL  EFI_DRIVER_DIAGNOSTICS2_PROTOCOL;
+
+//
+// HardwareInterrupt protocol.
+//
+typedef UINTN HARDWARE_INTERRUPT_SOURCE;
+typedef union {
+  VOID  *SystemContextAArch64;
+} EFI_SYSTEM_CONTEXT;
+
+typedef struct _EFI_HARDWARE_INTERRUPT_PROTOCOL EFI_HARDWARE_INTERRUPT_PROTOCOL;
+
+typedef VOID (EFIAPI *HARDWARE_INTERRUPT_HANDLER) (
+  IN  HARDWARE_INTERRUPT_SOURCE Source,
+  IN  EFI_SYSTEM_CONTEXT        SystemContext
+  );
+
+struct _EFI_HARDWARE_INTERRUPT_PROTOCOL {
+  EFI_STATUS (EFIAPI *RegisterInterruptSource) (IN EFI_HARDWARE_INTERRUPT_PROTOCOL *This,
+                                                IN HARDWARE_INTERRUPT_SOURCE Source,
+                                                IN HARDWARE_INTERRUPT_HANDLER Handler);
+  EFI_STATUS (EFIAPI *EnableInterruptSource) (IN EFI_HARDWARE_INTERRUPT_PROTOCOL *This,
+                                              IN HARDWARE_INTERRUPT_SOURCE Source);
+  EFI_STATUS (EFIAPI *DisableInterruptSource) (IN EFI_HARDWARE_INTERRUPT_PROTOCOL *This,
+                                               IN HARDWARE_INTERRUPT_SOURCE Source);
+  EFI_STATUS (EFIAPI *GetInterruptSourceState) (IN EFI_HARDWARE_INTERRUPT_PROTOCOL *This,
+                                                IN HARDWARE_INTERRUPT_SOURCE Source,
+                                                IN BOOLEAN *InterruptState);
+  EFI_STATUS (EFIAPI *EndOfInterrupt) (IN EFI_HARDWARE_INTERRUPT_PROTOCOL *This,
+                                       IN HARDWARE_INTERRUPT_SOURCE Source);
+};
+
+//
+// IndustryStandard/Usb.h.
+//
+#pragma pack(1)
+typedef struct {
+  UINT8   RequestType;
+  UINT8   Request;
+  UINT16  Value;
+  UINT16  Index;
+  UINT16  Length;
+} USB_DEVICE_REQUEST;
+
+typedef struct {
+  UINT8   Length;
+  UINT8   DescriptorType;
+  UINT16  BcdUSB;
+  UINT8   DeviceClass;
+  UINT8   DeviceSubClass;
+  UINT8   DeviceProtocol;
+  UINT8   MaxPacketSize0;
+  UINT16  IdVendor;
+  UINT16  IdProduct;
+  UINT16  BcdDevice;
+  UINT8   StrManufacturer;
+  UINT8   StrProduct;
+  UINT8   StrSerialNumber;
+  UINT8   NumConfigurations;
+} USB_DEVICE_DESCRIPTOR;
+
+typedef struct {
+  UINT8   Length;
+  UINT8   DescriptorType;
+  UINT16  TotalLength;
+  UINT8   NumInterfaces;
+  UINT8   ConfigurationValue;
+  UINT8   Configuration;
+  UINT8   Attributes;
+  UINT8   MaxPower;
+} USB_CONFIG_DESCRIPTOR;
+#pragma pack()
+
+typedef USB_DEVICE_REQUEST EFI_USB_DEVICE_REQUEST;
+
+#define USB_REQ_TYPE_STANDARD       (0x00 << 5)
+#define USB_REQ_TYPE_CLASS          (0x01 << 5)
+#define USB_REQ_TYPE_VENDOR         (0x02 << 5)
+#define USB_TARGET_DEVICE           0
+#define USB_TARGET_INTERFACE        0x01
+#define USB_TARGET_ENDPOINT         0x02
+#define USB_TARGET_OTHER            0x03
+
+#define USB_REQ_GET_STATUS          0x00
+#define USB_REQ_CLEAR_FEATURE       0x01
+#define USB_REQ_SET_FEATURE         0x03
+#define USB_REQ_SET_ADDRESS         0x05
+#define USB_REQ_GET_DESCRIPTOR      0x06
+#define USB_REQ_SET_DESCRIPTOR      0x07
+#define USB_REQ_GET_CONFIG          0x08
+#define USB_REQ_SET_CONFIG          0x09
+
+#define USB_DESC_TYPE_DEVICE        0x01
+#define USB_DESC_TYPE_CONFIG        0x02
+#define USB_DESC_TYPE_STRING        0x03
+#define USB_DESC_TYPE_INTERFACE     0x04
+#define USB_DESC_TYPE_ENDPOINT      0x05
+#define USB_DESC_TYPE_HUB           0x29
+
+#define USB_DEV_GET_DESCRIPTOR_REQ_TYPE  0x80
+#define USB_DEV_SET_ADDRESS_REQ_TYPE     0x00
+#define USB_ENDPOINT_DIR_IN              0x80
+
+//
+// Protocol/UsbIo.h and Protocol/Usb2HostController.h.
+//
+typedef enum {
+  EfiUsbDataIn,
+  EfiUsbDataOut,
+  EfiUsbNoData
+} EFI_USB_DATA_DIRECTION;
+
+#define EFI_USB_NOERROR             0x0000
+#define EFI_USB_ERR_NOTEXECUTE      0x0001
+#define EFI_USB_ERR_STALL           0x0002
+#define EFI_USB_ERR_BUFFER          0x0004
+#define EFI_USB_ERR_BABBLE          0x0008
+#define EFI_USB_ERR_NAK             0x0010
+#define EFI_USB_ERR_CRC             0x0020
+#define EFI_USB_ERR_TIMEOUT         0x0040
+#define EFI_USB_ERR_BITSTUFF        0x0080
+#define EFI_USB_ERR_SYSTEM          0x0100
+
+typedef EFI_STATUS (EFIAPI *EFI_ASYNC_USB_TRANSFER_CALLBACK) (
+  IN VOID   *Data,
+  IN UINTN  DataLength,
+  IN VOID   *Context,
+  IN UINT32 Status
+  );
+
+#define EFI_USB_SPEED_FULL          0x0000
+#define EFI_USB_SPEED_LOW           0x0001
+#define EFI_USB_SPEED_HIGH          0x0002
+#define EFI_USB_SPEED_SUPER         0x0003
+
+#define EFI_USB_HC_RESET_GLOBAL             0x0001
+#define EFI_USB_HC_RESET_HOST_CONTROLLER    0x0002
+#define EFI_USB_HC_RESET_GLOBAL_WITH_DEBUG  0x0004
+#define EFI_USB_HC_RESET_HOST_WITH_DEBUG    0x0008
+
+#define EFI_USB_MAX_BULK_BUFFER_NUM   10
+#define EFI_USB_MAX_ISO_BUFFER_NUM    7
+#define EFI_USB_MAX_ISO_BUFFER_NUM1   2
+
+typedef struct {
+  UINT8 TranslatorHubAddress;
+  UINT8 TranslatorPortNumber;
+} EFI_USB2_HC_TRANSACTION_TRANSLATOR;
+
+typedef enum {
+  EfiUsbHcStateHalt,
+  EfiUsbHcStateOperational,
+  EfiUsbHcStateSuspend,
+  EfiUsbHcStateMaximum
+} EFI_USB_HC_STATE;
+
+typedef struct {
+  UINT16  PortStatus;
+  UINT16  PortChangeStatus;
+} EFI_USB_PORT_STATUS;
+
+#define USB_PORT_STAT_CONNECTION    0x0001
+#define USB_PORT_STAT_ENABLE        0x0002
+#define USB_PORT_STAT_SUSPEND       0x0004
+#define USB_PORT_STAT_OVERCURRENT   0x0008
+#define USB_PORT_STAT_RESET         0x0010
+#define USB_PORT_STAT_POWER         0x0100
+#define USB_PORT_STAT_LOW_SPEED     0x0200
+#define USB_PORT_STAT_HIGH_SPEED    0x0400
+#define USB_PORT_STAT_SUPER_SPEED   0x0800
+#define USB_PORT_STAT_OWNER         0x2000
+
+#define USB_PORT_STAT_C_CONNECTION  0x0001
+#define USB_PORT_STAT_C_ENABLE      0x0002
+#define USB_PORT_STAT_C_SUSPEND     0x0004
+#define USB_PORT_STAT_C_OVERCURRENT 0x0008
+#define USB_PORT_STAT_C_RESET       0x0010
+
+typedef enum {
+  EfiUsbPortEnable            = 1,
+  EfiUsbPortSuspend           = 2,
+  EfiUsbPortReset             = 4,
+  EfiUsbPortPower             = 8,
+  EfiUsbPortOwner             = 13,
+  EfiUsbPortConnectChange     = 16,
+  EfiUsbPortEnableChange      = 17,
+  EfiUsbPortSuspendChange     = 18,
+  EfiUsbPortOverCurrentChange = 19,
+  EfiUsbPortResetChange       = 20
+} EFI_USB_PORT_FEATURE;
+
+typedef struct _EFI_USB2_HC_PROTOCOL EFI_USB2_HC_PROTOCOL;
+
+struct _EFI_USB2_HC_PROTOCOL {
+  EFI_STATUS (EFIAPI *GetCapability) (IN EFI_USB2_HC_PROTOCOL *This,
+                                      OUT UINT8 *MaxSpeed, OUT UINT8 *PortNumber,
+                                      OUT UINT8 *Is64BitCapable);
+  EFI_STATUS (EFIAPI *Reset) (IN EFI_USB2_HC_PROTOCOL *This, IN UINT16 Attributes);
+  EFI_STATUS (EFIAPI *GetState) (IN EFI_USB2_HC_PROTOCOL *This,
+                                 OUT EFI_USB_HC_STATE *State);
+  EFI_STATUS (EFIAPI *SetState) (IN EFI_USB2_HC_PROTOCOL *This,
+                                 IN EFI_USB_HC_STATE State);
+  EFI_STATUS (EFIAPI *ControlTransfer) (IN EFI_USB2_HC_PROTOCOL *This,
+                                        IN UINT8 DeviceAddress, IN UINT8 DeviceSpeed,
+                                        IN UINTN MaximumPacketLength,
+                                        IN EFI_USB_DEVICE_REQUEST *Request,
+                                        IN EFI_USB_DATA_DIRECTION TransferDirection,
+                                        IN OUT VOID *Data OPTIONAL,
+                                        IN OUT UINTN *DataLength OPTIONAL,
+                                        IN UINTN TimeOut,
+                                        IN EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator,
+                                        OUT UINT32 *TransferResult);
+  EFI_STATUS (EFIAPI *BulkTransfer) (IN EFI_USB2_HC_PROTOCOL *This,
+                                     IN UINT8 DeviceAddress, IN UINT8 EndPointAddress,
+                                     IN UINT8 DeviceSpeed, IN UINTN MaximumPacketLength,
+                                     IN UINT8 DataBuffersNumber,
+                                     IN OUT VOID *Data[EFI_USB_MAX_BULK_BUFFER_NUM],
+                                     IN OUT UINTN *DataLength, IN OUT UINT8 *DataToggle,
+                                     IN UINTN TimeOut,
+                                     IN EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator,
+                                     OUT UINT32 *TransferResult);
+  EFI_STATUS (EFIAPI *AsyncInterruptTransfer) (IN EFI_USB2_HC_PROTOCOL *This,
+                                               IN UINT8 DeviceAddress,
+                                               IN UINT8 EndPointAddress,
+                                               IN UINT8 DeviceSpeed,
+                                               IN UINTN MaxiumPacketLength,
+                                               IN BOOLEAN IsNewTransfer,
+                                               IN OUT UINT8 *DataToggle,
+                                               IN UINTN PollingInterval OPTIONAL,
+                                               IN UINTN DataLength OPTIONAL,
+                                               IN EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator OPTIONAL,
+                                               IN EFI_ASYNC_USB_TRANSFER_CALLBACK CallBackFunction OPTIONAL,
+                                               IN VOID *Context OPTIONAL);
+  EFI_STATUS (EFIAPI *SyncInterruptTransfer) (IN EFI_USB2_HC_PROTOCOL *This,
+                                              IN UINT8 DeviceAddress,
+                                              IN UINT8 EndPointAddress,
+                                              IN UINT8 DeviceSpeed,
+                                              IN UINTN MaximumPacketLength,
+                                              IN OUT VOID *Data,
+                                              IN OUT UINTN *DataLength,
+                                              IN OUT UINT8 *DataToggle,
+                                              IN UINTN TimeOut,
+                                              IN EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator,
+                                              OUT UINT32 *TransferResult);
+  EFI_STATUS (EFIAPI *IsochronousTransfer) (IN EFI_USB2_HC_PROTOCOL *This,
+                                            IN UINT8 DeviceAddress,
+                                            IN UINT8 EndPointAddress,
+                                            IN UINT8 DeviceSpeed,
+                                            IN UINTN MaximumPacketLength,
+                                            IN UINT8 DataBuffersNumber,
+                                            IN OUT VOID *Data[EFI_USB_MAX_ISO_BUFFER_NUM],
+                                            IN UINTN DataLength,
+                                            IN EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator,
+                                            OUT UINT32 *TransferResult);
+  EFI_STATUS (EFIAPI *AsyncIsochronousTransfer) (IN EFI_USB2_HC_PROTOCOL *This,
+                                                 IN UINT8 DeviceAddress,
+                                                 IN UINT8 EndPointAddress,
+                                                 IN UINT8 DeviceSpeed,
+                                                 IN UINTN MaximumPacketLength,
+                                                 IN UINT8 DataBuffersNumber,
+                                                 IN OUT VOID *Data[EFI_USB_MAX_ISO_BUFFER_NUM],
+                                                 IN UINTN DataLength,
+                                                 IN EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator,
+                                                 IN EFI_ASYNC_USB_TRANSFER_CALLBACK IsochronousCallBack,
+                                                 IN VOID *Context OPTIONAL);
+  EFI_STATUS (EFIAPI *GetRootHubPortStatus) (IN EFI_USB2_HC_PROTOCOL *This,
+                                             IN UINT8 PortNumber,
+                                             OUT EFI_USB_PORT_STATUS *PortStatus);
+  EFI_STATUS (EFIAPI *SetRootHubPortFeature) (IN EFI_USB2_HC_PROTOCOL *This,
+                                              IN UINT8 PortNumber,
+                                              IN EFI_USB_PORT_FEATURE PortFeature);
+  EFI_STATUS (EFIAPI *ClearRootHubPortFeature) (IN EFI_USB2_HC_PROTOCOL *This,
+                                                IN UINT8 PortNumber,
+                                                IN EFI_USB_PORT_FEATURE PortFeature);
+  UINT16  MajorRevision;
+  UINT16  MinorRevision;
+};
+
+#endif /* __HOST_UEFI_H__ */
@@ -0,0 +1,346 @@
+/** @file
+ *
+ *  Replays a DwUsbHostDxe transfer trace against FakeDwc2: each
+ *  bulk and interrupt transfer is issued again, with its endpoint
+ *  primed to answer as it did when the trace was taken (the same
+ *  amount of data, NAKs, NYETs, frame overruns, STALL or bus
+ *  error), and the driver's trace of the replay is compared with
+ *  the original. A scheduler change that alters how a captured
+ *  workload goes through shows up as a mismatch, or as a change
+ *  in the microframes it took.
+ *
+ *  The trace doesn't record device speeds: devices with complete-
+ *  splits in the trace are replayed as full-speed devices behind
+ *  a hub's TT, all others as high-speed ones.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "DwUsbHostDxe.h"
+#include "FakeDwc2.h"
+#include "TraceReplay.h"
+
+#define REPLAY_HUB_ADDRESS  127
+#define REPLAY_TIMEOUT_MS   1000
+#define REPLAY_HS_BULK_MPS  512
+#define REPLAY_FS_MPS       64
+
+#define REPLAY_BUS_ERROR    (EFI_USB_ERR_CRC | EFI_USB_ERR_TIMEOUT | \
+                             EFI_USB_ERR_BITSTUFF | EFI_USB_ERR_SYSTEM)
+
+STATIC CONST CHAR8 *mEpTypeNames[] = { "ctrl", "isoc", "bulk", "intr" };
+
+STATIC FAKE_DEVICE mDevices[FAKE_DWC2_MAX_DEVICES];
+STATIC UINTN       mDeviceCount;
+
+VOID
+TraceReplayFormat (
+  IN  CONST DW_USB_HOST_TRACE_ENTRY *Entry,
+  OUT CHAR8                         *Line,
+  IN  UINTN                         Size
+  )
+{
+  snprintf (Line, Size,
+            "%5u %3u %02x   %s %2d %8u %8u %3u %4u %4u %3u %4u %s (0x%x)",
+            Entry->StartMicroFrame, Entry->DeviceAddress, Entry->EpAddress,
+            mEpTypeNames[Entry->EpType & 3],
+            Entry->Channel == MAX_UINT8 ? -1 : (INT32) Entry->Channel,
+            Entry->Length, Entry->Actual, Entry->Restarts, Entry->Naks,
+            Entry->Csplits, Entry->FrameOverruns, Entry->MicroFrames,
+            EFI_ERROR (Entry->Status) ? "Error" : "Success",
+            Entry->TransferResult);
+}
+
+EFI_STATUS
+TraceReplayParse (
+  IN  CONST CHAR8             *Line,
+  OUT DW_USB_HOST_TRACE_ENTRY *Entry
+  )
+{
+  unsigned    Field[11];
+  int         Channel;
+  char        Type[5];
+  unsigned    Result;
+  CONST CHAR8 *Paren;
+  UINTN       Index;
+
+  if (sscanf (Line, "%u %u %x %4s %d %u %u %u %u %u %u %u",
+              &Field[0], &Field[1], &Field[2], Type, &Channel, &Field[3],
+              &Field[4], &Field[5], &Field[6], &Field[7], &Field[8],
+              &Field[9]) != 12) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Paren = strrchr (Line, '(');
+  if (Paren == NULL || sscanf (Paren, "(0x%x)", &Result) != 1) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  for (Index = 0; Index < ARRAY_SIZE (mEpTypeNames); Index++) {
+    if (strcmp (Type, mEpTypeNames[Index]) == 0) {
+      break;
+    }
+  }
+  if (Index == ARRAY_SIZE (mEpTypeNames)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  ZeroMem (Entry, sizeof (*Entry));
+  Entry->StartMicroFrame = Field[0];
+  Entry->DeviceAddress = (UINT8) Field[1];
+  Entry->EpAddress = (UINT8) Field[2];
+  Entry->EpType = (UINT8) Index;
+  Entry->Channel = Channel < 0 ? MAX_UINT8 : (UINT8) Channel;
+  Entry->Length = Field[3];
+  Entry->Actual = Field[4];
+  Entry->Restarts = Field[5];
+  Entry->Naks = Field[6];
+  Entry->Csplits = Field[7];
+  Entry->FrameOverruns = Field[8];
+  Entry->MicroFrames = Field[9];
+  Entry->TransferResult = Result;
+  Entry->Status = Result == EFI_USB_NOERROR ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+  return EFI_SUCCESS;
+}
+
+STATIC
+BOOLEAN
+ReplayReissues (
+  IN  CONST DW_USB_HOST_TRACE_ENTRY *Entry
+  )
+{
+  if (Entry->EpType != DW_USB_HOST_EP_BULK &&
+      Entry->EpType != DW_USB_HOST_EP_INTR) {
+    return FALSE;
+  }
+
+  /*
+   * Timeouts and running out of channels depend on what else
+   * was going on, which the trace doesn't have.
+   */
+  return Entry->TransferResult == EFI_USB_NOERROR ||
+    Entry->TransferResult == EFI_USB_ERR_STALL ||
+    Entry->TransferResult == EFI_USB_ERR_NAK ||
+    Entry->TransferResult == REPLAY_BUS_ERROR;
+}
+
+STATIC
+FAKE_DEVICE *
+ReplayDevice (
+  IN  UINT8 Address
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < mDeviceCount; Index++) {
+    if (mDevices[Index].Address == Address) {
+      return &mDevices[Index];
+    }
+  }
+
+  if (mDeviceCount == ARRAY_SIZE (mDevices)) {
+    return NULL;
+  }
+
+  ZeroMem (&mDevices[mDeviceCount], sizeof (mDevices[0]));
+  mDevices[mDeviceCount].Address = Address;
+  FakeDwc2Attach (&mDevices[mDeviceCount]);
+  return &mDevices[mDeviceCount++];
+}
+
+/*
+ * Primes the endpoint to answer the next transfer as in Entry:
+ * errors go ahead of the data, as FakeDwc2 plays them in order.
+ */
+STATIC
+VOID
+ReplayPrime (
+  IN  FAKE_DEVICE                   *Device,
+  IN  CONST DW_USB_HOST_TRACE_ENTRY *Entry,
+  IN  UINT8                         *Data
+  )
+{
+  FAKE_ENDPOINT *Ep;
+  UINT32        StartSplits;
+
+  if ((Entry->EpAddress & BIT7) != 0) {
+    Ep = &Device->In[Entry->EpAddress & 0xF];
+    Ep->InData = Data;
+    Ep->InLength = Entry->Actual;
+    Ep->InOffset = 0;
+  } else {
+    Ep = &Device->Out[Entry->EpAddress & 0xF];
+    Ep->OutData = Data;
+    Ep->OutCapacity = Entry->Length;
+    Ep->OutLength = 0;
+  }
+
+  Ep->Naks = Entry->Naks;
+  Ep->FrameOverruns = Entry->FrameOverruns;
+  Ep->Stall = (Entry->TransferResult & EFI_USB_ERR_STALL) != 0;
+  Ep->XactErrors = Entry->TransferResult == REPLAY_BUS_ERROR ? 1 : 0;
+
+  /*
+   * Every start-split the TT takes, one per packet and one more
+   * per restart, is followed by one complete-split more than the
+   * NYETs it answers.
+   */
+  Ep->Nyets = 0;
+  if (Device->TtHub != 0) {
+    StartSplits = MAX (1, (Entry->Actual + REPLAY_FS_MPS - 1) / REPLAY_FS_MPS) +
+                  Entry->Restarts;
+    if (Entry->Csplits > StartSplits) {
+      Ep->Nyets = Entry->Csplits - StartSplits;
+    }
+  }
+}
+
+STATIC
+BOOLEAN
+ReplayMatches (
+  IN  CONST DW_USB_HOST_TRACE_ENTRY *Recorded,
+  IN  CONST DW_USB_HOST_TRACE_ENTRY *Replayed
+  )
+{
+  return Recorded->Length == Replayed->Length &&
+    Recorded->Actual == Replayed->Actual &&
+    Recorded->Restarts == Replayed->Restarts &&
+    Recorded->Naks == Replayed->Naks &&
+    Recorded->Csplits == Replayed->Csplits &&
+    Recorded->FrameOverruns == Replayed->FrameOverruns &&
+    Recorded->TransferResult == Replayed->TransferResult;
+}
+
+STATIC
+EFI_STATUS
+ReplayTransfer (
+  IN  EFI_USB2_HC_PROTOCOL              *Hc,
+  IN  FAKE_DEVICE                       *Device,
+  IN  CONST DW_USB_HOST_TRACE_ENTRY     *Entry,
+  IN  UINT8                             *Data
+  )
+{
+  EFI_USB2_HC_TRANSACTION_TRANSLATOR Translator;
+  VOID                               *Buffers[EFI_USB_MAX_BULK_BUFFER_NUM];
+  UINT8                              Speed;
+  UINTN                              MaxPacket;
+  UINTN                              Length;
+  UINT8                              Toggle;
+  UINT32                             Result;
+
+  Translator.TranslatorHubAddress = Device->TtHub;
+  Translator.TranslatorPortNumber = Device->TtPort;
+  Speed = Device->TtHub != 0 ? EFI_USB_SPEED_FULL : EFI_USB_SPEED_HIGH;
+  Length = Entry->Length;
+  Toggle = 0;
+
+  if (Entry->EpType == DW_USB_HOST_EP_BULK) {
+    MaxPacket = Device->TtHub != 0 ? REPLAY_FS_MPS : REPLAY_HS_BULK_MPS;
+    ZeroMem (Buffers, sizeof (Buffers));
+    Buffers[0] = Data;
+    return Hc->BulkTransfer (Hc, Entry->DeviceAddress, Entry->EpAddress,
+                             Speed, MaxPacket, 1, Buffers, &Length, &Toggle,
+                             REPLAY_TIMEOUT_MS, &Translator, &Result);
+  }
+
+  MaxPacket = MIN (MAX (Entry->Length, 1), REPLAY_FS_MPS);
+  return Hc->SyncInterruptTransfer (Hc, Entry->DeviceAddress,
+                                    Entry->EpAddress, Speed, MaxPacket,
+                                    Data, &Length, &Toggle,
+                                    REPLAY_TIMEOUT_MS, &Translator, &Result);
+}
+
+VOID
+TraceReplay (
+  IN  CONST DW_USB_HOST_TRACE_ENTRY *Entries,
+  IN  UINTN                         Count,
+  OUT TRACE_REPLAY_RESULT           *Result
+  )
+{
+  EFI_STATUS              Status;
+  DWUSB_OTGHC_DEV         *DwHc;
+  FAKE_DEVICE             *Device;
+  DW_USB_HOST_TRACE_ENTRY Replayed;
+  UINTN                   Index;
+  UINTN                   Traced;
+  UINT32                  MaxLength;
+  UINT8                   *Data;
+  CHAR8                   Line[128];
+
+  ZeroMem (Result, sizeof (*Result));
+  FakeDwc2Init ();
+  mDeviceCount = 0;
+
+  MaxLength = 0;
+  for (Index = 0; Index < Count; Index++) {
+    if (!ReplayReissues (&Entries[Index])) {
+      continue;
+    }
+
+    MaxLength = MAX (MaxLength, Entries[Index].Length);
+    Device = ReplayDevice (Entries[Index].DeviceAddress);
+    if (Device != NULL && Entries[Index].Csplits != 0) {
+      Device->TtHub = REPLAY_HUB_ADDRESS;
+      Device->TtPort = 1;
+    }
+  }
+
+  Data = AllocatePool (MAX (MaxLength, 1));
+  for (Index = 0; Index < MaxLength; Index++) {
+    Data[Index] = (UINT8) Index;
+  }
+
+  Status = CreateDwUsbHc (&DwHc);
+  if (!EFI_ERROR (Status)) {
+    Status = DwHc->DwUsbOtgHc.Reset (&DwHc->DwUsbOtgHc,
+                                     EFI_USB_HC_RESET_GLOBAL);
+  }
+  if (EFI_ERROR (Status)) {
+    fprintf (stderr, "controller setup: 0x%llx\n", (unsigned long long) Status);
+    exit (1);
+  }
+
+  for (Index = 0; Index < Count; Index++) {
+    Device = ReplayDevice (Entries[Index].DeviceAddress);
+    if (!ReplayReissues (&Entries[Index]) || Device == NULL) {
+      Result->Skipped++;
+      continue;
+    }
+
+    ReplayPrime (Device, &Entries[Index], Data);
+    Traced = DwHc->TraceNext;
+    ReplayTransfer (&DwHc->DwUsbOtgHc, Device, &Entries[Index], Data);
+    Result->Replayed++;
+    Result->RecordedMicroFrames += Entries[Index].MicroFrames;
+
+    if (Traced == DwHc->TraceNext ||
+        EFI_ERROR (DwHc->TraceProtocol.GetTraceEntry (&DwHc->TraceProtocol,
+                                                      0, &Replayed))) {
+      ZeroMem (&Replayed, sizeof (Replayed));
+    }
+    Result->ReplayedMicroFrames += Replayed.MicroFrames;
+
+    if (!ReplayMatches (&Entries[Index], &Replayed)) {
+      Result->Mismatches++;
+      TraceReplayFormat (&Entries[Index], Line, sizeof (Line));
+      fprintf (stderr, "recorded %s\n", Line);
+      TraceReplayFormat (&Replayed, Line, sizeof (Line));
+      fprintf (stderr, "replayed %s\n", Line);
+    }
+  }
+
+  DestroyDwUsbHc (DwHc);
+  FreePool (Data);
+}
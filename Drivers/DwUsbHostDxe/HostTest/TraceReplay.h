@@ -0,0 +1,73 @@
+/** @file
+ *
+ *  Replays a DwUsbHostDxe transfer trace against FakeDwc2.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#ifndef __TRACE_REPLAY_H__
+#define __TRACE_REPLAY_H__
+
+#include "HostUefi.h"
+#include <Protocol/DwUsbHostTrace.h>
+
+typedef struct {
+  UINTN  Replayed;
+  /*
+   * Control and isochronous transfers, which the trace doesn't
+   * hold enough to reissue, and transfers that timed out.
+   */
+  UINTN  Skipped;
+  /*
+   * Replayed transfers whose length, result or retry counts came
+   * out differently.
+   */
+  UINTN  Mismatches;
+  UINT64 RecordedMicroFrames;
+  UINT64 ReplayedMicroFrames;
+} TRACE_REPLAY_RESULT;
+
+/*
+ * Formats Entry as one line of the transfer trace DwHcLogTrace
+ * writes to the diagnostics log.
+ */
+VOID
+TraceReplayFormat (
+  IN  CONST DW_USB_HOST_TRACE_ENTRY *Entry,
+  OUT CHAR8                         *Line,
+  IN  UINTN                         Size
+  );
+
+/*
+ * Parses one line of a diagnostics log transfer trace. Fails with
+ * EFI_INVALID_PARAMETER for anything else, such as the headings.
+ */
+EFI_STATUS
+TraceReplayParse (
+  IN  CONST CHAR8             *Line,
+  OUT DW_USB_HOST_TRACE_ENTRY *Entry
+  );
+
+/*
+ * Issues the bulk and interrupt transfers in Entries, oldest first,
+ * on a controller of its own over a fresh FakeDwc2, with each
+ * device primed to answer as it did when the trace was taken.
+ * Mismatches are printed to stderr.
+ */
+VOID
+TraceReplay (
+  IN  CONST DW_USB_HOST_TRACE_ENTRY *Entries,
+  IN  UINTN                         Count,
+  OUT TRACE_REPLAY_RESULT           *Result
+  );
+
+#endif /* __TRACE_REPLAY_H__ */
@@ -0,0 +1,181 @@
+/** @file
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include "DwUsbHostDxe.h"
+
+/*
+ * Transfer trace ring and per-endpoint counters. Transfers can
+ * be preempted by the periodic handler, so both are only
+ * touched at TPL_NOTIFY.
+ */
+
+STATIC
+DW_USB_HOST_ENDPOINT_STATS *
+DwHcFindEndpointStats (
+  IN  DWUSB_OTGHC_DEV         *DwHc,
+  IN  DW_USB_HOST_TRACE_ENTRY *Entry
+  )
+{
+  UINTN                      Index;
+  DW_USB_HOST_ENDPOINT_STATS *Stats;
+
+  for (Index = 0; Index < DwHc->EndpointCount; Index++) {
+    Stats = &DwHc->EndpointStats[Index];
+    if (Stats->DeviceAddress == Entry->DeviceAddress &&
+        Stats->EpAddress == Entry->EpAddress &&
+        Stats->EpType == Entry->EpType) {
+      return Stats;
+    }
+  }
+
+  if (DwHc->EndpointCount == TRACE_MAX_ENDPOINTS) {
+    return NULL;
+  }
+
+  Stats = &DwHc->EndpointStats[DwHc->EndpointCount++];
+  ZeroMem (Stats, sizeof (*Stats));
+  Stats->DeviceAddress = Entry->DeviceAddress;
+  Stats->EpAddress = Entry->EpAddress;
+  Stats->EpType = Entry->EpType;
+  return Stats;
+}
+
+VOID
+DwHcTraceTransfer (
+  IN  DWUSB_OTGHC_DEV         *DwHc,
+  IN  DW_USB_HOST_TRACE_ENTRY *Entry
+  )
+{
+  EFI_TPL                    Tpl;
+  DW_USB_HOST_ENDPOINT_STATS *Stats;
+
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+
+  Stats = DwHcFindEndpointStats (DwHc, Entry);
+  if (Stats != NULL) {
+    Stats->Transfers++;
+    Stats->Bytes += Entry->Actual;
+    Stats->Restarts += Entry->Restarts;
+    Stats->Naks += Entry->Naks;
+    Stats->Csplits += Entry->Csplits;
+    Stats->FrameOverruns += Entry->FrameOverruns;
+    Stats->MicroFrames += Entry->MicroFrames;
+    Stats->CopyNs += Entry->CopyNs;
+    Stats->SetupNs += Entry->SetupNs;
+    Stats->WaitNs += Entry->WaitNs;
+    if (EFI_ERROR (Entry->Status) &&
+        Entry->TransferResult != EFI_USB_ERR_NAK) {
+      Stats->Errors++;
+    }
+  }
+
+  /*
+   * Interrupt endpoints are polled continuously and mostly NAK,
+   * which would flush everything else out of the ring. They only
+   * show up in the counters.
+   */
+  if (Entry->EpType == DW_USB_HOST_EP_INTR &&
+      Entry->TransferResult == EFI_USB_ERR_NAK) {
+    gBS->RestoreTPL (Tpl);
+    return;
+  }
+
+  CopyMem (&DwHc->Trace[DwHc->TraceNext], Entry, sizeof (*Entry));
+  DwHc->TraceNext = (DwHc->TraceNext + 1) % TRACE_RING_SIZE;
+  if (DwHc->TraceCount < TRACE_RING_SIZE) {
+    DwHc->TraceCount++;
+  }
+
+  gBS->RestoreTPL (Tpl);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+DwHcGetTraceEntry (
+  IN  DW_USB_HOST_TRACE_PROTOCOL *This,
+  IN  UINTN                      Index,
+  OUT DW_USB_HOST_TRACE_ENTRY    *Entry
+  )
+{
+  EFI_TPL         Tpl;
+  DWUSB_OTGHC_DEV *DwHc;
+
+  DwHc = DWHC_FROM_TRACE_THIS (This);
+
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+  if (Index >= DwHc->TraceCount) {
+    gBS->RestoreTPL (Tpl);
+    return EFI_NOT_FOUND;
+  }
+
+  CopyMem (Entry, &DwHc->Trace[(DwHc->TraceNext + TRACE_RING_SIZE - 1 - Index) %
+                               TRACE_RING_SIZE], sizeof (*Entry));
+  gBS->RestoreTPL (Tpl);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+DwHcGetEndpointStats (
+  IN  DW_USB_HOST_TRACE_PROTOCOL *This,
+  IN  UINTN                      Index,
+  OUT DW_USB_HOST_ENDPOINT_STATS *Stats
+  )
+{
+  EFI_TPL         Tpl;
+  DWUSB_OTGHC_DEV *DwHc;
+
+  DwHc = DWHC_FROM_TRACE_THIS (This);
+
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+  if (Index >= DwHc->EndpointCount) {
+    gBS->RestoreTPL (Tpl);
+    return EFI_NOT_FOUND;
+  }
+
+  CopyMem (Stats, &DwHc->EndpointStats[Index], sizeof (*Stats));
+  gBS->RestoreTPL (Tpl);
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+EFIAPI
+DwHcResetTrace (
+  IN  DW_USB_HOST_TRACE_PROTOCOL *This
+  )
+{
+  EFI_TPL         Tpl;
+  DWUSB_OTGHC_DEV *DwHc;
+
+  DwHc = DWHC_FROM_TRACE_THIS (This);
+
+  Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+  DwHc->TraceNext = 0;
+  DwHc->TraceCount = 0;
+  DwHc->EndpointCount = 0;
+  gBS->RestoreTPL (Tpl);
+}
+
+VOID
+DwHcInitTrace (
+  IN  DWUSB_OTGHC_DEV *DwHc
+  )
+{
+  DwHc->TraceProtocol.GetTraceEntry = DwHcGetTraceEntry;
+  DwHc->TraceProtocol.GetEndpointStats = DwHcGetEndpointStats;
+  DwHc->TraceProtocol.ResetTrace = DwHcResetTrace;
+}
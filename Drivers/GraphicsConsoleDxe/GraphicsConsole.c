@@ -43,6 +43,16 @@ GRAPHICS_CONSOLE_DEV    mGraphicsConsoleDevTemplate = {
   },
   (GRAPHICS_CONSOLE_MODE_DATA *) NULL,
   (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *) NULL,
+  (GRAPHICS_CONSOLE_GLYPH *) NULL,
+  (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *) NULL,
+  0,
+  0,
+  FALSE,
+  (EFI_EVENT) NULL,
+  (EFI_EVENT) NULL,
+  (DISPLAY_SCROLL_PROTOCOL *) NULL,
+  0,
+  {0, 0, 0, 0},
   {
     (EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *) NULL,
     (EFI_GRAPHICS_OUTPUT_PROTOCOL *) NULL,
@@ -399,6 +409,27 @@ GraphicsConsoleControllerDriverStart (
   Private->ExtendedTextOutput.TextOut = &(Private->SimpleTextOutput);
   Private->ExtendedTextOutput.GraphicsOutput = Private->GraphicsOutput;
 
+  //
+  // The glyph cache is only an accelerator; without it all text goes
+  // through the HII Font protocol.
+  //
+  Private->GlyphCache = AllocateZeroPool (sizeof (GRAPHICS_CONSOLE_GLYPH) * GLYPH_CACHE_SIZE);
+
+  //
+  // Optional: lets a scroll pan the display instead of redrawing it.
+  //
+  Status = gBS->OpenProtocol (
+                  Controller,
+                  &gDisplayScrollProtocolGuid,
+                  (VOID **) &Private->DisplayScroll,
+                  This->DriverBindingHandle,
+                  Controller,
+                  EFI_OPEN_PROTOCOL_GET_PROTOCOL
+                  );
+  if (EFI_ERROR (Status)) {
+    Private->DisplayScroll = NULL;
+  }
+
   HorizontalResolution  = PcdGet32 (PcdVideoHorizontalResolution);
   VerticalResolution    = PcdGet32 (PcdVideoVerticalResolution);
 
@@ -527,6 +558,10 @@ GraphicsConsoleControllerDriverStart (
                   NULL
                   );
 
+  if (!EFI_ERROR (Status) && PcdGet32 (PcdDisplayDisableConsoleBatching) == 0) {
+    GraphicsConsoleStartBatching (Private);
+  }
+
 Error:
   if (EFI_ERROR (Status)) {
     //
@@ -543,6 +578,14 @@ Error:
       FreePool (Private->LineBuffer);
     }
 
+    if (Private->ShadowBuffer != NULL) {
+      FreePool (Private->ShadowBuffer);
+    }
+
+    if (Private->GlyphCache != NULL) {
+      FreePool (Private->GlyphCache);
+    }
+
     if (Private->ModeData != NULL) {
       FreePool (Private->ModeData);
     }
@@ -610,6 +653,8 @@ GraphicsConsoleControllerDriverStop (
                   );
 
   if (!EFI_ERROR (Status)) {
+    GraphicsConsoleStopBatching (Private);
+
     //
     // Close GOP.
     //
@@ -624,6 +669,14 @@ GraphicsConsoleControllerDriverStop (
       FreePool (Private->LineBuffer);
     }
 
+    if (Private->ShadowBuffer != NULL) {
+      FreePool (Private->ShadowBuffer);
+    }
+
+    if (Private->GlyphCache != NULL) {
+      FreePool (Private->GlyphCache);
+    }
+
     if (Private->ModeData != NULL) {
       FreePool (Private->ModeData);
     }
@@ -805,19 +858,16 @@ GraphicsConsoleConOutOutputString (
   )
 {
   GRAPHICS_CONSOLE_DEV  *Private;
-  EFI_GRAPHICS_OUTPUT_PROTOCOL   *GraphicsOutput;
   INTN                  Mode;
   UINTN                 MaxColumn;
   UINTN                 MaxRow;
   UINTN                 Width;
   UINTN                 Height;
-  UINTN                 Delta;
   EFI_STATUS            Status;
   BOOLEAN               Warning;
+  BOOLEAN               Nested;
   EFI_GRAPHICS_OUTPUT_BLT_PIXEL  Foreground;
   EFI_GRAPHICS_OUTPUT_BLT_PIXEL  Background;
-  UINTN                 DeltaX;
-  UINTN                 DeltaY;
   UINTN                 Count;
   UINTN                 Index;
   INT32                 OriginAttribute;
@@ -838,15 +888,18 @@ GraphicsConsoleConOutOutputString (
   //
   Mode      = This->Mode->Mode;
   Private   = GRAPHICS_CONSOLE_CON_OUT_DEV_FROM_THIS (This);
-  GraphicsOutput = Private->GraphicsOutput;
 
   MaxColumn = Private->ModeData[Mode].Columns;
   MaxRow    = Private->ModeData[Mode].Rows;
-  DeltaX    = (UINTN) Private->ModeData[Mode].DeltaX;
-  DeltaY    = (UINTN) Private->ModeData[Mode].DeltaY;
   Width     = MaxColumn * EFI_GLYPH_WIDTH;
   Height    = (MaxRow - 1) * EFI_GLYPH_HEIGHT;
-  Delta     = Width * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL);
+
+  //
+  // OutputString recurses for wrapping and backspace, only the outermost
+  // call flushes the shadow buffer.
+  //
+  Nested = Private->InOutputString;
+  Private->InOutputString = TRUE;
 
   //
   // The Attributes won't change when during the time OutputString is called
@@ -899,34 +952,31 @@ GraphicsConsoleConOutOutputString (
         //
         // Scroll Screen Up One Row
         //
-        GraphicsOutput->Blt (
-                             GraphicsOutput,
-                             NULL,
-                             EfiBltVideoToVideo,
-                             DeltaX,
-                             DeltaY + EFI_GLYPH_HEIGHT,
-                             DeltaX,
-                             DeltaY,
-                             Width,
-                             Height,
-                             Delta
-                             );
+        CopyMem (
+          Private->ShadowBuffer,
+          Private->ShadowBuffer + Width * EFI_GLYPH_HEIGHT,
+          Width * Height * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL)
+          );
 
         //
         // Print Blank Line at last line
         //
-        GraphicsOutput->Blt (
-                             GraphicsOutput,
-                             &Background,
-                             EfiBltVideoFill,
-                             0,
-                             0,
-                             DeltaX,
-                             DeltaY + Height,
-                             Width,
-                             EFI_GLYPH_HEIGHT,
-                             Delta
-                             );
+        ShadowFill (Private, MaxRow - 1, 1, &Background);
+        if (Private->DisplayScroll != NULL) {
+          //
+          // The screen is panned at the next flush, so rows that were
+          // dirty are now one row higher, and only the new last row
+          // needs drawing.
+          //
+          Private->PendingScroll++;
+          if (Private->DirtyStart < Private->DirtyEnd) {
+            Private->DirtyStart = (Private->DirtyStart > 0) ? Private->DirtyStart - 1 : 0;
+            Private->DirtyEnd--;
+          }
+          ShadowMarkDirty (Private, MaxRow - 1, 1);
+        } else {
+          ShadowMarkDirty (Private, 0, MaxRow);
+        }
       } else {
         This->Mode->CursorRow++;
       }
@@ -1023,6 +1073,14 @@ GraphicsConsoleConOutOutputString (
 
   FlushCursor (This);
 
+  //
+  // When batching, the flush timer writes the dirty rows out.
+  //
+  Private->InOutputString = Nested;
+  if (!Nested && Private->FlushEvent == NULL) {
+    ShadowFlush (Private);
+  }
+
   if (Warning) {
     Status = EFI_WARN_UNKNOWN_GLYPH;
   }
@@ -1169,6 +1227,7 @@ GraphicsConsoleConOutSetMode (
   GRAPHICS_CONSOLE_DEV            *Private;
   GRAPHICS_CONSOLE_MODE_DATA      *ModeData;
   EFI_GRAPHICS_OUTPUT_BLT_PIXEL   *NewLineBuffer;
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL   *NewShadowBuffer;
   EFI_GRAPHICS_OUTPUT_PROTOCOL    *GraphicsOutput;
   EFI_TPL                         OldTpl;
 
@@ -1209,12 +1268,10 @@ GraphicsConsoleConOutSetMode (
     }
     //
     // Otherwise, the size of the text console and/or the GOP mode will
-    // be changed, so erase the cursor, and free the LineBuffer for the
-    // current mode
+    // be changed, so erase the cursor. The LineBuffer and ShadowBuffer for
+    // the current mode are freed once the new ones have been allocated.
     //
     FlushCursor (This);
-
-    FreePool (Private->LineBuffer);
   }
 
   //
@@ -1231,10 +1288,27 @@ GraphicsConsoleConOutSetMode (
     goto Done;
   }
 
+  NewShadowBuffer = AllocatePool (
+                      sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL) *
+                      ModeData->Columns * EFI_GLYPH_WIDTH *
+                      ModeData->Rows * EFI_GLYPH_HEIGHT
+                      );
+  if (NewShadowBuffer == NULL) {
+    FreePool (NewLineBuffer);
+    Status = EFI_OUT_OF_RESOURCES;
+    goto Done;
+  }
+
+  if (Private->LineBuffer != NULL) {
+    FreePool (Private->LineBuffer);
+    FreePool (Private->ShadowBuffer);
+  }
+
   //
   // Assign the current line buffer to the newly allocated line buffer
   //
-  Private->LineBuffer = NewLineBuffer;
+  Private->LineBuffer   = NewLineBuffer;
+  Private->ShadowBuffer = NewShadowBuffer;
 
   if (ModeData->GopModeNumber != GraphicsOutput->Mode->Mode) {
     //
@@ -1271,6 +1345,15 @@ GraphicsConsoleConOutSetMode (
   //
   This->Mode->Mode = (INT32) ModeNumber;
 
+  //
+  // The display was cleared to black by either path above.
+  //
+  ShadowFill (Private, 0, ModeData->Rows, &mGraphicsEfiColors[0]);
+  Private->DirtyStart    = 0;
+  Private->DirtyEnd      = 0;
+  Private->PendingScroll = 0;
+  Private->MarginColor   = mGraphicsEfiColors[0];
+
   //
   // Move the text cursor to the upper left hand corner of the display and flush it
   //
@@ -1278,6 +1361,7 @@ GraphicsConsoleConOutSetMode (
   This->Mode->CursorRow     = 0;
 
   FlushCursor (This);  
+  ShadowSync (Private);
 
   Status = EFI_SUCCESS;
 
@@ -1388,10 +1472,20 @@ GraphicsConsoleConOutClearScreen (
                                 0
                                 );
 
+  //
+  // The screen was filled directly, so the cleared shadow is not dirty.
+  //
+  ShadowFill (Private, 0, ModeData->Rows, &Background);
+  Private->DirtyStart    = 0;
+  Private->DirtyEnd      = 0;
+  Private->PendingScroll = 0;
+  Private->MarginColor   = Background;
+
   This->Mode->CursorColumn  = 0;
   This->Mode->CursorRow     = 0;
 
   FlushCursor (This);
+  ShadowSync (Private);
 
   gBS->RestoreTPL (OldTpl);
 
@@ -1506,6 +1600,7 @@ GraphicsConsoleConOutEnableCursor (
   This->Mode->CursorVisible = Visible;
 
   FlushCursor (This);
+  ShadowSync (GRAPHICS_CONSOLE_CON_OUT_DEV_FROM_THIS (This));
 
   gBS->RestoreTPL (OldTpl);
   return EFI_SUCCESS;
@@ -1538,6 +1633,162 @@ GetTextColors (
   return EFI_SUCCESS;
 }
 
+/**
+  Find the built-in narrow glyph for a Unicode character.
+
+  @param  UnicodeWeight         The character to look up.
+
+  @return The glyph, or NULL if the built-in font has no plain narrow glyph
+          for the character.
+
+**/
+STATIC
+EFI_NARROW_GLYPH *
+FindNarrowGlyph (
+  IN  CHAR16                           UnicodeWeight
+  )
+{
+  EFI_NARROW_GLYPH  *Glyph;
+
+  for (Glyph = gUsStdNarrowGlyphData; Glyph->UnicodeWeight != 0; Glyph++) {
+    if (Glyph->UnicodeWeight == UnicodeWeight) {
+      //
+      // Non-spacing glyphs combine with the previous cell, leave
+      // those to HII.
+      //
+      return Glyph->Attributes == 0 ? Glyph : NULL;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Return the pre-rendered cell for a character in the given colors,
+  rendering it into the glyph cache on a miss.
+
+  @param  Private               The graphics console device.
+  @param  UnicodeWeight         The character to render.
+  @param  Attribute             The text attribute, foreground and background.
+
+  @return The EFI_GLYPH_HEIGHT x EFI_GLYPH_WIDTH cell, or NULL if the
+          character cannot be rendered from the built-in font.
+
+**/
+STATIC
+EFI_GRAPHICS_OUTPUT_BLT_PIXEL *
+GlyphCacheLookup (
+  IN  GRAPHICS_CONSOLE_DEV             *Private,
+  IN  CHAR16                           UnicodeWeight,
+  IN  UINT8                            Attribute
+  )
+{
+  GRAPHICS_CONSOLE_GLYPH         *Entry;
+  EFI_NARROW_GLYPH               *Glyph;
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL  Foreground;
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL  Background;
+  UINTN                          PosX;
+  UINTN                          PosY;
+
+  Entry = &Private->GlyphCache[(UnicodeWeight + Attribute * 97) & (GLYPH_CACHE_SIZE - 1)];
+  if (Entry->Valid &&
+      Entry->UnicodeWeight == UnicodeWeight &&
+      Entry->Attribute == Attribute) {
+    return &Entry->Cell[0][0];
+  }
+
+  Glyph = FindNarrowGlyph (UnicodeWeight);
+  if (Glyph == NULL) {
+    return NULL;
+  }
+
+  Foreground = mGraphicsEfiColors[Attribute & 0x0f];
+  Background = mGraphicsEfiColors[Attribute >> 4];
+
+  for (PosY = 0; PosY < EFI_GLYPH_HEIGHT; PosY++) {
+    for (PosX = 0; PosX < EFI_GLYPH_WIDTH; PosX++) {
+      if ((Glyph->GlyphCol1[PosY] & (BIT0 << PosX)) != 0) {
+        Entry->Cell[PosY][EFI_GLYPH_WIDTH - PosX - 1] = Foreground;
+      } else {
+        Entry->Cell[PosY][EFI_GLYPH_WIDTH - PosX - 1] = Background;
+      }
+    }
+  }
+
+  Entry->UnicodeWeight = UnicodeWeight;
+  Entry->Attribute     = Attribute;
+  Entry->Valid         = TRUE;
+
+  return &Entry->Cell[0][0];
+}
+
+/**
+  Draw a run of narrow characters from the glyph cache.
+
+  The cells are copied into the shadow buffer, so nothing is allocated
+  on this path.
+
+  @param  This                  Protocol instance pointer.
+  @param  UnicodeWeight         One Unicode string to be displayed.
+  @param  Count                 The count of Unicode string.
+
+  @retval EFI_SUCCESS           The run was drawn.
+  @retval EFI_UNSUPPORTED       The run cannot be drawn from the cache, the
+                                caller must use HII instead.
+
+**/
+STATIC
+EFI_STATUS
+DrawCachedGlyphsAtCursorN (
+  IN  EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL  *This,
+  IN  CHAR16                           *UnicodeWeight,
+  IN  UINTN                            Count
+  )
+{
+  GRAPHICS_CONSOLE_DEV           *Private;
+  GRAPHICS_CONSOLE_MODE_DATA     *ModeData;
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL  *Cell;
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL  *Row;
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL  *Dest;
+  UINTN                          Width;
+  UINTN                          Index;
+  UINTN                          PosY;
+  UINT8                          Attribute;
+
+  Private  = GRAPHICS_CONSOLE_CON_OUT_DEV_FROM_THIS (This);
+  ModeData = &Private->ModeData[This->Mode->Mode];
+
+  if (Private->GlyphCache == NULL ||
+      (This->Mode->Attribute & EFI_WIDE_ATTRIBUTE) != 0 ||
+      Count == 0 ||
+      (UINTN) This->Mode->CursorColumn + Count > ModeData->Columns) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Attribute = (UINT8) (This->Mode->Attribute & 0x7F);
+  Width     = ModeData->Columns * EFI_GLYPH_WIDTH;
+  Row       = Private->ShadowBuffer +
+              This->Mode->CursorRow * EFI_GLYPH_HEIGHT * Width +
+              This->Mode->CursorColumn * EFI_GLYPH_WIDTH;
+
+  for (Index = 0; Index < Count; Index++) {
+    Cell = GlyphCacheLookup (Private, UnicodeWeight[Index], Attribute);
+    if (Cell == NULL) {
+      return EFI_UNSUPPORTED;
+    }
+
+    Dest = Row + Index * EFI_GLYPH_WIDTH;
+    for (PosY = 0; PosY < EFI_GLYPH_HEIGHT; PosY++) {
+      CopyMem (Dest, Cell, EFI_GLYPH_WIDTH * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+      Dest += Width;
+      Cell += EFI_GLYPH_WIDTH;
+    }
+  }
+
+  ShadowMarkDirty (Private, This->Mode->CursorRow, 1);
+  return EFI_SUCCESS;
+}
+
 /**
   Draw Unicode string on the Graphics Console device's screen.
 
@@ -1563,14 +1814,23 @@ DrawUnicodeWeightAtCursorN (
   EFI_STRING                        String;
   EFI_FONT_DISPLAY_INFO             *FontInfo;
 
+  //
+  // Plain narrow text is drawn straight from the glyph cache. Anything
+  // else (wide text, glyphs outside the built-in font) goes through HII.
+  //
+  Status = DrawCachedGlyphsAtCursorN (This, UnicodeWeight, Count);
+  if (Status != EFI_UNSUPPORTED) {
+    return Status;
+  }
+
   Private = GRAPHICS_CONSOLE_CON_OUT_DEV_FROM_THIS (This);
   Blt = (EFI_IMAGE_OUTPUT *) AllocateZeroPool (sizeof (EFI_IMAGE_OUTPUT));
   if (Blt == NULL) {
     return EFI_OUT_OF_RESOURCES;
   }
 
-  Blt->Width        = (UINT16) (Private->ModeData[This->Mode->Mode].GopWidth);
-  Blt->Height       = (UINT16) (Private->ModeData[This->Mode->Mode].GopHeight);
+  Blt->Width        = (UINT16) (Private->ModeData[This->Mode->Mode].Columns * EFI_GLYPH_WIDTH);
+  Blt->Height       = (UINT16) (Private->ModeData[This->Mode->Mode].Rows * EFI_GLYPH_HEIGHT);
 
   String = AllocateCopyPool ((Count + 1) * sizeof (CHAR16), UnicodeWeight);
   if (String == NULL) {
@@ -1594,22 +1854,23 @@ DrawUnicodeWeightAtCursorN (
   GetTextColors (This, &FontInfo->ForegroundColor, &FontInfo->BackgroundColor);
 
   //
-  // If Graphics Output protocol exists, using HII Font protocol to draw.
+  // Use HII Font protocol to draw into the shadow buffer.
   //
-  Blt->Image.Screen = Private->GraphicsOutput;
+  Blt->Image.Bitmap = Private->ShadowBuffer;
 
   Status = mHiiFont->StringToImage (
                                     mHiiFont,
-                                    EFI_HII_IGNORE_IF_NO_GLYPH | EFI_HII_DIRECT_TO_SCREEN | EFI_HII_IGNORE_LINE_BREAK,
+                                    EFI_HII_IGNORE_IF_NO_GLYPH | EFI_HII_IGNORE_LINE_BREAK,
                                     String,
                                     FontInfo,
                                     &Blt,
-                                    This->Mode->CursorColumn * EFI_GLYPH_WIDTH + Private->ModeData[This->Mode->Mode].DeltaX,
-                                    This->Mode->CursorRow * EFI_GLYPH_HEIGHT + Private->ModeData[This->Mode->Mode].DeltaY,
+                                    This->Mode->CursorColumn * EFI_GLYPH_WIDTH,
+                                    This->Mode->CursorRow * EFI_GLYPH_HEIGHT,
                                     NULL,
                                     NULL,
                                     NULL
                                     );
+  ShadowMarkDirty (Private, This->Mode->CursorRow, 1);
 
   if (Blt != NULL) {
     FreePool (Blt);
@@ -1642,13 +1903,15 @@ FlushCursor (
   )
 {
   GRAPHICS_CONSOLE_DEV                *Private;
+  GRAPHICS_CONSOLE_MODE_DATA          *ModeData;
   EFI_SIMPLE_TEXT_OUTPUT_MODE         *CurrentMode;
   INTN                                GlyphX;
   INTN                                GlyphY;
   EFI_GRAPHICS_OUTPUT_PROTOCOL        *GraphicsOutput;
   EFI_GRAPHICS_OUTPUT_BLT_PIXEL_UNION Foreground;
   EFI_GRAPHICS_OUTPUT_BLT_PIXEL_UNION Background;
-  EFI_GRAPHICS_OUTPUT_BLT_PIXEL_UNION BltChar[EFI_GLYPH_HEIGHT][EFI_GLYPH_WIDTH];
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL_UNION *Cell;
+  UINTN                               Width;
   UINTN                               PosX;
   UINTN                               PosY;
 
@@ -1661,57 +1924,405 @@ FlushCursor (
   Private = GRAPHICS_CONSOLE_CON_OUT_DEV_FROM_THIS (This);
   GraphicsOutput = Private->GraphicsOutput;
 
+  if (CurrentMode->Mode == -1 || Private->ShadowBuffer == NULL) {
+    return EFI_SUCCESS;
+  }
+
+  ModeData = &Private->ModeData[CurrentMode->Mode];
+  Width    = ModeData->Columns * EFI_GLYPH_WIDTH;
+
   //
   // In this driver, only narrow character was supported.
   //
-  //
-  // Blt a character to the screen
-  //
-  GlyphX  = (CurrentMode->CursorColumn * EFI_GLYPH_WIDTH) + Private->ModeData[CurrentMode->Mode].DeltaX;
-  GlyphY  = (CurrentMode->CursorRow * EFI_GLYPH_HEIGHT) + Private->ModeData[CurrentMode->Mode].DeltaY;
-
-  GraphicsOutput->Blt (
-                       GraphicsOutput,
-                       (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *) BltChar,
-                       EfiBltVideoToBltBuffer,
-                       GlyphX,
-                       GlyphY,
-                       0,
-                       0,
-                       EFI_GLYPH_WIDTH,
-                       EFI_GLYPH_HEIGHT,
-                       EFI_GLYPH_WIDTH * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL)
-                       );
+  Cell = (EFI_GRAPHICS_OUTPUT_BLT_PIXEL_UNION *) Private->ShadowBuffer +
+         CurrentMode->CursorRow * EFI_GLYPH_HEIGHT * Width +
+         CurrentMode->CursorColumn * EFI_GLYPH_WIDTH;
 
   GetTextColors (This, &Foreground.Pixel, &Background.Pixel);
 
   //
-  // Convert Monochrome bitmap of the Glyph to BltBuffer structure
+  // XOR the cursor glyph into the cell in the shadow buffer
   //
   for (PosY = 0; PosY < EFI_GLYPH_HEIGHT; PosY++) {
     for (PosX = 0; PosX < EFI_GLYPH_WIDTH; PosX++) {
       if ((mCursorGlyph.GlyphCol1[PosY] & (BIT0 << PosX)) != 0) {
-        BltChar[PosY][EFI_GLYPH_WIDTH - PosX - 1].Raw ^= Foreground.Raw;
+        Cell[PosY * Width + EFI_GLYPH_WIDTH - PosX - 1].Raw ^= Foreground.Raw;
       }
     }
   }
 
+  //
+  // A dirty row goes out with the next flush anyway. When batching, or
+  // with a pan pending that would move the cell, the cursor is only drawn
+  // by the flush.
+  //
+  if (Private->FlushEvent != NULL || Private->PendingScroll != 0) {
+    ShadowMarkDirty (Private, CurrentMode->CursorRow, 1);
+    return EFI_SUCCESS;
+  }
+
+  if ((UINTN) CurrentMode->CursorRow >= Private->DirtyStart &&
+      (UINTN) CurrentMode->CursorRow < Private->DirtyEnd) {
+    return EFI_SUCCESS;
+  }
+
+  //
+  // Blt a character to the screen
+  //
+  GlyphX  = (CurrentMode->CursorColumn * EFI_GLYPH_WIDTH) + ModeData->DeltaX;
+  GlyphY  = (CurrentMode->CursorRow * EFI_GLYPH_HEIGHT) + ModeData->DeltaY;
+
   GraphicsOutput->Blt (
                        GraphicsOutput,
-                       (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *) BltChar,
+                       Private->ShadowBuffer,
                        EfiBltBufferToVideo,
-                       0,
-                       0,
+                       CurrentMode->CursorColumn * EFI_GLYPH_WIDTH,
+                       CurrentMode->CursorRow * EFI_GLYPH_HEIGHT,
                        GlyphX,
                        GlyphY,
                        EFI_GLYPH_WIDTH,
                        EFI_GLYPH_HEIGHT,
-                       EFI_GLYPH_WIDTH * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL)
+                       Width * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL)
                        );
 
   return EFI_SUCCESS;
 }
 
+/**
+  Fill text rows of the shadow buffer with a color.
+
+  The rows are not marked dirty, callers either mark them or have already
+  filled the same area on screen.
+
+  @param  Private               The graphics console device.
+  @param  Row                   The first text row to fill.
+  @param  Rows                  The number of text rows to fill.
+  @param  Color                 The fill color.
+
+**/
+VOID
+ShadowFill (
+  IN  GRAPHICS_CONSOLE_DEV             *Private,
+  IN  UINTN                            Row,
+  IN  UINTN                            Rows,
+  IN  EFI_GRAPHICS_OUTPUT_BLT_PIXEL    *Color
+  )
+{
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL_UNION  Fill;
+  UINTN                                Width;
+
+  Width      = Private->ModeData[Private->SimpleTextOutputMode.Mode].Columns * EFI_GLYPH_WIDTH;
+  Fill.Pixel = *Color;
+
+  SetMem32 (
+    Private->ShadowBuffer + Row * EFI_GLYPH_HEIGHT * Width,
+    Rows * EFI_GLYPH_HEIGHT * Width * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL),
+    Fill.Raw
+    );
+}
+
+/**
+  Mark text rows of the shadow buffer as needing to be written to the screen.
+
+  @param  Private               The graphics console device.
+  @param  Row                   The first modified text row.
+  @param  Rows                  The number of modified text rows.
+
+**/
+VOID
+ShadowMarkDirty (
+  IN  GRAPHICS_CONSOLE_DEV             *Private,
+  IN  UINTN                            Row,
+  IN  UINTN                            Rows
+  )
+{
+  if (Private->DirtyStart >= Private->DirtyEnd) {
+    Private->DirtyStart = Row;
+    Private->DirtyEnd   = Row + Rows;
+    return;
+  }
+
+  Private->DirtyStart = MIN (Private->DirtyStart, Row);
+  Private->DirtyEnd   = MAX (Private->DirtyEnd, Row + Rows);
+}
+
+/**
+  Apply the pending scroll by panning the display.
+
+  The lines the pan brings into view are refilled with the margin color,
+  the text rows among them are already dirty. If the display cannot pan,
+  the whole text area is marked dirty instead.
+
+  Unlike redrawing the text area, a pan moves the whole screen: whatever
+  other GOP clients drew in the side margins scrolls up with the text,
+  and their graphics in the top and bottom margins are painted over with
+  the margin color. DisplayDxe stops panning at ReadyToBoot, so this only
+  affects output before the first boot option runs.
+
+  @param  Private               The graphics console device.
+
+**/
+STATIC
+VOID
+ShadowScroll (
+  IN  GRAPHICS_CONSOLE_DEV             *Private
+  )
+{
+  GRAPHICS_CONSOLE_MODE_DATA  *ModeData;
+  EFI_STATUS                  Status;
+  UINTN                       Rows;
+  UINTN                       Lines;
+
+  ModeData = &Private->ModeData[Private->SimpleTextOutputMode.Mode];
+  Rows     = ModeData->Rows;
+  Lines    = Private->PendingScroll * EFI_GLYPH_HEIGHT;
+
+  Private->PendingScroll = 0;
+
+  Status = EFI_UNSUPPORTED;
+  if (Lines < Rows * EFI_GLYPH_HEIGHT) {
+    Status = Private->DisplayScroll->Scroll (Private->DisplayScroll, (UINT32) Lines);
+  }
+
+  if (EFI_ERROR (Status)) {
+    ShadowMarkDirty (Private, 0, Rows);
+    return;
+  }
+
+  //
+  // The top margin now shows what were text rows.
+  //
+  if (ModeData->DeltaY != 0) {
+    Private->GraphicsOutput->Blt (
+                               Private->GraphicsOutput,
+                               &Private->MarginColor,
+                               EfiBltVideoFill,
+                               0,
+                               0,
+                               0,
+                               0,
+                               ModeData->GopWidth,
+                               ModeData->DeltaY,
+                               0
+                               );
+  }
+
+  Private->GraphicsOutput->Blt (
+                             Private->GraphicsOutput,
+                             &Private->MarginColor,
+                             EfiBltVideoFill,
+                             0,
+                             0,
+                             0,
+                             ModeData->GopHeight - Lines,
+                             ModeData->GopWidth,
+                             Lines,
+                             0
+                             );
+}
+
+/**
+  Write the dirty text rows of the shadow buffer to the screen.
+
+  @param  Private               The graphics console device.
+
+  @retval EFI_SUCCESS           The screen is up to date.
+  @retval other                 The Blt to the screen failed.
+
+**/
+EFI_STATUS
+ShadowFlush (
+  IN  GRAPHICS_CONSOLE_DEV             *Private
+  )
+{
+  GRAPHICS_CONSOLE_MODE_DATA  *ModeData;
+  UINTN                       Width;
+  UINTN                       Start;
+  UINTN                       Rows;
+
+  if (Private->PendingScroll != 0) {
+    ShadowScroll (Private);
+  }
+
+  if (Private->DirtyStart >= Private->DirtyEnd) {
+    return EFI_SUCCESS;
+  }
+
+  ModeData = &Private->ModeData[Private->SimpleTextOutputMode.Mode];
+  Width    = ModeData->Columns * EFI_GLYPH_WIDTH;
+  Start    = Private->DirtyStart;
+  Rows     = Private->DirtyEnd - Private->DirtyStart;
+
+  Private->DirtyStart = 0;
+  Private->DirtyEnd   = 0;
+
+  return Private->GraphicsOutput->Blt (
+                                       Private->GraphicsOutput,
+                                       Private->ShadowBuffer,
+                                       EfiBltBufferToVideo,
+                                       0,
+                                       Start * EFI_GLYPH_HEIGHT,
+                                       ModeData->DeltaX,
+                                       ModeData->DeltaY + Start * EFI_GLYPH_HEIGHT,
+                                       Width,
+                                       Rows * EFI_GLYPH_HEIGHT,
+                                       Width * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL)
+                                       );
+}
+
+/**
+  Write out batched output right away.
+
+  Batched text otherwise reaches the screen up to a flush period later,
+  after whatever the caller draws through GOP next, so this is called
+  before returning from the functions that typically precede that:
+  SetMode, ClearScreen and EnableCursor.
+
+  @param  Private               The graphics console device.
+
+**/
+VOID
+ShadowSync (
+  IN  GRAPHICS_CONSOLE_DEV             *Private
+  )
+{
+  if (Private->FlushEvent != NULL) {
+    ShadowFlush (Private);
+  }
+}
+
+/**
+  Flush timer notification handler.
+
+  Runs at TPL_NOTIFY, so it never interleaves with the text output
+  functions, which raise to the same TPL.
+
+  @param[in] Event    Event whose notification function is being invoked.
+  @param[in] Context  The graphics console device.
+
+**/
+STATIC
+VOID
+EFIAPI
+GraphicsConsoleFlushNotify (
+  IN  EFI_EVENT                        Event,
+  IN  VOID                             *Context
+  )
+{
+  ShadowFlush ((GRAPHICS_CONSOLE_DEV *) Context);
+}
+
+/**
+  ExitBootServices notification handler.
+
+  Writes out pending output and makes any later output synchronous, as
+  the flush timer no longer runs. The events are left open, since no
+  memory may be freed here.
+
+  DisplayDxe un-pans the display from its own TPL_NOTIFY handler, which
+  may run before or after this one. Either order is fine: if the display
+  was un-panned first, the pending scroll fails and the text area is
+  redrawn instead.
+
+  @param[in] Event    Event whose notification function is being invoked.
+  @param[in] Context  The graphics console device.
+
+**/
+STATIC
+VOID
+EFIAPI
+GraphicsConsoleExitBootServicesNotify (
+  IN  EFI_EVENT                        Event,
+  IN  VOID                             *Context
+  )
+{
+  GRAPHICS_CONSOLE_DEV  *Private;
+
+  Private = (GRAPHICS_CONSOLE_DEV *) Context;
+  ShadowFlush (Private);
+  Private->FlushEvent = NULL;
+}
+
+/**
+  Switch the console to batched output, flushed from a periodic timer.
+
+  If the events cannot be created, output stays synchronous.
+
+  @param  Private               The graphics console device.
+
+**/
+VOID
+GraphicsConsoleStartBatching (
+  IN  GRAPHICS_CONSOLE_DEV             *Private
+  )
+{
+  EFI_STATUS  Status;
+  EFI_EVENT   FlushEvent;
+
+  Status = gBS->CreateEvent (
+                  EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                  TPL_NOTIFY,
+                  GraphicsConsoleFlushNotify,
+                  Private,
+                  &FlushEvent
+                  );
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  //
+  // Pending output must reach the screen before the OS takes over.
+  //
+  Status = gBS->CreateEvent (
+                  EVT_SIGNAL_EXIT_BOOT_SERVICES,
+                  TPL_NOTIFY,
+                  GraphicsConsoleExitBootServicesNotify,
+                  Private,
+                  &Private->ExitBootServicesEvent
+                  );
+  if (EFI_ERROR (Status)) {
+    gBS->CloseEvent (FlushEvent);
+    Private->ExitBootServicesEvent = NULL;
+    return;
+  }
+
+  Status = gBS->SetTimer (FlushEvent, TimerPeriodic, GRAPHICS_CONSOLE_FLUSH_PERIOD);
+  if (EFI_ERROR (Status)) {
+    gBS->CloseEvent (FlushEvent);
+    gBS->CloseEvent (Private->ExitBootServicesEvent);
+    Private->ExitBootServicesEvent = NULL;
+    return;
+  }
+
+  Private->FlushEvent = FlushEvent;
+}
+
+/**
+  Stop batching output and write out anything still pending.
+
+  @param  Private               The graphics console device.
+
+**/
+VOID
+GraphicsConsoleStopBatching (
+  IN  GRAPHICS_CONSOLE_DEV             *Private
+  )
+{
+  EFI_TPL  OldTpl;
+
+  if (Private->FlushEvent == NULL) {
+    return;
+  }
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  gBS->CloseEvent (Private->FlushEvent);
+  gBS->CloseEvent (Private->ExitBootServicesEvent);
+  Private->FlushEvent            = NULL;
+  Private->ExitBootServicesEvent = NULL;
+  ShadowFlush (Private);
+  gBS->RestoreTPL (OldTpl);
+}
+
 /**
   HII Database Protocol notification event handler.
 
@@ -21,6 +21,7 @@
 #include <Protocol/DevicePath.h>
 #include <Protocol/HiiFont.h>
 #include <Protocol/HiiDatabase.h>
+#include <Protocol/DisplayScroll.h>
 #include <Library/DebugLib.h>
 #include <Library/UefiDriverEntryPoint.h>
 #include <Library/UefiLib.h>
@@ -59,6 +60,27 @@ typedef struct {
   UINT32  GopModeNumber;
 } GRAPHICS_CONSOLE_MODE_DATA;
 
+//
+// Glyph cache: pre-rendered narrow cells keyed on (code point, attribute),
+// where the attribute carries both the foreground and background color.
+// Direct mapped, so the size must be a power of two.
+//
+#define GLYPH_CACHE_SIZE  512
+
+//
+// Batched output is written to the screen at about 60Hz. Until then it
+// can be overtaken by graphics other GOP clients Blt directly, except
+// across SetMode, ClearScreen and EnableCursor, which flush first.
+//
+#define GRAPHICS_CONSOLE_FLUSH_PERIOD  EFI_TIMER_PERIOD_MILLISECONDS (16)
+
+typedef struct {
+  CHAR16                           UnicodeWeight;
+  UINT8                            Attribute;
+  BOOLEAN                          Valid;
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL    Cell[EFI_GLYPH_HEIGHT][EFI_GLYPH_WIDTH];
+} GRAPHICS_CONSOLE_GLYPH;
+
 typedef struct {
   UINTN                            Signature;
   EFI_GRAPHICS_OUTPUT_PROTOCOL     *GraphicsOutput;
@@ -66,6 +88,32 @@ typedef struct {
   EFI_SIMPLE_TEXT_OUTPUT_MODE      SimpleTextOutputMode;
   GRAPHICS_CONSOLE_MODE_DATA       *ModeData;
   EFI_GRAPHICS_OUTPUT_BLT_PIXEL    *LineBuffer;
+  GRAPHICS_CONSOLE_GLYPH           *GlyphCache;
+  //
+  // Cached copy of the text area. Text is drawn and scrolled here and the
+  // dirty text rows [DirtyStart, DirtyEnd) are written out at flush points,
+  // so the framebuffer is never read back.
+  //
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL    *ShadowBuffer;
+  UINTN                            DirtyStart;
+  UINTN                            DirtyEnd;
+  BOOLEAN                          InOutputString;
+  //
+  // Set when output is batched: the dirty rows are flushed by this
+  // periodic timer instead of at the end of each OutputString.
+  //
+  EFI_EVENT                        FlushEvent;
+  EFI_EVENT                        ExitBootServicesEvent;
+  //
+  // When the display can pan, line feeds at the bottom of the screen are
+  // counted in PendingScroll and applied with a single Scroll at the next
+  // flush. MarginColor is what the area outside the text was last filled
+  // with, to redraw the margins the pan brings into view. Panning also
+  // moves anything other clients drew in the margins, see ShadowScroll.
+  //
+  DISPLAY_SCROLL_PROTOCOL          *DisplayScroll;
+  UINTN                            PendingScroll;
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL    MarginColor;
   EXTENDED_TEXT_OUTPUT_PROTOCOL    ExtendedTextOutput;
 } GRAPHICS_CONSOLE_DEV;
 
@@ -561,6 +609,90 @@ FlushCursor (
   IN  EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL  *This
   );
 
+/**
+  Fill text rows of the shadow buffer with a color.
+
+  The rows are not marked dirty, callers either mark them or have already
+  filled the same area on screen.
+
+  @param  Private               The graphics console device.
+  @param  Row                   The first text row to fill.
+  @param  Rows                  The number of text rows to fill.
+  @param  Color                 The fill color.
+
+**/
+VOID
+ShadowFill (
+  IN  GRAPHICS_CONSOLE_DEV             *Private,
+  IN  UINTN                            Row,
+  IN  UINTN                            Rows,
+  IN  EFI_GRAPHICS_OUTPUT_BLT_PIXEL    *Color
+  );
+
+/**
+  Mark text rows of the shadow buffer as needing to be written to the screen.
+
+  @param  Private               The graphics console device.
+  @param  Row                   The first modified text row.
+  @param  Rows                  The number of modified text rows.
+
+**/
+VOID
+ShadowMarkDirty (
+  IN  GRAPHICS_CONSOLE_DEV             *Private,
+  IN  UINTN                            Row,
+  IN  UINTN                            Rows
+  );
+
+/**
+  Write the dirty text rows of the shadow buffer to the screen.
+
+  @param  Private               The graphics console device.
+
+  @retval EFI_SUCCESS           The screen is up to date.
+  @retval other                 The Blt to the screen failed.
+
+**/
+EFI_STATUS
+ShadowFlush (
+  IN  GRAPHICS_CONSOLE_DEV             *Private
+  );
+
+/**
+  Write out batched output right away.
+
+  @param  Private               The graphics console device.
+
+**/
+VOID
+ShadowSync (
+  IN  GRAPHICS_CONSOLE_DEV             *Private
+  );
+
+/**
+  Switch the console to batched output, flushed from a periodic timer.
+
+  If the events cannot be created, output stays synchronous.
+
+  @param  Private               The graphics console device.
+
+**/
+VOID
+GraphicsConsoleStartBatching (
+  IN  GRAPHICS_CONSOLE_DEV             *Private
+  );
+
+/**
+  Stop batching output and write out anything still pending.
+
+  @param  Private               The graphics console device.
+
+**/
+VOID
+GraphicsConsoleStopBatching (
+  IN  GRAPHICS_CONSOLE_DEV             *Private
+  );
+
 /**
   Check if the current specific mode supported the user defined resolution
   for the Graphics Console device based on Graphics Output Protocol.
@@ -18,10 +18,27 @@
 #include <Library/BaseMemoryLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/BaseLib.h>
+#include <Library/BenchmarkLib.h>
+#include <Library/PrintLib.h>
+#include <Library/TimerLib.h>
 
 #include "Mmc.h"
 
 #define DIAGNOSTIC_LOGBUFFER_MAXCHAR  1024
+#define BENCHMARK_LOGBUFFER_MAXCHAR   8192
+
+//
+// The benchmark sweeps transfer sizes from one block to 4MiB, with
+// BenchmarkLib picking the LBAs and the number of transfers per run.
+//
+// Reads may land anywhere on the card. Writes are only done when a
+// scratch range is set with PcdMmcBenchmarkScratchLba/Blocks (in the
+// setup menu), and its contents are destroyed: putting old data back
+// can't be made safe against a file system writing the same blocks in
+// between.
+//
+#define BENCHMARK_MAX_SIZE            SIZE_4MB
+#define BENCHMARK_LOG_FILE            L"\\MmcBench.csv"
 
 CHAR16* mLogBuffer = NULL;
 UINTN   mLogRemainChar = 0;
@@ -168,6 +185,274 @@ MmcReadWriteDataTest (
   return EFI_SUCCESS;
 }
 
+STATIC
+VOID
+MmcCacheLogStatistics (
+  MMC_HOST_INSTANCE *MmcHostInstance
+  )
+{
+  CHAR16    Line[128];
+  MMC_CACHE *Cache;
+  UINT64    Reads;
+
+  Cache = &MmcHostInstance->Cache;
+  if (PcdGet32 (PcdMmcDisableCache) != 0 || Cache->Blocks == NULL) {
+    DiagnosticLog (L"Read cache: disabled\n");
+    return;
+  }
+
+  Reads = Cache->Hits + Cache->Misses;
+  UnicodeSPrint (Line, sizeof (Line),
+                 L"Read cache: %Lu/%Lu reads hit (%Lu%%), %Lu KiB saved\n",
+                 Cache->Hits, Reads,
+                 Reads == 0 ? 0 : DivU64x64Remainder (Cache->Hits * 100, Reads, NULL),
+                 RShiftU64 (Cache->BytesSaved, 10));
+  DiagnosticLog (Line);
+
+  UnicodeSPrint (Line, sizeof (Line),
+                 L"Read-ahead: %Lu blocks prefetched, %Lu wasted\n",
+                 Cache->PrefetchedBlocks, Cache->WastedBlocks);
+  DiagnosticLog (Line);
+}
+
+/**
+  Times Ops transfers of Size bytes each, at sequential or random
+  Size-aligned LBAs. Reads cover the whole card, writes only the
+  scratch range.
+**/
+STATIC
+EFI_STATUS
+MmcBenchmarkRun (
+  MMC_HOST_INSTANCE *MmcHostInstance,
+  UINTN             Transfer,
+  BOOLEAN           Random,
+  UINTN             Size,
+  UINT8             *Buffer,
+  EFI_LBA           *Lbas,
+  UINT64            *Samples,
+  BENCHMARK_RESULT  *Result
+  )
+{
+  EFI_STATUS            Status;
+  EFI_BLOCK_IO_PROTOCOL *BlockIo;
+  EFI_TPL               OldTpl;
+  UINT64                Start;
+  UINTN                 Ops;
+  UINTN                 Index;
+
+  BlockIo = &MmcHostInstance->BlockIo;
+  if (Transfer == MMC_IOBLOCKS_WRITE) {
+    Ops = BenchmarkPlan (PcdGet64 (PcdMmcBenchmarkScratchLba),
+                         PcdGet32 (PcdMmcBenchmarkScratchBlocks),
+                         BlockIo->Media->BlockSize, Size, Random, Lbas);
+  } else {
+    Ops = BenchmarkPlan (0, BlockIo->Media->LastBlock + 1,
+                         BlockIo->Media->BlockSize, Size, Random, Lbas);
+  }
+  if (Ops == 0) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (Transfer == MMC_IOBLOCKS_WRITE) {
+    GenerateRandomBuffer (Buffer, Ops * Size);
+  }
+
+  //
+  // Reads bypass the read cache, it's the card that's being measured.
+  // Writes go through it, so it drops the scratch blocks they replace.
+  //
+  for (Index = 0; Index < Ops; Index++) {
+    Status = MmcAcquireHost (MmcHostInstance, &OldTpl);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    MmcFlushQueue (MmcHostInstance);
+    Start = GetPerformanceCounter ();
+    if (Transfer == MMC_IOBLOCKS_WRITE) {
+      Status = MmcCacheIo (BlockIo, Transfer, BlockIo->Media->MediaId,
+                           Lbas[Index], Size, Buffer + Index * Size);
+    } else {
+      Status = MmcIoBlocks (BlockIo, Transfer, BlockIo->Media->MediaId,
+                            Lbas[Index], Size, Buffer + Index * Size);
+    }
+    Samples[Index] = BenchmarkElapsedNs (Start, GetPerformanceCounter ());
+    MmcReleaseHost (MmcHostInstance, OldTpl);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  BenchmarkSummarize (Samples, Ops, Result);
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+MmcBenchmark (
+  MMC_HOST_INSTANCE *MmcHostInstance
+  )
+{
+  EFI_STATUS        Status;
+  EFI_FILE_PROTOCOL *File;
+  BENCHMARK_RESULT  Result;
+  BOOLEAN           Random;
+  UINTN             Pattern;
+  UINTN             Transfer;
+  UINTN             Size;
+  UINTN             BufferSize;
+  UINT8             *Buffer;
+  EFI_LBA           *Lbas;
+  UINT64            *Samples;
+  UINT64            KiBPerSec;
+  UINT64            Iops;
+  UINTN             LastTransfer;
+  EFI_LBA           ScratchLba;
+  UINT32            ScratchBlocks;
+  CONST CHAR8       *Host;
+  CONST CHAR8       *DisableDma;
+  CHAR16            Line[128];
+  CHAR8             CsvLine[256];
+
+  if (!MmcHostInstance->BlockIo.Media->MediaPresent) {
+    DiagnosticLog (L"ERROR: No Media Present\n");
+    return EFI_NO_MEDIA;
+  }
+
+  ScratchLba = PcdGet64 (PcdMmcBenchmarkScratchLba);
+  ScratchBlocks = PcdGet32 (PcdMmcBenchmarkScratchBlocks);
+  LastTransfer = MMC_IOBLOCKS_READ;
+  if (ScratchBlocks == 0) {
+    DiagnosticLog (L"No scratch range set, skipping write tests\n");
+  } else if (ScratchLba + ScratchBlocks - 1 > MmcHostInstance->BlockIo.Media->LastBlock) {
+    DiagnosticLog (L"ERROR: Scratch range is past the end of the media\n");
+    return EFI_INVALID_PARAMETER;
+  } else if (MmcHostInstance->BlockIo.Media->ReadOnly) {
+    DiagnosticLog (L"Media is write-protected, skipping write tests\n");
+  } else {
+    UnicodeSPrint (Line, sizeof (Line),
+                   L"Write tests overwrite LBAs %Lu-%Lu\n",
+                   ScratchLba, ScratchLba + ScratchBlocks - 1);
+    DiagnosticLog (Line);
+    LastTransfer = MMC_IOBLOCKS_WRITE;
+  }
+
+  //
+  // Room for every transfer of the largest run.
+  //
+  BufferSize = MAX (BENCHMARK_RUN_BYTES, BENCHMARK_MIN_OPS * BENCHMARK_MAX_SIZE);
+  Buffer = AllocatePages (EFI_SIZE_TO_PAGES (BufferSize));
+  Lbas = AllocatePool (BENCHMARK_MAX_OPS * sizeof (EFI_LBA));
+  Samples = AllocatePool (BENCHMARK_MAX_OPS * sizeof (UINT64));
+  if (Buffer == NULL || Lbas == NULL || Samples == NULL) {
+    DiagnosticLog (L"ERROR: Out of memory\n");
+    Status = EFI_OUT_OF_RESOURCES;
+    goto Done;
+  }
+
+  //
+  // Only the Arasan host does DMA.
+  //
+  if (PcdGet32 (PcdSdIsArasan) != 0) {
+    Host = "Arasan";
+    DisableDma = PcdGet32 (PcdMmcDisableDma) != 0 ? "1" : "0";
+    UnicodeSPrint (Line, sizeof (Line), L"Host %a, DMA %a, ", Host,
+                   PcdGet32 (PcdMmcDisableDma) != 0 ? "off" : "on");
+  } else {
+    Host = "SdHost";
+    DisableDma = "";
+    UnicodeSPrint (Line, sizeof (Line), L"Host %a, ", Host);
+  }
+  DiagnosticLog (Line);
+
+  UnicodeSPrint (Line, sizeof (Line),
+                 L"multi-block %a, cache %a, %u MHz, %a bus\n",
+                 PcdGet32 (PcdMmcDisableMulti) != 0 ? "off" : "on",
+                 PcdGet32 (PcdMmcDisableCache) != 0 ? "off" : "on",
+                 PcdGet32 (PcdMmcSdHighSpeedMHz),
+                 PcdGet32 (PcdMmcForce1Bit) != 0 ? "1-bit" : "4-bit");
+  DiagnosticLog (Line);
+
+  File = BenchmarkOpenLog (BENCHMARK_LOG_FILE,
+                           "firmware,revision,host,disable_multi,disable_dma,"
+                           "disable_cache,hs_mhz,force_1bit,pattern,op,size,ops,"
+                           "kib_per_s,iops,p50_us,p99_us\r\n");
+  if (File == NULL) {
+    DiagnosticLog (L"WARNING: no boot or EFI system partition, results are not saved\n");
+  }
+
+  Status = EFI_SUCCESS;
+  for (Transfer = MMC_IOBLOCKS_READ; Transfer <= LastTransfer; Transfer++) {
+    for (Pattern = 0; Pattern < 2; Pattern++) {
+      Random = (Pattern != 0);
+      for (Size = MmcHostInstance->BlockIo.Media->BlockSize;
+           Size <= BENCHMARK_MAX_SIZE;
+           Size <<= 1) {
+        Status = MmcBenchmarkRun (MmcHostInstance, Transfer, Random, Size,
+                                  Buffer, Lbas, Samples, &Result);
+        if (Status == EFI_UNSUPPORTED) {
+          //
+          // Not enough room for this size, nor any larger one.
+          //
+          Status = EFI_SUCCESS;
+          break;
+        }
+        if (EFI_ERROR (Status)) {
+          UnicodeSPrint (Line, sizeof (Line), L"ERROR: %a %a of %u bytes: %r\n",
+                         Random ? "random" : "sequential",
+                         Transfer == MMC_IOBLOCKS_READ ? "read" : "write",
+                         (UINT32) Size, Status);
+          DiagnosticLog (Line);
+          goto Close;
+        }
+
+        KiBPerSec = BenchmarkKiBPerSecond (Size, &Result);
+        Iops = BenchmarkIops (&Result);
+        UnicodeSPrint (Line, sizeof (Line),
+                       L"%a %a %7u: %5Lu KiB/s %6Lu IOPS, p50 %Lu us, p99 %Lu us\n",
+                       Random ? "rand" : "seq ",
+                       Transfer == MMC_IOBLOCKS_READ ? "read " : "write",
+                       (UINT32) Size,
+                       KiBPerSec, Iops,
+                       DivU64x32 (Result.P50Ns, 1000),
+                       DivU64x32 (Result.P99Ns, 1000));
+        DiagnosticLog (Line);
+
+        AsciiSPrint (CsvLine, sizeof (CsvLine),
+                     "%s,0x%x,%a,%u,%a,%u,%u,%u,%a,%a,%u,%u,%Lu,%Lu,%Lu,%Lu\r\n",
+                     gST->FirmwareVendor, gST->FirmwareRevision, Host,
+                     PcdGet32 (PcdMmcDisableMulti), DisableDma,
+                     PcdGet32 (PcdMmcDisableCache), PcdGet32 (PcdMmcSdHighSpeedMHz),
+                     PcdGet32 (PcdMmcForce1Bit),
+                     Random ? "random" : "sequential",
+                     Transfer == MMC_IOBLOCKS_READ ? "read" : "write",
+                     (UINT32) Size, (UINT32) Result.Ops,
+                     KiBPerSec, Iops,
+                     DivU64x32 (Result.P50Ns, 1000),
+                     DivU64x32 (Result.P99Ns, 1000));
+        BenchmarkLogWrite (File, CsvLine);
+      }
+    }
+  }
+
+Close:
+  if (File != NULL) {
+    File->Close (File);
+  }
+
+Done:
+  if (Buffer != NULL) {
+    FreePages (Buffer, EFI_SIZE_TO_PAGES (BufferSize));
+  }
+  if (Lbas != NULL) {
+    FreePool (Lbas);
+  }
+  if (Samples != NULL) {
+    FreePool (Samples);
+  }
+
+  return Status;
+}
+
 EFI_STATUS
 EFIAPI
 MmcDriverDiagnosticsRunDiagnostics (
@@ -200,8 +485,12 @@ MmcDriverDiagnosticsRunDiagnostics (
 
   Status = EFI_SUCCESS;
   *ErrorType  = NULL;
-  *BufferSize = DIAGNOSTIC_LOGBUFFER_MAXCHAR;
-  *Buffer = DiagnosticInitLog (DIAGNOSTIC_LOGBUFFER_MAXCHAR);
+  if (DiagnosticType == EfiDriverDiagnosticTypeExtended) {
+    *BufferSize = BENCHMARK_LOGBUFFER_MAXCHAR;
+  } else {
+    *BufferSize = DIAGNOSTIC_LOGBUFFER_MAXCHAR;
+  }
+  *Buffer = DiagnosticInitLog (*BufferSize);
 
   DiagnosticLog (L"MMC Driver Diagnostics\n");
 
@@ -223,6 +512,15 @@ MmcDriverDiagnosticsRunDiagnostics (
     return EFI_UNSUPPORTED;
   }
 
+  // Report cache efficiency before the tests below disturb it
+  MmcCacheLogStatistics (MmcHostInstance);
+
+  // The extended diagnostic is a throughput/latency benchmark
+  if (DiagnosticType == EfiDriverDiagnosticTypeExtended) {
+    DiagnosticLog (L"MMC Driver Diagnostics - Benchmark\n");
+    return MmcBenchmark (MmcHostInstance);
+  }
+
   // LBA=1 Size=BlockSize
   DiagnosticLog (L"MMC Driver Diagnostics - Test: First Block\n");
   Status = MmcReadWriteDataTest (MmcHostInstance, 1, MmcHostInstance->BlockIo.Media->BlockSize);
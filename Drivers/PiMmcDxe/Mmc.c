@@ -111,17 +111,30 @@ MMC_HOST_INSTANCE* CreateMmcHostInstance (
   MmcHostInstance->BlockIo.WriteBlocks = MmcWriteBlocks;
   MmcHostInstance->BlockIo.FlushBlocks = MmcFlushBlocks;
 
+  MmcHostInstance->BlockIo2.Media = MmcHostInstance->BlockIo.Media;
+  MmcHostInstance->BlockIo2.Reset = MmcResetEx;
+  MmcHostInstance->BlockIo2.ReadBlocksEx = MmcReadBlocksEx;
+  MmcHostInstance->BlockIo2.WriteBlocksEx = MmcWriteBlocksEx;
+  MmcHostInstance->BlockIo2.FlushBlocksEx = MmcFlushBlocksEx;
+
   MmcHostInstance->MmcHost = MmcHost;
 
+  Status = MmcInitializeQueue (MmcHostInstance);
+  if (EFI_ERROR (Status)) {
+    goto FREE_MEDIA;
+  }
+
+  MmcCacheInitialize (MmcHostInstance);
+
   // Create DevicePath for the new MMC Host
   Status = MmcHost->BuildDevicePath (MmcHost, &NewDevicePathNode);
   if (EFI_ERROR (Status)) {
-    goto FREE_MEDIA;
+    goto FREE_QUEUE;
   }
 
   DevicePath = (EFI_DEVICE_PATH_PROTOCOL *) AllocatePool (END_DEVICE_PATH_LENGTH);
   if (DevicePath == NULL) {
-    goto FREE_MEDIA;
+    goto FREE_QUEUE;
   }
 
   SetDevicePathEndNode (DevicePath);
@@ -131,6 +144,7 @@ MMC_HOST_INSTANCE* CreateMmcHostInstance (
   Status = gBS->InstallMultipleProtocolInterfaces (
                 &MmcHostInstance->MmcHandle,
                 &gEfiBlockIoProtocolGuid,&MmcHostInstance->BlockIo,
+                &gEfiBlockIo2ProtocolGuid,&MmcHostInstance->BlockIo2,
                 &gEfiDevicePathProtocolGuid,MmcHostInstance->DevicePath,
                 NULL
                 );
@@ -143,6 +157,10 @@ MMC_HOST_INSTANCE* CreateMmcHostInstance (
 FREE_DEVICE_PATH:
   FreePool(DevicePath);
 
+FREE_QUEUE:
+  MmcCacheFree (MmcHostInstance);
+  MmcDestroyQueue (MmcHostInstance);
+
 FREE_MEDIA:
   FreePool(MmcHostInstance->BlockIo.Media);
 
@@ -162,11 +180,15 @@ EFI_STATUS DestroyMmcHostInstance (
   Status = gBS->UninstallMultipleProtocolInterfaces (
         MmcHostInstance->MmcHandle,
         &gEfiBlockIoProtocolGuid,&(MmcHostInstance->BlockIo),
+        &gEfiBlockIo2ProtocolGuid,&(MmcHostInstance->BlockIo2),
         &gEfiDevicePathProtocolGuid,MmcHostInstance->DevicePath,
         NULL
         );
   ASSERT_EFI_ERROR (Status);
 
+  MmcDestroyQueue (MmcHostInstance);
+  MmcCacheFree (MmcHostInstance);
+
   // Free Memory allocated for the instance
   if (MmcHostInstance->BlockIo.Media) {
     FreePool(MmcHostInstance->BlockIo.Media);
@@ -372,6 +394,13 @@ CheckCardsCallback (
 
       if (MmcHostInstance->BlockIo.Media->MediaPresent) {
         InitializeMmcDevice (MmcHostInstance);
+      } else {
+        //
+        // Nothing still queued for the card that went away can be
+        // done. This runs at TPL_CALLBACK, so no transfer is in
+        // progress.
+        //
+        MmcAbortQueue (MmcHostInstance, EFI_NO_MEDIA);
       }
 
       Status = gBS->ReinstallProtocolInterface (
@@ -384,6 +413,17 @@ CheckCardsCallback (
       if (EFI_ERROR(Status)) {
         Print(L"MMC Card: Error reinstalling BlockIo interface\n");
       }
+
+      Status = gBS->ReinstallProtocolInterface (
+                    (MmcHostInstance->MmcHandle),
+                    &gEfiBlockIo2ProtocolGuid,
+                    &(MmcHostInstance->BlockIo2),
+                    &(MmcHostInstance->BlockIo2)
+                    );
+
+      if (EFI_ERROR(Status)) {
+        Print(L"MMC Card: Error reinstalling BlockIo2 interface\n");
+      }
     }
 
     CurrentLink = CurrentLink->ForwardLink;
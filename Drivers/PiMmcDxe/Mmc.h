@@ -20,6 +20,7 @@
 
 #include <Protocol/DiskIo.h>
 #include <Protocol/BlockIo.h>
+#include <Protocol/BlockIo2.h>
 #include <Protocol/DevicePath.h>
 #include <Protocol/PiMmcHost.h>
 
@@ -70,6 +71,7 @@
 
 #define SWITCH_CMD_DATA_LENGTH              64
 #define SD_HIGH_SPEED_SUPPORTED             0x200
+#define SD_CMD23_SUPPORTED                  BIT1   // SCR CMD_SUPPORT, bit 33
 #define SD_DEFAULT_SPEED                    25000000
 #define SD_HIGH_SPEED                       50000000
 #define SWITCH_CMD_SUCCESS_MASK             0xf
@@ -333,8 +335,44 @@ typedef struct  {
   CID       CIDData;
   CSD       CSDData;
   ECSD      *ECSDData;                         // MMC V4 extended card specific
+  BOOLEAN   SupportsCmd23;                     // SET_BLOCK_COUNT for CMD18/CMD25
 } CARD_INFO;
 
+//
+// Read cache: a read-ahead window for sequential streams, and an LRU of
+// blocks from small random reads (FAT, directory sectors).
+//
+#define MMC_CACHE_BLOCK_SIZE        512
+#define MMC_CACHE_READ_AHEAD_BLOCKS 256
+#define MMC_CACHE_LRU_BLOCKS        64
+#define MMC_CACHE_LRU_MAX_READ      8   // Largest read kept in the LRU, in blocks
+
+typedef struct {
+  LIST_ENTRY                Link;
+  EFI_LBA                   Lba;
+  BOOLEAN                   Valid;
+  UINT8                     *Data;
+} MMC_CACHE_BLOCK;
+
+typedef struct {
+  UINT32                    MediaId;
+  EFI_LBA                   NextLba;          // Block after the last read, MAX_UINT64 if none
+
+  UINT8                     *ReadAhead;
+  EFI_LBA                   ReadAheadLba;
+  UINTN                     ReadAheadCount;   // Valid blocks in the window
+  UINTN                     ReadAheadUsed;    // Furthest block consumed, from window start
+
+  LIST_ENTRY                Lru;              // Most recently used first
+  MMC_CACHE_BLOCK           *Blocks;
+
+  UINT64                    Hits;
+  UINT64                    Misses;
+  UINT64                    BytesSaved;
+  UINT64                    PrefetchedBlocks;
+  UINT64                    WastedBlocks;
+} MMC_CACHE;
+
 typedef struct _MMC_HOST_INSTANCE {
   UINTN                     Signature;
   LIST_ENTRY                Link;
@@ -343,16 +381,45 @@ typedef struct _MMC_HOST_INSTANCE {
 
   MMC_STATE                 State;
   EFI_BLOCK_IO_PROTOCOL     BlockIo;
+  EFI_BLOCK_IO2_PROTOCOL    BlockIo2;
   CARD_INFO                 CardInfo;
   EFI_MMC_HOST_PROTOCOL     *MmcHost;
 
   BOOLEAN                   Initialized;
+
+  //
+  // Non-blocking BlockIo2 requests, serviced from QueueEvent.
+  //
+  LIST_ENTRY                Queue;
+  EFI_EVENT                 QueueEvent;
+
+  //
+  // Set while a transfer owns the host, see MmcAcquireHost.
+  //
+  BOOLEAN                   IoActive;
+
+  MMC_CACHE                 Cache;
 } MMC_HOST_INSTANCE;
 
 #define MMC_HOST_INSTANCE_SIGNATURE                 SIGNATURE_32('m', 'm', 'c', 'h')
 #define MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS(a)     CR (a, MMC_HOST_INSTANCE, BlockIo, MMC_HOST_INSTANCE_SIGNATURE)
+#define MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS(a)    CR (a, MMC_HOST_INSTANCE, BlockIo2, MMC_HOST_INSTANCE_SIGNATURE)
 #define MMC_HOST_INSTANCE_FROM_LINK(a)              CR (a, MMC_HOST_INSTANCE, Link, MMC_HOST_INSTANCE_SIGNATURE)
 
+typedef struct {
+  UINTN                     Signature;
+  LIST_ENTRY                Link;
+  UINTN                     Transfer;
+  UINT32                    MediaId;
+  EFI_LBA                   Lba;
+  UINTN                     BufferSize;
+  VOID                      *Buffer;
+  EFI_BLOCK_IO2_TOKEN       *Token;
+} MMC_IO_REQUEST;
+
+#define MMC_IO_REQUEST_SIGNATURE                    SIGNATURE_32('m', 'm', 'c', 'r')
+#define MMC_IO_REQUEST_FROM_LINK(a)                 CR (a, MMC_IO_REQUEST, Link, MMC_IO_REQUEST_SIGNATURE)
+
 
 EFI_STATUS
 EFIAPI
@@ -486,6 +553,202 @@ MmcFlushBlocks (
   IN EFI_BLOCK_IO_PROTOCOL  *This
   );
 
+/**
+  Resets the block device hardware.
+
+  This function implements EFI_BLOCK_IO2_PROTOCOL.Reset(). Queued
+  non-blocking requests are completed with EFI_ABORTED.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcResetEx (
+  IN EFI_BLOCK_IO2_PROTOCOL   *This,
+  IN BOOLEAN                  ExtendedVerification
+  );
+
+/**
+  Reads the requested number of blocks from the device.
+
+  This function implements EFI_BLOCK_IO2_PROTOCOL.ReadBlocksEx(). With
+  a NULL Token (or Token->Event), the read is blocking. Otherwise it is
+  queued, and Token->Event is signaled once it has completed.
+
+  @retval EFI_SUCCESS            The read request was queued if Token->Event is
+                                 not NULL, or the data was read correctly from
+                                 the device otherwise.
+  @retval EFI_OUT_OF_RESOURCES   The request could not be queued.
+
+  Other return values are as for MmcReadBlocks.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN     UINT32                 MediaId,
+  IN     EFI_LBA                Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token,
+  IN     UINTN                  BufferSize,
+     OUT VOID                   *Buffer
+  );
+
+/**
+  Writes a specified number of blocks to the device.
+
+  This function implements EFI_BLOCK_IO2_PROTOCOL.WriteBlocksEx(), see
+  MmcReadBlocksEx.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN     UINT32                 MediaId,
+  IN     EFI_LBA                Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token,
+  IN     UINTN                  BufferSize,
+  IN     VOID                   *Buffer
+  );
+
+/**
+  Completes all queued requests, then Token if any.
+
+  This function implements EFI_BLOCK_IO2_PROTOCOL.FlushBlocksEx().
+
+**/
+EFI_STATUS
+EFIAPI
+MmcFlushBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token
+  );
+
+/**
+  Sets up the BlockIo2 request queue of an MMC host instance.
+
+**/
+EFI_STATUS
+MmcInitializeQueue (
+  IN MMC_HOST_INSTANCE      *MmcHostInstance
+  );
+
+/**
+  Completes every queued request with EFI_ABORTED, without doing any
+  I/O, and tears the request queue down.
+
+**/
+VOID
+MmcDestroyQueue (
+  IN MMC_HOST_INSTANCE      *MmcHostInstance
+  );
+
+/**
+  Services all queued requests. Must be called with the host
+  acquired by MmcAcquireHost.
+
+**/
+VOID
+MmcFlushQueue (
+  IN MMC_HOST_INSTANCE      *MmcHostInstance
+  );
+
+/**
+  Completes every queued request with Status, without doing any I/O.
+  Must be called at TPL_CALLBACK or above.
+
+**/
+VOID
+MmcAbortQueue (
+  IN MMC_HOST_INSTANCE      *MmcHostInstance,
+  IN EFI_STATUS             Status
+  );
+
+/**
+  Raises the TPL to TPL_CALLBACK, at which the request queue is
+  serviced, unless the caller already runs at or above it. Raising
+  to a lower TPL is not allowed, and BlockIo2 completion chains can
+  call back in at TPL_NOTIFY.
+
+  @return The TPL to pass to gBS->RestoreTPL.
+
+**/
+EFI_TPL
+MmcRaiseTpl (
+  VOID
+  );
+
+/**
+  Takes the host for a transfer, at TPL_CALLBACK or above. A caller
+  above TPL_CALLBACK may have interrupted a transfer already using
+  the host, in which case it is turned away.
+
+  @retval EFI_SUCCESS            The host is taken, release it with
+                                 MmcReleaseHost and OldTpl.
+  @retval EFI_NOT_READY          A transfer already owns the host.
+
+**/
+EFI_STATUS
+MmcAcquireHost (
+  IN  MMC_HOST_INSTANCE     *MmcHostInstance,
+  OUT EFI_TPL               *OldTpl
+  );
+
+VOID
+MmcReleaseHost (
+  IN MMC_HOST_INSTANCE      *MmcHostInstance,
+  IN EFI_TPL                OldTpl
+  );
+
+/**
+  Allocates the read cache. On failure, reads are simply not cached.
+
+**/
+VOID
+MmcCacheInitialize (
+  IN MMC_HOST_INSTANCE      *MmcHostInstance
+  );
+
+VOID
+MmcCacheFree (
+  IN MMC_HOST_INSTANCE      *MmcHostInstance
+  );
+
+/**
+  Same as MmcIoBlocks, but reads go through the read cache and
+  writes invalidate the blocks they cover.
+
+**/
+EFI_STATUS
+MmcCacheIo (
+  IN EFI_BLOCK_IO_PROTOCOL    *This,
+  IN UINTN                    Transfer,
+  IN UINT32                   MediaId,
+  IN EFI_LBA                  Lba,
+  IN UINTN                    BufferSize,
+  IN OUT VOID                 *Buffer
+  );
+
+EFI_STATUS
+MmcCheckIoParameters (
+  IN EFI_BLOCK_IO_PROTOCOL    *This,
+  IN UINTN                    Transfer,
+  IN UINT32                   MediaId,
+  IN EFI_LBA                  Lba,
+  IN UINTN                    BufferSize,
+  IN VOID                     *Buffer
+  );
+
+EFI_STATUS
+MmcIoBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL    *This,
+  IN UINTN                    Transfer,
+  IN UINT32                   MediaId,
+  IN EFI_LBA                  Lba,
+  IN UINTN                    BufferSize,
+  OUT VOID                    *Buffer
+  );
+
 EFI_STATUS
 MmcNotifyState (
   IN MMC_HOST_INSTANCE      *MmcHostInstance,
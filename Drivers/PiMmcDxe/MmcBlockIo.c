@@ -13,11 +13,19 @@
 **/
 
 #include <Library/BaseMemoryLib.h>
+#include <Library/TimerLib.h>
 
 #include "Mmc.h"
 
 #define MMCI0_BLOCKLEN 512
-#define MMCI0_TIMEOUT  1000
+#define MMCI0_TIMEOUT  1000 // ms
+#define MMCI0_POLL_US  20
+
+//
+// SD cards take a 32-bit CMD23 block count, but keep to what eMMC
+// and the hosts' block count registers can express.
+//
+#define MMC_CMD23_MAX_BLOCKS 0xFFFF
 
 STATIC
 EFI_STATUS
@@ -103,19 +111,46 @@ ValidateWrittenBlockCount(
   return EFI_SUCCESS;
 }
 
+STATIC
+UINT64
+ElapsedUs(
+  IN UINT64 Start
+  )
+{
+  UINT64 Now;
+  UINT64 CounterStart;
+  UINT64 CounterEnd;
+
+  Now = GetPerformanceCounter ();
+  GetPerformanceCounterProperties (&CounterStart, &CounterEnd);
+  if (CounterEnd < CounterStart) {
+    return DivU64x32 (GetTimeInNanoSecond (Start - Now), 1000);
+  }
+
+  return DivU64x32 (GetTimeInNanoSecond (Now - Start), 1000);
+}
+
 STATIC
 EFI_STATUS
 WaitUntilTran(
   IN MMC_HOST_INSTANCE *MmcHostInstance
   )
 {
-  INTN Timeout;
+  UINT64 Start;
+  BOOLEAN TimedOut;
   UINT32 Response[1];
   EFI_STATUS Status = EFI_SUCCESS;
   EFI_MMC_HOST_PROTOCOL *MmcHost = MmcHostInstance->MmcHost;
 
-  Timeout = MMCI0_TIMEOUT;
-  while(Timeout--) {
+  //
+  // Programming usually completes well within a millisecond, so poll
+  // at a fine granularity instead of sleeping in 1ms steps. Hosts that
+  // can see DAT0 already busy-wait on it inside CMD13, which can then
+  // take far longer than the stall, so the bound is on elapsed time.
+  //
+  Start = GetPerformanceCounter ();
+  TimedOut = FALSE;
+  while (!TimedOut) {
     /*
      * We expect CMD13 to timeout while card is programming,
      * because the card holds DAT0 low (busy).
@@ -136,10 +171,13 @@ WaitUntilTran(
       }
     }
 
-    gBS->Stall(1000);
+    TimedOut = ElapsedUs (Start) >= MMCI0_TIMEOUT * 1000;
+    if (!TimedOut) {
+      gBS->Stall(MMCI0_POLL_US);
+    }
   }
 
-  if (0 == Timeout) {
+  if (TimedOut) {
     DEBUG ((EFI_D_ERROR, "%a(%u) card is busy\n", __FUNCTION__, __LINE__));
     return EFI_NOT_READY;
   }
@@ -236,9 +274,16 @@ MmcTransferBlock (
   MMC_HOST_INSTANCE       *MmcHostInstance;
   EFI_MMC_HOST_PROTOCOL   *MmcHost;
   UINTN                   CmdArg;
+  UINTN                   BlockCount;
+  BOOLEAN                 SetBlockCount;
+  UINT32                  Response[1];
 
   MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This);
   MmcHost = MmcHostInstance->MmcHost;
+  BlockCount = BufferSize / This->Media->BlockSize;
+  SetBlockCount = MmcHostInstance->CardInfo.SupportsCmd23 &&
+    (Cmd == MMC_CMD18 || Cmd == MMC_CMD25) &&
+    BlockCount <= MMC_CMD23_MAX_BLOCKS;
 
   //Set command argument based on the card access mode (Byte mode or Block mode)
   if ((MmcHostInstance->CardInfo.OCRData.AccessMode & MMC_OCR_ACCESS_MASK) ==
@@ -248,6 +293,24 @@ MmcTransferBlock (
     CmdArg = Lba * This->Media->BlockSize;
   }
 
+  if (SetBlockCount) {
+    //
+    // With a pre-defined block count the card leaves RECV/DATA on
+    // its own, so neither CMD12 nor ACMD22 are needed.
+    //
+    Status = MmcHost->SendCommand (MmcHost, MMC_CMD23, BlockCount);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "%a(MMC_CMD23): Error %r\n", __func__, Status));
+      return Status;
+    }
+
+    Status = MmcHost->ReceiveResponse (MmcHost, MMC_RESPONSE_TYPE_R1, Response);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "%a(MMC_CMD23): Error %r\n", __func__, Status));
+      return Status;
+    }
+  }
+
   Status = MmcHost->SendCommand (MmcHost, Cmd, CmdArg);
   if (EFI_ERROR (Status)) {
     DEBUG ((EFI_D_ERROR, "%a(MMC_CMD%d): Error %r\n", __func__,
@@ -269,10 +332,10 @@ MmcTransferBlock (
   }
 
   if (EFI_ERROR (Status) ||
-      BufferSize > This->Media->BlockSize) {
+      (BufferSize > This->Media->BlockSize && !SetBlockCount)) {
     /*
-     * CMD12 needs to be set for multiblock (to transition from
-     * RECV to PROG) or for errors.
+     * CMD12 needs to be set for open-ended multiblock (to transition
+     * from RECV to PROG) or for errors.
      */
     EFI_STATUS Status2 = MmcStopTransmission (MmcHost);
     if (EFI_ERROR (Status2)) {
@@ -307,7 +370,9 @@ MmcTransferBlock (
     return Status;
   }
 
-  if (Transfer != MMC_IOBLOCKS_READ) {
+  if (Transfer != MMC_IOBLOCKS_READ && SetBlockCount) {
+    *TransferredSize = BufferSize;
+  } else if (Transfer != MMC_IOBLOCKS_READ) {
     UINTN BlocksWritten = 0;
 
     Status = ValidateWrittenBlockCount (MmcHostInstance,
@@ -324,24 +389,18 @@ MmcTransferBlock (
 }
 
 EFI_STATUS
-MmcIoBlocks (
+MmcCheckIoParameters (
   IN EFI_BLOCK_IO_PROTOCOL    *This,
   IN UINTN                    Transfer,
   IN UINT32                   MediaId,
   IN EFI_LBA                  Lba,
   IN UINTN                    BufferSize,
-  OUT VOID                    *Buffer
+  IN VOID                     *Buffer
   )
 {
-  EFI_STATUS              Status;
-  UINTN                   Cmd;
   MMC_HOST_INSTANCE       *MmcHostInstance;
   EFI_MMC_HOST_PROTOCOL   *MmcHost;
-  UINTN                   BytesRemainingToBeTransfered;
-  UINTN                   BlockCount;
-  UINTN                   ConsumeSize;
 
-  BlockCount = 1;
   MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This);
   ASSERT (MmcHostInstance != NULL);
   MmcHost = MmcHostInstance->MmcHost;
@@ -360,12 +419,6 @@ MmcIoBlocks (
     return EFI_NO_MEDIA;
   }
 
-  if (PcdGet32(PcdMmcDisableMulti) == 0 &&
-      MMC_HOST_HAS_ISMULTIBLOCK(MmcHost) &&
-      MmcHost->IsMultiBlock(MmcHost)) {
-    BlockCount = (BufferSize + This->Media->BlockSize - 1) / This->Media->BlockSize;
-  }
-
   // All blocks must be within the device
   if ((Lba + (BufferSize / This->Media->BlockSize)) > (This->Media->LastBlock + 1)) {
     return EFI_INVALID_PARAMETER;
@@ -390,6 +443,42 @@ MmcIoBlocks (
     return EFI_INVALID_PARAMETER;
   }
 
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+MmcIoBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL    *This,
+  IN UINTN                    Transfer,
+  IN UINT32                   MediaId,
+  IN EFI_LBA                  Lba,
+  IN UINTN                    BufferSize,
+  OUT VOID                    *Buffer
+  )
+{
+  EFI_STATUS              Status;
+  UINTN                   Cmd;
+  MMC_HOST_INSTANCE       *MmcHostInstance;
+  EFI_MMC_HOST_PROTOCOL   *MmcHost;
+  UINTN                   BytesRemainingToBeTransfered;
+  UINTN                   BlockCount;
+  UINTN                   ConsumeSize;
+
+  BlockCount = 1;
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This);
+  MmcHost = MmcHostInstance->MmcHost;
+
+  Status = MmcCheckIoParameters (This, Transfer, MediaId, Lba, BufferSize, Buffer);
+  if (EFI_ERROR (Status) || BufferSize == 0) {
+    return Status;
+  }
+
+  if (PcdGet32(PcdMmcDisableMulti) == 0 &&
+      MMC_HOST_HAS_ISMULTIBLOCK(MmcHost) &&
+      MmcHost->IsMultiBlock(MmcHost)) {
+    BlockCount = (BufferSize + This->Media->BlockSize - 1) / This->Media->BlockSize;
+  }
+
   BytesRemainingToBeTransfered = BufferSize;
   while (BytesRemainingToBeTransfered > 0) {
     Status = WaitUntilTran(MmcHostInstance);
@@ -447,7 +536,25 @@ MmcReadBlocks (
   OUT VOID                    *Buffer
   )
 {
-  return MmcIoBlocks (This, MMC_IOBLOCKS_READ, MediaId, Lba, BufferSize, Buffer);
+  EFI_STATUS        Status;
+  EFI_TPL           OldTpl;
+  MMC_HOST_INSTANCE *MmcHostInstance;
+
+  //
+  // Keep the BlockIo2 queue from issuing commands in the middle of
+  // this transfer, and complete what it already accepted first.
+  //
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This);
+  Status = MmcAcquireHost (MmcHostInstance, &OldTpl);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  MmcFlushQueue (MmcHostInstance);
+  Status = MmcCacheIo (This, MMC_IOBLOCKS_READ, MediaId, Lba, BufferSize, Buffer);
+  MmcReleaseHost (MmcHostInstance, OldTpl);
+
+  return Status;
 }
 
 EFI_STATUS
@@ -460,7 +567,21 @@ MmcWriteBlocks (
   IN VOID                     *Buffer
   )
 {
-  return MmcIoBlocks (This, MMC_IOBLOCKS_WRITE, MediaId, Lba, BufferSize, Buffer);
+  EFI_STATUS        Status;
+  EFI_TPL           OldTpl;
+  MMC_HOST_INSTANCE *MmcHostInstance;
+
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This);
+  Status = MmcAcquireHost (MmcHostInstance, &OldTpl);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  MmcFlushQueue (MmcHostInstance);
+  Status = MmcCacheIo (This, MMC_IOBLOCKS_WRITE, MediaId, Lba, BufferSize, Buffer);
+  MmcReleaseHost (MmcHostInstance, OldTpl);
+
+  return Status;
 }
 
 EFI_STATUS
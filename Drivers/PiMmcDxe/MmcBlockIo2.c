@@ -0,0 +1,439 @@
+/** @file
+*
+*  Non-blocking EFI_BLOCK_IO2_PROTOCOL support, built on a per-host
+*  request queue. Requests are serviced from a timer event, with
+*  adjacent requests merged into a single multi-block transfer.
+*
+*  Copyright (c) 2018, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include "Mmc.h"
+
+//
+// Period of the queue event, in 100ns units (1ms).
+//
+#define MMC_QUEUE_PERIOD          10000
+
+//
+// Upper bound on a merged transfer, which may need a bounce buffer.
+//
+#define MMC_QUEUE_MAX_MERGE_SIZE  SIZE_1MB
+
+STATIC
+VOID
+MmcCompleteRequest (
+  IN MMC_IO_REQUEST *Request,
+  IN EFI_STATUS     Status
+  )
+{
+  RemoveEntryList (&Request->Link);
+  Request->Token->TransactionStatus = Status;
+  gBS->SignalEvent (Request->Token->Event);
+  FreePool (Request);
+}
+
+/**
+  Issues the request at the head of the queue, together with any
+  requests following it that continue the same transfer.
+**/
+STATIC
+VOID
+MmcServiceQueueHead (
+  IN MMC_HOST_INSTANCE *MmcHostInstance
+  )
+{
+  EFI_STATUS     Status;
+  LIST_ENTRY     *Link;
+  MMC_IO_REQUEST *First;
+  MMC_IO_REQUEST *Last;
+  MMC_IO_REQUEST *Next;
+  MMC_IO_REQUEST *Request;
+  UINTN          BlockSize;
+  UINTN          Size;
+  UINTN          Offset;
+  UINT8          *Buffer;
+  BOOLEAN        Contiguous;
+  BOOLEAN        Bounce;
+  BOOLEAN        Done;
+
+  ASSERT (!IsListEmpty (&MmcHostInstance->Queue));
+
+  BlockSize = MmcHostInstance->BlockIo.Media->BlockSize;
+  First = MMC_IO_REQUEST_FROM_LINK (GetFirstNode (&MmcHostInstance->Queue));
+  Last = First;
+  Size = First->BufferSize;
+  Contiguous = TRUE;
+
+  for (Link = GetNextNode (&MmcHostInstance->Queue, &First->Link);
+       !IsNull (&MmcHostInstance->Queue, Link);
+       Link = GetNextNode (&MmcHostInstance->Queue, Link)) {
+    Next = MMC_IO_REQUEST_FROM_LINK (Link);
+    if (Next->Transfer != First->Transfer ||
+        Next->MediaId != First->MediaId ||
+        Next->Lba != Last->Lba + Last->BufferSize / BlockSize ||
+        Size + Next->BufferSize > MMC_QUEUE_MAX_MERGE_SIZE) {
+      break;
+    }
+
+    if ((UINT8 *) Last->Buffer + Last->BufferSize != Next->Buffer) {
+      Contiguous = FALSE;
+    }
+
+    Size += Next->BufferSize;
+    Last = Next;
+  }
+
+  Buffer = First->Buffer;
+  Bounce = FALSE;
+  if (!Contiguous) {
+    Buffer = AllocatePool (Size);
+    if (Buffer == NULL) {
+      //
+      // Just issue the head request on its own.
+      //
+      Buffer = First->Buffer;
+      Size = First->BufferSize;
+      Last = First;
+    } else {
+      Bounce = TRUE;
+    }
+  }
+
+  if (Bounce && First->Transfer == MMC_IOBLOCKS_WRITE) {
+    Link = &First->Link;
+    Offset = 0;
+    while (Offset < Size) {
+      Request = MMC_IO_REQUEST_FROM_LINK (Link);
+      CopyMem (Buffer + Offset, Request->Buffer, Request->BufferSize);
+      Offset += Request->BufferSize;
+      Link = GetNextNode (&MmcHostInstance->Queue, Link);
+    }
+  }
+
+  if (Last != First) {
+    DEBUG ((DEBUG_BLKIO, "%a: merged LBA 0x%lx-0x%lx%a\n", __FUNCTION__,
+            First->Lba, Last->Lba + Last->BufferSize / BlockSize - 1,
+            Bounce ? " (bounced)" : ""));
+  }
+
+  Status = MmcCacheIo (&MmcHostInstance->BlockIo, First->Transfer,
+                       First->MediaId, First->Lba, Size, Buffer);
+
+  Offset = 0;
+  do {
+    Request = MMC_IO_REQUEST_FROM_LINK (GetFirstNode (&MmcHostInstance->Queue));
+    if (Bounce && Request->Transfer == MMC_IOBLOCKS_READ && !EFI_ERROR (Status)) {
+      CopyMem (Request->Buffer, Buffer + Offset, Request->BufferSize);
+    }
+
+    Offset += Request->BufferSize;
+    Done = (Request == Last);
+    MmcCompleteRequest (Request, Status);
+  } while (!Done);
+
+  if (Bounce) {
+    FreePool (Buffer);
+  }
+}
+
+EFI_TPL
+MmcRaiseTpl (
+  VOID
+  )
+{
+  EFI_TPL OldTpl;
+
+  OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+  gBS->RestoreTPL (OldTpl);
+
+  if (OldTpl < TPL_CALLBACK) {
+    gBS->RaiseTPL (TPL_CALLBACK);
+  }
+
+  return OldTpl;
+}
+
+EFI_STATUS
+MmcAcquireHost (
+  IN  MMC_HOST_INSTANCE *MmcHostInstance,
+  OUT EFI_TPL           *OldTpl
+  )
+{
+  *OldTpl = MmcRaiseTpl ();
+  if (MmcHostInstance->IoActive) {
+    gBS->RestoreTPL (*OldTpl);
+    DEBUG ((DEBUG_ERROR, "%a: host busy, called at TPL %u during a transfer\n",
+            __FUNCTION__, (UINT32) *OldTpl));
+    return EFI_NOT_READY;
+  }
+
+  MmcHostInstance->IoActive = TRUE;
+  return EFI_SUCCESS;
+}
+
+VOID
+MmcReleaseHost (
+  IN MMC_HOST_INSTANCE *MmcHostInstance,
+  IN EFI_TPL           OldTpl
+  )
+{
+  ASSERT (MmcHostInstance->IoActive);
+  MmcHostInstance->IoActive = FALSE;
+  gBS->RestoreTPL (OldTpl);
+}
+
+STATIC
+VOID
+EFIAPI
+MmcQueueNotify (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  EFI_TPL           OldTpl;
+  MMC_HOST_INSTANCE *MmcHostInstance = Context;
+
+  if (EFI_ERROR (MmcAcquireHost (MmcHostInstance, &OldTpl))) {
+    return;
+  }
+
+  //
+  // One transfer per tick, leaving the rest of the time to the caller.
+  //
+  if (!IsListEmpty (&MmcHostInstance->Queue)) {
+    MmcServiceQueueHead (MmcHostInstance);
+  }
+
+  if (IsListEmpty (&MmcHostInstance->Queue)) {
+    gBS->SetTimer (MmcHostInstance->QueueEvent, TimerCancel, 0);
+  }
+
+  MmcReleaseHost (MmcHostInstance, OldTpl);
+}
+
+VOID
+MmcAbortQueue (
+  IN MMC_HOST_INSTANCE *MmcHostInstance,
+  IN EFI_STATUS        Status
+  )
+{
+  while (!IsListEmpty (&MmcHostInstance->Queue)) {
+    MmcCompleteRequest (MMC_IO_REQUEST_FROM_LINK (GetFirstNode (&MmcHostInstance->Queue)),
+                        Status);
+  }
+
+  gBS->SetTimer (MmcHostInstance->QueueEvent, TimerCancel, 0);
+}
+
+VOID
+MmcFlushQueue (
+  IN MMC_HOST_INSTANCE *MmcHostInstance
+  )
+{
+  while (!IsListEmpty (&MmcHostInstance->Queue)) {
+    MmcServiceQueueHead (MmcHostInstance);
+  }
+
+  gBS->SetTimer (MmcHostInstance->QueueEvent, TimerCancel, 0);
+}
+
+EFI_STATUS
+MmcInitializeQueue (
+  IN MMC_HOST_INSTANCE *MmcHostInstance
+  )
+{
+  InitializeListHead (&MmcHostInstance->Queue);
+
+  return gBS->CreateEvent (EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_CALLBACK,
+                           MmcQueueNotify, MmcHostInstance,
+                           &MmcHostInstance->QueueEvent);
+}
+
+VOID
+MmcDestroyQueue (
+  IN MMC_HOST_INSTANCE *MmcHostInstance
+  )
+{
+  EFI_TPL OldTpl;
+
+  OldTpl = MmcRaiseTpl ();
+  ASSERT (!MmcHostInstance->IoActive);
+  MmcAbortQueue (MmcHostInstance, EFI_ABORTED);
+  gBS->RestoreTPL (OldTpl);
+
+  gBS->CloseEvent (MmcHostInstance->QueueEvent);
+}
+
+STATIC
+EFI_STATUS
+MmcQueueRequest (
+  IN     MMC_HOST_INSTANCE   *MmcHostInstance,
+  IN     UINTN               Transfer,
+  IN     UINT32              MediaId,
+  IN     EFI_LBA             Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN *Token,
+  IN     UINTN               BufferSize,
+  IN     VOID                *Buffer
+  )
+{
+  EFI_STATUS     Status;
+  EFI_TPL        OldTpl;
+  MMC_IO_REQUEST *Request;
+
+  Status = MmcCheckIoParameters (&MmcHostInstance->BlockIo, Transfer,
+                                 MediaId, Lba, BufferSize, Buffer);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (BufferSize == 0) {
+    Token->TransactionStatus = EFI_SUCCESS;
+    gBS->SignalEvent (Token->Event);
+    return EFI_SUCCESS;
+  }
+
+  Request = AllocatePool (sizeof (MMC_IO_REQUEST));
+  if (Request == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Request->Signature = MMC_IO_REQUEST_SIGNATURE;
+  Request->Transfer = Transfer;
+  Request->MediaId = MediaId;
+  Request->Lba = Lba;
+  Request->BufferSize = BufferSize;
+  Request->Buffer = Buffer;
+  Request->Token = Token;
+  Token->TransactionStatus = EFI_NOT_READY;
+
+  OldTpl = MmcRaiseTpl ();
+  if (IsListEmpty (&MmcHostInstance->Queue)) {
+    gBS->SetTimer (MmcHostInstance->QueueEvent, TimerPeriodic, MMC_QUEUE_PERIOD);
+  }
+  InsertTailList (&MmcHostInstance->Queue, &Request->Link);
+  gBS->RestoreTPL (OldTpl);
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+MmcResetEx (
+  IN EFI_BLOCK_IO2_PROTOCOL *This,
+  IN BOOLEAN                ExtendedVerification
+  )
+{
+  MMC_HOST_INSTANCE *MmcHostInstance;
+  EFI_TPL           OldTpl;
+  EFI_STATUS        Status;
+
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS (This);
+
+  Status = MmcAcquireHost (MmcHostInstance, &OldTpl);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  MmcAbortQueue (MmcHostInstance, EFI_ABORTED);
+  MmcReleaseHost (MmcHostInstance, OldTpl);
+
+  return MmcReset (&MmcHostInstance->BlockIo, ExtendedVerification);
+}
+
+EFI_STATUS
+EFIAPI
+MmcReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN     UINT32                 MediaId,
+  IN     EFI_LBA                Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token,
+  IN     UINTN                  BufferSize,
+     OUT VOID                   *Buffer
+  )
+{
+  MMC_HOST_INSTANCE *MmcHostInstance;
+
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS (This);
+
+  if (Token == NULL || Token->Event == NULL) {
+    return MmcReadBlocks (&MmcHostInstance->BlockIo, MediaId, Lba,
+                          BufferSize, Buffer);
+  }
+
+  return MmcQueueRequest (MmcHostInstance, MMC_IOBLOCKS_READ, MediaId, Lba,
+                          Token, BufferSize, Buffer);
+}
+
+EFI_STATUS
+EFIAPI
+MmcWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN     UINT32                 MediaId,
+  IN     EFI_LBA                Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token,
+  IN     UINTN                  BufferSize,
+  IN     VOID                   *Buffer
+  )
+{
+  MMC_HOST_INSTANCE *MmcHostInstance;
+
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS (This);
+
+  if (Token == NULL || Token->Event == NULL) {
+    return MmcWriteBlocks (&MmcHostInstance->BlockIo, MediaId, Lba,
+                           BufferSize, Buffer);
+  }
+
+  return MmcQueueRequest (MmcHostInstance, MMC_IOBLOCKS_WRITE, MediaId, Lba,
+                          Token, BufferSize, Buffer);
+}
+
+EFI_STATUS
+EFIAPI
+MmcFlushBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token
+  )
+{
+  MMC_HOST_INSTANCE *MmcHostInstance;
+  EFI_TPL           OldTpl;
+  EFI_STATUS        Status;
+
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS (This);
+
+  if (!MmcHostInstance->BlockIo.Media->MediaPresent) {
+    return EFI_NO_MEDIA;
+  }
+
+  //
+  // Writes are never cached, so flushing only means finishing
+  // everything queued so far.
+  //
+  Status = MmcAcquireHost (MmcHostInstance, &OldTpl);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  MmcFlushQueue (MmcHostInstance);
+  MmcReleaseHost (MmcHostInstance, OldTpl);
+
+  if (Token != NULL && Token->Event != NULL) {
+    Token->TransactionStatus = EFI_SUCCESS;
+    gBS->SignalEvent (Token->Event);
+  }
+
+  return EFI_SUCCESS;
+}
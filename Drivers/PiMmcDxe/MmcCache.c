@@ -0,0 +1,361 @@
+/** @file
+*
+*  Read cache for the MMC DXE driver. Sequential read streams are
+*  served from a read-ahead window filled with large multi-block
+*  reads, while blocks from small random reads (FAT, directories)
+*  are kept in an LRU. Writes invalidate the blocks they cover.
+*
+*  Copyright (c) 2018, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include "Mmc.h"
+
+#define MMC_CACHE_BLOCK_FROM_LINK(a) BASE_CR (a, MMC_CACHE_BLOCK, Link)
+
+STATIC
+VOID
+MmcCacheDropReadAhead (
+  IN MMC_CACHE *Cache
+  )
+{
+  if (Cache->ReadAheadCount != 0) {
+    Cache->WastedBlocks += Cache->ReadAheadCount - Cache->ReadAheadUsed;
+    Cache->ReadAheadCount = 0;
+    Cache->ReadAheadUsed = 0;
+  }
+}
+
+/**
+  Drops all cached blocks in [Lba, Lba + Count).
+**/
+STATIC
+VOID
+MmcCacheInvalidate (
+  IN MMC_CACHE *Cache,
+  IN EFI_LBA   Lba,
+  IN UINTN     Count
+  )
+{
+  UINTN           Index;
+  MMC_CACHE_BLOCK *Block;
+
+  if (Cache->ReadAheadCount != 0 &&
+      Lba < Cache->ReadAheadLba + Cache->ReadAheadCount &&
+      Lba + Count > Cache->ReadAheadLba) {
+    MmcCacheDropReadAhead (Cache);
+  }
+
+  for (Index = 0; Index < MMC_CACHE_LRU_BLOCKS; Index++) {
+    Block = &Cache->Blocks[Index];
+    if (Block->Valid && Block->Lba >= Lba && Block->Lba < Lba + Count) {
+      //
+      // Free blocks go to the tail, to be reused first.
+      //
+      Block->Valid = FALSE;
+      RemoveEntryList (&Block->Link);
+      InsertTailList (&Cache->Lru, &Block->Link);
+    }
+  }
+}
+
+STATIC
+VOID
+MmcCacheReset (
+  IN MMC_CACHE *Cache,
+  IN UINT32    MediaId
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < MMC_CACHE_LRU_BLOCKS; Index++) {
+    Cache->Blocks[Index].Valid = FALSE;
+  }
+
+  Cache->ReadAheadCount = 0;
+  Cache->ReadAheadUsed = 0;
+  //
+  // No read has been seen yet, so nothing is sequential, not even
+  // a first read of block 0.
+  //
+  Cache->NextLba = MAX_UINT64;
+  Cache->MediaId = MediaId;
+}
+
+STATIC
+MMC_CACHE_BLOCK *
+MmcCacheLookup (
+  IN MMC_CACHE *Cache,
+  IN EFI_LBA   Lba
+  )
+{
+  LIST_ENTRY      *Link;
+  MMC_CACHE_BLOCK *Block;
+
+  for (Link = GetFirstNode (&Cache->Lru);
+       !IsNull (&Cache->Lru, Link);
+       Link = GetNextNode (&Cache->Lru, Link)) {
+    Block = MMC_CACHE_BLOCK_FROM_LINK (Link);
+    if (!Block->Valid) {
+      //
+      // Only free blocks follow.
+      //
+      break;
+    }
+
+    if (Block->Lba == Lba) {
+      return Block;
+    }
+  }
+
+  return NULL;
+}
+
+STATIC
+VOID
+MmcCacheInsert (
+  IN MMC_CACHE *Cache,
+  IN EFI_LBA   Lba,
+  IN VOID      *Data
+  )
+{
+  MMC_CACHE_BLOCK *Block;
+
+  Block = MmcCacheLookup (Cache, Lba);
+  if (Block == NULL) {
+    Block = MMC_CACHE_BLOCK_FROM_LINK (GetPreviousNode (&Cache->Lru, &Cache->Lru));
+    Block->Lba = Lba;
+    Block->Valid = TRUE;
+  }
+
+  CopyMem (Block->Data, Data, MMC_CACHE_BLOCK_SIZE);
+  RemoveEntryList (&Block->Link);
+  InsertHeadList (&Cache->Lru, &Block->Link);
+}
+
+/**
+  Copies whatever prefix of [Lba, Lba + Count) the read-ahead
+  window holds into Buffer, returning the number of blocks copied.
+**/
+STATIC
+UINTN
+MmcCacheReadAheadCopy (
+  IN  MMC_CACHE *Cache,
+  IN  EFI_LBA   Lba,
+  IN  UINTN     Count,
+  OUT UINT8     *Buffer
+  )
+{
+  UINTN Offset;
+
+  if (Cache->ReadAheadCount == 0 ||
+      Lba < Cache->ReadAheadLba ||
+      Lba >= Cache->ReadAheadLba + Cache->ReadAheadCount) {
+    return 0;
+  }
+
+  Offset = (UINTN) (Lba - Cache->ReadAheadLba);
+  Count = MIN (Count, Cache->ReadAheadCount - Offset);
+  CopyMem (Buffer, Cache->ReadAhead + Offset * MMC_CACHE_BLOCK_SIZE,
+           Count * MMC_CACHE_BLOCK_SIZE);
+
+  Cache->ReadAheadUsed = MAX (Cache->ReadAheadUsed, Offset + Count);
+  return Count;
+}
+
+STATIC
+EFI_STATUS
+MmcCacheRead (
+  IN  EFI_BLOCK_IO_PROTOCOL *This,
+  IN  MMC_CACHE             *Cache,
+  IN  UINT32                MediaId,
+  IN  EFI_LBA               Lba,
+  IN  UINTN                 BlockCount,
+  OUT UINT8                 *Buffer
+  )
+{
+  EFI_STATUS      Status;
+  BOOLEAN         Sequential;
+  MMC_CACHE_BLOCK *Block;
+  UINTN           Index;
+  UINTN           Count;
+
+  Sequential = (Lba == Cache->NextLba);
+  Cache->NextLba = Lba + BlockCount;
+
+  Count = MmcCacheReadAheadCopy (Cache, Lba, BlockCount, Buffer);
+  if (Count != 0) {
+    Cache->BytesSaved += Count * MMC_CACHE_BLOCK_SIZE;
+    Lba += Count;
+    BlockCount -= Count;
+    Buffer += Count * MMC_CACHE_BLOCK_SIZE;
+    Sequential = TRUE;
+  }
+
+  if (BlockCount == 0) {
+    Cache->Hits++;
+    return EFI_SUCCESS;
+  }
+
+  if (BlockCount <= MMC_CACHE_LRU_MAX_READ) {
+    for (Index = 0; Index < BlockCount; Index++) {
+      if (MmcCacheLookup (Cache, Lba + Index) == NULL) {
+        break;
+      }
+    }
+
+    if (Index == BlockCount) {
+      for (Index = 0; Index < BlockCount; Index++) {
+        Block = MmcCacheLookup (Cache, Lba + Index);
+        CopyMem (Buffer + Index * MMC_CACHE_BLOCK_SIZE, Block->Data,
+                 MMC_CACHE_BLOCK_SIZE);
+        RemoveEntryList (&Block->Link);
+        InsertHeadList (&Cache->Lru, &Block->Link);
+      }
+
+      Cache->Hits++;
+      Cache->BytesSaved += BlockCount * MMC_CACHE_BLOCK_SIZE;
+      return EFI_SUCCESS;
+    }
+  }
+
+  Cache->Misses++;
+
+  if (Sequential && BlockCount < MMC_CACHE_READ_AHEAD_BLOCKS) {
+    //
+    // Part of a stream: fetch the next window with a single command.
+    //
+    MmcCacheDropReadAhead (Cache);
+    Count = (UINTN) MIN (MMC_CACHE_READ_AHEAD_BLOCKS, This->Media->LastBlock + 1 - Lba);
+    Status = MmcIoBlocks (This, MMC_IOBLOCKS_READ, MediaId, Lba,
+                          Count * MMC_CACHE_BLOCK_SIZE, Cache->ReadAhead);
+    if (!EFI_ERROR (Status)) {
+      Cache->ReadAheadLba = Lba;
+      Cache->ReadAheadCount = Count;
+      Cache->PrefetchedBlocks += Count - BlockCount;
+      MmcCacheReadAheadCopy (Cache, Lba, BlockCount, Buffer);
+      return EFI_SUCCESS;
+    }
+
+    DEBUG ((DEBUG_WARN, "%a: read-ahead at LBA 0x%lx failed: %r\n",
+            __FUNCTION__, Lba, Status));
+  }
+
+  Status = MmcIoBlocks (This, MMC_IOBLOCKS_READ, MediaId, Lba,
+                        BlockCount * MMC_CACHE_BLOCK_SIZE, Buffer);
+  if (!EFI_ERROR (Status) && BlockCount <= MMC_CACHE_LRU_MAX_READ) {
+    for (Index = 0; Index < BlockCount; Index++) {
+      MmcCacheInsert (Cache, Lba + Index, Buffer + Index * MMC_CACHE_BLOCK_SIZE);
+    }
+  }
+
+  return Status;
+}
+
+EFI_STATUS
+MmcCacheIo (
+  IN EFI_BLOCK_IO_PROTOCOL    *This,
+  IN UINTN                    Transfer,
+  IN UINT32                   MediaId,
+  IN EFI_LBA                  Lba,
+  IN UINTN                    BufferSize,
+  IN OUT VOID                 *Buffer
+  )
+{
+  EFI_STATUS        Status;
+  MMC_HOST_INSTANCE *MmcHostInstance;
+  MMC_CACHE         *Cache;
+
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This);
+  Cache = &MmcHostInstance->Cache;
+
+  if (PcdGet32 (PcdMmcDisableCache) != 0 ||
+      Cache->Blocks == NULL ||
+      This->Media->BlockSize != MMC_CACHE_BLOCK_SIZE) {
+    return MmcIoBlocks (This, Transfer, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  Status = MmcCheckIoParameters (This, Transfer, MediaId, Lba, BufferSize, Buffer);
+  if (EFI_ERROR (Status) || BufferSize == 0) {
+    return Status;
+  }
+
+  if (Cache->MediaId != This->Media->MediaId) {
+    MmcCacheReset (Cache, This->Media->MediaId);
+  }
+
+  if (Transfer == MMC_IOBLOCKS_WRITE) {
+    MmcCacheInvalidate (Cache, Lba, BufferSize / MMC_CACHE_BLOCK_SIZE);
+    return MmcIoBlocks (This, Transfer, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  return MmcCacheRead (This, Cache, MediaId, Lba,
+                       BufferSize / MMC_CACHE_BLOCK_SIZE, Buffer);
+}
+
+VOID
+MmcCacheInitialize (
+  IN MMC_HOST_INSTANCE *MmcHostInstance
+  )
+{
+  MMC_CACHE *Cache;
+  UINT8     *Data;
+  UINTN     Index;
+
+  Cache = &MmcHostInstance->Cache;
+  Cache->NextLba = MAX_UINT64;
+  InitializeListHead (&Cache->Lru);
+
+  Cache->ReadAhead = AllocatePool (MMC_CACHE_READ_AHEAD_BLOCKS * MMC_CACHE_BLOCK_SIZE);
+  Cache->Blocks = AllocateZeroPool (MMC_CACHE_LRU_BLOCKS * sizeof (MMC_CACHE_BLOCK));
+  Data = AllocatePool (MMC_CACHE_LRU_BLOCKS * MMC_CACHE_BLOCK_SIZE);
+  if (Cache->ReadAhead == NULL || Cache->Blocks == NULL || Data == NULL) {
+    DEBUG ((DEBUG_ERROR, "%a: out of memory, reads will not be cached\n",
+            __FUNCTION__));
+    if (Data != NULL) {
+      FreePool (Data);
+    }
+    MmcCacheFree (MmcHostInstance);
+    return;
+  }
+
+  for (Index = 0; Index < MMC_CACHE_LRU_BLOCKS; Index++) {
+    Cache->Blocks[Index].Data = Data + Index * MMC_CACHE_BLOCK_SIZE;
+    InsertTailList (&Cache->Lru, &Cache->Blocks[Index].Link);
+  }
+}
+
+VOID
+MmcCacheFree (
+  IN MMC_HOST_INSTANCE *MmcHostInstance
+  )
+{
+  MMC_CACHE *Cache;
+
+  Cache = &MmcHostInstance->Cache;
+
+  if (Cache->Blocks != NULL) {
+    if (Cache->Blocks[0].Data != NULL) {
+      FreePool (Cache->Blocks[0].Data);
+    }
+    FreePool (Cache->Blocks);
+    Cache->Blocks = NULL;
+  }
+
+  if (Cache->ReadAhead != NULL) {
+    FreePool (Cache->ReadAhead);
+    Cache->ReadAhead = NULL;
+  }
+}
@@ -602,6 +602,8 @@ InitializeSdMmcDevice (
   EFI_STATUS    Status;
   EFI_MMC_HOST_PROTOCOL *MmcHost = MmcHostInstance->MmcHost;
 
+  MmcHostInstance->CardInfo.SupportsCmd23 = FALSE;
+
   Status = SdGetCsd (MmcHostInstance, Response, TRUE);
   if (EFI_ERROR (Status)) {
     return Status;
@@ -694,6 +696,15 @@ InitializeSdMmcDevice (
     }
   }
 
+  //
+  // A pre-defined block count lets multi-block transfers finish
+  // without CMD12, and writes without the ACMD22 check.
+  //
+  MmcHostInstance->CardInfo.SupportsCmd23 =
+    (Scr.CMD_SUPPORT & SD_CMD23_SUPPORTED) != 0;
+  DEBUG ((DEBUG_INFO, "SD Card %a CMD23\n",
+          MmcHostInstance->CardInfo.SupportsCmd23 ? "supports" : "does not support"));
+
   Status = SdSetSpeed(MmcHostInstance, CccSwitch);
   if (EFI_ERROR(Status)) {
     return Status;
@@ -626,6 +626,62 @@ LogSmbiosData (
   return Status;
 }
 
+/***********************************************************************
+        Firmware queries
+************************************************************************/
+STATIC UINT32 mBoardRevision;
+STATIC UINT64 mBoardSerial;
+STATIC UINT32 mArmMem[2];
+STATIC UINT32 mMaxArmClock[2] = { RPI_FW_CLOCK_RATE_ARM, 0 };
+STATIC UINT32 mArmClock[2] = { RPI_FW_CLOCK_RATE_ARM, 0 };
+
+enum {
+  FW_TAG_REVISION,
+  FW_TAG_SERIAL,
+  FW_TAG_MAX_CLOCK,
+  FW_TAG_CLOCK,
+  FW_TAG_ARM_MEM,
+};
+
+//
+// Indexed by the FW_TAG_xxx values above.
+//
+STATIC RASPBERRY_PI_FIRMWARE_TAG mFwTags[] = {
+  { RPI_FW_GET_BOARD_REVISION, sizeof (mBoardRevision), &mBoardRevision },
+  { RPI_FW_GET_BOARD_SERIAL,   sizeof (mBoardSerial),   &mBoardSerial   },
+  { RPI_FW_GET_MAX_CLOCK_RATE, sizeof (mMaxArmClock),   mMaxArmClock    },
+  { RPI_FW_GET_CLOCK_RATE,     sizeof (mArmClock),      mArmClock       },
+  { RPI_FW_GET_ARM_MEMSIZE,    sizeof (mArmMem),        mArmMem         },
+};
+
+/*
+ * Everything the tables below need from the VideoCore is fetched
+ * in one mailbox transaction. A tag the firmware didn't answer is
+ * left with a zero ResponseSize.
+ */
+STATIC
+VOID
+QueryFirmware (
+               VOID
+               )
+{
+  EFI_STATUS Status;
+
+  Status = mFwProtocol->SendTags(mFwTags, ELES(mFwTags));
+  if (EFI_ERROR(Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed to query firmware: %r\n", Status));
+  }
+}
+
+STATIC
+EFI_STATUS
+FwTagStatus (
+             IN UINTN Tag
+             )
+{
+  return mFwTags[Tag].ResponseSize != 0 ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
 /***********************************************************************
         SMBIOS data update  TYPE0  BIOS Information
 ************************************************************************/
@@ -683,12 +739,13 @@ SysInfoUpdateSmbiosType1 (
   UINTN Prod = PROD_UNKNOWN;
   UINTN Manu = MANU_UNKNOWN;
 
-  Status = mFwProtocol->GetModelRevision(&BoardRevision);
+  Status = FwTagStatus(FW_TAG_REVISION);
   if (EFI_ERROR(Status)) {
     DEBUG ((EFI_D_ERROR,
             "Failed to get board model: %r\n",
             Status));
   } else {
+    BoardRevision = mBoardRevision;
     Prod = X(BoardRevision, 4, 11);
   }
 
@@ -715,11 +772,13 @@ SysInfoUpdateSmbiosType1 (
                  sizeof(mSysInfoSKU),
                  BoardRevision);
 
-  Status = mFwProtocol->GetSerial(&BoardSerial);
+  Status = FwTagStatus(FW_TAG_SERIAL);
   if (EFI_ERROR(Status)) {
     DEBUG ((EFI_D_ERROR,
             "Failed to get board serial: %r\n",
             Status));
+  } else {
+    BoardSerial = mBoardSerial;
   }
 
   I64ToHexString(mSysInfoSerial,
@@ -774,18 +833,20 @@ ProcessorInfoUpdateSmbiosType4 (
   mProcessorInfoType4.EnabledCoreCount = (UINT8) MaxCpus;
   mProcessorInfoType4.ThreadCount      = (UINT8) MaxCpus;
 
-  Status = mFwProtocol->GetMaxClockRate(RPI_FW_CLOCK_RATE_ARM, &Rate);
+  Status = FwTagStatus(FW_TAG_MAX_CLOCK);
   if (Status != EFI_SUCCESS) {
     DEBUG ((DEBUG_ERROR, "Couldn't get the max CPU speed: %r\n", Status));
   } else {
+    Rate = mMaxArmClock[1];
     mProcessorInfoType4.MaxSpeed = Rate / 1000000;
     DEBUG ((DEBUG_INFO, "Max CPU speed: %uHz\n", Rate));
   }
 
-  Status = mFwProtocol->GetClockRate(RPI_FW_CLOCK_RATE_ARM, &Rate);
+  Status = FwTagStatus(FW_TAG_CLOCK);
   if (Status != EFI_SUCCESS) {
     DEBUG ((DEBUG_ERROR, "Couldn't get the current CPU speed: %r\n", Status));
   } else {
+    Rate = mArmClock[1];
     mProcessorInfoType4.CurrentSpeed = Rate / 1000000;
     DEBUG ((DEBUG_INFO, "Current CPU speed: %uHz\n", Rate));
   }
@@ -856,10 +917,12 @@ MemArrMapInfoUpdateSmbiosType19 (
   UINT32 Base;
   UINT32 Size;
 
-  Status = mFwProtocol->GetArmMem(&Base, &Size);
+  Status = FwTagStatus(FW_TAG_ARM_MEM);
   if (Status != EFI_SUCCESS) {
     DEBUG ((DEBUG_ERROR, "Couldn't get the ARM memory size: %r\n", Status));
   } else {
+    Base = mArmMem[0];
+    Size = mArmMem[1];
     mMemArrMapInfoType19.StartingAddress = Base / 1024;
     mMemArrMapInfoType19.EndingAddress = (Base + Size - 1) / 1024;
   }
@@ -898,6 +961,8 @@ PlatformSmbiosDriverEntryPoint (
     return Status;
   }
 
+  QueryFirmware();
+
   BIOSInfoUpdateSmbiosType0();
 
   SysInfoUpdateSmbiosType1();
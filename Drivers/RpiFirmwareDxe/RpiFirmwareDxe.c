@@ -25,10 +25,15 @@
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiLib.h>
 
+#include <Guid/EventGroup.h>
+
 #include <IndustryStandard/Bcm2836.h>
 #include <IndustryStandard/RpiFirmware.h>
 
+#include <Protocol/HardwareInterrupt.h>
 #include <Protocol/RaspberryPiFirmware.h>
+#include <Protocol/RaspberryPiFirmwareDebug.h>
+#include <Protocol/Timer.h>
 
 //
 // The number of statically allocated buffer pages
@@ -45,7 +50,85 @@ STATIC VOID  *mDmaBuffer;
 STATIC VOID  *mDmaBufferMapping;
 STATIC UINTN mDmaBufferBusAddress;
 
-STATIC SPIN_LOCK mMailboxLock;
+//
+// How long to wait for the firmware to respond, once the mailbox
+// IRQ is in use
+//
+#define MAILBOX_TIMEOUT_MS  1000
+
+//
+// While boot services are up, callers at or below TPL_NOTIFY are
+// serialized by running the transaction at TPL_NOTIFY: requests from
+// lower TPLs (such as timer callbacks) wait until the current owner is
+// done, rather than failing. The spinlock is what actually guards the
+// buffer, so callers above TPL_NOTIFY, and everyone from the
+// ExitBootServices notification on, fail fast when it is taken, as
+// they always did.
+//
+STATIC SPIN_LOCK        mMailboxLock;
+STATIC EFI_TPL          mMailboxTpl;
+STATIC BOOLEAN          mMailboxTplRaised;
+STATIC BOOLEAN          mBootServicesActive = TRUE;
+
+//
+// Once the timer (and thus the interrupt controller) is up, the
+// response is signalled via the ARM mailbox IRQ instead of being
+// polled for. Until then, and whenever interrupts are masked, we
+// fall back to polling.
+//
+STATIC EFI_HARDWARE_INTERRUPT_PROTOCOL  *mInterrupt;
+STATIC VOID                             *mTimerRegistration;
+STATIC EFI_EVENT                        mTimerNotifyEvent;
+STATIC EFI_EVENT                        mMailboxTimeoutEvent;
+STATIC volatile BOOLEAN                 mMailboxIrq;
+STATIC volatile BOOLEAN                 mMailboxResponded;
+STATIC volatile UINT32                  mMailboxResponse;
+
+STATIC
+BOOLEAN
+MailboxAcquire (
+  VOID
+  )
+{
+  EFI_TPL Tpl;
+  BOOLEAN Raised;
+
+  Tpl = TPL_APPLICATION;
+  Raised = FALSE;
+  if (mBootServicesActive && EfiGetCurrentTpl () <= TPL_NOTIFY) {
+    Tpl = gBS->RaiseTPL (TPL_NOTIFY);
+    Raised = TRUE;
+  }
+
+  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
+    if (Raised) {
+      gBS->RestoreTPL (Tpl);
+    }
+    return FALSE;
+  }
+
+  mMailboxTpl = Tpl;
+  mMailboxTplRaised = Raised;
+  return TRUE;
+}
+
+STATIC
+VOID
+MailboxRelease (
+  VOID
+  )
+{
+  EFI_TPL Tpl;
+  BOOLEAN Raised;
+
+  Tpl = mMailboxTpl;
+  Raised = mMailboxTplRaised;
+  ReleaseSpinLock (&mMailboxLock);
+
+  if (Raised) {
+    gBS->RestoreTPL (Tpl);
+  }
+}
 
 STATIC
 BOOLEAN
@@ -96,6 +179,77 @@ MailboxWaitForStatusCleared (
   return FALSE;
 }
 
+STATIC
+VOID
+EFIAPI
+MailboxInterruptHandler (
+  IN  HARDWARE_INTERRUPT_SOURCE   Source,
+  IN  EFI_SYSTEM_CONTEXT          SystemContext
+  )
+{
+  while ((MmioRead32 (BCM2836_MBOX_BASE_ADDRESS + BCM2836_MBOX_STATUS_OFFSET) &
+          (1U << BCM2836_MBOX_STATUS_EMPTY)) == 0) {
+    ArmDataSynchronizationBarrier ();
+    mMailboxResponse = MmioRead32 (BCM2836_MBOX_BASE_ADDRESS +
+                                   BCM2836_MBOX_READ_OFFSET);
+    mMailboxResponded = TRUE;
+  }
+
+  mInterrupt->EndOfInterrupt (mInterrupt, Source);
+}
+
+STATIC
+BOOLEAN
+MailboxWaitForResponse (
+  OUT   UINT32  *Result
+  )
+{
+  //
+  // The IRQ path depends on the timeout timer, so it is only used
+  // while the transaction owns TPL_NOTIFY with boot services up.
+  //
+  if (!mMailboxIrq || !mMailboxTplRaised || !ArmGetInterruptState ()) {
+    //
+    // Wait for the 'input register empty' bit to clear
+    //
+    if (!MailboxWaitForStatusCleared (1U << BCM2836_MBOX_STATUS_EMPTY)) {
+      return FALSE;
+    }
+
+    ArmDataSynchronizationBarrier ();
+    *Result = MmioRead32 (BCM2836_MBOX_BASE_ADDRESS + BCM2836_MBOX_READ_OFFSET);
+    return TRUE;
+  }
+
+  gBS->SetTimer (mMailboxTimeoutEvent, TimerRelative,
+    EFI_TIMER_PERIOD_MILLISECONDS (MAILBOX_TIMEOUT_MS));
+
+  while (!mMailboxResponded) {
+    if (gBS->CheckEvent (mMailboxTimeoutEvent) == EFI_SUCCESS) {
+      break;
+    }
+
+    //
+    // Check again with interrupts masked, so the IRQ can't sneak in
+    // between the check and the WFI. A pending IRQ still wakes us up.
+    //
+    ArmDisableInterrupts ();
+    if (!mMailboxResponded) {
+      CpuSleep ();
+    }
+    ArmEnableInterrupts ();
+  }
+
+  gBS->SetTimer (mMailboxTimeoutEvent, TimerCancel, 0);
+
+  if (!mMailboxResponded) {
+    return FALSE;
+  }
+
+  *Result = mMailboxResponse;
+  return TRUE;
+}
+
 STATIC
 EFI_STATUS
 MailboxTransaction (
@@ -128,6 +282,8 @@ MailboxTransaction (
 
   ArmDataSynchronizationBarrier ();
 
+  mMailboxResponded = FALSE;
+
   //
   // Start the mailbox transaction
   //
@@ -137,19 +293,13 @@ MailboxTransaction (
   ArmDataSynchronizationBarrier ();
 
   //
-  // Wait for the 'input register empty' bit to clear
+  // Wait for and read back the result
   //
-  if (!MailboxWaitForStatusCleared (1U << BCM2836_MBOX_STATUS_EMPTY)) {
+  if (!MailboxWaitForResponse (Result)) {
     DEBUG ((DEBUG_ERROR, "%a: timeout waiting for inbox to become full\n",
       __FUNCTION__));
     return EFI_TIMEOUT;
   }
-
-  //
-  // Read back the result
-  //
-  ArmDataSynchronizationBarrier ();
-  *Result = MmioRead32 (BCM2836_MBOX_BASE_ADDRESS + BCM2836_MBOX_READ_OFFSET);
   ArmDataSynchronizationBarrier ();
 
   return EFI_SUCCESS;
@@ -180,6 +330,272 @@ typedef struct {
 } RPI_FW_SET_POWER_STATE_CMD;
 #pragma pack()
 
+//
+// Properties that never change (or only change when we change them)
+// are served from memory after the first query. Entries are keyed
+// on tag ID plus the clock ID for clock rate tags.
+//
+#define CACHE_ENTRIES       32
+#define CACHE_VALUE_SIZE    16
+
+typedef struct {
+  BOOLEAN                   Used;
+  BOOLEAN                   Valid;
+  UINT32                    TagId;
+  UINT32                    Arg;
+  UINT32                    ValueSize;
+  UINT8                     Value[CACHE_VALUE_SIZE];
+  UINT32                    Hits;
+  UINT32                    Misses;
+} PROPERTY_CACHE_ENTRY;
+
+STATIC PROPERTY_CACHE_ENTRY mCache[CACHE_ENTRIES];
+STATIC RPI_FW_CACHE_STATS   mCacheStats;
+
+STATIC
+BOOLEAN
+CacheIsCacheable (
+  IN  UINT32  TagId
+  )
+{
+  switch (TagId) {
+  case RPI_FW_GET_BOARD_MODEL:
+  case RPI_FW_GET_BOARD_REVISION:
+  case RPI_FW_GET_MAC_ADDRESS:
+  case RPI_FW_GET_BOARD_SERIAL:
+  case RPI_FW_GET_ARM_MEMSIZE:
+  case RPI_FW_GET_MAX_CLOCK_RATE:
+  case RPI_FW_GET_MIN_CLOCK_RATE:
+  case RPI_FW_GET_CLOCK_RATE:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+//
+// Returns the part of the request that, together with the
+// tag ID, identifies the property.
+//
+STATIC
+UINT32
+CacheArg (
+  IN  UINT32  TagId,
+  IN  VOID    *Value,
+  IN  UINTN   ValueSize
+  )
+{
+  switch (TagId) {
+  case RPI_FW_GET_MAX_CLOCK_RATE:
+  case RPI_FW_GET_MIN_CLOCK_RATE:
+  case RPI_FW_GET_CLOCK_RATE:
+  case RPI_FW_SET_CLOCK_RATE:
+    return ValueSize >= sizeof (UINT32) ? *(UINT32 *)Value : 0;
+  default:
+    return 0;
+  }
+}
+
+STATIC
+PROPERTY_CACHE_ENTRY *
+CacheFind (
+  IN  UINT32  TagId,
+  IN  UINT32  Arg,
+  IN  BOOLEAN Create
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < CACHE_ENTRIES; Index++) {
+    if (!mCache[Index].Used) {
+      if (!Create) {
+        return NULL;
+      }
+
+      mCache[Index].TagId = TagId;
+      mCache[Index].Arg = Arg;
+      mCache[Index].Used = TRUE;
+      return &mCache[Index];
+    }
+
+    if (mCache[Index].TagId == TagId && mCache[Index].Arg == Arg) {
+      return &mCache[Index];
+    }
+  }
+
+  return NULL;
+}
+
+STATIC
+PROPERTY_CACHE_ENTRY *
+CacheFindValid (
+  IN  UINT32  TagId,
+  IN  UINT32  Arg,
+  IN  UINTN   ValueSize
+  )
+{
+  PROPERTY_CACHE_ENTRY *Entry;
+
+  if (!CacheIsCacheable (TagId)) {
+    return NULL;
+  }
+
+  Entry = CacheFind (TagId, Arg, FALSE);
+  if (Entry == NULL || !Entry->Valid || Entry->ValueSize > ValueSize) {
+    return NULL;
+  }
+
+  return Entry;
+}
+
+STATIC
+VOID
+CacheCountMiss (
+  IN  UINT32  TagId,
+  IN  UINT32  Arg
+  )
+{
+  PROPERTY_CACHE_ENTRY *Entry;
+
+  mCacheStats.Misses++;
+  Entry = CacheFind (TagId, Arg, TRUE);
+  if (Entry != NULL) {
+    Entry->Misses++;
+  }
+}
+
+STATIC
+BOOLEAN
+CacheLookup (
+  IN  UINT32  TagId,
+  IN  UINT32  Arg,
+  OUT VOID    *Value,
+  IN  UINTN   ValueSize,
+  OUT UINT32  *ResponseSize OPTIONAL
+  )
+{
+  PROPERTY_CACHE_ENTRY *Entry;
+
+  if (!CacheIsCacheable (TagId)) {
+    return FALSE;
+  }
+
+  Entry = CacheFindValid (TagId, Arg, ValueSize);
+  if (Entry == NULL) {
+    CacheCountMiss (TagId, Arg);
+    return FALSE;
+  }
+
+  mCacheStats.Hits++;
+  Entry->Hits++;
+  CopyMem (Value, Entry->Value, Entry->ValueSize);
+  if (ResponseSize != NULL) {
+    *ResponseSize = Entry->ValueSize;
+  }
+  return TRUE;
+}
+
+STATIC
+VOID
+CacheInvalidate (
+  IN  UINT32  TagId,
+  IN  UINT32  Arg
+  )
+{
+  PROPERTY_CACHE_ENTRY *Entry;
+
+  Entry = CacheFind (TagId, Arg, FALSE);
+  if (Entry != NULL && Entry->Valid) {
+    Entry->Valid = FALSE;
+    mCacheStats.Invalidations++;
+  }
+}
+
+//
+// Updates the cache from a tag the firmware has responded to.
+//
+STATIC
+VOID
+CacheUpdate (
+  IN  RPI_FW_TAG_HEAD *TagHead
+  )
+{
+  PROPERTY_CACHE_ENTRY *Entry;
+  UINT32               ValueSize;
+  UINT32               Arg;
+
+  ValueSize = MIN (TagHead->TagValueSize & ~RPI_FW_VALUE_SIZE_RESPONSE_MASK,
+                TagHead->TagSize);
+  Arg = CacheArg (TagHead->TagId, TagHead + 1, ValueSize);
+
+  if (TagHead->TagId == RPI_FW_SET_CLOCK_RATE) {
+    CacheInvalidate (RPI_FW_GET_CLOCK_RATE, Arg);
+    return;
+  }
+
+  if (!CacheIsCacheable (TagHead->TagId) ||
+      (TagHead->TagValueSize & RPI_FW_VALUE_SIZE_RESPONSE_MASK) == 0 ||
+      ValueSize == 0 || ValueSize > CACHE_VALUE_SIZE) {
+    return;
+  }
+
+  Entry = CacheFind (TagHead->TagId, Arg, TRUE);
+  if (Entry == NULL) {
+    return;
+  }
+
+  CopyMem (Entry->Value, TagHead + 1, ValueSize);
+  Entry->ValueSize = ValueSize;
+  Entry->Valid = TRUE;
+}
+
+STATIC
+VOID
+EFIAPI
+RpiFirmwareGetCacheStats (
+  OUT RPI_FW_CACHE_STATS *Stats
+  )
+{
+  CopyMem (Stats, &mCacheStats, sizeof *Stats);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+RpiFirmwareGetCacheEntryStats (
+  IN  UINTN                    Index,
+  OUT RPI_FW_CACHE_ENTRY_STATS *Stats
+  )
+{
+  if (Index >= CACHE_ENTRIES || !mCache[Index].Used) {
+    return EFI_NOT_FOUND;
+  }
+
+  Stats->TagId  = mCache[Index].TagId;
+  Stats->Arg    = mCache[Index].Arg;
+  Stats->Valid  = mCache[Index].Valid;
+  Stats->Hits   = mCache[Index].Hits;
+  Stats->Misses = mCache[Index].Misses;
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+EFIAPI
+RpiFirmwareFlushCache (
+  VOID
+  )
+{
+  ZeroMem (mCache, sizeof mCache);
+  ZeroMem (&mCacheStats, sizeof mCacheStats);
+}
+
+STATIC RASPBERRY_PI_FIRMWARE_DEBUG_PROTOCOL mRpiFirmwareDebugProtocol = {
+  RpiFirmwareGetCacheStats,
+  RpiFirmwareGetCacheEntryStats,
+  RpiFirmwareFlushCache
+};
+
 STATIC
 EFI_STATUS
 EFIAPI
@@ -193,8 +609,8 @@ RpiFirmwareSetPowerState (
   EFI_STATUS                        Status;
   UINT32                            Result;
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
     return EFI_DEVICE_ERROR;
   }
 
@@ -213,7 +629,7 @@ RpiFirmwareSetPowerState (
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
 
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
@@ -256,11 +672,18 @@ RpiFirmwareGetArmMemory (
   )
 {
   RPI_FW_GET_ARM_MEMORY_CMD   *Cmd;
+  RPI_FW_ARM_MEMORY_TAG       Body;
   EFI_STATUS                  Status;
   UINT32                      Result;
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  if (CacheLookup (RPI_FW_GET_ARM_MEMSIZE, 0, &Body, sizeof Body, NULL)) {
+    *Base = Body.Base;
+    *Size = Body.Size;
+    return EFI_SUCCESS;
+  }
+
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
     return EFI_DEVICE_ERROR;
   }
 
@@ -276,7 +699,7 @@ RpiFirmwareGetArmMemory (
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
 
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
@@ -286,6 +709,7 @@ RpiFirmwareGetArmMemory (
     return EFI_DEVICE_ERROR;
   }
 
+  CacheUpdate (&Cmd->TagHead);
   *Base = Cmd->TagBody.Base;
   *Size = Cmd->TagBody.Size;
   return EFI_SUCCESS;
@@ -313,11 +737,17 @@ RpiFirmwareGetMacAddress (
   )
 {
   RPI_FW_GET_MAC_ADDR_CMD     *Cmd;
+  RPI_FW_MAC_ADDR_TAG         Body;
   EFI_STATUS                  Status;
   UINT32                      Result;
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  if (CacheLookup (RPI_FW_GET_MAC_ADDRESS, 0, &Body, sizeof Body, NULL)) {
+    CopyMem (MacAddress, Body.MacAddress, sizeof Body.MacAddress);
+    return EFI_SUCCESS;
+  }
+
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
     return EFI_DEVICE_ERROR;
   }
 
@@ -333,7 +763,7 @@ RpiFirmwareGetMacAddress (
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
 
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
@@ -343,6 +773,7 @@ RpiFirmwareGetMacAddress (
     return EFI_DEVICE_ERROR;
   }
 
+  CacheUpdate (&Cmd->TagHead);
   CopyMem (MacAddress, Cmd->TagBody.MacAddress, sizeof Cmd->TagBody.MacAddress);
   return EFI_SUCCESS;
 }
@@ -371,8 +802,12 @@ RpiFirmwareGetSerial (
   EFI_STATUS                  Status;
   UINT32                      Result;
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  if (CacheLookup (RPI_FW_GET_BOARD_SERIAL, 0, Serial, sizeof *Serial, NULL)) {
+    return EFI_SUCCESS;
+  }
+
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
     return EFI_DEVICE_ERROR;
   }
 
@@ -388,7 +823,7 @@ RpiFirmwareGetSerial (
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
 
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
@@ -398,6 +833,7 @@ RpiFirmwareGetSerial (
     return EFI_DEVICE_ERROR;
   }
 
+  CacheUpdate (&Cmd->TagHead);
   *Serial = Cmd->TagBody.Serial;
   return EFI_SUCCESS;
 }
@@ -426,8 +862,12 @@ RpiFirmwareGetModel (
   EFI_STATUS                  Status;
   UINT32                      Result;
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  if (CacheLookup (RPI_FW_GET_BOARD_MODEL, 0, Model, sizeof *Model, NULL)) {
+    return EFI_SUCCESS;
+  }
+
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
     return EFI_DEVICE_ERROR;
   }
 
@@ -443,7 +883,7 @@ RpiFirmwareGetModel (
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
 
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
@@ -453,6 +893,7 @@ RpiFirmwareGetModel (
     return EFI_DEVICE_ERROR;
   }
 
+  CacheUpdate (&Cmd->TagHead);
   *Model = Cmd->TagBody.Model;
   return EFI_SUCCESS;
 }
@@ -481,8 +922,13 @@ RpiFirmwareGetModelRevision (
   EFI_STATUS                    Status;
   UINT32                        Result;
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  if (CacheLookup (RPI_FW_GET_BOARD_REVISION, 0, Revision, sizeof *Revision,
+        NULL)) {
+    return EFI_SUCCESS;
+  }
+
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
     return EFI_DEVICE_ERROR;
   }
 
@@ -498,7 +944,7 @@ RpiFirmwareGetModelRevision (
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
 
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
@@ -508,6 +954,7 @@ RpiFirmwareGetModelRevision (
     return EFI_DEVICE_ERROR;
   }
 
+  CacheUpdate (&Cmd->TagHead);
   *Revision = Cmd->TagBody.Revision;
   return EFI_SUCCESS;
 }
@@ -572,8 +1019,8 @@ RpiFirmwareGetFbSize (
   EFI_STATUS                  Status;
   UINT32                      Result;
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
     return EFI_DEVICE_ERROR;
   }
 
@@ -589,7 +1036,7 @@ RpiFirmwareGetFbSize (
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
 
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
@@ -613,8 +1060,8 @@ RpiFirmwareFreeFb (VOID)
   EFI_STATUS         Status;
   UINT32             Result;
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
     return EFI_DEVICE_ERROR;
   }
 
@@ -630,7 +1077,7 @@ RpiFirmwareFreeFb (VOID)
   Cmd->EndTag                  = 0;
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
@@ -661,8 +1108,8 @@ RpiFirmwareAllocFb (
   ASSERT (FbSize != NULL);
   ASSERT (FbBase != NULL);
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
     return EFI_DEVICE_ERROR;
   }
 
@@ -692,7 +1139,7 @@ RpiFirmwareAllocFb (
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
 
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
@@ -740,8 +1187,8 @@ RpiFirmwareGetCommmandLine (
     return EFI_OUT_OF_RESOURCES;
   }
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
     return EFI_DEVICE_ERROR;
   }
 
@@ -756,7 +1203,7 @@ RpiFirmwareGetCommmandLine (
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
 
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
@@ -813,8 +1260,13 @@ RpiFirmwareSetClockRate (
   EFI_STATUS                  Status;
   UINT32                      Result;
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  //
+  // Whatever the outcome, the cached current rate can't be trusted.
+  //
+  CacheInvalidate (RPI_FW_GET_CLOCK_RATE, ClockId);
+
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
     return EFI_DEVICE_ERROR;
   }
 
@@ -833,7 +1285,7 @@ RpiFirmwareSetClockRate (
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
 
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
@@ -871,11 +1323,17 @@ RpiFirmwareGetClockRate (
   )
 {
   RPI_FW_GET_CLOCK_RATE_CMD   *Cmd;
+  RPI_FW_CLOCK_RATE_TAG       Body;
   EFI_STATUS                  Status;
   UINT32                      Result;
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  if (CacheLookup (ClockKind, ClockId, &Body, sizeof Body, NULL)) {
+    *ClockRate = Body.ClockRate;
+    return EFI_SUCCESS;
+  }
+
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
     return EFI_DEVICE_ERROR;
   }
 
@@ -892,7 +1350,7 @@ RpiFirmwareGetClockRate (
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
 
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
@@ -902,6 +1360,7 @@ RpiFirmwareGetClockRate (
     return EFI_DEVICE_ERROR;
   }
 
+  CacheUpdate (&Cmd->TagHead);
   *ClockRate = Cmd->TagBody.ClockRate;
   return EFI_SUCCESS;
 }
@@ -954,8 +1413,8 @@ typedef struct {
 #pragma pack()
 
 STATIC
-VOID
-RpiFirmwareLedSet (
+EFI_STATUS
+LedSetState (
   IN  BOOLEAN On
   )
 {
@@ -963,9 +1422,9 @@ RpiFirmwareLedSet (
   EFI_STATUS          Status;
   UINT32              Result;
 
-  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
-    return;
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
+    return EFI_DEVICE_ERROR;
   }
 
   Cmd = mDmaBuffer;
@@ -989,14 +1448,293 @@ RpiFirmwareLedSet (
 
   Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
 
-  ReleaseSpinLock (&mMailboxLock);
+  MailboxRelease ();
 
   if (EFI_ERROR (Status) ||
       Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
     DEBUG ((DEBUG_ERROR,
       "%a: mailbox  transaction error: Status == %r, Response == 0x%x\n",
       __FUNCTION__, Status, Cmd->BufferHead.Response));
+    return EFI_DEVICE_ERROR;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+EFIAPI
+RpiFirmwareLedSet (
+  IN  BOOLEAN On
+  )
+{
+  LedSetState (On);
+}
+
+//
+// I/O paths only record that activity happened. The LED itself is
+// updated from a low-rate timer, and is only turned off again once
+// there's been no activity for LED_ACTIVITY_IDLE_TICKS periods.
+//
+#define LED_ACTIVITY_PERIOD_MS      50
+#define LED_ACTIVITY_IDLE_TICKS     2
+
+STATIC EFI_EVENT        mLedActivityEvent;
+STATIC EFI_EVENT        mExitBootServicesEvent;
+STATIC volatile BOOLEAN mLedActivity;
+STATIC BOOLEAN          mLedOn;
+STATIC UINTN            mLedIdleTicks;
+
+STATIC
+VOID
+EFIAPI
+RpiFirmwareLedActivity (
+  VOID
+  )
+{
+  mLedActivity = TRUE;
+}
+
+STATIC
+VOID
+EFIAPI
+LedActivityTimer (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  BOOLEAN On;
+
+  On = mLedOn;
+  if (mLedActivity) {
+    mLedActivity = FALSE;
+    mLedIdleTicks = 0;
+    On = TRUE;
+  } else if (mLedOn && ++mLedIdleTicks >= LED_ACTIVITY_IDLE_TICKS) {
+    On = FALSE;
+  }
+
+  if (On == mLedOn) {
+    return;
+  }
+
+  //
+  // If the transaction failed, just try again on the next tick.
+  //
+  if (!EFI_ERROR (LedSetState (On))) {
+    mLedOn = On;
+  }
+}
+
+STATIC
+VOID
+EFIAPI
+ExitBootServicesEvent (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  //
+  // The timer is already stopped, so from here on transactions
+  // poll with a bounded busy count and don't touch the TPL. This
+  // event is created before the protocol is installed, so it runs
+  // ahead of any TPL_NOTIFY notification a consumer registers.
+  //
+  mBootServicesActive = FALSE;
+
+  gBS->CloseEvent (mLedActivityEvent);
+
+  //
+  // The interrupt controller may already be shut down, so go
+  // back to polling.
+  //
+  if (mMailboxIrq) {
+    mMailboxIrq = FALSE;
+    MmioAnd32 (BCM2836_MBOX_BASE_ADDRESS + BCM2836_MBOX_CONFIG_OFFSET,
+      ~BCM2836_MBOX_CONFIG_DATA_IRQ);
+  }
+
+  if (mLedOn) {
+    LedSetState (FALSE);
+  }
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+RpiFirmwareSendTags (
+  IN OUT RASPBERRY_PI_FIRMWARE_TAG *Tags,
+  IN     UINTN                     TagCount
+  )
+{
+  RPI_FW_BUFFER_HEAD          *BufferHead;
+  RPI_FW_TAG_HEAD             *TagHead;
+  UINT8                       *Pos;
+  UINTN                       Index;
+  UINTN                       Size;
+  UINTN                       Sent;
+  UINT32                      ValueSize;
+  UINT32                      Arg;
+  EFI_STATUS                  Status;
+  UINT32                      Result;
+
+  if (Tags == NULL || TagCount == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Size = sizeof *BufferHead + sizeof (UINT32);
+  for (Index = 0; Index < TagCount; Index++) {
+    if (Tags[Index].BufferSize != 0 && Tags[Index].Buffer == NULL) {
+      return EFI_INVALID_PARAMETER;
+    }
+    Size += sizeof *TagHead + ALIGN_VALUE (Tags[Index].BufferSize,
+                                           sizeof (UINT32));
+  }
+
+  if (Size > EFI_PAGES_TO_SIZE (NUM_PAGES)) {
+    DEBUG ((DEBUG_ERROR, "%a: %u tags exceed size of DMA buffer\n",
+      __FUNCTION__, TagCount));
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
+    return EFI_DEVICE_ERROR;
+  }
+
+  BufferHead = mDmaBuffer;
+  ZeroMem (BufferHead, Size);
+
+  BufferHead->Response        = 0;
+
+  //
+  // Cached properties are answered here, in batch order, so a
+  // GET_CLOCK_RATE after a SET_CLOCK_RATE of the same clock goes
+  // to the firmware. Only the rest are sent, and a tag answered
+  // here is left with a non-zero ResponseSize.
+  //
+  Sent = 0;
+  Pos = (UINT8 *)(BufferHead + 1);
+  for (Index = 0; Index < TagCount; Index++) {
+    Arg = CacheArg (Tags[Index].TagId, Tags[Index].Buffer,
+            Tags[Index].BufferSize);
+    if (Tags[Index].TagId == RPI_FW_SET_CLOCK_RATE) {
+      CacheInvalidate (RPI_FW_GET_CLOCK_RATE, Arg);
+    } else if (CacheLookup (Tags[Index].TagId, Arg, Tags[Index].Buffer,
+                 Tags[Index].BufferSize, &Tags[Index].ResponseSize)) {
+      continue;
+    }
+
+    Tags[Index].ResponseSize  = 0;
+    TagHead = (RPI_FW_TAG_HEAD *)Pos;
+    TagHead->TagId            = Tags[Index].TagId;
+    TagHead->TagSize          = ALIGN_VALUE (Tags[Index].BufferSize,
+                                             sizeof (UINT32));
+    TagHead->TagValueSize     = 0;
+    CopyMem (TagHead + 1, Tags[Index].Buffer, Tags[Index].BufferSize);
+    Pos += sizeof *TagHead + TagHead->TagSize;
+    Sent++;
+  }
+
+  if (Sent == 0) {
+    MailboxRelease ();
+    return EFI_SUCCESS;
+  }
+
+  BufferHead->BufferSize      = (UINT32)(Pos - (UINT8 *)BufferHead) +
+                                sizeof (UINT32);
+
+  //
+  // The end tag is already zeroed.
+  //
+  Status = MailboxTransaction (BufferHead->BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
+
+  if (EFI_ERROR (Status) ||
+      BufferHead->Response != RPI_FW_RESP_SUCCESS) {
+    DEBUG ((DEBUG_ERROR,
+      "%a: mailbox transaction error: Status == %r, Response == 0x%x\n",
+      __FUNCTION__, Status, BufferHead->Response));
+    MailboxRelease ();
+    return EFI_DEVICE_ERROR;
   }
+
+  //
+  // Copy out the responses while we still own the buffer.
+  //
+  Pos = (UINT8 *)(BufferHead + 1);
+  for (Index = 0; Index < TagCount; Index++) {
+    if (Tags[Index].ResponseSize != 0) {
+      continue;
+    }
+
+    TagHead = (RPI_FW_TAG_HEAD *)Pos;
+    CacheUpdate (TagHead);
+
+    ValueSize = TagHead->TagValueSize;
+    if ((ValueSize & RPI_FW_VALUE_SIZE_RESPONSE_MASK) == 0) {
+      DEBUG ((DEBUG_ERROR, "%a: tag 0x%x was not processed\n",
+        __FUNCTION__, TagHead->TagId));
+      Status = EFI_DEVICE_ERROR;
+    }
+
+    ValueSize &= ~RPI_FW_VALUE_SIZE_RESPONSE_MASK;
+    Tags[Index].ResponseSize = ValueSize;
+    CopyMem (Tags[Index].Buffer, TagHead + 1,
+      MIN (ValueSize, Tags[Index].BufferSize));
+    Pos += sizeof *TagHead + TagHead->TagSize;
+  }
+
+  MailboxRelease ();
+
+  return Status;
+}
+
+STATIC
+VOID
+EFIAPI
+TimerProtocolNotify (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  EFI_HARDWARE_INTERRUPT_PROTOCOL *Interrupt;
+  VOID                            *Timer;
+  EFI_STATUS                      Status;
+
+  Status = gBS->LocateProtocol (&gEfiTimerArchProtocolGuid, NULL, &Timer);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  gBS->CloseEvent (Event);
+
+  Status = gBS->LocateProtocol (&gHardwareInterruptProtocolGuid, NULL,
+                  (VOID **)&Interrupt);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  if (!MailboxAcquire ()) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire mailbox\n", __FUNCTION__));
+    return;
+  }
+
+  mInterrupt = Interrupt;
+  Status = Interrupt->RegisterInterruptSource (Interrupt, BCM2836_MBOX_IRQ,
+                        MailboxInterruptHandler);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR,
+      "%a: failed to register mailbox IRQ handler (Status == %r)\n",
+      __FUNCTION__, Status));
+    MailboxRelease ();
+    return;
+  }
+
+  MmioOr32 (BCM2836_MBOX_BASE_ADDRESS + BCM2836_MBOX_CONFIG_OFFSET,
+    BCM2836_MBOX_CONFIG_DATA_IRQ);
+  mMailboxIrq = TRUE;
+
+  MailboxRelease ();
 }
 
 STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL mRpiFirmwareProtocol = {
@@ -1014,7 +1752,9 @@ STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL mRpiFirmwareProtocol = {
   RpiFirmwareGetSerial,
   RpiFirmwareGetModel,
   RpiFirmwareGetModelRevision,
-  RpiFirmwareGetArmMemory
+  RpiFirmwareGetArmMemory,
+  RpiFirmwareLedActivity,
+  RpiFirmwareSendTags
 };
 
 /**
@@ -1066,18 +1806,70 @@ RpiFirmwareDxeInitialize (
   //
   ASSERT (!(mDmaBufferBusAddress & (BCM2836_MBOX_NUM_CHANNELS - 1)));
 
-  Status = gBS->InstallProtocolInterface (&ImageHandle,
-                  &gRaspberryPiFirmwareProtocolGuid, EFI_NATIVE_INTERFACE,
-                  &mRpiFirmwareProtocol);
+  Status = gBS->CreateEvent (EVT_TIMER, 0, NULL, NULL, &mMailboxTimeoutEvent);
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR,
-      "%a: failed to install RPI firmware protocol (Status == %r)\n",
+      "%a: failed to create mailbox timeout event (Status == %r)\n",
       __FUNCTION__, Status));
     goto UnmapBuffer;
   }
 
+  Status = gBS->CreateEvent (EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_CALLBACK,
+                  LedActivityTimer, NULL, &mLedActivityEvent);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR,
+      "%a: failed to create LED activity event (Status == %r)\n",
+      __FUNCTION__, Status));
+    goto CloseTimeoutEvent;
+  }
+
+  Status = gBS->SetTimer (mLedActivityEvent, TimerPeriodic,
+                  EFI_TIMER_PERIOD_MILLISECONDS (LED_ACTIVITY_PERIOD_MS));
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR,
+      "%a: failed to arm LED activity timer (Status == %r)\n",
+      __FUNCTION__, Status));
+    goto CloseLedEvent;
+  }
+
+  Status = gBS->CreateEventEx (EVT_NOTIFY_SIGNAL, TPL_NOTIFY,
+                  ExitBootServicesEvent, NULL,
+                  &gEfiEventExitBootServicesGuid, &mExitBootServicesEvent);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR,
+      "%a: failed to create ExitBootServices event (Status == %r)\n",
+      __FUNCTION__, Status));
+    goto CloseLedEvent;
+  }
+
+  Status = gBS->InstallMultipleProtocolInterfaces (&ImageHandle,
+                  &gRaspberryPiFirmwareProtocolGuid, &mRpiFirmwareProtocol,
+                  &gRaspberryPiFirmwareDebugProtocolGuid,
+                  &mRpiFirmwareDebugProtocol,
+                  NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR,
+      "%a: failed to install RPI firmware protocol (Status == %r)\n",
+      __FUNCTION__, Status));
+    goto CloseExitBootServicesEvent;
+  }
+
+  //
+  // Switch to the mailbox IRQ once the timer is around.
+  //
+  mTimerNotifyEvent = EfiCreateProtocolNotifyEvent (&gEfiTimerArchProtocolGuid,
+                        TPL_CALLBACK, TimerProtocolNotify, NULL,
+                        &mTimerRegistration);
+  ASSERT (mTimerNotifyEvent != NULL);
+
   return EFI_SUCCESS;
 
+CloseExitBootServicesEvent:
+  gBS->CloseEvent (mExitBootServicesEvent);
+CloseLedEvent:
+  gBS->CloseEvent (mLedActivityEvent);
+CloseTimeoutEvent:
+  gBS->CloseEvent (mMailboxTimeoutEvent);
 UnmapBuffer:
   DmaUnmap (mDmaBufferMapping);
 FreeBuffer:
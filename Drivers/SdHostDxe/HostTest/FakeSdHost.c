@@ -0,0 +1,273 @@
+/** @file
+ *
+ *  A simulated SDHOST controller with a card behind it.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include "FakeSdHost.h"
+#include <IndustryStandard/Bcm2836.h>
+#include <IndustryStandard/Bcm2836SdHost.h>
+
+#define REG(Register)       ((Register) - SDHOST_BASE_ADDRESS)
+
+/*
+ * R1 for a card in the tran state, ready for data.
+ */
+#define CARD_STATUS_TRAN    ((4 << 9) | BIT8)
+
+STATIC FAKE_SD_CARD         *mCard;
+STATIC FAKE_SDHOST_COUNTERS mCounters;
+
+STATIC UINT32  mArg;
+STATIC UINT32  mHsts;
+STATIC UINT32  mHcfg;
+STATIC UINT32  mHbct;
+STATIC UINT32  mHblc;
+STATIC UINT32  mCdiv;
+STATIC UINT32  mTout;
+STATIC UINT32  mVdd;
+
+STATIC UINT32  mFifo[SDHOST_FIFO_WORDS];
+STATIC UINT32  mFifoHead;
+STATIC UINT32  mFifoLevel;
+
+/*
+ * The transfer in progress: Word words of Words moved by the card,
+ * the card having got to CardNs in simulated time.
+ */
+STATIC BOOLEAN mActive;
+STATIC BOOLEAN mWrite;
+STATIC UINT32  *mData;
+STATIC UINT32  mWord;
+STATIC UINT32  mWords;
+STATIC UINT64  mCardNs;
+STATIC BOOLEAN mBusyDone;
+
+VOID
+FakeSdHostInit (
+  IN  FAKE_SD_CARD *Card
+  )
+{
+  mCard = Card;
+  ZeroMem (&mCounters, sizeof (mCounters));
+  mArg = mHsts = mHcfg = mHbct = mHblc = mCdiv = mTout = mVdd = 0;
+  mFifoHead = mFifoLevel = 0;
+  mActive = FALSE;
+}
+
+VOID
+FakeSdHostCounters (
+  OUT FAKE_SDHOST_COUNTERS *Counters
+  )
+{
+  CopyMem (Counters, &mCounters, sizeof (*Counters));
+}
+
+/*
+ * Has the card catch up with simulated time. It never gets ahead
+ * of the FIFO: time spent waiting on it isn't banked.
+ */
+STATIC
+VOID
+FakeSdHostAdvance (
+  VOID
+  )
+{
+  UINT64 Now;
+
+  Now = HostNowNs ();
+  while (mActive && mCardNs + mCard->WordNs <= Now) {
+    if (mWord == mCard->ErrorWord && mCard->ErrorHsts != 0) {
+      mHsts |= mCard->ErrorHsts;
+      mActive = FALSE;
+      break;
+    }
+
+    if (mWord == mCard->BusyWord && mCard->BusyNs != 0 && !mBusyDone) {
+      if (mCardNs + mCard->BusyNs > Now) {
+        break;
+      }
+      mCardNs += mCard->BusyNs;
+      mBusyDone = TRUE;
+      continue;
+    }
+
+    if (mWrite) {
+      if (mFifoLevel == 0) {
+        mCardNs = Now;
+        break;
+      }
+      mData[mWord] = mFifo[mFifoHead];
+      mFifoHead = (mFifoHead + 1) % SDHOST_FIFO_WORDS;
+      mFifoLevel--;
+    } else {
+      if (mFifoLevel == SDHOST_FIFO_WORDS) {
+        mCardNs = Now;
+        break;
+      }
+      mFifo[(mFifoHead + mFifoLevel) % SDHOST_FIFO_WORDS] = mData[mWord];
+      mFifoLevel++;
+    }
+
+    mCardNs += mCard->WordNs;
+    if (++mWord == mWords) {
+      mActive = FALSE;
+    }
+  }
+
+  if (!mWrite && mFifoLevel != 0) {
+    mHsts |= SDHOST_HSTS_DATA_FLAG;
+  }
+}
+
+STATIC
+VOID
+FakeSdHostCommand (
+  IN  UINT32 Cmd
+  )
+{
+  UINT32 Blocks;
+  UINT32 Index;
+
+  Index = Cmd & 0x3F;
+  if ((Cmd & (SDHOST_CMD_READ_CMD | SDHOST_CMD_WRITE_CMD)) == 0) {
+    return;
+  }
+
+  /*
+   * Block addressing, as for SDHC and SDXC cards. The multi-block
+   * commands run for HBLC blocks, or to the end of the card.
+   */
+  Blocks = 1;
+  if (Index == 18 || Index == 25) {
+    Blocks = mHblc != 0 ? mHblc :
+      (UINT32) (mCard->ImageLength / mHbct) - mArg;
+  }
+
+  ASSERT (((UINT64) mArg + Blocks) * mHbct <= mCard->ImageLength);
+  mActive = TRUE;
+  mWrite = (Cmd & SDHOST_CMD_WRITE_CMD) != 0;
+  mData = (UINT32 *) (mCard->Image + (UINTN) mArg * mHbct);
+  mWord = 0;
+  mWords = Blocks * mHbct / 4;
+  mCardNs = HostNowNs ();
+  mBusyDone = FALSE;
+}
+
+UINT32
+FakeSdHostRead32 (
+  IN  UINTN Offset
+  )
+{
+  UINT32 Value;
+
+  mCounters.Accesses++;
+  FakeSdHostAdvance ();
+
+  switch (Offset) {
+  case REG (SDHOST_CMD):
+    return 0;
+  case REG (SDHOST_ARG):
+    return mArg;
+  case REG (SDHOST_TOUT):
+    return mTout;
+  case REG (SDHOST_CDIV):
+    return mCdiv;
+  case REG (SDHOST_RSP0):
+    return CARD_STATUS_TRAN;
+  case REG (SDHOST_HSTS):
+    return mHsts;
+  case REG (SDHOST_VDD):
+    return mVdd;
+  case REG (SDHOST_EDM):
+    return mFifoLevel << SDHOST_EDM_FIFO_LEVEL_SHIFT;
+  case REG (SDHOST_HCFG):
+    return mHcfg;
+  case REG (SDHOST_HBCT):
+    return mHbct;
+  case REG (SDHOST_HBLC):
+    return mHblc;
+  case REG (SDHOST_DATA):
+    mCounters.DataAccesses++;
+    if (mFifoLevel == 0) {
+      mCounters.Underruns++;
+      return 0;
+    }
+    Value = mFifo[mFifoHead];
+    mFifoHead = (mFifoHead + 1) % SDHOST_FIFO_WORDS;
+    if (--mFifoLevel == 0) {
+      mHsts &= ~SDHOST_HSTS_DATA_FLAG;
+    }
+    return Value;
+  default:
+    return 0;
+  }
+}
+
+VOID
+FakeSdHostWrite32 (
+  IN  UINTN  Offset,
+  IN  UINT32 Value
+  )
+{
+  mCounters.Accesses++;
+  FakeSdHostAdvance ();
+
+  switch (Offset) {
+  case REG (SDHOST_CMD):
+    if ((Value & SDHOST_CMD_NEW_FLAG) != 0) {
+      FakeSdHostCommand (Value);
+    }
+    break;
+  case REG (SDHOST_ARG):
+    mArg = Value;
+    break;
+  case REG (SDHOST_TOUT):
+    mTout = Value;
+    break;
+  case REG (SDHOST_CDIV):
+    mCdiv = Value;
+    break;
+  case REG (SDHOST_HSTS):
+    mHsts &= ~Value;
+    break;
+  case REG (SDHOST_VDD):
+    mVdd = Value;
+    break;
+  case REG (SDHOST_EDM):
+    if ((Value & SDHOST_EDM_FIFO_CLEAR) != 0) {
+      mFifoHead = mFifoLevel = 0;
+    }
+    break;
+  case REG (SDHOST_HCFG):
+    mHcfg = Value;
+    break;
+  case REG (SDHOST_HBCT):
+    mHbct = Value;
+    break;
+  case REG (SDHOST_HBLC):
+    mHblc = Value;
+    break;
+  case REG (SDHOST_DATA):
+    mCounters.DataAccesses++;
+    if (mFifoLevel == SDHOST_FIFO_WORDS) {
+      mCounters.Overruns++;
+      break;
+    }
+    mFifo[(mFifoHead + mFifoLevel) % SDHOST_FIFO_WORDS] = Value;
+    mFifoLevel++;
+    break;
+  default:
+    break;
+  }
+}
@@ -0,0 +1,99 @@
+/** @file
+ *
+ *  A simulated SDHOST controller with a card behind it, for running
+ *  SdHostDxe on the host. Only what block transfers need is there:
+ *  commands complete at once, and data moves between the card and
+ *  the 16-word FIFO at the card's pace, in simulated time.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#ifndef __FAKE_SD_HOST_H__
+#define __FAKE_SD_HOST_H__
+
+#include "HostUefi.h"
+#include <Protocol/PiMmcHost.h>
+
+/*
+ * Simulated time each register access takes.
+ */
+#define FAKE_SDHOST_ACCESS_NS   50
+
+typedef struct {
+  UINT8   *Image;
+  UINTN   ImageLength;
+  /*
+   * Time the card takes to move one 32-bit word.
+   */
+  UINT32  WordNs;
+  /*
+   * The card stops moving data for BusyNs when a transfer reaches
+   * word BusyWord, as it does while programming a block.
+   */
+  UINT32  BusyWord;
+  UINT64  BusyNs;
+  /*
+   * HSTS error bits raised when a transfer reaches word ErrorWord,
+   * which also stops the transfer.
+   */
+  UINT32  ErrorWord;
+  UINT32  ErrorHsts;
+} FAKE_SD_CARD;
+
+typedef struct {
+  UINT64  Accesses;
+  UINT64  DataAccesses;
+  /*
+   * DATA reads from an empty FIFO, and writes to a full one.
+   */
+  UINT32  Underruns;
+  UINT32  Overruns;
+} FAKE_SDHOST_COUNTERS;
+
+VOID
+FakeSdHostInit (
+  IN  FAKE_SD_CARD *Card
+  );
+
+VOID
+FakeSdHostCounters (
+  OUT FAKE_SDHOST_COUNTERS *Counters
+  );
+
+UINT32
+FakeSdHostRead32 (
+  IN  UINTN Offset
+  );
+
+VOID
+FakeSdHostWrite32 (
+  IN  UINTN  Offset,
+  IN  UINT32 Value
+  );
+
+/*
+ * The simulated time, in ns, kept by HostShim.c.
+ */
+UINT64
+HostNowNs (
+  VOID
+  );
+
+/*
+ * The MMC host protocol SdHostInitialize installed.
+ */
+EFI_MMC_HOST_PROTOCOL *
+HostMmcHost (
+  VOID
+  );
+
+#endif /* __FAKE_SD_HOST_H__ */
@@ -0,0 +1,386 @@
+/** @file
+ *
+ *  Host implementations of the boot services and libraries
+ *  SdHostDxe uses. Time is simulated: it moves on every stall and
+ *  every register access, so timeouts are deterministic and the
+ *  card behind FakeSdHost runs at its own pace.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FakeSdHost.h"
+#include <IndustryStandard/Bcm2836.h>
+#include <IndustryStandard/Bcm2836SdHost.h>
+#include <IndustryStandard/RpiFirmware.h>
+#include <Protocol/RaspberryPiFirmware.h>
+
+#define HOST_CORE_CLOCK_HZ      250000000
+
+STATIC UINT64                mNowNs;
+STATIC EFI_MMC_HOST_PROTOCOL *mMmcHost;
+
+EFI_GUID gRaspberryPiFirmwareProtocolGuid;
+EFI_GUID gRaspberryPiMmcHostProtocolGuid;
+
+/*
+ * DebugLib. Only errors and warnings are printed unless
+ * SDHOST_HOST_VERBOSE is set in the environment. EDK2 format
+ * strings are mostly printf's: %a is an ASCII string, %r a
+ * status, and an l or L makes an integer 64-bit.
+ */
+VOID
+HostDebugPrint (
+  IN  UINTN       ErrorLevel,
+  IN  CONST CHAR8 *Format,
+  ...
+  )
+{
+  va_list     Args;
+  CHAR8       Spec[32];
+  UINTN       SpecLength;
+  BOOLEAN     Long;
+  CONST CHAR8 *Walk;
+
+  if ((ErrorLevel & (DEBUG_ERROR | DEBUG_WARN)) == 0 &&
+      getenv ("SDHOST_HOST_VERBOSE") == NULL) {
+    return;
+  }
+
+  va_start (Args, Format);
+  for (Walk = Format; *Walk != '\0'; Walk++) {
+    if (*Walk != '%') {
+      fputc (*Walk, stderr);
+      continue;
+    }
+
+    SpecLength = 0;
+    Spec[SpecLength++] = '%';
+    Walk++;
+    while (*Walk == '-' || *Walk == '0' || (*Walk >= '1' && *Walk <= '9') ||
+           *Walk == '.') {
+      if (SpecLength < sizeof (Spec) - 4) {
+        Spec[SpecLength++] = *Walk;
+      }
+      Walk++;
+    }
+
+    Long = FALSE;
+    if (*Walk == 'l' || *Walk == 'L') {
+      Long = TRUE;
+      Walk++;
+    }
+
+    switch (*Walk) {
+    case 'a':
+      Spec[SpecLength++] = 's';
+      Spec[SpecLength] = '\0';
+      fprintf (stderr, Spec, va_arg (Args, CHAR8 *));
+      break;
+    case 'r':
+      fprintf (stderr, "Status 0x%llx",
+               (unsigned long long) va_arg (Args, EFI_STATUS));
+      break;
+    case 'p':
+      fprintf (stderr, "%p", va_arg (Args, VOID *));
+      break;
+    case 'c':
+      fputc (va_arg (Args, int), stderr);
+      break;
+    case 'd':
+    case 'u':
+    case 'x':
+    case 'X':
+      if (Long) {
+        Spec[SpecLength++] = 'l';
+        Spec[SpecLength++] = 'l';
+        Spec[SpecLength++] = *Walk;
+        Spec[SpecLength] = '\0';
+        fprintf (stderr, Spec, va_arg (Args, unsigned long long));
+      } else {
+        Spec[SpecLength++] = *Walk;
+        Spec[SpecLength] = '\0';
+        fprintf (stderr, Spec, va_arg (Args, unsigned int));
+      }
+      break;
+    case '%':
+      fputc ('%', stderr);
+      break;
+    default:
+      fputc ('?', stderr);
+      if (*Walk == '\0') {
+        Walk--;
+      }
+      break;
+    }
+  }
+  va_end (Args);
+}
+
+VOID
+HostAssert (
+  IN  CONST CHAR8 *FileName,
+  IN  UINTN       LineNumber,
+  IN  CONST CHAR8 *Description
+  )
+{
+  fprintf (stderr, "ASSERT %s(%u): %s\n", FileName, (unsigned) LineNumber,
+           Description);
+  abort ();
+}
+
+UINT64
+HostNowNs (
+  VOID
+  )
+{
+  return mNowNs;
+}
+
+EFI_MMC_HOST_PROTOCOL *
+HostMmcHost (
+  VOID
+  )
+{
+  return mMmcHost;
+}
+
+/*
+ * The firmware calls SdHostDxe makes.
+ */
+STATIC
+EFI_STATUS
+EFIAPI
+HostGetClockRate (
+  IN  UINT32 ClockId,
+  OUT UINT32 *ClockRate
+  )
+{
+  if (ClockId != RPI_FW_CLOCK_RATE_CORE) {
+    return EFI_UNSUPPORTED;
+  }
+
+  *ClockRate = HOST_CORE_CLOCK_HZ;
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+EFIAPI
+HostLedActivity (
+  VOID
+  )
+{
+}
+
+STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL mFirmware = {
+  .GetClockRate = HostGetClockRate,
+  .LedActivity = HostLedActivity
+};
+
+/*
+ * Boot services.
+ */
+STATIC
+EFI_STATUS
+EFIAPI
+HostLocateProtocol (
+  IN  EFI_GUID *Protocol,
+  IN  VOID     *Registration OPTIONAL,
+  OUT VOID     **Interface
+  )
+{
+  if (Protocol == &gRaspberryPiFirmwareProtocolGuid) {
+    *Interface = &mFirmware;
+    return EFI_SUCCESS;
+  }
+
+  *Interface = NULL;
+  return EFI_NOT_FOUND;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostInstallMultipleProtocolInterfaces (
+  IN OUT EFI_HANDLE *Handle,
+  ...
+  )
+{
+  va_list  Args;
+  EFI_GUID *Protocol;
+  VOID     *Interface;
+
+  va_start (Args, Handle);
+  while ((Protocol = va_arg (Args, EFI_GUID *)) != NULL) {
+    Interface = va_arg (Args, VOID *);
+    if (Protocol == &gRaspberryPiMmcHostProtocolGuid) {
+      mMmcHost = Interface;
+    }
+  }
+  va_end (Args);
+
+  *Handle = &mMmcHost;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostStall (
+  IN  UINTN Microseconds
+  )
+{
+  mNowNs += (UINT64) Microseconds * 1000;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_BOOT_SERVICES mBootServices = {
+  HostLocateProtocol,
+  HostInstallMultipleProtocolInterfaces,
+  HostStall
+};
+
+EFI_BOOT_SERVICES *gBS = &mBootServices;
+
+/*
+ * DevicePathLib, BaseLib, MemoryAllocationLib.
+ */
+EFI_DEVICE_PATH_PROTOCOL *
+CreateDeviceNode (
+  IN UINT8  NodeType,
+  IN UINT8  NodeSubType,
+  IN UINT16 NodeLength
+  )
+{
+  EFI_DEVICE_PATH_PROTOCOL *Node;
+
+  Node = AllocateZeroPool (NodeLength);
+  Node->Type = NodeType;
+  Node->SubType = NodeSubType;
+  Node->Length[0] = (UINT8) NodeLength;
+  Node->Length[1] = (UINT8) (NodeLength >> 8);
+  return Node;
+}
+
+UINT64
+DivU64x32 (
+  IN UINT64 Dividend,
+  IN UINT32 Divisor
+  )
+{
+  return Dividend / Divisor;
+}
+
+VOID *
+AllocatePool (
+  IN UINTN AllocationSize
+  )
+{
+  return malloc (AllocationSize);
+}
+
+VOID *
+AllocateZeroPool (
+  IN UINTN AllocationSize
+  )
+{
+  return calloc (1, AllocationSize);
+}
+
+VOID
+FreePool (
+  IN VOID *Buffer
+  )
+{
+  free (Buffer);
+}
+
+/*
+ * IoLib. Each access takes FAKE_SDHOST_ACCESS_NS.
+ */
+STATIC
+UINTN
+SdHostOffset (
+  IN  UINTN Address
+  )
+{
+  ASSERT (Address >= SDHOST_BASE_ADDRESS &&
+          Address < SDHOST_BASE_ADDRESS + 0x100);
+  return Address - SDHOST_BASE_ADDRESS;
+}
+
+UINT32
+MmioRead32 (
+  IN UINTN Address
+  )
+{
+  mNowNs += FAKE_SDHOST_ACCESS_NS;
+  return FakeSdHostRead32 (SdHostOffset (Address));
+}
+
+UINT32
+MmioWrite32 (
+  IN UINTN  Address,
+  IN UINT32 Value
+  )
+{
+  mNowNs += FAKE_SDHOST_ACCESS_NS;
+  FakeSdHostWrite32 (SdHostOffset (Address), Value);
+  return Value;
+}
+
+UINT32
+MmioOr32 (
+  IN UINTN  Address,
+  IN UINT32 OrData
+  )
+{
+  return MmioWrite32 (Address, MmioRead32 (Address) | OrData);
+}
+
+/*
+ * TimerLib.
+ */
+UINT64
+GetPerformanceCounter (
+  VOID
+  )
+{
+  return mNowNs;
+}
+
+UINT64
+GetPerformanceCounterProperties (
+  OUT UINT64 *StartValue OPTIONAL,
+  OUT UINT64 *EndValue OPTIONAL
+  )
+{
+  if (StartValue != NULL) {
+    *StartValue = 0;
+  }
+  if (EndValue != NULL) {
+    *EndValue = (UINT64) -1;
+  }
+  return 1000000000;
+}
+
+UINT64
+GetTimeInNanoSecond (
+  IN UINT64 Ticks
+  )
+{
+  return Ticks;
+}
@@ -0,0 +1,309 @@
+/** @file
+ *
+ *  Runs SdHostDxe's block transfers through EFI_MMC_HOST_PROTOCOL
+ *  against FakeSdHost: reads and writes with the card faster and
+ *  slower than the register accesses, the register accesses each
+ *  block takes, a card busy for seconds, a FIFO that never moves,
+ *  and a CRC error.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FakeSdHost.h"
+#include <IndustryStandard/Bcm2836.h>
+#include <IndustryStandard/Bcm2836SdHost.h>
+
+#define BLOCK_LENGTH        512
+#define BLOCK_WORDS         (BLOCK_LENGTH / 4)
+#define CARD_BLOCKS         64
+#define TRANSFER_BLOCKS     8
+
+/*
+ * A card word time shorter than a register access keeps the FIFO
+ * full; a longer one has the driver wait on the card.
+ */
+#define FAST_CARD_WORD_NS   20
+#define SLOW_CARD_WORD_NS   640
+
+#define NS_PER_SECOND       1000000000ULL
+
+#define CHECK(Expression)                                               \
+  do {                                                                  \
+    if (!(Expression)) {                                                \
+      fprintf (stderr, "%s:%u: %s: check failed: %s\n", __FILE__,      \
+               __LINE__, __func__, #Expression);                        \
+      mFailures++;                                                      \
+    }                                                                   \
+  } while (FALSE)
+
+EFI_STATUS
+SdHostInitialize (
+  IN EFI_HANDLE          ImageHandle,
+  IN EFI_SYSTEM_TABLE    *SystemTable
+  );
+
+STATIC UINTN                 mFailures;
+STATIC EFI_MMC_HOST_PROTOCOL *mHost;
+STATIC FAKE_SD_CARD          mCard;
+STATIC UINT8                 mImage[CARD_BLOCKS * BLOCK_LENGTH];
+STATIC UINT32                mBuffer[TRANSFER_BLOCKS * BLOCK_WORDS];
+
+STATIC
+VOID
+ResetCard (
+  IN  UINT32 WordNs
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < sizeof (mImage); Index++) {
+    mImage[Index] = (UINT8) (Index * 7 + (Index >> 9));
+  }
+
+  ZeroMem (&mCard, sizeof (mCard));
+  mCard.Image = mImage;
+  mCard.ImageLength = sizeof (mImage);
+  mCard.WordNs = WordNs;
+  FakeSdHostInit (&mCard);
+  CHECK (mHost->NotifyState (mHost, MmcHwInitializationState) == EFI_SUCCESS);
+}
+
+/*
+ * Lets the card take what a write left in the FIFO.
+ */
+STATIC
+VOID
+DrainFifo (
+  VOID
+  )
+{
+  while (SDHOST_EDM_FIFO_LEVEL (MmioRead32 (SDHOST_EDM)) != 0) {
+    gBS->Stall (1);
+  }
+}
+
+/*
+ * Issues the read or write command for Blocks blocks at Lba and
+ * moves the data, counting the register accesses the data stage
+ * takes.
+ */
+STATIC
+EFI_STATUS
+Transfer (
+  IN  BOOLEAN              IsWrite,
+  IN  EFI_LBA              Lba,
+  IN  UINTN                Blocks,
+  OUT FAKE_SDHOST_COUNTERS *Counters
+  )
+{
+  FAKE_SDHOST_COUNTERS Before;
+  EFI_STATUS           Status;
+  MMC_CMD              Cmd;
+
+  if (Blocks > 1) {
+    CHECK (mHost->SendCommand (mHost, MMC_CMD23, (UINT32) Blocks) ==
+           EFI_SUCCESS);
+    Cmd = IsWrite ? MMC_CMD25 : MMC_CMD18;
+  } else {
+    Cmd = IsWrite ? MMC_CMD24 : MMC_CMD17;
+  }
+  CHECK (mHost->SendCommand (mHost, Cmd, (UINT32) Lba) == EFI_SUCCESS);
+
+  FakeSdHostCounters (&Before);
+  if (IsWrite) {
+    Status = mHost->WriteBlockData (mHost, Lba, Blocks * BLOCK_LENGTH, mBuffer);
+  } else {
+    Status = mHost->ReadBlockData (mHost, Lba, Blocks * BLOCK_LENGTH, mBuffer);
+  }
+  FakeSdHostCounters (Counters);
+
+  Counters->Accesses -= Before.Accesses;
+  Counters->DataAccesses -= Before.DataAccesses;
+  Counters->Underruns -= Before.Underruns;
+  Counters->Overruns -= Before.Overruns;
+  return Status;
+}
+
+/*
+ * The per-word loop this replaced read HSTS, wrote it back and
+ * moved the word: three accesses per word. Moving a FIFO's worth
+ * per EDM read and checking HSTS once a block keeps it close to
+ * one.
+ */
+STATIC
+VOID
+TestFastCard (
+  VOID
+  )
+{
+  FAKE_SDHOST_COUNTERS Counters;
+  UINTN                Index;
+  EFI_LBA              Lba;
+
+  ResetCard (FAST_CARD_WORD_NS);
+  Lba = 16;
+  CHECK (Transfer (FALSE, Lba, TRANSFER_BLOCKS, &Counters) == EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, mImage + Lba * BLOCK_LENGTH,
+                     sizeof (mBuffer)) == 0);
+  CHECK (Counters.Underruns == 0);
+  CHECK (Counters.DataAccesses == TRANSFER_BLOCKS * BLOCK_WORDS);
+  CHECK (Counters.Accesses <= TRANSFER_BLOCKS * (BLOCK_WORDS + BLOCK_WORDS / 8));
+  printf ("read:  %.2f register accesses per word\n",
+          (double) Counters.Accesses / (TRANSFER_BLOCKS * BLOCK_WORDS));
+
+  for (Index = 0; Index < ARRAY_SIZE (mBuffer); Index++) {
+    mBuffer[Index] = (UINT32) (Index * 0x01010101);
+  }
+  Lba = 40;
+  CHECK (Transfer (TRUE, Lba, TRANSFER_BLOCKS, &Counters) == EFI_SUCCESS);
+  DrainFifo ();
+  CHECK (CompareMem (mBuffer, mImage + Lba * BLOCK_LENGTH,
+                     sizeof (mBuffer)) == 0);
+  CHECK (Counters.Overruns == 0);
+  CHECK (Counters.DataAccesses == TRANSFER_BLOCKS * BLOCK_WORDS);
+  CHECK (Counters.Accesses <= TRANSFER_BLOCKS * (BLOCK_WORDS + BLOCK_WORDS / 8));
+  printf ("write: %.2f register accesses per word\n",
+          (double) Counters.Accesses / (TRANSFER_BLOCKS * BLOCK_WORDS));
+}
+
+/*
+ * The driver waits on the card without reading an empty FIFO or
+ * writing a full one.
+ */
+STATIC
+VOID
+TestSlowCard (
+  VOID
+  )
+{
+  FAKE_SDHOST_COUNTERS Counters;
+  EFI_LBA              Lba;
+
+  ResetCard (SLOW_CARD_WORD_NS);
+  Lba = 3;
+  CHECK (Transfer (FALSE, Lba, 1, &Counters) == EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, mImage + Lba * BLOCK_LENGTH, BLOCK_LENGTH) == 0);
+  CHECK (Counters.Underruns == 0);
+
+  SetMem (mBuffer, sizeof (mBuffer), 0x5A);
+  CHECK (Transfer (TRUE, Lba, 2, &Counters) == EFI_SUCCESS);
+  DrainFifo ();
+  CHECK (CompareMem (mBuffer, mImage + Lba * BLOCK_LENGTH,
+                     BLOCK_LENGTH * 2) == 0);
+  CHECK (Counters.Overruns == 0);
+}
+
+/*
+ * A card busy programming a block for 5s. That is past the 1s
+ * FIFO_MAX_POLL_COUNT polls of 1us came to, but within the 20s
+ * FIFO_POLL_TIMEOUT_US bound.
+ */
+STATIC
+VOID
+TestLongBusy (
+  VOID
+  )
+{
+  FAKE_SDHOST_COUNTERS Counters;
+  EFI_LBA              Lba;
+  UINT64               Start;
+
+  ResetCard (FAST_CARD_WORD_NS);
+  mCard.BusyWord = BLOCK_WORDS;
+  mCard.BusyNs = 5 * NS_PER_SECOND;
+
+  SetMem (mBuffer, sizeof (mBuffer), 0xA5);
+  Lba = 8;
+  Start = HostNowNs ();
+  CHECK (Transfer (TRUE, Lba, 4, &Counters) == EFI_SUCCESS);
+  CHECK (HostNowNs () - Start >= 5 * NS_PER_SECOND);
+  DrainFifo ();
+  CHECK (CompareMem (mBuffer, mImage + Lba * BLOCK_LENGTH,
+                     BLOCK_LENGTH * 4) == 0);
+  CHECK (Counters.Overruns == 0);
+}
+
+/*
+ * A FIFO that stops moving fails the transfer once it has made no
+ * progress for FIFO_POLL_TIMEOUT_US, 20s.
+ */
+STATIC
+VOID
+TestStuckFifo (
+  VOID
+  )
+{
+  FAKE_SDHOST_COUNTERS Counters;
+  UINT64               Start;
+  UINT64               Elapsed;
+
+  ResetCard (FAST_CARD_WORD_NS);
+  mCard.BusyWord = BLOCK_WORDS / 2;
+  mCard.BusyNs = 60 * NS_PER_SECOND;
+
+  Start = HostNowNs ();
+  CHECK (Transfer (FALSE, 0, 1, &Counters) == EFI_TIMEOUT);
+  Elapsed = HostNowNs () - Start;
+  CHECK (Elapsed >= 20 * NS_PER_SECOND && Elapsed < 21 * NS_PER_SECOND);
+  CHECK (Counters.Underruns == 0);
+  CHECK ((MmioRead32 (SDHOST_HSTS) & SDHOST_HSTS_ERROR) == 0);
+}
+
+STATIC
+VOID
+TestCrcError (
+  VOID
+  )
+{
+  FAKE_SDHOST_COUNTERS Counters;
+
+  ResetCard (FAST_CARD_WORD_NS);
+  mCard.ErrorWord = BLOCK_WORDS + 10;
+  mCard.ErrorHsts = SDHOST_HSTS_CRC16_ERROR;
+
+  CHECK (Transfer (FALSE, 0, 4, &Counters) == EFI_DEVICE_ERROR);
+  CHECK (Counters.Underruns == 0);
+  CHECK ((MmioRead32 (SDHOST_HSTS) & SDHOST_HSTS_ERROR) == 0);
+}
+
+int
+main (
+  int  argc,
+  char **argv
+  )
+{
+  EFI_STATUS Status;
+
+  Status = SdHostInitialize (NULL, NULL);
+  mHost = HostMmcHost ();
+  if (EFI_ERROR (Status) || mHost == NULL) {
+    fprintf (stderr, "SdHostInitialize: 0x%llx\n", (unsigned long long) Status);
+    return 1;
+  }
+
+  TestFastCard ();
+  TestSlowCard ();
+  TestLongBusy ();
+  TestStuckFifo ();
+  TestCrcError ();
+
+  if (mFailures != 0) {
+    printf ("%u check(s) failed\n", (unsigned) mFailures);
+    return 1;
+  }
+
+  printf ("all checks passed\n");
+  return 0;
+}
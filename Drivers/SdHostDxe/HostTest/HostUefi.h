@@ -0,0 +1,207 @@
+/** @file
+ *
+ *  Just enough of the UEFI environment to build SdHostDxe as a host
+ *  program. Every EDK2 header the driver includes from outside this
+ *  package is generated by the Makefile as an include of this one.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#ifndef __HOST_UEFI_H__
+#define __HOST_UEFI_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//
+// Base types.
+//
+typedef uint8_t             UINT8;
+typedef uint16_t            UINT16;
+typedef uint32_t            UINT32;
+typedef uint64_t            UINT64;
+typedef int32_t             INT32;
+typedef int64_t             INT64;
+typedef uintptr_t           UINTN;
+typedef intptr_t            INTN;
+typedef unsigned char       BOOLEAN;
+typedef char                CHAR8;
+typedef uint16_t            CHAR16;
+typedef void                VOID;
+
+typedef UINTN               EFI_STATUS;
+typedef VOID                *EFI_HANDLE;
+typedef UINT64              EFI_LBA;
+typedef UINT64              EFI_PHYSICAL_ADDRESS;
+
+typedef struct {
+  UINT32  Data1;
+  UINT16  Data2;
+  UINT16  Data3;
+  UINT8   Data4[8];
+} EFI_GUID;
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define CONST               const
+#define STATIC              static
+#define EFIAPI
+
+#define TRUE                ((BOOLEAN)(1==1))
+#define FALSE               ((BOOLEAN)(0==1))
+
+#define MAX_UINTN           ((UINTN)-1)
+
+#define BIT0     0x00000001
+#define BIT1     0x00000002
+#define BIT2     0x00000004
+#define BIT3     0x00000008
+#define BIT4     0x00000010
+#define BIT5     0x00000020
+#define BIT6     0x00000040
+#define BIT7     0x00000080
+#define BIT8     0x00000100
+#define BIT9     0x00000200
+#define BIT10    0x00000400
+#define BIT11    0x00000800
+#define BIT14    0x00004000
+#define BIT15    0x00008000
+#define BIT21    0x00200000
+
+#define MIN(a, b)                 (((a) < (b)) ? (a) : (b))
+#define MAX(a, b)                 (((a) > (b)) ? (a) : (b))
+#define ARRAY_SIZE(Array)         (sizeof (Array) / sizeof ((Array)[0]))
+
+//
+// Status codes.
+//
+#define ENCODE_ERROR(a)           ((EFI_STATUS) (MAX_UINTN ^ (MAX_UINTN >> 1)) | (a))
+#define EFI_ERROR(a)              (((INTN) (EFI_STATUS) (a)) < 0)
+#define EFI_SUCCESS               0
+#define EFI_INVALID_PARAMETER     ENCODE_ERROR (2)
+#define EFI_UNSUPPORTED           ENCODE_ERROR (3)
+#define EFI_DEVICE_ERROR          ENCODE_ERROR (7)
+#define EFI_NOT_FOUND             ENCODE_ERROR (14)
+#define EFI_NO_RESPONSE           ENCODE_ERROR (16)
+#define EFI_TIMEOUT               ENCODE_ERROR (18)
+#define EFI_REQUEST_UNLOAD_IMAGE  ENCODE_ERROR (34)
+
+//
+// DebugLib. DEBUG output goes to stderr, ASSERT aborts.
+//
+#define DEBUG_WARN      0x00000002
+#define DEBUG_INFO      0x00000040
+#define DEBUG_VERBOSE   0x00400000
+#define DEBUG_ERROR     0x80000000
+#define EFI_D_INFO      DEBUG_INFO
+#define EFI_D_ERROR     DEBUG_ERROR
+
+VOID HostDebugPrint (UINTN ErrorLevel, CONST CHAR8 *Format, ...);
+VOID HostAssert (CONST CHAR8 *FileName, UINTN LineNumber, CONST CHAR8 *Description);
+
+#define DEBUG(Expression)   HostDebugPrint Expression
+#define ASSERT(Expression)                                \
+  do {                                                    \
+    if (!(Expression)) {                                  \
+      HostAssert (__FILE__, __LINE__, #Expression);       \
+    }                                                     \
+  } while (FALSE)
+#define ASSERT_EFI_ERROR(StatusParameter)                 \
+  do {                                                    \
+    if (EFI_ERROR (StatusParameter)) {                    \
+      HostAssert (__FILE__, __LINE__, #StatusParameter);  \
+    }                                                     \
+  } while (FALSE)
+
+//
+// Boot services.
+//
+typedef struct {
+  UINT32  Hdr;
+} EFI_SYSTEM_TABLE;
+
+typedef struct {
+  EFI_STATUS  (EFIAPI *LocateProtocol) (IN EFI_GUID *Protocol,
+                                        IN VOID *Registration OPTIONAL,
+                                        OUT VOID **Interface);
+  EFI_STATUS  (EFIAPI *InstallMultipleProtocolInterfaces) (IN OUT EFI_HANDLE *Handle,
+                                                           ...);
+  EFI_STATUS  (EFIAPI *Stall) (IN UINTN Microseconds);
+} EFI_BOOT_SERVICES;
+
+extern EFI_BOOT_SERVICES *gBS;
+
+extern EFI_GUID gRaspberryPiFirmwareProtocolGuid;
+extern EFI_GUID gRaspberryPiMmcHostProtocolGuid;
+
+#define EFI_CALLER_ID_GUID \
+  { 0x58ABD787, 0xF64D, 0x4CA2, { 0xA0, 0x34, 0xB9, 0xAC, 0x2D, 0x5A, 0xD0, 0xCF } }
+
+//
+// PcdLib. The values the host build runs with.
+//
+#define PcdGet32(TokenName)       _PCD_VALUE_##TokenName
+#define _PCD_VALUE_PcdSdIsArasan  0
+
+//
+// Device paths.
+//
+typedef struct {
+  UINT8 Type;
+  UINT8 SubType;
+  UINT8 Length[2];
+} EFI_DEVICE_PATH_PROTOCOL;
+
+typedef struct {
+  EFI_DEVICE_PATH_PROTOCOL  Header;
+  EFI_GUID                  Guid;
+} VENDOR_DEVICE_PATH;
+
+#define HARDWARE_DEVICE_PATH      0x01
+#define HW_VENDOR_DP              0x04
+
+EFI_DEVICE_PATH_PROTOCOL *CreateDeviceNode (IN UINT8 NodeType, IN UINT8 NodeSubType,
+                                            IN UINT16 NodeLength);
+
+//
+// BaseLib, BaseMemoryLib, MemoryAllocationLib.
+//
+UINT64 DivU64x32 (IN UINT64 Dividend, IN UINT32 Divisor);
+
+#define CopyMem(Destination, Source, Length)  memmove ((Destination), (Source), (Length))
+#define SetMem(Buffer, Length, Value)         memset ((Buffer), (Value), (Length))
+#define ZeroMem(Buffer, Length)               memset ((Buffer), 0, (Length))
+#define CompareMem(A, B, Length)              memcmp ((A), (B), (Length))
+#define CopyGuid(Destination, Source)         memmove ((Destination), (Source), sizeof (EFI_GUID))
+
+VOID *AllocatePool (IN UINTN AllocationSize);
+VOID *AllocateZeroPool (IN UINTN AllocationSize);
+VOID FreePool (IN VOID *Buffer);
+
+//
+// IoLib. Accesses to the SDHOST register window go to FakeSdHost.
+//
+UINT32 MmioRead32 (IN UINTN Address);
+UINT32 MmioWrite32 (IN UINTN Address, IN UINT32 Value);
+UINT32 MmioOr32 (IN UINTN Address, IN UINT32 OrData);
+
+//
+// TimerLib. One performance counter tick is one simulated nanosecond.
+//
+UINT64 GetPerformanceCounter (VOID);
+UINT64 GetPerformanceCounterProperties (OUT UINT64 *StartValue OPTIONAL,
+                                        OUT UINT64 *EndValue OPTIONAL);
+UINT64 GetTimeInNanoSecond (IN UINT64 Ticks);
+
+#endif /* __HOST_UEFI_H__ */
@@ -36,6 +36,7 @@
 #include <IndustryStandard/Bcm2836SdHost.h>
 
 #define SDHOST_BLOCK_BYTE_LENGTH            512
+#define SDHOST_BLOCK_WORDS                  (SDHOST_BLOCK_BYTE_LENGTH / 4)
 
 // Driver Timing Parameters
 #define CMD_STALL_AFTER_POLL_US             1
@@ -43,7 +44,7 @@
 #define CMD_MAX_POLL_COUNT                  (CMD_MIN_POLL_TOTAL_TIME_US / CMD_STALL_AFTER_POLL_US)
 #define CMD_MAX_RETRY_COUNT                 3
 #define CMD_STALL_AFTER_RETRY_US            20 // 20us
-#define FIFO_MAX_POLL_COUNT                 1000000
+#define FIFO_POLL_TIMEOUT_US                20000000 // 20s, 1000000 polls of 20us
 #define STALL_TO_STABILIZE_US               10000 // 10ms
 
 #define IDENT_MODE_SD_CLOCK_FREQ_HZ         400000 // 400KHz
@@ -71,6 +72,8 @@ STATIC CONST CHAR8 *mFsmState[] = { "identmode", "datamode", "readdata",
                                     "startpowdown" };
 #endif /* NDEBUG */
 STATIC UINT32 mLastGoodCmd = MMC_GET_INDX(MMC_CMD0);
+// Block count of the last CMD23, for the multi-block command after it.
+STATIC UINT32 mSetBlockCount;
 
 STATIC inline BOOLEAN
 IsAppCmd(
@@ -229,10 +232,11 @@ SdHostDumpStatus(
          "SdHost: Diagnose EDM: 0x%8.8X\n", Edm));
   DEBUG(((Hsts & SDHOST_HSTS_ERROR) ?
          DEBUG_MMCHOST_SD_ERROR : DEBUG_MMCHOST_SD,
-         "  - FSM: 0x%x (%a)\n", (Edm & 0xF), mFsmState[Edm & 0xF]));
+         "  - FSM: 0x%x (%a)\n", (Edm & SDHOST_EDM_FSM_MASK),
+         mFsmState[Edm & SDHOST_EDM_FSM_MASK]));
   DEBUG(((Hsts & SDHOST_HSTS_ERROR) ?
          DEBUG_MMCHOST_SD_ERROR : DEBUG_MMCHOST_SD,
-         "  - Fifo Count: %d\n", ((Edm >> 4) & 0x1F)));
+         "  - Fifo Count: %d\n", SDHOST_EDM_FIFO_LEVEL(Edm)));
   DEBUG(((Hsts & SDHOST_HSTS_ERROR) ?
          DEBUG_MMCHOST_SD_ERROR : DEBUG_MMCHOST_SD,
          "  - Fifo Write Threshold: %d\n",
@@ -389,6 +393,15 @@ SdSendCommand(
     } else {
       MmioWrite32(SDHOST_HBCT, SDHOST_BLOCK_BYTE_LENGTH);
     }
+
+    if (!IsAppCmd() && (MmcCmd == MMC_CMD18 || MmcCmd == MMC_CMD25)) {
+      MmioWrite32(SDHOST_HBLC,
+                  mLastGoodCmd == MMC_CMD23 ? mSetBlockCount : 0);
+    }
+  }
+
+  if (MmcCmd == MMC_CMD23) {
+    mSetBlockCount = Argument;
   }
 
   DEBUG((
@@ -539,6 +552,115 @@ SdReceiveResponse(
   return EFI_SUCCESS;
 }
 
+STATIC UINT64
+SdElapsedUs(
+  IN UINT64 Start
+  )
+{
+  UINT64 Now;
+  UINT64 CounterStart;
+  UINT64 CounterEnd;
+
+  Now = GetPerformanceCounter();
+  GetPerformanceCounterProperties(&CounterStart, &CounterEnd);
+  if (CounterEnd < CounterStart) {
+    return DivU64x32(GetTimeInNanoSecond(Start - Now), 1000);
+  }
+
+  return DivU64x32(GetTimeInNanoSecond(Now - Start), 1000);
+}
+
+/**
+  Moves Length bytes between Buffer and the data FIFO. Words are moved
+  in bursts sized by the FIFO fill level reported in EDM, and HSTS is
+  only looked at on block boundaries or when the FIFO stops making
+  progress, so that (almost) every MMIO access moves data. The FIFO
+  may stall for up to FIFO_POLL_TIMEOUT_US without making progress,
+  however long each poll takes.
+**/
+STATIC EFI_STATUS
+SdTransferFifo(
+  IN BOOLEAN IsWrite,
+  IN UINTN   Length,
+  IN UINT32  *Buffer
+  )
+{
+  UINT32 NumWords = Length / 4;
+  UINT32 WordIdx = 0;
+  BOOLEAN Polling = FALSE;
+  UINT64 PollStart = 0;
+  UINT32 Level;
+  UINT32 Burst;
+  UINT32 Hsts;
+
+  while (WordIdx < NumWords) {
+    Level = SDHOST_EDM_FIFO_LEVEL(MmioRead32(SDHOST_EDM));
+    if (IsWrite) {
+      Burst = Level < SDHOST_FIFO_WORDS ? SDHOST_FIFO_WORDS - Level : 0;
+    } else {
+      Burst = Level;
+    }
+
+    if (Burst == 0) {
+      Hsts = MmioRead32(SDHOST_HSTS);
+      if ((Hsts & SDHOST_HSTS_ERROR) != 0) {
+        goto Error;
+      }
+
+      if (!Polling) {
+        Polling = TRUE;
+        PollStart = GetPerformanceCounter();
+      } else if (SdElapsedUs(PollStart) >= FIFO_POLL_TIMEOUT_US) {
+        DEBUG((
+               DEBUG_MMCHOST_SD_ERROR,
+               "SdHost: SdTransferFifo(): Block Word%d %a poll timed-out\n",
+               WordIdx, IsWrite ? "write" : "read"));
+        SdHostDumpStatus();
+        MmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
+        return EFI_TIMEOUT;
+      }
+
+      gBS->Stall(CMD_STALL_AFTER_POLL_US);
+      continue;
+    }
+
+    //
+    // Never cross a block boundary within a burst.
+    //
+    Burst = MIN(Burst, NumWords - WordIdx);
+    Burst = MIN(Burst, SDHOST_BLOCK_WORDS - (WordIdx % SDHOST_BLOCK_WORDS));
+
+    if (IsWrite) {
+      for (; Burst != 0; Burst--, WordIdx++) {
+        MmioWrite32(SDHOST_DATA, Buffer[WordIdx]);
+      }
+    } else {
+      for (; Burst != 0; Burst--, WordIdx++) {
+        Buffer[WordIdx] = MmioRead32(SDHOST_DATA);
+      }
+    }
+
+    Polling = FALSE;
+    if ((WordIdx % SDHOST_BLOCK_WORDS) == 0) {
+      Hsts = MmioRead32(SDHOST_HSTS);
+      if ((Hsts & SDHOST_HSTS_ERROR) != 0) {
+        goto Error;
+      }
+    }
+  }
+
+  return EFI_SUCCESS;
+
+Error:
+  DEBUG((
+         DEBUG_MMCHOST_SD_ERROR,
+         "SdHost: SdTransferFifo(): %a error at Word%d HSTS 0x%x\n",
+         IsWrite ? "write" : "read", WordIdx, Hsts));
+  SdHostDumpStatus();
+  MmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
+  return EFI_DEVICE_ERROR;
+}
+
 STATIC EFI_STATUS
 SdReadBlockData(
   IN EFI_MMC_HOST_PROTOCOL    *This,
@@ -555,42 +677,8 @@ SdReadBlockData(
   ASSERT(Buffer != NULL);
   ASSERT(Length % 4 == 0);
 
-  EFI_STATUS Status = EFI_SUCCESS;
-
-  mFwProtocol->SetLed(TRUE);
-  {
-    UINT32 NumWords = Length / 4;
-    UINT32 WordIdx;
-
-    for (WordIdx = 0; WordIdx < NumWords; ++WordIdx) {
-      UINT32 PollCount = 0;
-      while (PollCount < FIFO_MAX_POLL_COUNT) {
-        UINT32 Hsts = MmioRead32(SDHOST_HSTS);
-        if ((Hsts & SDHOST_HSTS_DATA_FLAG) != 0) {
-          MmioWrite32(SDHOST_HSTS, SDHOST_HSTS_DATA_FLAG);
-          Buffer[WordIdx] = MmioRead32(SDHOST_DATA);
-          break;
-        }
-
-        ++PollCount;
-        gBS->Stall(CMD_STALL_AFTER_RETRY_US);
-      }
-
-      if (PollCount == FIFO_MAX_POLL_COUNT) {
-        DEBUG(
-              (DEBUG_MMCHOST_SD_ERROR,
-               "SdHost: SdReadBlockData(): Block Word%d read poll timed-out\n",
-               WordIdx));
-        SdHostDumpStatus();
-        MmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
-        Status = EFI_TIMEOUT;
-        break;
-      }
-    }
-  }
-  mFwProtocol->SetLed(FALSE);
-
-  return Status;
+  mFwProtocol->LedActivity();
+  return SdTransferFifo(FALSE, Length, Buffer);
 }
 
 STATIC EFI_STATUS
@@ -609,41 +697,8 @@ SdWriteBlockData(
   ASSERT(Buffer != NULL);
   ASSERT(Length % SDHOST_BLOCK_BYTE_LENGTH == 0);
 
-  EFI_STATUS Status = EFI_SUCCESS;
-
-  mFwProtocol->SetLed(TRUE);
-  {
-    UINT32 NumWords = Length / 4;
-    UINT32 WordIdx;
-
-    for (WordIdx = 0; WordIdx < NumWords; ++WordIdx) {
-      UINT32 PollCount = 0;
-      while (PollCount < FIFO_MAX_POLL_COUNT) {
-        if (MmioRead32(SDHOST_HSTS) & SDHOST_HSTS_DATA_FLAG) {
-          MmioWrite32(SDHOST_HSTS, SDHOST_HSTS_DATA_FLAG);
-          MmioWrite32(SDHOST_DATA, Buffer[WordIdx]);
-          break;
-        }
-
-        ++PollCount;
-        gBS->Stall(CMD_STALL_AFTER_RETRY_US);
-      }
-
-      if (PollCount == FIFO_MAX_POLL_COUNT) {
-        DEBUG((
-               DEBUG_MMCHOST_SD_ERROR,
-               "SdHost: SdWriteBlockData(): Block Word%d write poll timed-out\n",
-               WordIdx));
-        SdHostDumpStatus();
-        MmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
-        Status = EFI_TIMEOUT;
-        break;
-      }
-    }
-  }
-  mFwProtocol->SetLed(FALSE);
-
-  return Status;
+  mFwProtocol->LedActivity();
+  return SdTransferFifo(TRUE, Length, Buffer);
 }
 
 STATIC EFI_STATUS
@@ -813,7 +868,7 @@ SdHostInitialize(
 
   DEBUG((DEBUG_MMCHOST_SD, "SdHost: Initialize\n"));
   DEBUG((DEBUG_MMCHOST_SD, "Config:\n"));
-  DEBUG((DEBUG_MMCHOST_SD, " - FIFO_MAX_POLL_COUNT=%d\n", FIFO_MAX_POLL_COUNT));
+  DEBUG((DEBUG_MMCHOST_SD, " - FIFO_POLL_TIMEOUT_US=%dus\n", FIFO_POLL_TIMEOUT_US));
   DEBUG((DEBUG_MMCHOST_SD, " - CMD_STALL_AFTER_POLL_US=%dus\n", CMD_STALL_AFTER_POLL_US));
   DEBUG((DEBUG_MMCHOST_SD, " - CMD_MIN_POLL_TOTAL_TIME_US=%dms\n", CMD_MIN_POLL_TOTAL_TIME_US / 1000));
   DEBUG((DEBUG_MMCHOST_SD, " - CMD_MAX_POLL_COUNT=%d\n", CMD_MAX_POLL_COUNT));
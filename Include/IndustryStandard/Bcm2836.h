@@ -63,6 +63,36 @@
 
 #define BCM2836_MBOX_NUM_CHANNELS                           16
 
+/* raise the ARM mailbox IRQ when the ARM's mailbox has data */
+#define BCM2836_MBOX_CONFIG_DATA_IRQ                        0x00000001
+
 /* interrupt controller constants */
 #define BCM2836_INTC_TIMER_CONTROL_OFFSET                   0x00000040
 #define BCM2836_INTC_TIMER_PENDING_OFFSET                   0x00000060
+#define BCM2836_INTC_GPU_PENDING                            0x00000100
+
+/* "basic" IRQs of the ARM (BCM2835-style) interrupt controller */
+#define BCM2836_ARM_INTC_BASE_ADDRESS                       0x3f00b200
+#define BCM2836_ARM_INTC_BASIC_PENDING_OFFSET               0x00000000
+#define BCM2836_ARM_INTC_BASIC_ENABLE_OFFSET                0x00000018
+#define BCM2836_ARM_INTC_BASIC_DISABLE_OFFSET               0x00000024
+#define BCM2836_ARM_INTC_NUM_BASIC_IRQS                     8
+
+/* GPU IRQs 0-31, flagged in the basic pending register by bit 8 or a shortcut bit */
+#define BCM2836_ARM_INTC_PENDING1_OFFSET                    0x00000004
+#define BCM2836_ARM_INTC_ENABLE1_OFFSET                     0x00000010
+#define BCM2836_ARM_INTC_DISABLE1_OFFSET                    0x0000001c
+#define BCM2836_ARM_INTC_BASIC_PENDING1                     0x00000100
+#define BCM2836_ARM_INTC_BASIC_SHORTCUT1_MASK               0x00007c00
+#define BCM2836_ARM_INTC_NUM_GPU1_IRQS                      32
+
+/*
+ * Interrupt sources as numbered by Bcm2836InterruptDxe: 0-3 are the
+ * per-CPU timers, followed by the basic IRQs of the ARM controller
+ * and then GPU IRQs 0-31.
+ */
+#define BCM2836_INTC_NUM_TIMER_IRQS                         4
+#define BCM2836_INTC_BASIC_IRQ(x)                           (BCM2836_INTC_NUM_TIMER_IRQS + (x))
+#define BCM2836_INTC_GPU1_IRQ(x)                            (BCM2836_INTC_BASIC_IRQ (BCM2836_ARM_INTC_NUM_BASIC_IRQS) + (x))
+#define BCM2836_MBOX_IRQ                                    BCM2836_INTC_BASIC_IRQ (1)
+#define BCM2836_USB_IRQ                                     BCM2836_INTC_GPU1_IRQ (9)
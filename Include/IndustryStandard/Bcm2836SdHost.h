@@ -80,12 +80,21 @@
 // EDM
 //
 #define SDHOST_EDM_FIFO_CLEAR               BIT21
+#define SDHOST_EDM_FSM_MASK                 0xF
+#define SDHOST_EDM_FIFO_LEVEL_SHIFT         4
+#define SDHOST_EDM_FIFO_LEVEL_MASK          0x1F
+#define SDHOST_EDM_FIFO_LEVEL(Edm)          (((Edm) >> SDHOST_EDM_FIFO_LEVEL_SHIFT) & SDHOST_EDM_FIFO_LEVEL_MASK)
 #define SDHOST_EDM_WRITE_THRESHOLD_SHIFT    9
 #define SDHOST_EDM_READ_THRESHOLD_SHIFT     14
 #define SDHOST_EDM_THRESHOLD_MASK           0x1F
 #define SDHOST_EDM_READ_THRESHOLD(X)        ((X) << SDHOST_EDM_READ_THRESHOLD_SHIFT)
 #define SDHOST_EDM_WRITE_THRESHOLD(X)       ((X) << SDHOST_EDM_WRITE_THRESHOLD_SHIFT)
 
+//
+// DATA
+//
+#define SDHOST_FIFO_WORDS                   16
+
 #define CMD8_SD_ARG       (0x0UL << 12 | BIT8 | 0xCEUL << 0)
 #define CMD8_MMC_ARG      (0)
 
@@ -69,6 +69,7 @@
 #define RPI_FW_SET_FB_PGEOM                                 0x00048003
 #define RPI_FW_SET_FB_VGEOM                                 0x00048004
 #define RPI_FW_SET_FB_DEPTH                                 0x00048005
+#define RPI_FW_SET_FB_VOFFSET                               0x00048009
 #define RPI_FW_ALLOC_FB                                     0x00040001
 #define RPI_FW_FREE_FB                                      0x00048001
 
@@ -0,0 +1,112 @@
+/** @file
+ *
+ *  Block device benchmark helpers, shared by the driver diagnostics
+ *  that time transfers and append the results to a CSV log.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#ifndef __BENCHMARK_LIB__
+#define __BENCHMARK_LIB__
+
+#include <Protocol/SimpleFileSystem.h>
+
+/*
+ * Each run does between BENCHMARK_MIN_OPS and BENCHMARK_MAX_OPS
+ * transfers, aiming at BENCHMARK_RUN_BYTES in total.
+ */
+#define BENCHMARK_MIN_OPS             4
+#define BENCHMARK_MAX_OPS             64
+#define BENCHMARK_RUN_BYTES           SIZE_8MB
+
+typedef struct {
+  UINTN  Ops;
+  UINT64 TotalNs;
+  UINT64 P50Ns;
+  UINT64 P99Ns;
+} BENCHMARK_RESULT;
+
+/**
+  Picks the LBAs for one run of Size-byte transfers within the
+  RangeBlocks blocks at Base: a sequential stretch in the middle of
+  the range, or Size-aligned offsets from a generator seeded with
+  Size, so that runs are repeatable.
+
+  @param  Lbas    Room for BENCHMARK_MAX_OPS LBAs.
+
+  @return The number of transfers in the run, or 0 if the range is
+          too small for it.
+**/
+UINTN
+BenchmarkPlan (
+  IN  EFI_LBA  Base,
+  IN  UINT64   RangeBlocks,
+  IN  UINT32   BlockSize,
+  IN  UINTN    Size,
+  IN  BOOLEAN  Random,
+  OUT EFI_LBA  *Lbas
+  );
+
+/**
+  Time between two GetPerformanceCounter () values, in ns.
+**/
+UINT64
+BenchmarkElapsedNs (
+  IN  UINT64 Start,
+  IN  UINT64 End
+  );
+
+/**
+  Fills in Result from the Ops per-transfer times in Samples,
+  which are left sorted.
+**/
+VOID
+BenchmarkSummarize (
+  IN OUT UINT64           *Samples,
+  IN     UINTN            Ops,
+  OUT    BENCHMARK_RESULT *Result
+  );
+
+UINT64
+BenchmarkKiBPerSecond (
+  IN  UINTN                  Size,
+  IN  CONST BENCHMARK_RESULT *Result
+  );
+
+UINT64
+BenchmarkIops (
+  IN  CONST BENCHMARK_RESULT *Result
+  );
+
+/**
+  Opens (or creates) FileName next to the firmware image, or else on
+  the first EFI system partition, positioned for appending. A new
+  file gets Header as its first line.
+
+  @return The file, or NULL if there is nowhere to put it.
+**/
+EFI_FILE_PROTOCOL *
+BenchmarkOpenLog (
+  IN  CONST CHAR16 *FileName,
+  IN  CONST CHAR8  *Header
+  );
+
+/**
+  Appends Line to the log, if there is one.
+**/
+VOID
+BenchmarkLogWrite (
+  IN  EFI_FILE_PROTOCOL *File OPTIONAL,
+  IN  CONST CHAR8       *Line
+  );
+
+#endif /* __BENCHMARK_LIB__ */
@@ -0,0 +1,52 @@
+/** @file
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#ifndef __DISPLAY_SCROLL_PROTOCOL_H__
+#define __DISPLAY_SCROLL_PROTOCOL_H__
+
+//
+// Installed by DisplayDxe next to GOP. Scrolls the whole screen by
+// panning the VideoCore virtual framebuffer instead of copying pixels.
+//
+#define DISPLAY_SCROLL_PROTOCOL_GUID \
+  { 0x6a3a5c1e, 0x0b6d, 0x4d5e, { 0x9f, 0x41, 0x27, 0xc8, 0x3e, 0x15, 0xa2, 0x7b } }
+
+typedef struct _DISPLAY_SCROLL_PROTOCOL DISPLAY_SCROLL_PROTOCOL;
+
+//
+// Scrolls the screen up by Lines scan lines. Afterwards scan line Y
+// shows what scan line Y + Lines showed before, and the bottom Lines
+// scan lines have undefined contents that the caller must redraw.
+//
+// Returns EFI_UNSUPPORTED if the current mode cannot be panned, or
+// panning is turned off in setup or has stopped for good (at
+// ExitBootServices, or at the first ReadyToBoot if setup asks for
+// that), in which case the caller must redraw the screen through GOP.
+// At each ReadyToBoot the screen is moved back to the start of the
+// framebuffer, for boot loaders that access it directly.
+//
+typedef
+EFI_STATUS
+(EFIAPI *DISPLAY_SCROLL_SCROLL) (
+  IN DISPLAY_SCROLL_PROTOCOL *This,
+  IN UINT32                  Lines
+  );
+
+struct _DISPLAY_SCROLL_PROTOCOL {
+  DISPLAY_SCROLL_SCROLL Scroll;
+};
+
+extern EFI_GUID gDisplayScrollProtocolGuid;
+
+#endif /* __DISPLAY_SCROLL_PROTOCOL_H__ */
@@ -0,0 +1,120 @@
+/** @file
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#ifndef __DW_USB_HOST_TRACE_PROTOCOL_H__
+#define __DW_USB_HOST_TRACE_PROTOCOL_H__
+
+#define DW_USB_HOST_TRACE_PROTOCOL_GUID \
+  { 0x14ddff2c, 0x0eec, 0x45b9, { 0xaf, 0x10, 0x3f, 0x8f, 0x6b, 0x98, 0x08, 0x3c } }
+
+typedef struct _DW_USB_HOST_TRACE_PROTOCOL DW_USB_HOST_TRACE_PROTOCOL;
+
+//
+// Endpoint types, as programmed into HCCHAR.
+//
+#define DW_USB_HOST_EP_CONTROL    0
+#define DW_USB_HOST_EP_ISOCH      1
+#define DW_USB_HOST_EP_BULK       2
+#define DW_USB_HOST_EP_INTR       3
+
+//
+// One transfer (or one stage of a control transfer). EpAddress
+// has the direction in bit 7. StartMicroFrame and MicroFrames are
+// in 125us microframes. CopyNs, SetupNs and WaitNs break the time
+// down into bounce buffer copies, mapping and programming the
+// channel, and waiting for it to halt.
+//
+typedef struct {
+  UINT8      DeviceAddress;
+  UINT8      EpAddress;
+  UINT8      EpType;
+  UINT8      Channel;
+  UINT32     Length;
+  UINT32     Actual;
+  UINT32     Restarts;
+  UINT32     Naks;
+  UINT32     Csplits;
+  UINT32     FrameOverruns;
+  UINT32     StartMicroFrame;
+  UINT32     MicroFrames;
+  UINT64     CopyNs;
+  UINT64     SetupNs;
+  UINT64     WaitNs;
+  UINT32     TransferResult;
+  EFI_STATUS Status;
+} DW_USB_HOST_TRACE_ENTRY;
+
+typedef struct {
+  UINT8      DeviceAddress;
+  UINT8      EpAddress;
+  UINT8      EpType;
+  UINT64     Transfers;
+  UINT64     Bytes;
+  UINT64     Errors;
+  UINT64     Restarts;
+  UINT64     Naks;
+  UINT64     Csplits;
+  UINT64     FrameOverruns;
+  UINT64     MicroFrames;
+  UINT64     CopyNs;
+  UINT64     SetupNs;
+  UINT64     WaitNs;
+} DW_USB_HOST_ENDPOINT_STATS;
+
+/**
+  Returns a transfer from the trace ring, 0 being the most recent.
+
+  @retval EFI_SUCCESS    Entry is valid.
+  @retval EFI_NOT_FOUND  Index is past the oldest recorded transfer.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *DW_USB_HOST_GET_TRACE_ENTRY) (
+  IN  DW_USB_HOST_TRACE_PROTOCOL *This,
+  IN  UINTN                      Index,
+  OUT DW_USB_HOST_TRACE_ENTRY    *Entry
+  );
+
+/**
+  Returns the counters of the Index-th endpoint seen.
+
+  @retval EFI_SUCCESS    Stats is valid.
+  @retval EFI_NOT_FOUND  Index is past the last endpoint.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *DW_USB_HOST_GET_ENDPOINT_STATS) (
+  IN  DW_USB_HOST_TRACE_PROTOCOL *This,
+  IN  UINTN                      Index,
+  OUT DW_USB_HOST_ENDPOINT_STATS *Stats
+  );
+
+/**
+  Empties the trace ring and clears all endpoint counters.
+**/
+typedef
+VOID
+(EFIAPI *DW_USB_HOST_RESET_TRACE) (
+  IN  DW_USB_HOST_TRACE_PROTOCOL *This
+  );
+
+struct _DW_USB_HOST_TRACE_PROTOCOL {
+  DW_USB_HOST_GET_TRACE_ENTRY    GetTraceEntry;
+  DW_USB_HOST_GET_ENDPOINT_STATS GetEndpointStats;
+  DW_USB_HOST_RESET_TRACE        ResetTrace;
+};
+
+extern EFI_GUID gDwUsbHostTraceProtocolGuid;
+
+#endif
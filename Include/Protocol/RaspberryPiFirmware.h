@@ -16,6 +16,20 @@
 #define RASPBERRY_PI_FIRMWARE_PROTOL_GUID \
   { 0x0ACA9535, 0x7AD0, 0x4286, { 0xB0, 0x2E, 0x87, 0xFA, 0x7E, 0x2A, 0x57, 0x11 } }
 
+//
+// One property tag in a batched mailbox transaction. Buffer holds
+// BufferSize bytes of request values on input, and is overwritten
+// with the response values on output, so it must be large enough
+// for whichever of the two is bigger. ResponseSize returns the
+// number of value bytes the firmware produced.
+//
+typedef struct {
+  UINT32    TagId;
+  UINT32    BufferSize;
+  VOID      *Buffer;
+  UINT32    ResponseSize;
+} RASPBERRY_PI_FIRMWARE_TAG;
+
 typedef
 EFI_STATUS
 (EFIAPI *SET_POWER_STATE) (
@@ -82,6 +96,16 @@ VOID
   BOOLEAN On
   );
 
+//
+// Records that I/O happened. The activity LED is updated
+// asynchronously, so this never touches the mailbox.
+//
+typedef
+VOID
+(EFIAPI *LED_ACTIVITY) (
+  VOID
+  );
+
 typedef
 EFI_STATUS
 (EFIAPI *GET_SERIAL) (
@@ -107,6 +131,18 @@ EFI_STATUS
   UINT32 *Size
   );
 
+//
+// Runs all tags, in order, in a single property channel transaction.
+// Cached properties are answered without being sent, and if every
+// tag is cached there is no transaction at all.
+//
+typedef
+EFI_STATUS
+(EFIAPI *SEND_TAGS) (
+  IN OUT RASPBERRY_PI_FIRMWARE_TAG *Tags,
+  IN     UINTN                     TagCount
+  );
+
 typedef struct {
   SET_POWER_STATE    SetPowerState;
   GET_MAC_ADDRESS    GetMacAddress;
@@ -123,6 +159,8 @@ typedef struct {
   GET_MODEL          GetModel;
   GET_MODEL_REVISION GetModelRevision;
   GET_ARM_MEM        GetArmMem;
+  LED_ACTIVITY       LedActivity;
+  SEND_TAGS          SendTags;
 } RASPBERRY_PI_FIRMWARE_PROTOCOL;
 
 extern EFI_GUID gRaspberryPiFirmwareProtocolGuid;
@@ -0,0 +1,66 @@
+/** @file
+ *
+ *  Copyright (c) 2018, Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#ifndef __RASPBERRY_PI_FIRMWARE_DEBUG_PROTOCOL_H__
+#define __RASPBERRY_PI_FIRMWARE_DEBUG_PROTOCOL_H__
+
+#define RASPBERRY_PI_FIRMWARE_DEBUG_PROTOCOL_GUID \
+  { 0xad4574cb, 0xe915, 0x4386, { 0xb2, 0xc6, 0xd8, 0x32, 0x39, 0x4c, 0xb9, 0x18 } }
+
+typedef struct {
+  UINT32 Hits;
+  UINT32 Misses;
+  UINT32 Invalidations;
+} RPI_FW_CACHE_STATS;
+
+//
+// Per-property counters. Arg is the clock ID for clock rate
+// tags and 0 otherwise.
+//
+typedef struct {
+  UINT32  TagId;
+  UINT32  Arg;
+  BOOLEAN Valid;
+  UINT32  Hits;
+  UINT32  Misses;
+} RPI_FW_CACHE_ENTRY_STATS;
+
+typedef
+VOID
+(EFIAPI *GET_CACHE_STATS) (
+  OUT RPI_FW_CACHE_STATS *Stats
+  );
+
+typedef
+EFI_STATUS
+(EFIAPI *GET_CACHE_ENTRY_STATS) (
+  IN  UINTN                    Index,
+  OUT RPI_FW_CACHE_ENTRY_STATS *Stats
+  );
+
+typedef
+VOID
+(EFIAPI *FLUSH_CACHE) (
+  VOID
+  );
+
+typedef struct {
+  GET_CACHE_STATS       GetCacheStats;
+  GET_CACHE_ENTRY_STATS GetCacheEntryStats;
+  FLUSH_CACHE           FlushCache;
+} RASPBERRY_PI_FIRMWARE_DEBUG_PROTOCOL;
+
+extern EFI_GUID gRaspberryPiFirmwareDebugProtocolGuid;
+
+#endif
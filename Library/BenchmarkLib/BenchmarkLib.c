@@ -0,0 +1,243 @@
+/** @file
+ *
+ *  Block device benchmark helpers.
+ *
+ *  Copyright (c) 2019, Andrey Warkentin <andrey.warkentin@gmail.com>
+ *
+ *  This program and the accompanying materials
+ *  are licensed and made available under the terms and conditions of the BSD License
+ *  which accompanies this distribution.  The full text of the license may be found at
+ *  http://opensource.org/licenses/bsd-license.php
+ *
+ *  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+ *
+ **/
+
+#include <Uefi.h>
+#include <Guid/Gpt.h>
+#include <Protocol/SimpleFileSystem.h>
+#include <Library/BaseLib.h>
+#include <Library/BenchmarkLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TimerLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+
+/*
+ * The log goes next to the firmware image, where it is easy to
+ * find after pulling the SD card. On a Pi that is the FAT boot
+ * partition, which usually isn't typed as an EFI system partition,
+ * so that is only the fallback.
+ */
+#define BENCHMARK_FIRMWARE_FILE       L"\\RPI_EFI.fd"
+
+UINTN
+BenchmarkPlan (
+  IN  EFI_LBA  Base,
+  IN  UINT64   RangeBlocks,
+  IN  UINT32   BlockSize,
+  IN  UINTN    Size,
+  IN  BOOLEAN  Random,
+  OUT EFI_LBA  *Lbas
+  )
+{
+  UINT64 Slots;
+  UINT64 Seed;
+  UINT64 Slot;
+  UINTN  Blocks;
+  UINTN  Ops;
+  UINTN  Index;
+
+  Blocks = Size / BlockSize;
+  Ops = MIN (BENCHMARK_MAX_OPS, MAX (BENCHMARK_MIN_OPS, BENCHMARK_RUN_BYTES / Size));
+  if (Blocks == 0) {
+    return 0;
+  }
+
+  Slots = DivU64x64Remainder (RangeBlocks, Blocks, NULL);
+  if (Slots < Ops) {
+    return 0;
+  }
+
+  Seed = Size;
+  for (Index = 0; Index < Ops; Index++) {
+    if (Random) {
+      Seed = Seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      DivU64x64Remainder (RShiftU64 (Seed, 16), Slots, &Slot);
+    } else {
+      Slot = (Slots - Ops) / 2 + Index;
+    }
+    Lbas[Index] = Base + MultU64x32 (Slot, (UINT32) Blocks);
+  }
+
+  return Ops;
+}
+
+UINT64
+BenchmarkElapsedNs (
+  IN  UINT64 Start,
+  IN  UINT64 End
+  )
+{
+  UINT64 CounterStart;
+  UINT64 CounterEnd;
+
+  GetPerformanceCounterProperties (&CounterStart, &CounterEnd);
+  if (CounterEnd < CounterStart) {
+    return GetTimeInNanoSecond (Start - End);
+  }
+
+  return GetTimeInNanoSecond (End - Start);
+}
+
+VOID
+BenchmarkSummarize (
+  IN OUT UINT64           *Samples,
+  IN     UINTN            Ops,
+  OUT    BENCHMARK_RESULT *Result
+  )
+{
+  UINT64 Sample;
+  UINTN  Index;
+  UINTN  Sorted;
+
+  Result->Ops = Ops;
+  Result->TotalNs = 0;
+  for (Sorted = 0; Sorted < Ops; Sorted++) {
+    Sample = Samples[Sorted];
+    Result->TotalNs += Sample;
+    for (Index = Sorted; Index > 0 && Samples[Index - 1] > Sample; Index--) {
+      Samples[Index] = Samples[Index - 1];
+    }
+    Samples[Index] = Sample;
+  }
+
+  Result->TotalNs = MAX (Result->TotalNs, 1);
+  Result->P50Ns = Samples[Ops / 2];
+  Result->P99Ns = Samples[(Ops * 99 + 99) / 100 - 1];
+}
+
+UINT64
+BenchmarkKiBPerSecond (
+  IN  UINTN                  Size,
+  IN  CONST BENCHMARK_RESULT *Result
+  )
+{
+  return DivU64x64Remainder (MultU64x32 (MultU64x32 (Size, (UINT32) Result->Ops),
+                                         1000000000),
+                             MultU64x32 (Result->TotalNs, SIZE_1KB), NULL);
+}
+
+UINT64
+BenchmarkIops (
+  IN  CONST BENCHMARK_RESULT *Result
+  )
+{
+  return DivU64x64Remainder (MultU64x32 (Result->Ops, 1000000000),
+                             Result->TotalNs, NULL);
+}
+
+STATIC
+EFI_FILE_PROTOCOL *
+BenchmarkOpenLogOn (
+  IN  EFI_HANDLE   Handle,
+  IN  CONST CHAR16 *FileName,
+  IN  BOOLEAN      NeedFirmware,
+  OUT BOOLEAN      *IsNew
+  )
+{
+  EFI_STATUS                      Status;
+  EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *Fs;
+  EFI_FILE_PROTOCOL               *Root;
+  EFI_FILE_PROTOCOL               *File;
+  UINT64                          Position;
+
+  Status = gBS->HandleProtocol (Handle, &gEfiSimpleFileSystemProtocolGuid,
+                                (VOID **) &Fs);
+  if (EFI_ERROR (Status)) {
+    return NULL;
+  }
+
+  Status = Fs->OpenVolume (Fs, &Root);
+  if (EFI_ERROR (Status)) {
+    return NULL;
+  }
+
+  if (NeedFirmware) {
+    Status = Root->Open (Root, &File, BENCHMARK_FIRMWARE_FILE,
+                         EFI_FILE_MODE_READ, 0);
+    if (EFI_ERROR (Status)) {
+      Root->Close (Root);
+      return NULL;
+    }
+    File->Close (File);
+  }
+
+  Status = Root->Open (Root, &File, (CHAR16 *) FileName,
+                       EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE,
+                       0);
+  Root->Close (Root);
+  if (EFI_ERROR (Status)) {
+    return NULL;
+  }
+
+  File->SetPosition (File, MAX_UINT64);
+  File->GetPosition (File, &Position);
+  *IsNew = (Position == 0);
+  return File;
+}
+
+EFI_FILE_PROTOCOL *
+BenchmarkOpenLog (
+  IN  CONST CHAR16 *FileName,
+  IN  CONST CHAR8  *Header
+  )
+{
+  EFI_STATUS        Status;
+  EFI_HANDLE        *Handles;
+  UINTN             HandleCount;
+  UINTN             Index;
+  EFI_FILE_PROTOCOL *File;
+  BOOLEAN           IsNew;
+  VOID              *Esp;
+
+  Status = gBS->LocateHandleBuffer (ByProtocol, &gEfiSimpleFileSystemProtocolGuid,
+                                    NULL, &HandleCount, &Handles);
+  if (EFI_ERROR (Status)) {
+    return NULL;
+  }
+
+  File = NULL;
+  IsNew = FALSE;
+  for (Index = 0; Index < HandleCount && File == NULL; Index++) {
+    File = BenchmarkOpenLogOn (Handles[Index], FileName, TRUE, &IsNew);
+  }
+
+  for (Index = 0; Index < HandleCount && File == NULL; Index++) {
+    Status = gBS->HandleProtocol (Handles[Index], &gEfiPartTypeSystemPartGuid, &Esp);
+    if (!EFI_ERROR (Status)) {
+      File = BenchmarkOpenLogOn (Handles[Index], FileName, FALSE, &IsNew);
+    }
+  }
+
+  FreePool (Handles);
+
+  if (IsNew) {
+    BenchmarkLogWrite (File, Header);
+  }
+  return File;
+}
+
+VOID
+BenchmarkLogWrite (
+  IN  EFI_FILE_PROTOCOL *File OPTIONAL,
+  IN  CONST CHAR8       *Line
+  )
+{
+  UINTN Size;
+
+  if (File != NULL) {
+    Size = AsciiStrLen (Line);
+    File->Write (File, &Size, (VOID *) Line);
+  }
+}